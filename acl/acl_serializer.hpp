@@ -19,12 +19,20 @@
 
   Protocol layer for communication with ACL
   Updating context dictionnary from incoming acl traffic
+
+  Messages are a 4 bytes big endian size followed by records. Text records
+  are "key\n!value\n" or "key\nASK\n". When the BINARY_FLAG bit is set in
+  the size, records are binary: authid (uint16_be), length (uint16_be)
+  and value including its trailing zero, length 0 meaning ASK. Binary
+  records are negotiated by the ACL: once it sent a binary message the
+  proxy answers with binary messages too.
 */
 
 #ifndef _REDEMPTION_ACL_SERIALIZER_HPP_
 #define _REDEMPTION_ACL_SERIALIZER_HPP_
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 
 
 #include "stream.hpp"
@@ -42,17 +50,35 @@ class AclSerializer{
 
     enum {
         HEADER_SIZE = 4,
+        MAX_MESSAGE_SIZE = 65536
+    };
+
+    enum {
+        LOG_RECORDS_PER_SECOND = 32
     };
 
     Inifile * ini;
     Transport & auth_trans;
     uint32_t verbose;
 
+    // records logging is limited to LOG_RECORDS_PER_SECOND
+    time_t   log_window;
+    unsigned log_count;
+    unsigned log_skipped;
+
 public:
+    static const uint32_t BINARY_FLAG = 0x80000000;
+
+    bool binary;
+
     AclSerializer(Inifile * ini, Transport & auth_trans, uint32_t verbose)
         : ini(ini)
         , auth_trans(auth_trans)
         , verbose(verbose)
+        , log_window(0)
+        , log_count(0)
+        , log_skipped(0)
+        , binary(false)
     {
         if (this->verbose & 0x10){
             LOG(LOG_INFO, "auth::AclSerializer");
@@ -67,6 +93,38 @@ public:
         }
     }
 
+    bool log_allowed()
+    {
+        const time_t now = time(NULL);
+        if (now != this->log_window) {
+            if (this->log_skipped) {
+                LOG(LOG_INFO, "%u ACL records not logged", this->log_skipped);
+            }
+            this->log_window  = now;
+            this->log_count   = 0;
+            this->log_skipped = 0;
+        }
+        if (this->log_count < LOG_RECORDS_PER_SECOND) {
+            this->log_count++;
+            return true;
+        }
+        this->log_skipped++;
+        return false;
+    }
+
+    void log_received(authid_t authid)
+    {
+        if (!this->log_allowed()) {
+            return;
+        }
+        const char * val         = this->ini->context_get_value(authid);
+        const char * display_val = val;
+        if ((authid == AUTHID_PASSWORD) || (authid == AUTHID_TARGET_PASSWORD)) {
+            display_val = ::get_printable_password(val, this->ini->debug.password);
+        }
+        LOG(LOG_INFO, "receiving '%s'='%s'", string_from_authid(authid), display_val);
+    }
+
     void in_items(Stream & stream)
     {
         if (this->verbose & 0x40){
@@ -77,6 +135,47 @@ public:
         }
     }
 
+    void in_items_binary(Stream & stream)
+    {
+        if (this->verbose & 0x40){
+            LOG(LOG_INFO, "auth::in_items_binary");
+        }
+        for (; stream.p < stream.end ; this->in_item_binary(stream)){
+            ;
+        }
+    }
+
+    void in_item_binary(Stream & stream)
+    {
+        if (!stream.in_check_rem(4)) {
+            LOG(LOG_WARNING, "Truncated binary ACL record");
+            throw Error(ERR_ACL_UNEXPECTED_IN_ITEM_OUT);
+        }
+        const authid_t authid = static_cast<authid_t>(stream.in_uint16_be());
+        const uint16_t len    = stream.in_uint16_be();
+        if (!stream.in_check_rem(len) || (len && stream.p[len - 1])) {
+            LOG(LOG_WARNING, "Truncated binary ACL record");
+            throw Error(ERR_ACL_UNEXPECTED_IN_ITEM_OUT);
+        }
+        const char * value = reinterpret_cast<const char*>(stream.p);
+        stream.in_skip_bytes(len);
+
+        if ((authid == AUTHID_UNKNOWN) || (authid >= MAX_AUTHID)) {
+            LOG(LOG_WARNING, "Unknown binary ACL record authid=%u", authid);
+            return;
+        }
+        if (len == 0) {
+            this->ini->ask_from_acl(authid);
+            if (this->log_allowed()) {
+                LOG(LOG_INFO, "receiving ASK '%s'", string_from_authid(authid));
+            }
+        }
+        else {
+            this->ini->set_from_acl(authid, value);
+            this->log_received(authid);
+        }
+    }
+
     void in_item(Stream & stream)
     {
         const char * keyword = reinterpret_cast<const char*>(stream.p);
@@ -93,9 +192,15 @@ public:
             if (*stream.p == '\n') {
                 *stream.p = 0;
 
-                if ((0 == strncasecmp(value, "ask", 3))) {
-                    this->ini->ask_from_acl(keyword);
-                    LOG(LOG_INFO, "receiving %s '%s'", value, keyword);
+                const authid_t authid = authid_from_string(keyword);
+                if (authid == AUTHID_UNKNOWN) {
+                    LOG(LOG_WARNING, "Unknown ACL record key=\"%s\"", keyword);
+                }
+                else if ((0 == strncasecmp(value, "ask", 3))) {
+                    this->ini->ask_from_acl(authid);
+                    if (this->log_allowed()) {
+                        LOG(LOG_INFO, "receiving %s '%s'", value, keyword);
+                    }
                 }
                 else {
                     // BASE64 TRY
@@ -106,14 +211,8 @@ public:
                     // output[out_len] = 0;
                     // this->ini->set_from_acl((char *)keyword,
                     //                         (char *)output);
-                    this->ini->set_from_acl(keyword, value + (value[0] == '!' ? 1 : 0));
-                    const char * val         = this->ini->context_get_value_by_string(keyword);
-                    const char * display_val = val;
-                    if ((strncasecmp("password", keyword, 9 ) == 0) ||
-                        (strncasecmp("target_password", keyword, 16) == 0)) {
-                        display_val = ::get_printable_password(val, this->ini->debug.password);
-                    }
-                    LOG(LOG_INFO, "receiving '%s'='%s'", keyword, display_val);
+                    this->ini->set_from_acl(authid, value + (value[0] == '!' ? 1 : 0));
+                    this->log_received(authid);
                 }
 
                 stream.p = stream.p+1;
@@ -130,9 +229,11 @@ public:
         BStream stream(HEADER_SIZE);
         this->auth_trans.recv(&stream.end, HEADER_SIZE);
 
-        size_t size = stream.in_uint32_be();
+        const uint32_t header = stream.in_uint32_be();
+        const bool binary = (header & BINARY_FLAG);
+        size_t size = header & ~BINARY_FLAG;
 
-        if (size > 65536){
+        if (size > MAX_MESSAGE_SIZE){
             LOG(LOG_WARNING, "Error: ACL message too big (got %u max 64 K)", size);
             throw Error(ERR_ACL_MESSAGE_TOO_BIG);
         }
@@ -145,8 +246,18 @@ public:
         if (this->verbose & 0x40){
             LOG(LOG_INFO, "ACL SERIALIZER : Data size without header (receive) = %u", size);
         }
+        if (binary && !this->binary) {
+            LOG(LOG_INFO, "ACL uses binary records");
+            this->binary = true;
+        }
+
         bool flag = this->ini->context.session_id.get().is_empty();
-        this->in_items(stream);
+        if (binary) {
+            this->in_items_binary(stream);
+        }
+        else {
+            this->in_items(stream);
+        }
         if (flag && !this->ini->context.session_id.get().is_empty()) {
             int child_pid = getpid();
             char old_session_file[256];
@@ -189,12 +300,40 @@ public:
     }
     void out_item_new(Stream & stream, Inifile::BaseField * bfield)
     {
+        if (this->binary) {
+            this->out_item_binary(stream, bfield);
+            return;
+        }
         char tmp[65536];
-        const char * serialized = bfield->get_serialized(tmp, sizeof(tmp), this->ini->debug.password);
+        const char * serialized = bfield->get_serialized(tmp, sizeof(tmp), this->ini->debug.password,
+                                                         this->log_allowed());
         bfield->use();
         stream.out_copy_bytes(serialized,strlen(serialized));
     }
 
+    void out_item_binary(Stream & stream, Inifile::BaseField * bfield)
+    {
+        const authid_t authid = bfield->get_authid();
+        const bool     asked  = bfield->is_asked();
+        const char *   val    = asked ? "" : bfield->get_value();
+        const size_t   len    = asked ? 0 : strlen(val) + 1;
+        if ((len > 0xFFFF) || !stream.has_room(4 + len)) {
+            LOG(LOG_ERR, "Sending Data to ACL Error: Buffer overflow (%s)", string_from_authid(authid));
+            throw Error(ERR_ACL_MESSAGE_TOO_BIG);
+        }
+        if (this->log_allowed()) {
+            const char * display_val = val;
+            if ((authid == AUTHID_PASSWORD) || (authid == AUTHID_TARGET_PASSWORD)) {
+                display_val = ::get_printable_password(val, this->ini->debug.password);
+            }
+            LOG(LOG_INFO, "sending %s=%s", string_from_authid(authid), asked ? "ASK" : display_val);
+        }
+        bfield->use();
+        stream.out_uint16_be(authid);
+        stream.out_uint16_be(len);
+        stream.out_copy_bytes(val, len);
+    }
+
     class OutItemFunctor {
         BStream & stream;
         AclSerializer * acl;
@@ -229,7 +368,7 @@ public:
             if (this->verbose & 0x40){
                 LOG(LOG_INFO, "ACL SERIALIZER : Data size without header (send) %u", total_length - HEADER_SIZE);
             }
-            stream.set_out_uint32_be(total_length - HEADER_SIZE, 0); /* size in header */
+            stream.set_out_uint32_be((total_length - HEADER_SIZE) | (this->binary ? BINARY_FLAG : 0), 0); /* size in header */
             this->auth_trans.send(stream.get_data(), total_length);
         } catch (Error e) {
             this->ini->context.authenticated.set(false);
@@ -39,6 +39,7 @@
 #include "internal/replay_mod.hpp"
 #include "front.hpp"
 #include "translation.hpp"
+#include "session_stats.hpp"
 
 #include "internal/flat_login_mod.hpp"
 #include "internal/flat_selector_mod.hpp"
@@ -292,6 +293,8 @@ public:
         if (this->mod != this->no_mod){
             delete this->mod;
             if (this->mod_transport) {
+                session_stats().closed_mod_bytes_received += this->mod_transport->total_received;
+                session_stats().closed_mod_bytes_sent     += this->mod_transport->total_sent;
                 delete this->mod_transport;
                 this->mod_transport = NULL;
             }
@@ -627,6 +630,7 @@ public:
                     mod_rdp_params.certificate_change_action           = this->ini.mod_rdp.certificate_change_action;
                     mod_rdp_params.enable_persistent_disk_bitmap_cache = this->ini.mod_rdp.persistent_disk_bitmap_cache;
                     mod_rdp_params.enable_cache_waiting_list           = this->ini.mod_rdp.cache_waiting_list;
+                    mod_rdp_params.mouse_move_policy                   = this->ini.mod_rdp.mouse_move_policy;
                     mod_rdp_params.password_printing_mode              = this->ini.debug.password;
                     mod_rdp_params.cache_verbose                       = this->ini.debug.cache;
 
@@ -0,0 +1,198 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+  Product name: redemption, a FLOSS RDP proxy
+  Copyright (C) Wallix 2014
+  Author(s): Christophe Grosjean, Meng Tan
+
+  Checks session input (decoded keyboard input and clipboard text sent by
+  client) against pattern_kill and pattern_notify patterns received from
+  ACL. Patterns of a list are separated by '\x01'.
+
+  All patterns are compiled into one automaton (see re::MultiRegex),
+  keyboard input and clipboard texts are separate streams.
+*/
+
+#ifndef _REDEMPTION_ACL_PATTERN_CHECKER_HPP_
+#define _REDEMPTION_ACL_PATTERN_CHECKER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "log.hpp"
+#include "stream.hpp"
+#include "auth_api.hpp"
+#include "regex_multi.hpp"
+
+class PatternChecker {
+public:
+    enum {
+        PATTERN_SEPARATOR = '\x01'
+    };
+
+private:
+    std::string kill_source;
+    std::string notify_source;
+
+    std::vector<std::string> patterns;  // by pattern number
+    std::vector<bool>        kill;      // by pattern number
+
+    re::MultiRegex keyboard;
+    re::MultiRegex clipboard;
+
+    // clipboard text is UTF-16LE, possibly cut anywhere between chunks
+    bool     has_pending_byte;
+    uint8_t  pending_byte;
+    uint16_t high_surrogate;
+
+    uint32_t verbose;
+
+public:
+    PatternChecker(uint32_t verbose = 0)
+    : has_pending_byte(false)
+    , pending_byte(0)
+    , high_surrogate(0)
+    , verbose(verbose)
+    {}
+
+    bool is_active() const {
+        return !this->patterns.empty();
+    }
+
+    // returns true if patterns changed
+    bool update(const char * kill_patterns, const char * notify_patterns) {
+        if ((this->kill_source == kill_patterns) && (this->notify_source == notify_patterns)) {
+            return false;
+        }
+        this->kill_source   = kill_patterns;
+        this->notify_source = notify_patterns;
+
+        this->patterns.clear();
+        this->kill.clear();
+        this->keyboard.clear();
+        this->clipboard.clear();
+        this->add_patterns(this->kill_source, true);
+        this->add_patterns(this->notify_source, false);
+        this->keyboard.reset();
+        this->clipboard.reset();
+
+        LOG(LOG_INFO, "PatternChecker: %u patterns", static_cast<unsigned>(this->patterns.size()));
+        return true;
+    }
+
+    // decoded_data contains unicode characters (uint32_le) given by Keymap2::event,
+    // returns true if the session must be closed
+    bool check_input(const Stream & decoded_data, auth_api * authentifier) {
+        bool res = false;
+        for (const uint8_t * p = decoded_data.get_data(); p + 4 <= decoded_data.end; p += 4) {
+            const uint32_t uchar = p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+            if (this->keyboard.step(re::utf8_char_int(uchar))) {
+                res |= this->found(this->keyboard.matches(), authentifier, "keyboard");
+            }
+        }
+        return res;
+    }
+
+    // clipboard text (UTF-16LE) chunk, last is true for the last chunk of a text,
+    // returns true if the session must be closed
+    bool check_clipboard_text(const uint8_t * data, size_t len, bool last, auth_api * authentifier) {
+        bool res = false;
+        const uint8_t * end = data + len;
+        while (data < end) {
+            uint16_t c;
+            if (this->has_pending_byte) {
+                c = this->pending_byte | (data[0] << 8);
+                data += 1;
+                this->has_pending_byte = false;
+            }
+            else if (data + 2 <= end) {
+                c = data[0] | (data[1] << 8);
+                data += 2;
+            }
+            else {
+                this->pending_byte     = data[0];
+                this->has_pending_byte = true;
+                break;
+            }
+
+            uint32_t uchar = c;
+            if ((c >= 0xD800) && (c < 0xDC00)) {
+                this->high_surrogate = c;
+                continue;
+            }
+            if ((c >= 0xDC00) && (c < 0xE000) && this->high_surrogate) {
+                uchar = 0x10000 + ((this->high_surrogate - 0xD800) << 10) + (c - 0xDC00);
+            }
+            this->high_surrogate = 0;
+            if (uchar == 0) {
+                continue;
+            }
+            if (this->clipboard.step(re::utf8_char_int(uchar))) {
+                res |= this->found(this->clipboard.matches(), authentifier, "clipboard");
+            }
+        }
+        if (last) {
+            std::vector<unsigned> ids = this->clipboard.finish();
+            if (!ids.empty()) {
+                res |= this->found(ids, authentifier, "clipboard");
+            }
+            this->has_pending_byte = false;
+            this->high_surrogate   = 0;
+        }
+        return res;
+    }
+
+private:
+    void add_patterns(const std::string & source, bool kill) {
+        std::string::size_type first = 0;
+        while (first < source.size()) {
+            std::string::size_type last = source.find(static_cast<char>(PATTERN_SEPARATOR), first);
+            if (last == std::string::npos) {
+                last = source.size();
+            }
+            if (last > first) {
+                const std::string pattern = source.substr(first, last - first);
+                const char * err = 0;
+                size_t pos_err = 0;
+                if (this->keyboard.add_pattern(pattern.c_str(), &err, &pos_err) == -1u) {
+                    LOG(LOG_WARNING, "PatternChecker: invalid pattern \"%s\" (%s at %u)",
+                        pattern.c_str(), err ? err : "empty", static_cast<unsigned>(pos_err));
+                }
+                else {
+                    this->clipboard.add_pattern(pattern.c_str());
+                    this->patterns.push_back(pattern);
+                    this->kill.push_back(kill);
+                }
+            }
+            first = last + 1;
+        }
+    }
+
+    bool found(const std::vector<unsigned> & ids, auth_api * authentifier, const char * source) {
+        bool res = false;
+        for (std::vector<unsigned>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+            const char * pattern = this->patterns[*it].c_str();
+            LOG(LOG_INFO, "PatternChecker: %s pattern \"%s\" found in %s",
+                this->kill[*it] ? "kill" : "notify", pattern, source);
+            if (authentifier) {
+                authentifier->report(this->kill[*it] ? "FINDPATTERN_KILL" : "FINDPATTERN_NOTIFY", pattern);
+            }
+            res |= this->kill[*it];
+        }
+        return res;
+    }
+};
+
+#endif
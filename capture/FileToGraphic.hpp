@@ -137,6 +137,14 @@ struct FileToGraphic
 
     bool ignore_frame_in_timeval;
 
+    REDOC("Incremental keyframes: how far the last full keyframe is from the"
+          " keyframe of last read META chunk (wrm files and keyframes), 0 if full")
+    uint16_t keyframe_files_back;
+    uint16_t keyframes_back;
+    bool     in_keyframe;
+    REDOC("Number of keyframes still to chain, only keyframes are played until then")
+    unsigned chained_keyframes;
+
     FileToGraphic(Transport * trans, const timeval begin_capture, const timeval end_capture, bool real_time, uint32_t verbose)
         : stream(65536)
         , trans(trans)
@@ -201,6 +209,10 @@ struct FileToGraphic
         , info_cache_4_size(0)
         , info_cache_4_persistent(false)
         , ignore_frame_in_timeval(false)
+        , keyframe_files_back(0)
+        , keyframes_back(0)
+        , in_keyframe(false)
+        , chained_keyframes(0)
     {
         init_palette332(this->palette); // We don't really care movies are always 24 bits for now
 
@@ -290,9 +302,25 @@ struct FileToGraphic
         return true;
     }
 
+    REDOC("Reader was opened at the wrm file of a full keyframe to reach an"
+          " incremental one count keyframes later: chunks out of keyframes are"
+          " skipped until then")
+    void chain_keyframes(unsigned count)
+    {
+        // full keyframe META was already read by constructor
+        this->chained_keyframes = count;
+    }
+
     void interpret_order()
     {
         this->total_orders_count++;
+        // image chunks are not read yet and are only found in keyframes
+        if (  this->chained_keyframes && !this->in_keyframe && (this->chunk_type != META_FILE)
+           && (this->chunk_type != LAST_IMAGE_CHUNK) && (this->chunk_type != PARTIAL_IMAGE_CHUNK)) {
+            this->stream.p = this->stream.end;
+            this->remaining_order_count = 0;
+            return;
+        }
         switch (this->chunk_type){
         case RDP_UPDATE_ORDERS:
         {
@@ -638,6 +666,10 @@ struct FileToGraphic
             TODO("Cache meta_data (sizes, number of entries) should be put in META chunk");
             {
                 this->info_version                = this->stream.in_uint16_le();
+                if (this->info_version > 5) {
+                    LOG(LOG_ERR, "unsupported wrm format version %u", this->info_version);
+                    throw Error(ERR_WRM);
+                }
                 this->mem3blt_support             = (this->info_version > 1);
                 this->polyline_support            = (this->info_version > 2);
                 this->multidstblt_support         = (this->info_version > 3);
@@ -679,8 +711,18 @@ struct FileToGraphic
                     this->info_cache_4_persistent = (this->stream.in_uint8() ? true : false);
                 }
 
+                // version 5: incremental keyframes
+                const bool incremental_keyframes = (this->info_version > 4);
+                this->keyframe_files_back = incremental_keyframes ? this->stream.in_uint16_le() : 0;
+                this->keyframes_back      = incremental_keyframes ? this->stream.in_uint16_le() : 0;
+
                 this->stream.p = this->stream.end;
 
+                this->in_keyframe = true;
+                if (this->chained_keyframes) {
+                    this->chained_keyframes--;
+                }
+
                 if (!this->meta_ok){
                     this->bmp_cache = new BmpCache(BmpCache::Recorder, this->info_bpp, this->info_number_of_cache,
                         this->info_use_waiting_list,
@@ -912,6 +954,12 @@ struct FileToGraphic
                 }
             break;
 
+            // version 5 only, older players fail on it (unknown chunk type)
+            case KEYFRAME_END:
+                this->in_keyframe = false;
+                this->stream.p = this->stream.end;
+            break;
+
             case LAST_IMAGE_CHUNK:
             case PARTIAL_IMAGE_CHUNK:
             {
@@ -42,6 +42,10 @@
 #include "colors.hpp"
 
 #include "RDP/RDPDrawable.hpp"
+#include "phase_timer.hpp"
+#include "keystroke_index.hpp"
+
+#include <vector>
 
 class WRMChunk_Send
 {
@@ -114,7 +118,8 @@ REDOC("To keep things easy all chunks have 8 bytes headers"
       " and order_count (whatever it means, depending on chunks")
 {
     enum {
-        GTF_SIZE_KEYBUF_REC = 1024
+        GTF_SIZE_KEYBUF_REC = 1024,
+        KEYFRAME_TILE_SIZE  = 32    // compressed 24 bpp tile fits in a bitmap batch
     };
 
     Transport * trans;
@@ -131,8 +136,25 @@ REDOC("To keep things easy all chunks have 8 bytes headers"
     bool send_input;
     RDPDrawable & drawable;
 
+
     BStream keyboard_buffer_32;
 
+    REDOC("Typed text is also indexed when not NULL (not owned)")
+    KeystrokeIndexWriter * keystroke_index;
+
+    REDOC("Every full_keyframe_interval-th keyframe is a full one (PNG image and"
+          " whole bitmap caches). Others only hold screen tiles and cache entries"
+          " changed since previous keyframe, a player chains them from the last"
+          " full keyframe. 1: all keyframes are full (wrm format version 3),"
+          " otherwise wrm format version 5, not readable by older players.")
+    const unsigned full_keyframe_interval;
+    uint16_t files_since_full_keyframe;
+    uint16_t keyframes_since_full_keyframe;
+
+    // state at last keyframe: hash of each screen tile, sha1 of cache entries
+    std::vector<uint64_t> keyframe_tiles;
+    std::vector<uint8_t>  keyframe_cache_sha1[BmpCache::MAXIMUM_NUMBER_OF_CACHES];
+
     GraphicToFile(const timeval& now
                 , Transport * trans
                 , const uint16_t width
@@ -157,6 +179,11 @@ REDOC("To keep things easy all chunks have 8 bytes headers"
     , send_input(false)
     , drawable(drawable)
     , keyboard_buffer_32(GTF_SIZE_KEYBUF_REC * sizeof(uint32_t))
+    , keystroke_index(NULL)
+    // mirror readers join at last keyframe, it must be a full one
+    , full_keyframe_interval(*ini.video.wrm_mirror_path ? 1 : std::max(1u, ini.video.wrm_full_keyframe_interval))
+    , files_since_full_keyframe(0)
+    , keyframes_since_full_keyframe(0)
     {
         last_sent_timer.tv_sec = 0;
         last_sent_timer.tv_usec = 0;
@@ -164,6 +191,11 @@ REDOC("To keep things easy all chunks have 8 bytes headers"
 
         this->send_meta_chunk();
         this->send_image_chunk();
+        if (this->full_keyframe_interval > 1) {
+            this->send_keyframe_tiles(false);
+            this->send_keyframe_caches(false);
+            this->send_keyframe_end_chunk(true);
+        }
     }
 
     ~GraphicToFile(){
@@ -197,10 +229,13 @@ REDOC("To keep things easy all chunks have 8 bytes headers"
 
     void send_meta_chunk(void)
     {
-        uint8_t wrm_format_version = 3;
+        // version 5 (incremental keyframes): version 4 META followed by last
+        // full keyframe position. Players before version 5 stop on the first
+        // KEYFRAME_END chunk ("unknown chunk type") and can't play the file.
+        uint8_t wrm_format_version = ((this->full_keyframe_interval > 1) ? 5 : 3);
 
         BStream header(8);
-        BStream payload(35);
+        BStream payload(64);
         payload.out_uint16_le(wrm_format_version);
         payload.out_uint16_le(this->width);
         payload.out_uint16_le(this->height);
@@ -228,6 +263,11 @@ REDOC("To keep things easy all chunks have 8 bytes headers"
             payload.out_uint8(this->bmp_cache.cache_persistent[4] ? 1 : 0);
         }
 
+        if (wrm_format_version > 4) {
+            payload.out_uint16_le(this->files_since_full_keyframe);
+            payload.out_uint16_le(this->keyframes_since_full_keyframe);
+        }
+
         payload.mark_end();
 
         WRMChunk_Send chunk(header, META_FILE, payload.size(), 1);
@@ -266,6 +306,9 @@ REDOC("To keep things easy all chunks have 8 bytes headers"
 */
 
             payload.out_copy_bytes(keyboard_buffer_32.get_data(), keyboard_buffer_32.size());
+            if (this->keystroke_index) {
+                this->keystroke_index->add(this->timer, keyboard_buffer_32.get_data(), keyboard_buffer_32.size());
+            }
             keyboard_buffer_32.rewind();
         }
         payload.mark_end();
@@ -509,20 +552,159 @@ REDOC("To keep things easy all chunks have 8 bytes headers"
         }
     }
 
+    REDOC("Following chunks are written in next wrm file of movie")
+    void next_file()
+    {
+        this->files_since_full_keyframe++;
+        if (this->keystroke_index) {
+            this->keystroke_index->next_file();
+            this->keystroke_index->save();
+        }
+    }
+
     void breakpoint()
     {
         this->flush_orders();
         this->flush_bitmaps();
         this->trans->next();
+        this->next_file();
+
+        const bool full = (this->keyframes_since_full_keyframe + 1u >= this->full_keyframe_interval);
+        if (full) {
+            this->files_since_full_keyframe     = 0;
+            this->keyframes_since_full_keyframe = 0;
+        }
+        else {
+            this->keyframes_since_full_keyframe++;
+        }
+
         this->send_meta_chunk();
         this->send_timestamp_chunk();
         this->send_save_state_chunk();
 
-        OutChunkedBufferingTransport<65536> png_trans(trans);
+        if (full) {
+            OutChunkedBufferingTransport<65536> png_trans(trans);
 
-        this->drawable.dump_png24(&png_trans, true);
+            this->drawable.dump_png24(&png_trans, true);
 
-        this->send_caches_chunk();
+            this->send_caches_chunk();
+        }
+        if (this->full_keyframe_interval > 1) {
+            this->send_keyframe_tiles(!full);
+            this->send_keyframe_caches(!full);
+            this->send_keyframe_end_chunk(full);
+        }
+    }
+
+    REDOC("Hashes screen tiles, with send tiles changed since previous keyframe"
+          " are written as 24 bpp compressed bitmaps")
+    void send_keyframe_tiles(bool send)
+    {
+        const Drawable & d = this->drawable.drawable;
+        const uint16_t columns = (d.width + KEYFRAME_TILE_SIZE - 1) / KEYFRAME_TILE_SIZE;
+        const uint16_t rows    = (d.height + KEYFRAME_TILE_SIZE - 1) / KEYFRAME_TILE_SIZE;
+        this->keyframe_tiles.resize(columns * rows, 0);
+
+        for (uint16_t row = 0; row < rows; row++) {
+            for (uint16_t column = 0; column < columns; column++) {
+                const uint16_t x  = column * KEYFRAME_TILE_SIZE;
+                const uint16_t y  = row * KEYFRAME_TILE_SIZE;
+                const uint16_t cx = std::min<uint16_t>(KEYFRAME_TILE_SIZE, d.width - x);
+                const uint16_t cy = std::min<uint16_t>(KEYFRAME_TILE_SIZE, d.height - y);
+
+                uint64_t h = 0xcbf29ce484222325ULL;
+                for (uint16_t i = 0; i < cy; i++) {
+                    const uint8_t * p   = d.data + (y + i) * d.rowsize + x * Drawable::Bpp;
+                    const size_t    len = cx * Drawable::Bpp;
+                    size_t n = 0;
+                    for (; n + sizeof(uint64_t) <= len; n += sizeof(uint64_t)) {
+                        uint64_t w;
+                        memcpy(&w, p + n, sizeof(w));
+                        h = (h ^ w) * 0x100000001b3ULL;
+                        h ^= h >> 29;
+                    }
+                    for (; n < len; n++) {
+                        h = (h ^ p[n]) * 0x100000001b3ULL;
+                    }
+                }
+
+                uint64_t & tile = this->keyframe_tiles[row * columns + column];
+                if (send && (tile != h)) {
+                    this->send_keyframe_tile(Rect(x, y, cx, cy));
+                }
+                tile = h;
+            }
+        }
+        if (this->bitmap_count > 0) {
+            this->send_bitmaps_chunk();
+        }
+    }
+
+    void send_keyframe_tile(const Rect & r)
+    {
+        const Drawable & d = this->drawable.drawable;
+        uint8_t tile[KEYFRAME_TILE_SIZE * KEYFRAME_TILE_SIZE * 3];
+        // bitmap rows are stored bottom-up, packed 24 bpp
+        for (uint16_t i = 0; i < r.cy; i++) {
+            Drawable::pixels_to_packed24( tile + (r.cy - i - 1) * r.cx * 3
+                                        , d.data + (r.y + i) * d.rowsize + r.x * Drawable::Bpp, r.cx);
+        }
+        Bitmap bmp(24, 24, NULL, r.cx, r.cy, tile, r.cx * r.cy * 3);
+
+        BStream bmp_stream(65535);
+        bmp.compress(24, bmp_stream);
+        bmp_stream.mark_end();
+
+        RDPBitmapData bitmap_data;
+        bitmap_data.dest_left      = r.x;
+        bitmap_data.dest_top       = r.y;
+        bitmap_data.dest_right     = r.x + r.cx - 1;
+        bitmap_data.dest_bottom    = r.y + r.cy - 1;
+        bitmap_data.width          = bmp.cx;
+        bitmap_data.height         = bmp.cy;
+        bitmap_data.bits_per_pixel = 24;
+        bitmap_data.flags          = BITMAP_COMPRESSION;
+        bitmap_data.bitmap_length  = bmp_stream.size() + 8;
+
+        bitmap_data.cb_comp_main_body_size = bmp_stream.size();
+        bitmap_data.cb_scan_width          = bmp.cx;
+        bitmap_data.cb_uncompressed_size   = bmp.bmp_size;
+
+        // drawable already holds it
+        this->RDPSerializer::draw(bitmap_data, bmp_stream.get_data(), bmp_stream.size(), bmp);
+    }
+
+    REDOC("Remembers cache entries, with send entries changed since previous"
+          " keyframe are written")
+    void send_keyframe_caches(bool send)
+    {
+        for (uint8_t id = 0; id < this->bmp_cache.number_of_cache; id++) {
+            std::vector<uint8_t> & sha1 = this->keyframe_cache_sha1[id];
+            sha1.resize(this->bmp_cache.cache_entries[id] * 20, 0);
+            for (uint16_t idx = 0; idx < this->bmp_cache.cache_entries[id]; idx++) {
+                if (memcmp(&sha1[idx * 20], this->bmp_cache.sha1[id][idx], 20)) {
+                    if (send) {
+                        this->emit_bmp_cache(id, idx, false);
+                    }
+                    memcpy(&sha1[idx * 20], this->bmp_cache.sha1[id][idx], 20);
+                }
+            }
+        }
+        if (this->order_count > 0) {
+            this->send_orders_chunk();
+        }
+    }
+
+    void send_keyframe_end_chunk(bool full)
+    {
+        BStream payload(1);
+        payload.out_uint8(full ? 1 : 0);
+        payload.mark_end();
+
+        BStream header(8);
+        WRMChunk_Send chunk(header, KEYFRAME_END, payload.size(), 1);
+        this->trans->send(header);
+        this->trans->send(payload);
     }
 
 protected:
@@ -539,6 +721,8 @@ public:
 
     void send_orders_chunk()
     {
+        PHASE_TIMER(PHASE_GRAPHIC_TO_FILE_FLUSH);
+
         this->stream_orders.mark_end();
         BStream header(8);
         WRMChunk_Send chunk(header, RDP_UPDATE_ORDERS, this->stream_orders.size(), this->order_count);
@@ -684,6 +868,8 @@ public:
 
     void send_bitmaps_chunk()
     {
+        PHASE_TIMER(PHASE_GRAPHIC_TO_FILE_FLUSH);
+
         this->stream_bitmaps.mark_end();
         BStream header(8);
         WRMChunk_Send chunk(header, RDP_UPDATE_BITMAP, this->stream_bitmaps.size(), this->bitmap_count);
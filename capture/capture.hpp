@@ -24,9 +24,11 @@
 #include "client_info.hpp"
 #include "outmetatransport.hpp"
 #include "outfilenametransport.hpp"
+#include "mirrortransport.hpp"
 #include "RDP/caches/pointercache.hpp"
 #include "staticcapture.hpp"
 #include "nativecapture.hpp"
+#include "session_stats.hpp"
 
 #include "wait_obj.hpp"
 #include "RDP/pointer.hpp"
@@ -48,8 +50,10 @@ private:
     TODO("wrm_trans and crypto_wrm_trans should be one and the same (and crypto status hidden)");
     OutmetaTransport       * wrm_trans;
     CryptoOutmetaTransport * crypto_wrm_trans;
+    MirrorTransport        * mirror_trans;
     BmpCache               * pnc_bmp_cache;
     NativeCapture          * pnc;
+    KeystrokeIndexWriter   * keystroke_index;
 
     RDPDrawable * drawable;
 
@@ -83,8 +87,10 @@ public:
             , psc(NULL)
             , wrm_trans(NULL)
             , crypto_wrm_trans(NULL)
+            , mirror_trans(NULL)
             , pnc_bmp_cache(NULL)
             , pnc(NULL)
+            , keystroke_index(NULL)
             , drawable(NULL)
             , capture_event(wait_obj(NULL))
             , png_path(png_path)
@@ -129,24 +135,41 @@ public:
                  "(This is related to the path split between png and wrm)."
                  "We should stop and consider what we should actually do")
             this->pnc_bmp_cache = new BmpCache(BmpCache::Recorder, 24, 3, false, 600, 768, false, 300, 3072, false, 262, 12288, false);
+            Transport * wrm_out;
             if (this->enable_file_encryption) {
                 this->crypto_wrm_trans = new CryptoOutmetaTransport( &this->crypto_ctx
                                                                    , wrm_path, hash_path, basename, now
                                                                    , width, height
                                                                    , ini.video.capture_groupid
                                                                    , authentifier);
-                this->pnc = new NativeCapture( now, *this->crypto_wrm_trans, width, height
-                                             , *this->pnc_bmp_cache, *this->drawable, ini);
+                wrm_out = this->crypto_wrm_trans;
             }
             else
             {
                 this->wrm_trans = new OutmetaTransport( wrm_path, basename, now, width, height
                                                       , ini.video.capture_groupid
                                                       , authentifier);
-                this->pnc = new NativeCapture( now, *this->wrm_trans, width, height, *this->pnc_bmp_cache
-                                             , *this->drawable, ini);
+                wrm_out = this->wrm_trans;
             }
+            if (*ini.video.wrm_mirror_path) {
+                this->mirror_trans = new MirrorTransport(wrm_out, ini.video.wrm_mirror_path, basename);
+                wrm_out = this->mirror_trans;
+            }
+            this->pnc = new NativeCapture( now, *wrm_out, width, height, *this->pnc_bmp_cache
+                                         , *this->drawable, ini);
             this->pnc->recorder.send_input = true;
+
+            if (ini.video.wrm_keystroke_index) {
+                if (this->enable_file_encryption) {
+                    LOG(LOG_WARNING, "Capture: keystroke index not written, wrm files are encrypted");
+                }
+                else {
+                    char kidx_path[2048];
+                    snprintf(kidx_path, sizeof(kidx_path), "%s%s-%06u.kidx", wrm_path, basename, getpid());
+                    this->keystroke_index = new KeystrokeIndexWriter(kidx_path, now);
+                    this->pnc->recorder.keystroke_index = this->keystroke_index;
+                }
+            }
         }
 
         Pointer pointer0(Pointer::POINTER_CURSOR0);
@@ -173,6 +196,8 @@ public:
         delete this->png_trans;
 
         delete this->pnc;
+        delete this->keystroke_index;
+        delete this->mirror_trans;
         if (this->enable_file_encryption){
             delete this->crypto_wrm_trans;
         }
@@ -210,6 +235,7 @@ public:
             else {
                 this->wrm_trans->next();
             }
+            this->pnc->recorder.next_file();
             struct timeval now = tvtime();
             this->pnc->recorder.timestamp(now);
             this->pnc->recorder.send_timestamp_chunk(true);
@@ -232,7 +258,18 @@ public:
         }
     }
 
+    REDOC("Screen as captured so far, NULL if capture keeps no drawable")
+    const Drawable * framebuffer()
+    {
+        if (!this->capture_drawable) {
+            return NULL;
+        }
+        return &this->drawable->drawable;
+    }
+
     void snapshot(const timeval & now, int x, int y, bool ignore_frame_in_timeval) {
+        SessionStatsTimer timer(session_stats().capture_usec);
+
         this->capture_event.reset();
 
         if (this->capture_drawable) {
@@ -255,6 +292,7 @@ public:
 
     void flush() {
         if (this->capture_wrm) {
+            SessionStatsTimer timer(session_stats().capture_usec);
             this->pnc->flush();
         }
     }
@@ -376,6 +414,7 @@ public:
 
         if (order.action == RDP::FrameMarker::FrameEnd) {
             if (this->capture_png) {
+                SessionStatsTimer timer(session_stats().capture_usec);
                 this->psc->snapshot(this->last_now, this->last_x, this->last_y, false);
             }
         }
@@ -0,0 +1,368 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Retention of capture files (rotated png snapshots) by count, size and
+   age. Unlinking is done by a helper process fed through a pipe, so that a
+   slow filesystem never stalls the session loop. The helper sees end of
+   file when the session process exits, whatever the reason, and then
+   removes remaining files if requested.
+
+   The helper is forked on first use, hence after session process fork. It
+   is forked twice, so that init reaps it and session process never waits
+   for it.
+*/
+
+#ifndef _REDEMPTION_CAPTURE_CAPTURE_RETENTION_HPP_
+#define _REDEMPTION_CAPTURE_CAPTURE_RETENTION_HPP_
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <deque>
+#include <string>
+
+#include "log.hpp"
+
+struct RetentionQuotas {
+    unsigned max_files;
+    uint64_t max_bytes;     // 0: no limit
+    unsigned max_age;       // in seconds, 0: no limit
+
+    RetentionQuotas()
+    : max_files(0)
+    , max_bytes(0)
+    , max_age(0)
+    {}
+};
+
+// Files under retention, oldest first.
+class RetainedFiles {
+    struct File {
+        std::string name;
+        uint64_t    size;
+        time_t      time;
+    };
+
+    std::deque<File> files;
+    uint64_t         bytes;
+
+public:
+    RetentionQuotas quotas;
+
+    RetainedFiles()
+    : bytes(0)
+    {}
+
+    void add(const char * filename, time_t now) {
+        File file;
+        file.name = filename;
+        file.size = 0;
+        file.time = now;
+
+        struct stat st;
+        if (stat(filename, &st) == 0) {
+            file.size = st.st_size;
+        }
+        this->files.push_back(file);
+        this->bytes += file.size;
+    }
+
+    // unlink oldest files while one of the quotas is exceeded
+    void enforce(time_t now) {
+        while (!this->files.empty()
+              && (   (this->files.size() > this->quotas.max_files)
+                  || (this->quotas.max_bytes && (this->bytes > this->quotas.max_bytes))
+                  || (this->quotas.max_age && (now - this->files.front().time >= static_cast<time_t>(this->quotas.max_age))))) {
+            this->remove_oldest();
+        }
+    }
+
+    void remove_all() {
+        while (!this->files.empty()) {
+            this->remove_oldest();
+        }
+    }
+
+    size_t size() const {
+        return this->files.size();
+    }
+
+    uint64_t total_bytes() const {
+        return this->bytes;
+    }
+
+private:
+    void remove_oldest() {
+        const File & file = this->files.front();
+        // unlink may fail, for instance if file does not exist, just don't care
+        if (unlink(file.name.c_str()) < 0) {
+            LOG(LOG_INFO, "removing file \"%s\" failed. Error [%u] : %s\n", file.name.c_str(), errno, strerror(errno));
+        }
+        this->bytes -= file.size;
+        this->files.pop_front();
+    }
+};
+
+class CaptureRetention {
+    enum {
+        MSG_ADD,
+        MSG_QUOTAS,
+        MSG_SYNC
+    };
+
+    // smaller than PIPE_BUF, hence written atomically
+    struct Message {
+        uint32_t type;
+        uint32_t max_files;
+        uint64_t max_bytes;
+        uint32_t max_age;
+        char     filename[1024];
+    };
+
+    RetainedFiles files;    // used when no helper process is running
+    bool          clear_on_exit;
+    bool          use_helper;
+
+    int           request_fd;
+    int           ack_fd;
+
+public:
+    // clear_on_exit: remaining files are removed when session ends
+    CaptureRetention(bool clear_on_exit, bool use_helper)
+    : clear_on_exit(clear_on_exit)
+    , use_helper(use_helper)
+    , request_fd(-1)
+    , ack_fd(-1)
+    {}
+
+    ~CaptureRetention() {
+        if (this->request_fd != -1) {
+            // helper finishes its queue, then removes remaining files
+            close(this->request_fd);
+            close(this->ack_fd);
+        }
+        else if (this->clear_on_exit) {
+            this->files.remove_all();
+        }
+    }
+
+    void set_quotas(const RetentionQuotas & quotas) {
+        this->files.quotas = quotas;
+
+        if (this->request_fd != -1) {
+            Message msg;
+            this->init_message(msg, MSG_QUOTAS);
+            this->send_message(msg);
+        }
+        else {
+            this->files.enforce(time(NULL));
+        }
+    }
+
+    // file is complete, from now on it may be removed
+    void add(const char * filename) {
+        if (this->use_helper && (this->request_fd == -1)) {
+            this->start();
+        }
+
+        if (this->request_fd != -1) {
+            Message msg;
+            this->init_message(msg, MSG_ADD);
+            strncpy(msg.filename, filename, sizeof(msg.filename) - 1);
+            this->send_message(msg);
+        }
+        else {
+            const time_t now = time(NULL);
+            this->files.add(filename, now);
+            this->files.enforce(now);
+        }
+    }
+
+    // Returns when all previous requests are done.
+    void sync() {
+        if (this->request_fd != -1) {
+            Message msg;
+            this->init_message(msg, MSG_SYNC);
+            this->send_message(msg);
+
+            char ack;
+            while ((this->request_fd != -1) && (read(this->ack_fd, &ack, 1) < 0) && (errno == EINTR)) {
+            }
+        }
+    }
+
+    bool helper_running() const {
+        return this->request_fd != -1;
+    }
+
+private:
+    void init_message(Message & msg, uint32_t type) const {
+        memset(&msg, 0, sizeof(msg));
+        msg.type      = type;
+        msg.max_files = this->files.quotas.max_files;
+        msg.max_bytes = this->files.quotas.max_bytes;
+        msg.max_age   = this->files.quotas.max_age;
+    }
+
+    void send_message(const Message & msg) {
+        ssize_t res;
+        while (((res = write(this->request_fd, &msg, sizeof(msg))) < 0) && (errno == EINTR)) {
+        }
+        if (res != static_cast<ssize_t>(sizeof(msg))) {
+            LOG(LOG_WARNING, "CaptureRetention: helper process is gone, removing files from session");
+            close(this->request_fd);
+            close(this->ack_fd);
+            this->request_fd = -1;
+            this->ack_fd     = -1;
+            this->use_helper = false;
+            if (msg.type == MSG_ADD) {
+                this->add(msg.filename);
+            }
+        }
+    }
+
+    void start() {
+        int requests[2];
+        int acks[2];
+        if (pipe(requests) != 0) {
+            LOG(LOG_WARNING, "CaptureRetention: pipe failed, removing files from session");
+            this->use_helper = false;
+            return;
+        }
+        if (pipe(acks) != 0) {
+            close(requests[0]);
+            close(requests[1]);
+            LOG(LOG_WARNING, "CaptureRetention: pipe failed, removing files from session");
+            this->use_helper = false;
+            return;
+        }
+
+        const pid_t pid = fork();
+        if (pid < 0) {
+            close(requests[0]);
+            close(requests[1]);
+            close(acks[0]);
+            close(acks[1]);
+            LOG(LOG_WARNING, "CaptureRetention: fork failed, removing files from session");
+            this->use_helper = false;
+            return;
+        }
+
+        if (pid == 0) {
+            // only keep helper pipes, client socket in particular must not
+            // survive the session process
+            const int max_fd = getdtablesize();
+            for (int fd = 3; fd < max_fd; fd++) {
+                if ((fd != requests[0]) && (fd != acks[1])) {
+                    close(fd);
+                }
+            }
+            // helper is the grandchild, intermediate child exits at once
+            const pid_t helper_pid = fork();
+            if (helper_pid == 0) {
+                run_helper(requests[0], acks[1], this->files.quotas, this->clear_on_exit);
+            }
+            _exit((helper_pid < 0) ? 1 : 0);
+        }
+
+        close(requests[0]);
+        close(acks[1]);
+
+        int status = 0;
+        while ((waitpid(pid, &status, 0) < 0) && (errno == EINTR)) {
+        }
+        if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+            close(requests[1]);
+            close(acks[0]);
+            LOG(LOG_WARNING, "CaptureRetention: fork failed, removing files from session");
+            this->use_helper = false;
+            return;
+        }
+
+        this->request_fd = requests[1];
+        this->ack_fd     = acks[0];
+    }
+
+    static void run_helper(int request_fd, int ack_fd, const RetentionQuotas & quotas, bool clear_on_exit) {
+        // session process end (pipe closed) is the only way out
+        signal(SIGINT,  SIG_IGN);
+        signal(SIGTERM, SIG_IGN);
+        signal(SIGHUP,  SIG_IGN);
+        signal(SIGPIPE, SIG_IGN);
+
+        RetainedFiles files;
+        files.quotas = quotas;
+
+        for (;;) {
+            struct pollfd pfd;
+            pfd.fd      = request_fd;
+            pfd.events  = POLLIN;
+            pfd.revents = 0;
+            // wake up every second when files expire with age
+            const int res = poll(&pfd, 1, (files.quotas.max_age && files.size()) ? 1000 : -1);
+            if ((res < 0) && (errno != EINTR)) {
+                break;
+            }
+
+            if (res > 0) {
+                Message msg;
+                ssize_t len;
+                while (((len = read(request_fd, &msg, sizeof(msg))) < 0) && (errno == EINTR)) {
+                }
+                if (len != static_cast<ssize_t>(sizeof(msg))) {
+                    break;
+                }
+
+                files.quotas.max_files = msg.max_files;
+                files.quotas.max_bytes = msg.max_bytes;
+                files.quotas.max_age   = msg.max_age;
+
+                if (msg.type == MSG_ADD) {
+                    msg.filename[sizeof(msg.filename) - 1] = 0;
+                    files.add(msg.filename, time(NULL));
+                }
+                files.enforce(time(NULL));
+
+                if (msg.type == MSG_SYNC) {
+                    const char ack = 0;
+                    while ((write(ack_fd, &ack, 1) < 0) && (errno == EINTR)) {
+                    }
+                }
+            }
+            else {
+                files.enforce(time(NULL));
+            }
+        }
+
+        if (clear_on_exit) {
+            files.remove_all();
+        }
+        _exit(0);
+    }
+};
+
+#endif
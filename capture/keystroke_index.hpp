@@ -0,0 +1,450 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Keystroke index: sidecar file (.kidx) written next to a .mwrm, searching
+   typed text does not need to decode any wrm.
+
+   Typed text is kept as one UTF-8 stream, cut in entries: the keys received
+   in a TIMESTAMP chunk (typed before entry time). Trigrams of lowercased
+   text point to entries holding their first byte. All integers are little
+   endian:
+
+   header   : "RKIX" version entry_count trigram_count posting_count
+              text_size (uint32) start_time (uint64, usec)
+   entries  : time (uint64, usec) text_offset wrm_index (uint32)
+   trigrams : key (3 bytes packed in uint32) first_posting posting_count,
+              sorted by key
+   postings : entry numbers (uint32), ascending for each trigram
+   text     : text_size bytes
+*/
+
+#ifndef _REDEMPTION_CAPTURE_KEYSTROKE_INDEX_HPP_
+#define _REDEMPTION_CAPTURE_KEYSTROKE_INDEX_HPP_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "log.hpp"
+#include "utf.hpp"
+
+namespace keystroke_index {
+    enum {
+        FORMAT_VERSION = 1,
+        HEADER_SIZE    = 32,
+        ENTRY_SIZE     = 16,
+        TRIGRAM_SIZE   = 12
+    };
+
+    static inline uint8_t fold(uint8_t c) {
+        return ((c >= 'A') && (c <= 'Z')) ? c + ('a' - 'A') : c;
+    }
+
+    static inline uint32_t trigram(const uint8_t * p) {
+        return (fold(p[0]) << 16) | (fold(p[1]) << 8) | fold(p[2]);
+    }
+
+    static inline uint32_t get_u32(const uint8_t * p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    static inline uint64_t get_u64(const uint8_t * p) {
+        return get_u32(p) | (static_cast<uint64_t>(get_u32(p + 4)) << 32);
+    }
+
+    static inline void put_u32(std::string & s, uint32_t v) {
+        const char b[4] = { char(v), char(v >> 8), char(v >> 16), char(v >> 24) };
+        s.append(b, 4);
+    }
+
+    static inline void put_u64(std::string & s, uint64_t v) {
+        put_u32(s, static_cast<uint32_t>(v));
+        put_u32(s, static_cast<uint32_t>(v >> 32));
+    }
+}   // namespace keystroke_index
+
+// Recorder side: collects typed text, (re)writes index file on save().
+class KeystrokeIndexWriter {
+    struct Entry {
+        uint64_t time;
+        uint32_t text_offset;
+        uint32_t wrm_index;
+    };
+
+    std::string        path;
+    uint64_t           start_time;
+    uint32_t           wrm_index;
+    std::vector<Entry> entries;
+    std::string        text;
+    bool               dirty;
+
+public:
+    KeystrokeIndexWriter(const char * path, const timeval & now)
+    : path(path)
+    , start_time(now.tv_sec * 1000000ULL + now.tv_usec)
+    , wrm_index(0)
+    , dirty(true)
+    {}
+
+    ~KeystrokeIndexWriter() {
+        this->save();
+    }
+
+    // following keys are recorded in next wrm file of movie
+    void next_file() {
+        this->wrm_index++;
+    }
+
+    // keys: unicode characters as decoded by keymap (uint32 little endian)
+    void add(const timeval & now, const uint8_t * keys, size_t size) {
+        if (size < sizeof(uint32_t)) {
+            return;
+        }
+        Entry entry;
+        entry.time        = now.tv_sec * 1000000ULL + now.tv_usec;
+        entry.text_offset = this->text.size();
+        entry.wrm_index   = this->wrm_index;
+        this->entries.push_back(entry);
+
+        for (size_t i = 0; i + sizeof(uint32_t) <= size; i += sizeof(uint32_t)) {
+            uint8_t utf8[8];
+            const size_t len = UTF32toUTF8(keys + i, 1, utf8, sizeof(utf8));
+            this->text.append(reinterpret_cast<const char *>(utf8), len);
+        }
+        this->dirty = true;
+    }
+
+    // atomically replaces index file, false on error (already logged)
+    bool save() {
+        if (!this->dirty) {
+            return true;
+        }
+        using namespace keystroke_index;
+
+        std::vector<std::pair<uint32_t, uint32_t> > keys;    // (trigram, entry)
+        const uint32_t last_trigram = (this->text.size() > 2) ? this->text.size() - 2 : 0;
+        for (uint32_t e = 0; e < this->entries.size(); e++) {
+            const uint32_t end = std::min<uint32_t>( last_trigram
+                                                   , (e + 1 < this->entries.size())
+                                                     ? this->entries[e + 1].text_offset
+                                                     : this->text.size());
+            for (uint32_t i = this->entries[e].text_offset; i < end; i++) {
+                keys.push_back(std::make_pair(
+                    trigram(reinterpret_cast<const uint8_t *>(this->text.data()) + i), e));
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        std::string trigrams;
+        uint32_t    trigram_count = 0;
+        for (size_t i = 0; i < keys.size(); ) {
+            size_t j = i;
+            while ((j < keys.size()) && (keys[j].first == keys[i].first)) {
+                j++;
+            }
+            put_u32(trigrams, keys[i].first);
+            put_u32(trigrams, i);
+            put_u32(trigrams, j - i);
+            trigram_count++;
+            i = j;
+        }
+
+        std::string out;
+        out.reserve( HEADER_SIZE + this->entries.size() * ENTRY_SIZE + trigrams.size()
+                   + keys.size() * sizeof(uint32_t) + this->text.size());
+        out.append("RKIX", 4);
+        put_u32(out, FORMAT_VERSION);
+        put_u32(out, this->entries.size());
+        put_u32(out, trigram_count);
+        put_u32(out, keys.size());
+        put_u32(out, this->text.size());
+        put_u64(out, this->start_time);
+        for (size_t e = 0; e < this->entries.size(); e++) {
+            put_u64(out, this->entries[e].time);
+            put_u32(out, this->entries[e].text_offset);
+            put_u32(out, this->entries[e].wrm_index);
+        }
+        out.append(trigrams);
+        for (size_t i = 0; i < keys.size(); i++) {
+            put_u32(out, keys[i].second);
+        }
+        out.append(this->text);
+
+        const std::string tmp_path = this->path + ".tmp";
+        const int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
+        if (fd < 0) {
+            LOG(LOG_ERR, "KeystrokeIndexWriter: failed to create \"%s\" (%d)", tmp_path.c_str(), errno);
+            return false;
+        }
+        size_t written = 0;
+        while (written < out.size()) {
+            const ssize_t res = ::write(fd, out.data() + written, out.size() - written);
+            if (res < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                LOG(LOG_ERR, "KeystrokeIndexWriter: failed to write \"%s\" (%d)", tmp_path.c_str(), errno);
+                ::close(fd);
+                ::unlink(tmp_path.c_str());
+                return false;
+            }
+            written += res;
+        }
+        ::close(fd);
+        if (::rename(tmp_path.c_str(), this->path.c_str()) < 0) {
+            LOG(LOG_ERR, "KeystrokeIndexWriter: failed to rename \"%s\" (%d)", tmp_path.c_str(), errno);
+            ::unlink(tmp_path.c_str());
+            return false;
+        }
+        this->dirty = false;
+        return true;
+    }
+};
+
+// Search side: index file is mapped, only trigram table and candidate
+// entries text are read.
+class KeystrokeIndexReader {
+    uint8_t * map;
+    size_t    map_size;
+
+    const uint8_t * entries;
+    const uint8_t * trigrams;
+    const uint8_t * postings;
+    const uint8_t * text;
+
+public:
+    uint32_t entry_count;
+    uint32_t trigram_count;
+    uint32_t posting_count;
+    uint32_t text_size;
+    uint64_t start_time;
+
+    struct Match {
+        uint32_t position;   // in text
+        uint32_t entry;
+        uint64_t begin;      // keys typed between begin and time (usec)
+        uint64_t time;
+        uint32_t wrm_index;
+    };
+
+    KeystrokeIndexReader()
+    : map(NULL)
+    , map_size(0)
+    , entries(NULL)
+    , trigrams(NULL)
+    , postings(NULL)
+    , text(NULL)
+    , entry_count(0)
+    , trigram_count(0)
+    , posting_count(0)
+    , text_size(0)
+    , start_time(0)
+    {}
+
+    ~KeystrokeIndexReader() {
+        this->close();
+    }
+
+    void close() {
+        if (this->map) {
+            ::munmap(this->map, this->map_size);
+        }
+        this->map      = NULL;
+        this->map_size = 0;
+    }
+
+    // false if file is missing or is not a valid index
+    bool open(const char * path) {
+        using namespace keystroke_index;
+
+        this->close();
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if ((::fstat(fd, &st) < 0) || (st.st_size < HEADER_SIZE)) {
+            ::close(fd);
+            return false;
+        }
+        void * map = ::mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        this->map      = static_cast<uint8_t *>(map);
+        this->map_size = st.st_size;
+
+        const uint8_t * h = this->map;
+        this->entry_count   = get_u32(h + 8);
+        this->trigram_count = get_u32(h + 12);
+        this->posting_count = get_u32(h + 16);
+        this->text_size     = get_u32(h + 20);
+        this->start_time    = get_u64(h + 24);
+        const uint64_t expected = HEADER_SIZE
+                                + static_cast<uint64_t>(this->entry_count) * ENTRY_SIZE
+                                + static_cast<uint64_t>(this->trigram_count) * TRIGRAM_SIZE
+                                + static_cast<uint64_t>(this->posting_count) * sizeof(uint32_t)
+                                + this->text_size;
+        if (memcmp(h, "RKIX", 4) || (get_u32(h + 4) != FORMAT_VERSION) || (expected != this->map_size)) {
+            this->close();
+            return false;
+        }
+        this->entries  = h + HEADER_SIZE;
+        this->trigrams = this->entries + this->entry_count * ENTRY_SIZE;
+        this->postings = this->trigrams + this->trigram_count * TRIGRAM_SIZE;
+        this->text     = this->postings + this->posting_count * sizeof(uint32_t);
+        return true;
+    }
+
+    uint64_t entry_time(uint32_t entry) const {
+        return keystroke_index::get_u64(this->entries + entry * keystroke_index::ENTRY_SIZE);
+    }
+
+    uint32_t entry_offset(uint32_t entry) const {
+        return (entry < this->entry_count)
+             ? keystroke_index::get_u32(this->entries + entry * keystroke_index::ENTRY_SIZE + 8)
+             : this->text_size;
+    }
+
+    uint32_t entry_wrm_index(uint32_t entry) const {
+        return keystroke_index::get_u32(this->entries + entry * keystroke_index::ENTRY_SIZE + 12);
+    }
+
+    // up to size bytes of text starting at position (not null terminated)
+    const char * text_at(uint32_t position, size_t & size) const {
+        size = std::min<size_t>(size, this->text_size - std::min(position, this->text_size));
+        return reinterpret_cast<const char *>(this->text) + position;
+    }
+
+    // Case insensitive (ASCII) occurrences of query, in text order.
+    void search(const char * query, std::vector<Match> & matches) const {
+        using namespace keystroke_index;
+
+        const uint8_t * q   = reinterpret_cast<const uint8_t *>(query);
+        const uint32_t  len = strlen(query);
+        if (!len || (len > this->text_size)) {
+            return;
+        }
+        if (len < 3) {
+            this->scan(q, len, 0, this->text_size - len + 1, matches);
+            return;
+        }
+
+        // candidates: entries holding the least frequent trigram of query
+        uint32_t best_first  = 0;
+        uint32_t best_count  = 0xFFFFFFFF;
+        uint32_t best_offset = 0;
+        for (uint32_t i = 0; i + 3 <= len; i++) {
+            uint32_t first = 0;
+            uint32_t count = 0;
+            if (!this->find_trigram(trigram(q + i), first, count)) {
+                return;
+            }
+            if (count < best_count) {
+                best_first  = first;
+                best_count  = count;
+                best_offset = i;
+            }
+        }
+        for (uint32_t i = 0; i < best_count; i++) {
+            const uint32_t entry = get_u32(this->postings + (best_first + i) * sizeof(uint32_t));
+            // trigram begins inside entry: query begins best_offset bytes before
+            const uint32_t begin = this->entry_offset(entry);
+            const uint32_t end   = this->entry_offset(entry + 1);
+            this->scan( q, len, (begin > best_offset) ? begin - best_offset : 0
+                      , std::min(end - std::min(end, best_offset), this->text_size - len + 1), matches);
+        }
+    }
+
+private:
+    bool find_trigram(uint32_t key, uint32_t & first, uint32_t & count) const {
+        using namespace keystroke_index;
+
+        uint32_t low  = 0;
+        uint32_t high = this->trigram_count;
+        while (low < high) {
+            const uint32_t  mid = low + (high - low) / 2;
+            const uint8_t * t   = this->trigrams + mid * TRIGRAM_SIZE;
+            const uint32_t  k   = get_u32(t);
+            if (k == key) {
+                first = get_u32(t + 4);
+                count = get_u32(t + 8);
+                return true;
+            }
+            if (k < key) {
+                low = mid + 1;
+            }
+            else {
+                high = mid;
+            }
+        }
+        return false;
+    }
+
+    // entry holding text position
+    uint32_t entry_at(uint32_t position) const {
+        uint32_t low  = 0;
+        uint32_t high = this->entry_count;
+        while (high - low > 1) {
+            const uint32_t mid = low + (high - low) / 2;
+            if (this->entry_offset(mid) <= position) {
+                low = mid;
+            }
+            else {
+                high = mid;
+            }
+        }
+        return low;
+    }
+
+    void scan(const uint8_t * q, uint32_t len, uint32_t from, uint32_t to, std::vector<Match> & matches) const {
+        using namespace keystroke_index;
+
+        for (uint32_t p = from; p < to; p++) {
+            uint32_t i = 0;
+            while ((i < len) && (fold(this->text[p + i]) == fold(q[i]))) {
+                i++;
+            }
+            if (i == len) {
+                Match m;
+                m.position  = p;
+                m.entry     = this->entry_at(p);
+                m.time      = this->entry_time(m.entry);
+                m.begin     = m.entry ? this->entry_time(m.entry - 1) : this->start_time;
+                m.wrm_index = this->entry_wrm_index(m.entry);
+                matches.push_back(m);
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Spreads png snapshots of sessions over time. Each session gets a phase
+   offset from its statistics slot, so that sessions opened together do not
+   snapshot together, and non urgent snapshots are only taken while the
+   host-wide encode budget of current second is not exhausted.
+
+   Admission reserves the expected encode time of the session (its last
+   one) in the budget, the difference with actual time is settled when the
+   snapshot is done. Sessions deferred to next second retry at their own
+   phase within it.
+*/
+
+#ifndef _REDEMPTION_CAPTURE_SNAPSHOT_SCHEDULER_HPP_
+#define _REDEMPTION_CAPTURE_SNAPSHOT_SCHEDULER_HPP_
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "session_stats.hpp"
+
+class SnapshotScheduler {
+    SnapshotBudget & budget;
+    uint64_t         budget_usec;   // per second, 0: no limit
+    unsigned         index;         // session number, for retry jitter
+
+    uint64_t         estimate_usec; // expected encode time
+    uint64_t         reserved_usec; // reserved by last admit
+    uint64_t         reserved_window;
+
+public:
+    // before a first snapshot is encoded
+    static const uint64_t DEFAULT_ESTIMATE_USEC = 20000;
+
+    SnapshotScheduler(SnapshotBudget & budget, uint64_t budget_usec, unsigned index = 0)
+    : budget(budget)
+    , budget_usec(budget_usec)
+    , index(index)
+    , estimate_usec(DEFAULT_ESTIMATE_USEC)
+    , reserved_usec(0)
+    , reserved_window(0)
+    {}
+
+    void set_budget(uint64_t budget_usec) {
+        this->budget_usec = budget_usec;
+    }
+
+    // Offset in [0, interval[ of session number index. Consecutive indexes
+    // are spread by golden ratio, any number of them stays evenly spaced.
+    static uint64_t phase_offset(unsigned index, uint64_t interval) {
+        const uint32_t fraction = static_cast<uint32_t>(index * 2654435769u);
+        return (interval * fraction) >> 32;
+    }
+
+    // false if snapshot should be postponed to a later window, otherwise
+    // expected encode time is reserved
+    bool admit(const timeval & now) {
+        this->reserved_usec = 0;
+        if (!this->budget_usec) {
+            return true;
+        }
+        this->update_window(now);
+        for (;;) {
+            const uint64_t current = this->budget.window_usec;
+            if (current >= this->budget_usec) {
+                return false;
+            }
+            if (__sync_bool_compare_and_swap(&this->budget.window_usec, current, current + this->estimate_usec)) {
+                break;
+            }
+        }
+        this->reserved_usec   = this->estimate_usec;
+        this->reserved_window = now.tv_sec;
+        return true;
+    }
+
+    // encode time of an admitted (or urgent) snapshot
+    void spent(const timeval & now, uint64_t usec) {
+        this->update_window(now);
+        if (this->reserved_usec && (this->reserved_window == static_cast<uint64_t>(now.tv_sec))) {
+            if (usec > this->reserved_usec) {
+                __sync_fetch_and_add(&this->budget.window_usec, usec - this->reserved_usec);
+            }
+            else {
+                this->release(this->reserved_usec - usec);
+            }
+        }
+        else {
+            // reservation belongs to a past window
+            __sync_fetch_and_add(&this->budget.window_usec, usec);
+        }
+        this->reserved_usec = 0;
+        this->estimate_usec = usec;
+    }
+
+    // time before next window
+    static uint64_t next_window_delay(const timeval & now) {
+        return 1000000 - now.tv_usec;
+    }
+
+    // time before retrying a deferred snapshot: next window, at session
+    // phase within it, so that deferred sessions do not retry together
+    uint64_t retry_delay(const timeval & now) const {
+        return next_window_delay(now) + phase_offset(this->index, 1000000);
+    }
+
+private:
+    void update_window(const timeval & now) {
+        const uint64_t window = now.tv_sec;
+        const uint64_t current = this->budget.window;
+        if ((current < window) && __sync_bool_compare_and_swap(&this->budget.window, current, window)) {
+            this->budget.window_usec = 0;
+        }
+    }
+
+    // never below 0, window may have been reset meanwhile
+    void release(uint64_t usec) {
+        for (;;) {
+            const uint64_t current = this->budget.window_usec;
+            const uint64_t next = (current > usec) ? current - usec : 0;
+            if (__sync_bool_compare_and_swap(&this->budget.window_usec, current, next)) {
+                break;
+            }
+        }
+    }
+};
+
+#endif
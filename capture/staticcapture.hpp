@@ -27,6 +27,8 @@
 #include <stdio.h>
 #include <png.h>
 
+#include <algorithm>
+
 #include "bitmap.hpp"
 #include "rect.hpp"
 #include "difftimeval.hpp"
@@ -44,6 +46,8 @@
 #include "RDP/RDPDrawable.hpp"
 #include "config.hpp"
 #include "outfilenametransport.hpp"
+#include "capture_retention.hpp"
+#include "snapshot_scheduler.hpp"
 
 struct StaticCaptureConfig {
     unsigned png_limit;
@@ -65,57 +69,77 @@ public:
     uint64_t inter_frame_interval_static_capture;
     uint64_t time_to_wait;
 
+    // rotation of png files already written, off the session loop
+    CaptureRetention retention;
+
+    SnapshotScheduler scheduler;
+
     StaticCapture(const timeval & now, Transport & trans, SQ * seq, unsigned width, unsigned height, bool clear_png, const Inifile & ini, Drawable & drawable)
     : ImageCapture(trans, width, height, drawable)
     , clear_png(clear_png)
     , seq(seq)
-    , time_to_wait(0) {
+    , time_to_wait(0)
+    , retention(clear_png, ini.video.png_cleanup_helper)
+    , scheduler(snapshot_budget(), 0, std::max(SessionStatsSegment::instance().owned_slot_index(), 0)) {
         this->start_static_capture = now;
         this->conf.png_interval = 3000; // png interval is in 1/10 s, default value, 1 static snapshot every 5 minutes
         this->inter_frame_interval_static_capture       = this->conf.png_interval * 100000; // 1 000 000 us is 1 sec
         this->update_config(ini);
+
+        // first snapshot sooner by session phase offset, later ones keep it
+        const int slot = SessionStatsSegment::instance().owned_slot_index();
+        if (slot > 0) {
+            const uint64_t phase = SnapshotScheduler::phase_offset(slot, this->inter_frame_interval_static_capture);
+            const uint64_t start = ustime(now) - phase;
+            this->start_static_capture.tv_sec  = start / 1000000;
+            this->start_static_capture.tv_usec = start % 1000000;
+        }
     }
 
+    // all captured files are deleted at the end of the RDP client session
+    // by retention when clear_png is set
     virtual ~StaticCapture() {
-        // delete all captured files at the end of the RDP client session
-        if (this->clear_png) {
-            for(size_t i = this->conf.png_limit ; i > 0 ; i--) {
-                if (this->trans.seqno >= i) {
-                    // unlink may fail, for instance if file does not exist, just don't care
-                    sq_outfilename_unlink(this->seq, this->trans.seqno - i);
-                }
-            }
-        }
     }
 
     void update_config(const Inifile & ini) {
-        if (ini.video.png_limit < this->conf.png_limit) {
-            for(size_t i = this->conf.png_limit ; i > ini.video.png_limit ; i--) {
-                if (this->trans.seqno >= i) {
-                    // unlink may fail, for instance if file does not exist, just don't care
-                    sq_outfilename_unlink(this->seq, this->trans.seqno - i);
-                }
-            }
-        }
         this->conf.png_limit = ini.video.png_limit;
 
+        RetentionQuotas quotas;
+        quotas.max_files = ini.video.png_limit;
+        quotas.max_bytes = static_cast<uint64_t>(ini.video.png_limit_size) * 1024;
+        quotas.max_age   = ini.video.png_limit_age;
+        this->retention.set_quotas(quotas);
+
         if (ini.video.png_interval != this->conf.png_interval) {
             // png interval is in 1/10 s, default value, 1 static snapshot every 5 minutes
             this->conf.png_interval = ini.video.png_interval;
             this->inter_frame_interval_static_capture = this->conf.png_interval * 100000; // 1 000 000 us is 1 sec
         }
+
+        this->scheduler.set_budget(static_cast<uint64_t>(ini.video.png_encode_budget) * 1000);
     }
 
     virtual void snapshot(const timeval & now, int x, int y, bool ignore_frame_in_timeval) {
         unsigned diff_time_val = static_cast<unsigned>(difftimeval(now, this->start_static_capture));
         if (diff_time_val >= static_cast<unsigned>(this->inter_frame_interval_static_capture)) {
-            if (   this->drawable.logical_frame_ended
-                // Force snapshot if diff_time_val >= 1,5 x inter_frame_interval_static_capture.
-                || (diff_time_val >= static_cast<unsigned>(this->inter_frame_interval_static_capture) * 3 / 2)) {
+            // Force snapshot if diff_time_val >= 1,5 x inter_frame_interval_static_capture.
+            const unsigned deadline = static_cast<unsigned>(this->inter_frame_interval_static_capture) * 3 / 2;
+            const bool     urgent   = (diff_time_val >= deadline);
+            if (this->drawable.logical_frame_ended || urgent) {
+                if (!urgent && !this->scheduler.admit(now)) {
+                    // host-wide encode budget exhausted, retry in next window
+                    session_stats().png_snapshots_deferred++;
+                    this->time_to_wait = std::min<uint64_t>( this->scheduler.retry_delay(now)
+                                                           , deadline - diff_time_val);
+                    return;
+                }
+                const uint64_t start = ustime();
                 this->drawable.trace_mouse();
                 this->breakpoint(now);
                 this->start_static_capture = addusectimeval(this->inter_frame_interval_static_capture, this->start_static_capture);
                 this->drawable.clear_mouse();
+                this->scheduler.spent(now, ustime() - start);
+                session_stats().png_snapshots++;
             }
             else {
                 // Wait 0,3 x inter_frame_interval_static_capture.
@@ -133,12 +157,9 @@ public:
         this->drawable.trace_pausetimestamp(*ptm);
 
         if (this->conf.png_limit > 0) {
-            if (this->trans.seqno >= this->conf.png_limit) {
-                // unlink may fail, for instance if file does not exist, just don't care
-                sq_outfilename_unlink(this->seq, this->trans.seqno - this->conf.png_limit);
-            }
             this->flush();
             this->trans.next();
+            this->retain_last_png();
         }
 
         this->drawable.clear_pausetimestamp();
@@ -152,16 +173,21 @@ public:
         this->drawable.trace_timestamp(*ptm);
 
         if (this->conf.png_limit > 0) {
-            if (this->trans.seqno >= this->conf.png_limit) {
-                // unlink may fail, for instance if file does not exist, just don't care
-                sq_outfilename_unlink(this->seq, this->trans.seqno - this->conf.png_limit);
-            }
             this->flush();
             this->trans.next();
+            this->retain_last_png();
         }
 
         this->drawable.clear_timestamp();
     }
+
+private:
+    // previous png is complete (renamed to its final name) after next()
+    void retain_last_png() {
+        char filename[1024];
+        sq_im_SQOutfilename_get_name(&(this->seq->u.outfilename), filename, sizeof(filename), this->trans.seqno - 1);
+        this->retention.add(filename);
+    }
 };
 
 #endif
@@ -0,0 +1,561 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Traffic profile of a transparent recording (server to client side):
+   order sizes, bytes per channel, bulk compression, bitmap cache usage,
+   bandwidth over time, and what-if numbers for other bitmap cache sizes
+   and bulk compressors.
+
+   TrafficProfile only holds fixed size counters, so that profiles of
+   recordings analyzed in worker processes can be sent back as is and
+   merged. TrafficProfiler keeps the state needed to compute them.
+*/
+
+#ifndef _REDEMPTION_CAPTURE_TRAFFIC_PROFILE_HPP_
+#define _REDEMPTION_CAPTURE_TRAFFIC_PROFILE_HPP_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <vector>
+
+#include "RDP/mppc.hpp"
+#include "RDP/orders/RDPOrdersCommon.hpp"
+
+// power of two buckets, bucket i: [2^i, 2^(i+1))
+struct SizeHistogram {
+    enum {
+        BUCKET_COUNT = 33
+    };
+
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint64_t buckets[BUCKET_COUNT];
+
+    void add(uint64_t value) {
+        this->count++;
+        this->total += value;
+        if (value > this->max) {
+            this->max = value;
+        }
+        const unsigned i = 63 - __builtin_clzll(value | 1);
+        this->buckets[(i < BUCKET_COUNT) ? i : BUCKET_COUNT - 1]++;
+    }
+
+    void merge(const SizeHistogram & other) {
+        this->count += other.count;
+        this->total += other.total;
+        if (other.max > this->max) {
+            this->max = other.max;
+        }
+        for (unsigned i = 0; i < BUCKET_COUNT; i++) {
+            this->buckets[i] += other.buckets[i];
+        }
+    }
+
+    // upper bound of bucket holding the given percentile (0 if empty)
+    uint64_t percentile(unsigned percent) const {
+        if (!this->count) {
+            return 0;
+        }
+        const uint64_t rank = (this->count * percent + 99) / 100;
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < BUCKET_COUNT; i++) {
+            seen += this->buckets[i];
+            if (seen >= rank) {
+                return std::min<uint64_t>(uint64_t(2) << i, this->max);
+            }
+        }
+        return this->max;
+    }
+};
+
+struct TrafficProfile {
+    enum {
+        PRIMARY_ORDER_TYPES   = 32,
+        SECONDARY_ORDER_TYPES = 16,
+        MAX_CHANNELS          = 8,
+        TIMELINE_MINUTES      = 24 * 60
+    };
+
+    enum {
+        CODEC_MPPC_40,
+        CODEC_MPPC_50,
+        CODEC_RDP_60,
+        CODEC_RDP_61,
+
+        CODEC_COUNT
+    };
+
+    enum {
+        CACHE_SIZE_COUNT = 5
+    };
+
+    static unsigned cache_size(unsigned i) {
+        static const unsigned sizes[CACHE_SIZE_COUNT] = { 256, 1024, 4096, 16384, 65536 };
+        return sizes[i];
+    }
+
+    uint64_t recordings;
+    uint64_t chunks;
+    uint64_t duration_usec;
+
+    uint64_t fastpath_bytes;
+    uint64_t slowpath_bytes;
+    uint64_t channel_bytes;
+
+    // bulk compression, as recorded
+    uint64_t update_pdus;
+    uint64_t compressed_update_pdus;
+    uint64_t update_wire_bytes;
+    uint64_t update_uncompressed_bytes;
+    // same uncompressed payloads through each proxy bulk compressor
+    uint64_t codec_bytes[CODEC_COUNT];
+
+    SizeHistogram primary_orders[PRIMARY_ORDER_TYPES];
+    SizeHistogram secondary_orders[SECONDARY_ORDER_TYPES];
+    SizeHistogram bitmap_updates;
+
+    struct Channel {
+        char     name[8];
+        uint64_t chunks;
+        uint64_t bytes;
+    } channels[MAX_CHANNELS];
+
+    // bitmap cache: stores are cache bitmap orders, references MemBlt and
+    // Mem3Blt, unknown_references target slots never stored in recording
+    uint64_t cache_stores;
+    uint64_t cache_store_bytes;
+    uint64_t cache_references;
+    uint64_t cache_unknown_references;
+    // LRU of cache_size(i) bitmaps, keyed on content, over stores and
+    // references in recording order
+    uint64_t cache_misses[CACHE_SIZE_COUNT];
+    uint64_t cache_miss_bytes[CACHE_SIZE_COUNT];
+
+    SizeHistogram bytes_per_second;
+    uint64_t      burst_seconds;    // seconds over 4 times recording average
+    uint64_t      timeline[TIMELINE_MINUTES];   // bytes per minute since start
+
+    TrafficProfile() {
+        this->reset();
+    }
+
+    void reset() {
+        ::memset(this, 0, sizeof(*this));
+    }
+
+    void add_channel(const char * name, uint64_t bytes) {
+        for (unsigned i = 0; i < MAX_CHANNELS; i++) {
+            Channel & channel = this->channels[i];
+            if (!channel.name[0]) {
+                strncpy(channel.name, name, sizeof(channel.name) - 1);
+            }
+            if (!strncmp(channel.name, name, sizeof(channel.name) - 1)) {
+                channel.chunks++;
+                channel.bytes += bytes;
+                return;
+            }
+        }
+    }
+
+    void merge(const TrafficProfile & other) {
+        this->recordings    += other.recordings;
+        this->chunks        += other.chunks;
+        this->duration_usec += other.duration_usec;
+
+        this->fastpath_bytes += other.fastpath_bytes;
+        this->slowpath_bytes += other.slowpath_bytes;
+        this->channel_bytes  += other.channel_bytes;
+
+        this->update_pdus               += other.update_pdus;
+        this->compressed_update_pdus    += other.compressed_update_pdus;
+        this->update_wire_bytes         += other.update_wire_bytes;
+        this->update_uncompressed_bytes += other.update_uncompressed_bytes;
+        for (unsigned i = 0; i < CODEC_COUNT; i++) {
+            this->codec_bytes[i] += other.codec_bytes[i];
+        }
+
+        for (unsigned i = 0; i < PRIMARY_ORDER_TYPES; i++) {
+            this->primary_orders[i].merge(other.primary_orders[i]);
+        }
+        for (unsigned i = 0; i < SECONDARY_ORDER_TYPES; i++) {
+            this->secondary_orders[i].merge(other.secondary_orders[i]);
+        }
+        this->bitmap_updates.merge(other.bitmap_updates);
+
+        for (unsigned i = 0; (i < MAX_CHANNELS) && other.channels[i].name[0]; i++) {
+            const Channel & channel = other.channels[i];
+            for (unsigned j = 0; j < MAX_CHANNELS; j++) {
+                if (!this->channels[j].name[0]) {
+                    memcpy(this->channels[j].name, channel.name, sizeof(channel.name));
+                }
+                if (!strcmp(this->channels[j].name, channel.name)) {
+                    this->channels[j].chunks += channel.chunks;
+                    this->channels[j].bytes  += channel.bytes;
+                    break;
+                }
+            }
+        }
+
+        this->cache_stores             += other.cache_stores;
+        this->cache_store_bytes        += other.cache_store_bytes;
+        this->cache_references         += other.cache_references;
+        this->cache_unknown_references += other.cache_unknown_references;
+        for (unsigned i = 0; i < CACHE_SIZE_COUNT; i++) {
+            this->cache_misses[i]     += other.cache_misses[i];
+            this->cache_miss_bytes[i] += other.cache_miss_bytes[i];
+        }
+
+        // recordings are taken as started together: worst case for a host
+        this->bytes_per_second.merge(other.bytes_per_second);
+        this->burst_seconds += other.burst_seconds;
+        for (unsigned i = 0; i < TIMELINE_MINUTES; i++) {
+            this->timeline[i] += other.timeline[i];
+        }
+    }
+
+    // one JSON object, written at given indentation
+    void write_json(FILE * out, const char * indent) const {
+        char in[64];
+        snprintf(in, sizeof(in), "%s    ", indent);
+
+        fprintf(out, "{\n");
+        fprintf(out, "%s\"recordings\": %llu,\n", in, ull(this->recordings));
+        fprintf(out, "%s\"chunks\": %llu,\n", in, ull(this->chunks));
+        fprintf(out, "%s\"duration_usec\": %llu,\n", in, ull(this->duration_usec));
+        fprintf(out, "%s\"bytes\": {\"fastpath\": %llu, \"slowpath\": %llu, \"channels\": %llu},\n",
+            in, ull(this->fastpath_bytes), ull(this->slowpath_bytes), ull(this->channel_bytes));
+
+        fprintf(out, "%s\"bulk_compression\": {\"update_pdus\": %llu, \"compressed_update_pdus\": %llu, "
+            "\"wire_bytes\": %llu, \"uncompressed_bytes\": %llu, \"ratio\": %.4f,\n",
+            in, ull(this->update_pdus), ull(this->compressed_update_pdus),
+            ull(this->update_wire_bytes), ull(this->update_uncompressed_bytes),
+            ratio(this->update_wire_bytes, this->update_uncompressed_bytes));
+        fprintf(out, "%s    \"what_if\": {", in);
+        for (unsigned i = 0; i < CODEC_COUNT; i++) {
+            fprintf(out, "%s\"%s\": {\"bytes\": %llu, \"ratio\": %.4f}", i ? ", " : "", codec_name(i),
+                ull(this->codec_bytes[i]), ratio(this->codec_bytes[i], this->update_uncompressed_bytes));
+        }
+        fprintf(out, "}},\n");
+
+        fprintf(out, "%s\"primary_orders\": {", in);
+        bool first = true;
+        for (unsigned i = 0; i < PRIMARY_ORDER_TYPES; i++) {
+            if (this->primary_orders[i].count) {
+                fprintf(out, "%s\n%s    \"%s\": ", first ? "" : ",", in, primary_order_name(i));
+                write_json(out, this->primary_orders[i]);
+                first = false;
+            }
+        }
+        fprintf(out, "%s%s},\n", first ? "" : "\n", first ? "" : in);
+
+        fprintf(out, "%s\"secondary_orders\": {", in);
+        first = true;
+        for (unsigned i = 0; i < SECONDARY_ORDER_TYPES; i++) {
+            if (this->secondary_orders[i].count) {
+                fprintf(out, "%s\n%s    \"%s\": ", first ? "" : ",", in, secondary_order_name(i));
+                write_json(out, this->secondary_orders[i]);
+                first = false;
+            }
+        }
+        fprintf(out, "%s%s},\n", first ? "" : "\n", first ? "" : in);
+
+        fprintf(out, "%s\"bitmap_updates\": ", in);
+        write_json(out, this->bitmap_updates);
+        fprintf(out, ",\n");
+
+        fprintf(out, "%s\"channels\": {", in);
+        for (unsigned i = 0; (i < MAX_CHANNELS) && this->channels[i].name[0]; i++) {
+            fprintf(out, "%s\"%s\": {\"chunks\": %llu, \"bytes\": %llu}", i ? ", " : "",
+                this->channels[i].name, ull(this->channels[i].chunks), ull(this->channels[i].bytes));
+        }
+        fprintf(out, "},\n");
+
+        fprintf(out, "%s\"bitmap_cache\": {\"stores\": %llu, \"store_bytes\": %llu, \"references\": %llu, "
+            "\"unknown_references\": %llu, \"hit_ratio\": %.4f,\n",
+            in, ull(this->cache_stores), ull(this->cache_store_bytes), ull(this->cache_references),
+            ull(this->cache_unknown_references),
+            (this->cache_references > this->cache_stores)
+                ? 1.0 - ratio(this->cache_stores, this->cache_references) : 0.0);
+        fprintf(out, "%s    \"what_if\": [", in);
+        for (unsigned i = 0; i < CACHE_SIZE_COUNT; i++) {
+            fprintf(out, "%s{\"entries\": %u, \"misses\": %llu, \"miss_bytes\": %llu}", i ? ", " : "",
+                cache_size(i), ull(this->cache_misses[i]), ull(this->cache_miss_bytes[i]));
+        }
+        fprintf(out, "]},\n");
+
+        fprintf(out, "%s\"bandwidth\": {\"bytes_per_second\": ", in);
+        write_json(out, this->bytes_per_second);
+        fprintf(out, ", \"burst_seconds\": %llu,\n%s    \"bytes_per_minute\": [", ull(this->burst_seconds), in);
+        unsigned minutes = TIMELINE_MINUTES;
+        while (minutes && !this->timeline[minutes - 1]) {
+            minutes--;
+        }
+        for (unsigned i = 0; i < minutes; i++) {
+            fprintf(out, "%s%llu", i ? ", " : "", ull(this->timeline[i]));
+        }
+        fprintf(out, "]}\n");
+
+        fprintf(out, "%s}", indent);
+    }
+
+    static void write_json(FILE * out, const SizeHistogram & h) {
+        fprintf(out, "{\"count\": %llu, \"bytes\": %llu, \"max\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu}",
+            ull(h.count), ull(h.total), ull(h.max),
+            ull(h.percentile(50)), ull(h.percentile(90)), ull(h.percentile(99)));
+    }
+
+    static const char * codec_name(unsigned codec) {
+        static const char * names[CODEC_COUNT] = { "mppc_40", "mppc_50", "rdp_60", "rdp_61" };
+        return (codec < CODEC_COUNT) ? names[codec] : "unknown";
+    }
+
+    static const char * primary_order_name(unsigned order) {
+        switch (order) {
+        case RDP::DESTBLT:         return "dstblt";
+        case RDP::PATBLT:          return "patblt";
+        case RDP::SCREENBLT:       return "scrblt";
+        case RDP::LINE:            return "lineto";
+        case RDP::RECT:            return "opaquerect";
+        case RDP::MEMBLT:          return "memblt";
+        case RDP::MEM3BLT:         return "mem3blt";
+        case RDP::MULTIDSTBLT:     return "multidstblt";
+        case RDP::MULTIPATBLT:     return "multipatblt";
+        case RDP::MULTISCRBLT:     return "multiscrblt";
+        case RDP::MULTIOPAQUERECT: return "multiopaquerect";
+        case RDP::POLYGONSC:       return "polygonsc";
+        case RDP::POLYGONCB:       return "polygoncb";
+        case RDP::POLYLINE:        return "polyline";
+        case RDP::ELLIPSESC:       return "ellipsesc";
+        case RDP::ELLIPSECB:       return "ellipsecb";
+        case RDP::GLYPHINDEX:      return "glyphindex";
+        default:                   return "other";
+        }
+    }
+
+    static const char * secondary_order_name(unsigned order) {
+        switch (order) {
+        case RDP::TS_CACHE_BITMAP_UNCOMPRESSED:      return "cache_bitmap_uncompressed";
+        case RDP::TS_CACHE_COLOR_TABLE:              return "cache_color_table";
+        case RDP::TS_CACHE_BITMAP_COMPRESSED:        return "cache_bitmap_compressed";
+        case RDP::TS_CACHE_GLYPH:                    return "cache_glyph";
+        case RDP::TS_CACHE_BITMAP_UNCOMPRESSED_REV2: return "cache_bitmap_uncompressed_rev2";
+        case RDP::TS_CACHE_BITMAP_COMPRESSED_REV2:   return "cache_bitmap_compressed_rev2";
+        case RDP::TS_CACHE_BRUSH:                    return "cache_brush";
+        case RDP::TS_CACHE_BITMAP_COMPRESSED_REV3:   return "cache_bitmap_compressed_rev3";
+        default:                                     return "other";
+        }
+    }
+
+private:
+    static unsigned long long ull(uint64_t value) {
+        return static_cast<unsigned long long>(value);
+    }
+
+    static double ratio(uint64_t a, uint64_t b) {
+        return b ? static_cast<double>(a) / static_cast<double>(b) : 0.0;
+    }
+};
+
+// Least recently used set of bitmaps of a given capacity
+class LRUCacheSimulator {
+    size_t                                                capacity;
+    std::list<uint64_t>                                   lru;    // most recent first
+    std::map<uint64_t, std::list<uint64_t>::iterator>     index;
+
+public:
+    explicit LRUCacheSimulator(size_t capacity)
+    : capacity(capacity)
+    {}
+
+    // true on hit, on miss key is added, evicting least recently used
+    bool access(uint64_t key) {
+        std::map<uint64_t, std::list<uint64_t>::iterator>::iterator it = this->index.find(key);
+        if (it != this->index.end()) {
+            this->lru.splice(this->lru.begin(), this->lru, it->second);
+            return true;
+        }
+        if (this->index.size() >= this->capacity) {
+            this->index.erase(this->lru.back());
+            this->lru.pop_back();
+        }
+        this->lru.push_front(key);
+        this->index[key] = this->lru.begin();
+        return false;
+    }
+};
+
+class TrafficProfiler {
+public:
+    TrafficProfile profile;
+
+private:
+    struct Slot {
+        uint64_t key;
+        uint32_t bytes;
+    };
+    std::map<uint32_t, Slot> slots;     // (cache id << 16 | index) -> stored bitmap
+
+    LRUCacheSimulator * caches[TrafficProfile::CACHE_SIZE_COUNT];
+
+    rdp_mppc_enc_match_finder * match_finder;
+    rdp_mppc_enc *              codecs[TrafficProfile::CODEC_COUNT];
+
+    uint64_t              start_usec;
+    uint64_t              last_usec;
+    bool                  started;
+    std::vector<uint64_t> seconds;      // bytes per second since start
+
+public:
+    TrafficProfiler()
+    : match_finder(new rdp_mppc_61_enc_hash_based_match_finder())
+    , start_usec(0)
+    , last_usec(0)
+    , started(false)
+    {
+        for (unsigned i = 0; i < TrafficProfile::CACHE_SIZE_COUNT; i++) {
+            this->caches[i] = new LRUCacheSimulator(TrafficProfile::cache_size(i));
+        }
+        this->codecs[TrafficProfile::CODEC_MPPC_40] = new rdp_mppc_40_enc();
+        this->codecs[TrafficProfile::CODEC_MPPC_50] = new rdp_mppc_50_enc();
+        this->codecs[TrafficProfile::CODEC_RDP_60]  = new rdp_mppc_60_enc();
+        this->codecs[TrafficProfile::CODEC_RDP_61]  = new rdp_mppc_61_enc(this->match_finder);
+        this->profile.recordings = 1;
+    }
+
+    ~TrafficProfiler() {
+        for (unsigned i = 0; i < TrafficProfile::CODEC_COUNT; i++) {
+            delete this->codecs[i];
+        }
+        delete this->match_finder;
+        for (unsigned i = 0; i < TrafficProfile::CACHE_SIZE_COUNT; i++) {
+            delete this->caches[i];
+        }
+    }
+
+    // one recorded chunk of bytes sent to client, at record time (usec)
+    void chunk(uint64_t time_usec, uint64_t bytes) {
+        if (!this->started) {
+            this->start_usec = time_usec;
+            this->started    = true;
+        }
+        if (time_usec < this->last_usec) {
+            time_usec = this->last_usec;
+        }
+        this->last_usec = time_usec;
+
+        const uint64_t elapsed = time_usec - this->start_usec;
+        const size_t   second  = elapsed / 1000000;
+        if (this->seconds.size() <= second) {
+            this->seconds.resize(second + 1, 0);
+        }
+        this->seconds[second] += bytes;
+        const uint64_t minute = std::min<uint64_t>(elapsed / 60000000, TrafficProfile::TIMELINE_MINUTES - 1);
+        this->profile.timeline[minute] += bytes;
+
+        this->profile.chunks++;
+        this->profile.duration_usec = elapsed;
+    }
+
+    // update PDU as received (wire_bytes) and once decompressed
+    void update(uint64_t wire_bytes, bool compressed, const uint8_t * payload, uint16_t payload_size) {
+        this->profile.update_pdus++;
+        this->profile.compressed_update_pdus += compressed;
+        this->profile.update_wire_bytes         += wire_bytes;
+        this->profile.update_uncompressed_bytes += payload_size;
+
+        for (unsigned i = 0; i < TrafficProfile::CODEC_COUNT; i++) {
+            uint8_t  compressed_type = 0;
+            uint16_t compressed_size = 0;
+            this->codecs[i]->compress(payload, payload_size, compressed_type, compressed_size,
+                rdp_mppc_enc::MAX_COMPRESSED_DATA_SIZE_UNUSED);
+            this->profile.codec_bytes[i] += (compressed_type & PACKET_COMPRESSED) ? compressed_size : payload_size;
+        }
+    }
+
+    void primary_order(uint8_t order, uint64_t bytes) {
+        this->profile.primary_orders[order % TrafficProfile::PRIMARY_ORDER_TYPES].add(bytes);
+    }
+
+    void secondary_order(uint8_t type, uint64_t bytes) {
+        this->profile.secondary_orders[type % TrafficProfile::SECONDARY_ORDER_TYPES].add(bytes);
+    }
+
+    void bitmap_update(uint64_t bytes) {
+        this->profile.bitmap_updates.add(bytes);
+    }
+
+    void channel(const char * name, uint64_t bytes) {
+        this->profile.channel_bytes += bytes;
+        this->profile.add_channel(name, bytes);
+    }
+
+    // key identifies bitmap content, bytes is size of cache order
+    void cache_store(uint8_t cache_id, uint16_t cache_idx, uint64_t key, uint32_t bytes) {
+        Slot & slot = this->slots[(cache_id << 16) | cache_idx];
+        slot.key   = key;
+        slot.bytes = bytes;
+
+        this->profile.cache_stores++;
+        this->profile.cache_store_bytes += bytes;
+        this->access(slot);
+    }
+
+    void cache_reference(uint8_t cache_id, uint16_t cache_idx) {
+        this->profile.cache_references++;
+        std::map<uint32_t, Slot>::const_iterator it = this->slots.find((cache_id << 16) | cache_idx);
+        if (it == this->slots.end()) {
+            this->profile.cache_unknown_references++;
+            return;
+        }
+        this->access(it->second);
+    }
+
+    // bandwidth figures need whole recording
+    void finish() {
+        uint64_t total = 0;
+        for (size_t i = 0; i < this->seconds.size(); i++) {
+            total += this->seconds[i];
+        }
+        const uint64_t average = this->seconds.empty() ? 0 : total / this->seconds.size();
+        for (size_t i = 0; i < this->seconds.size(); i++) {
+            this->profile.bytes_per_second.add(this->seconds[i]);
+            this->profile.burst_seconds += (this->seconds[i] > 4 * average);
+        }
+        this->seconds.clear();
+    }
+
+private:
+    void access(const Slot & slot) {
+        for (unsigned i = 0; i < TrafficProfile::CACHE_SIZE_COUNT; i++) {
+            if (!this->caches[i]->access(slot.key)) {
+                this->profile.cache_misses[i]++;
+                this->profile.cache_miss_bytes[i] += slot.bytes;
+            }
+        }
+    }
+};
+
+#endif
@@ -42,6 +42,11 @@ public:
         }
     }
 
+    // record time of last chunk read
+    const timeval & record_time() const {
+        return this->record_now;
+    }
+
     bool interpret_chunk(bool real_time = true) {
         try {
             BStream header(TRANSPARENT_CHUNT_HEADER_SIZE);
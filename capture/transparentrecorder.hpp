@@ -21,81 +21,155 @@
 #ifndef _REDEMPTION_CAPTURE_TRANSPARENTRECORDER_HPP_
 #define _REDEMPTION_CAPTURE_TRANSPARENTRECORDER_HPP_
 
+#include "log.hpp"
+#include "stream.hpp"
+#include "difftimeval.hpp"
 #include "transport.hpp"
 #include "transparentchunk.hpp"
 
+// Chunks are gathered in a batch written at once when full, or when a chunk
+// is recorded more than batch_delay after the first one of the batch. Chunks
+// larger than batch are written directly. Session loop calls periodic() so
+// that a batch is also written batch_delay after its first chunk when no
+// other chunk comes.
 class TransparentRecorder {
 private:
     Transport * t;
 
+    BStream  batch;
+    timeval  batch_start;
+    uint64_t batch_delay;   // in microseconds
+
 public:
-    TransparentRecorder(Transport * t) : t(t) {
+    enum {
+          DEFAULT_BATCH_SIZE  = 65536
+        , DEFAULT_BATCH_DELAY = 100000
+    };
+
+    TransparentRecorder(Transport * t, size_t batch_size = DEFAULT_BATCH_SIZE,
+                        uint64_t batch_delay = DEFAULT_BATCH_DELAY)
+    : t(t)
+    , batch(batch_size)
+    , batch_delay(batch_delay) {
+        this->batch_start.tv_sec  = 0;
+        this->batch_start.tv_usec = 0;
+
         this->send_meta_chunk();
     }
 
-    void send_data_indication_ex(uint16_t channelId, HStream & stream) {
-        BStream header(TRANSPARENT_CHUNT_HEADER_SIZE);
-        BStream payload(8);
-
-        payload.out_uint16_le(channelId);
-        payload.mark_end();
+    ~TransparentRecorder() {
+        try {
+            this->flush();
+        }
+        catch (Error & e) {
+            LOG(LOG_ERR, "TransparentRecorder: failed to write last chunks (%d)", e.id);
+        }
+    }
 
-        this->make_chunk_header(header, CHUNK_TYPE_SLOWPATH, payload.size() + stream.size());
+    void send_data_indication_ex(uint16_t channelId, HStream & stream) {
+        uint8_t payload[2];
+        payload[0] = channelId;
+        payload[1] = channelId >> 8;
 
-        this->t->send(header);
-        this->t->send(payload);
-        this->t->send(stream);
+        this->record(CHUNK_TYPE_SLOWPATH, payload, sizeof(payload), stream.get_data(), stream.size());
     }
 
     void send_fastpath_data(Stream & data) {
-        BStream header(TRANSPARENT_CHUNT_HEADER_SIZE);
-        this->make_chunk_header(header, CHUNK_TYPE_FASTPATH, data.size());
-
-        this->t->send(header);
-        this->t->send(data);
+        this->record(CHUNK_TYPE_FASTPATH, NULL, 0, data.get_data(), data.size());
     }
 
     void send_to_front_channel( const char * const mod_channel_name
                               , uint8_t * data, size_t length
                               , size_t chunk_size, int flags) {
-        BStream header(TRANSPARENT_CHUNT_HEADER_SIZE);
-        BStream payload(65535);
-
-        uint8_t mod_channel_name_length = strlen(mod_channel_name);
-        payload.out_uint8(mod_channel_name_length);
-        payload.out_uint16_le(length);
-        payload.out_uint16_le(chunk_size);
-        payload.out_uint32_le(flags);
-        payload.mark_end();
-
-        this->make_chunk_header(header, CHUNK_TYPE_FRONTCHANNEL, payload.size() + mod_channel_name_length + length);
-
-        this->t->send(header);
-        this->t->send(payload);
-        this->t->send(reinterpret_cast<const uint8_t *>(mod_channel_name), mod_channel_name_length);
-        this->t->send(reinterpret_cast<const uint8_t *>(data), length);
+        const uint8_t mod_channel_name_length = strlen(mod_channel_name);
+
+        uint8_t payload[9 + 255];
+        FixedSizeStream stream(payload, sizeof(payload));
+        stream.out_uint8(mod_channel_name_length);
+        stream.out_uint16_le(length);
+        stream.out_uint16_le(chunk_size);
+        stream.out_uint32_le(flags);
+        stream.out_copy_bytes(mod_channel_name, mod_channel_name_length);
+
+        this->record(CHUNK_TYPE_FRONTCHANNEL, payload, stream.get_offset(), data, length);
     }
 
     void server_resize(uint16_t width, uint16_t height, uint8_t bpp) {
-        BStream header(TRANSPARENT_CHUNT_HEADER_SIZE);
-        BStream payload(8);
+        uint8_t payload[5];
+        FixedSizeStream stream(payload, sizeof(payload));
+        stream.out_uint16_le(width);
+        stream.out_uint16_le(height);
+        stream.out_uint8(bpp);
 
-        payload.out_uint16_le(width);
-        payload.out_uint16_le(height);
-        payload.out_uint8(bpp);
-        payload.mark_end();
+        this->record(CHUNK_TYPE_RESIZE, payload, sizeof(payload), NULL, 0);
+    }
 
-        this->make_chunk_header(header, CHUNK_TYPE_RESIZE, payload.size());
+    // write batch if its first chunk is batch_delay old
+    void periodic(const timeval & now) {
+        if (this->batch.get_offset() && (difftimeval(now, this->batch_start) >= this->batch_delay)) {
+            this->flush();
+        }
+    }
 
-        this->t->send(header);
-        this->t->send(payload);
+    // time before periodic() has something to write (in microseconds)
+    uint64_t periodic_delay(const timeval & now) const {
+        if (!this->batch.get_offset()) {
+            return this->batch_delay;
+        }
+        const uint64_t elapsed = difftimeval(now, this->batch_start);
+        return (elapsed >= this->batch_delay) ? 0 : this->batch_delay - elapsed;
+    }
+
+    // write batched chunks
+    void flush() {
+        if (this->batch.get_offset()) {
+            this->t->send(this->batch.get_data(), this->batch.get_offset());
+            this->batch.reset();
+        }
     }
 
 private:
-    void make_chunk_header(Stream & stream, uint8_t chunk_type, uint16_t data_size) {
+    void record(uint8_t chunk_type, const uint8_t * payload, size_t payload_size,
+                const uint8_t * data, size_t data_size) {
+        const timeval now        = tvtime();
+        const size_t  chunk_size = TRANSPARENT_CHUNT_HEADER_SIZE + payload_size + data_size;
+
+        if (!this->batch.has_room(chunk_size)) {
+            this->flush();
+        }
+
+        if (!this->batch.has_room(chunk_size)) {
+            BStream header(TRANSPARENT_CHUNT_HEADER_SIZE);
+            this->make_chunk_header(header, chunk_type, payload_size + data_size, now);
+            this->t->send(header);
+            if (payload_size) {
+                this->t->send(payload, payload_size);
+            }
+            if (data_size) {
+                this->t->send(data, data_size);
+            }
+            return;
+        }
+
+        if (!this->batch.get_offset()) {
+            this->batch_start = now;
+        }
+        this->make_chunk_header(this->batch, chunk_type, payload_size + data_size, now);
+        if (payload_size) {
+            this->batch.out_copy_bytes(payload, payload_size);
+        }
+        if (data_size) {
+            this->batch.out_copy_bytes(data, data_size);
+        }
+
+        if (difftimeval(now, this->batch_start) >= this->batch_delay) {
+            this->flush();
+        }
+    }
+
+    void make_chunk_header(Stream & stream, uint8_t chunk_type, uint16_t data_size, const timeval & now) {
         stream.out_uint8(chunk_type);
         stream.out_uint16_le(data_size);
-        struct timeval now = tvtime();
         stream.out_timeval_to_uint64le_usec(now);
         stream.mark_end();
     }
@@ -103,16 +177,7 @@ private:
     void send_meta_chunk() {
         const uint8_t trm_format_version = 0;
 
-        BStream header(TRANSPARENT_CHUNT_HEADER_SIZE);
-        BStream payload(8);
-
-        payload.out_uint8(trm_format_version);
-        payload.mark_end();
-
-        this->make_chunk_header(header, CHUNK_TYPE_META, payload.size());
-
-        this->t->send(header);
-        this->t->send(payload);
+        this->record(CHUNK_TYPE_META, &trm_format_version, 1, NULL, 0);
     }
 };
 
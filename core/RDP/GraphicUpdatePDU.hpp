@@ -35,6 +35,8 @@
 #include "RDP/lic.hpp"
 #include "RDP/RDPGraphicDevice.hpp"
 #include "RDP/fastpath.hpp"
+#include "session_stats.hpp"
+#include "phase_timer.hpp"
 
 // MS-RDPEGDI 2.2.2.2 Fast-Path Orders Update (TS_FP_UPDATE_ORDERS)
 // ================================================================
@@ -240,6 +242,8 @@ protected:
                 LOG(LOG_INFO, "GraphicsUpdatePDU::flush_orders: order_count=%d offset=%u", this->order_count, this->offset_order_count);
             }
             this->stream_orders.set_out_uint16_le(this->order_count, this->offset_order_count);
+            session_stats().front_orders_sent += this->order_count;
+            session_stats().front_updates_sent++;
 
             if (this->fastpath_support == false) {
                 if (this->ini.debug.primary_orders > 3){
@@ -280,8 +284,12 @@ protected:
                     uint8_t  compressionFlags;
                     uint16_t datalen;
 
-                    this->mppc_enc->compress(this->buffer_stream_orders.get_data(), this->buffer_stream_orders.size(),
-                        compressionFlags, datalen, rdp_mppc_enc::MAX_COMPRESSED_DATA_SIZE_UNUSED);
+                    {
+                        SessionStatsTimer timer(session_stats().compression_usec);
+                        PHASE_TIMER(PHASE_MPPC_COMPRESS);
+                        this->mppc_enc->compress(this->buffer_stream_orders.get_data(), this->buffer_stream_orders.size(),
+                            compressionFlags, datalen, rdp_mppc_enc::MAX_COMPRESSED_DATA_SIZE_UNUSED);
+                    }
 
                     this->sdata_orders = new ShareData(compressed_buffer_stream_orders);
                     this->sdata_orders->emit_begin( PDUTYPE2_UPDATE, this->shareid
@@ -371,8 +379,12 @@ protected:
                     uint8_t  compressionFlags;
                     uint16_t datalen;
 
-                    this->mppc_enc->compress(this->buffer_stream_orders.get_data(), this->buffer_stream_orders.size(),
-                        compressionFlags, datalen, rdp_mppc_enc::MAX_COMPRESSED_DATA_SIZE_UNUSED);
+                    {
+                        SessionStatsTimer timer(session_stats().compression_usec);
+                        PHASE_TIMER(PHASE_MPPC_COMPRESS);
+                        this->mppc_enc->compress(this->buffer_stream_orders.get_data(), this->buffer_stream_orders.size(),
+                            compressionFlags, datalen, rdp_mppc_enc::MAX_COMPRESSED_DATA_SIZE_UNUSED);
+                    }
 
                     if (!(compressionFlags & PACKET_COMPRESSED)) {
                         datalen     = this->buffer_stream_orders.size();
@@ -431,6 +443,7 @@ protected:
                    , this->bitmap_count, this->offset_bitmap_count);
             }
             this->stream_bitmaps.set_out_uint16_le(this->bitmap_count, this->offset_bitmap_count);
+            session_stats().front_updates_sent++;
 
             if (this->fastpath_support == false) {
                 if (this->ini.debug.primary_orders > 3){
@@ -481,8 +494,12 @@ protected:
                     uint8_t  compressionFlags;
                     uint16_t datalen;
 
-                    this->mppc_enc->compress(this->buffer_stream_bitmaps.get_data(), this->buffer_stream_bitmaps.size(),
-                        compressionFlags, datalen, rdp_mppc_enc::MAX_COMPRESSED_DATA_SIZE_UNUSED);
+                    {
+                        SessionStatsTimer timer(session_stats().compression_usec);
+                        PHASE_TIMER(PHASE_MPPC_COMPRESS);
+                        this->mppc_enc->compress(this->buffer_stream_bitmaps.get_data(), this->buffer_stream_bitmaps.size(),
+                            compressionFlags, datalen, rdp_mppc_enc::MAX_COMPRESSED_DATA_SIZE_UNUSED);
+                    }
 
                     this->sdata_bitmaps = new ShareData(compressed_buffer_stream_bitmaps);
                     this->sdata_bitmaps->emit_begin( PDUTYPE2_UPDATE, this->shareid
@@ -570,8 +587,12 @@ protected:
                     uint16_t datalen;
                     uint8_t  compressionFlags;
 
-                    this->mppc_enc->compress(this->buffer_stream_bitmaps.get_data(), this->buffer_stream_bitmaps.size(),
-                        compressionFlags, datalen, rdp_mppc_enc::MAX_COMPRESSED_DATA_SIZE_UNUSED);
+                    {
+                        SessionStatsTimer timer(session_stats().compression_usec);
+                        PHASE_TIMER(PHASE_MPPC_COMPRESS);
+                        this->mppc_enc->compress(this->buffer_stream_bitmaps.get_data(), this->buffer_stream_bitmaps.size(),
+                            compressionFlags, datalen, rdp_mppc_enc::MAX_COMPRESSED_DATA_SIZE_UNUSED);
+                    }
 
                     uint8_t compression = FastPath::FASTPATH_OUTPUT_COMPRESSION_USED;
                     header_size = 4;
@@ -71,7 +71,7 @@ public:
 
     virtual void set_row(size_t rownum, const uint8_t * data)
     {
-        memcpy(this->drawable.data + this->drawable.rowsize * rownum, data, this->drawable.rowsize);
+        this->drawable.set_row(rownum, data);
     }
 
     virtual uint8_t * get_row(size_t rownum)
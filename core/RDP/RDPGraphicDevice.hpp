@@ -85,6 +85,10 @@ struct RDPGraphicDevice {
     virtual void draw(const RDPBitmapData & bitmap_data, const uint8_t * data,
         size_t size, const Bitmap & bmp) {}
 
+    // Bitmaps about to be drawn with MemBlt, in this order. Lets the device
+    // compress them ahead of time.
+    virtual void prepare_bitmaps(const Bitmap * const * bitmaps, size_t count) {}
+
 
     virtual void server_set_pointer(const Pointer & cursor) {}
     virtual void send_pointer(int cache_idx, const Pointer & cursor) {}
@@ -0,0 +1,201 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2014
+    Author(s): Christophe Grosjean, Raphael Zhou
+*/
+
+#ifndef _REDEMPTION_CORE_RDP_SUPPRESS_OUTPUT_PDU_HPP_
+#define _REDEMPTION_CORE_RDP_SUPPRESS_OUTPUT_PDU_HPP_
+
+#include "RDP/x224.hpp"
+#include "RDP/mcs.hpp"
+#include "RDP/share.hpp"
+#include "RDP/sec.hpp"
+#include "RDP/gcc.hpp"
+#include "RDP/out_per_bstream.hpp"
+
+namespace RDP {
+
+// 2.2.11.3 Client Suppress Output PDU
+// ===================================
+// The Suppress Output PDU is sent by the client to toggle the sending of
+//  desktop display updates from the server. This PDU is primarily used when
+//  the client window is minimized. Server support for this PDU is indicated
+//  in the General Capability Set (section 2.2.7.1.1).
+
+// Headers (tpktHeader, x224Data, mcsSDrq, securityHeader) are the same as the
+//  ones of the Refresh Rect PDU (section 2.2.11.2).
+
+// 2.2.11.3.1 Suppress Output PDU Data (TS_SUPPRESS_OUTPUT_PDU)
+// ============================================================
+// The TS_SUPPRESS_OUTPUT_PDU structure contains the contents of the Suppress
+//  Output PDU, which is a Share Data Header (section 2.2.8.1.1.1.2) and two
+//  fields.
+
+// shareDataHeader (18 bytes): A Share Data Header containing information
+//  about the packet. The type subfield of the pduType field of the Share
+//  Control Header (section 2.2.8.1.1.1.1) MUST be set to PDUTYPE_DATAPDU
+//  (7). The pduType2 field of the Share Data Header MUST be set to
+//  PDUTYPE2_SUPPRESS_OUTPUT (35).
+
+// allowDisplayUpdates (1 byte): An 8-bit, unsigned integer. Indicates whether
+//  the client wants to receive display updates from the server.
+
+// +-------------------------------+------------------------------------------+
+// | 0x00 SUPPRESS_DISPLAY_UPDATES | Turn off display updates from the server |
+// +-------------------------------+------------------------------------------+
+// | 0x01 ALLOW_DISPLAY_UPDATES    | Turn on display updates from the server  |
+// +-------------------------------+------------------------------------------+
+
+// pad3Octets (3 bytes): A 3-element array of 8-bit, unsigned integer values.
+//  Padding. Values in this field MUST be ignored.
+
+// desktopRect (8 bytes): An optional Inclusive Rectangle (section 2.2.11.1)
+//  which contains the coordinates of the desktop rectangle if the
+//  allowDisplayUpdates field is set to ALLOW_DISPLAY_UPDATES (1). If the
+//  allowDisplayUpdates field is set to SUPPRESS_DISPLAY_UPDATES (0), this
+//  field MUST NOT be included in the PDU.
+
+enum {
+      SUPPRESS_DISPLAY_UPDATES = 0x00
+    , ALLOW_DISPLAY_UPDATES    = 0x01
+};
+
+struct SuppressOutputPDUData_Recv {
+    uint8_t  allowDisplayUpdates;
+    uint16_t left;
+    uint16_t top;
+    uint16_t right;
+    uint16_t bottom;
+
+    explicit SuppressOutputPDUData_Recv(Stream & stream)
+    : allowDisplayUpdates(0)
+    , left(0)
+    , top(0)
+    , right(0)
+    , bottom(0)
+    {
+        unsigned expected = 4;  /* allowDisplayUpdates(1) + pad3Octets(3) */
+        if (!stream.in_check_rem(expected)) {
+            LOG(LOG_ERR, "Truncated Suppress Output PDU data, need=%u remains=%u",
+                expected, stream.in_remain());
+            throw Error(ERR_RDP_DATA_TRUNCATED);
+        }
+
+        this->allowDisplayUpdates = stream.in_uint8();
+        stream.in_skip_bytes(3);
+
+        if (this->allowDisplayUpdates == ALLOW_DISPLAY_UPDATES) {
+            expected = 8;   /* left(2) + top(2) + right(2) + bottom(2) */
+            if (!stream.in_check_rem(expected)) {
+                LOG(LOG_ERR, "Truncated Suppress Output PDU data, need=%u remains=%u",
+                    expected, stream.in_remain());
+                throw Error(ERR_RDP_DATA_TRUNCATED);
+            }
+
+            this->left   = stream.in_uint16_le();
+            this->top    = stream.in_uint16_le();
+            this->right  = stream.in_uint16_le();
+            this->bottom = stream.in_uint16_le();
+        }
+    }
+};
+
+struct SuppressOutputPDU {
+    BStream buffer_stream;
+
+    ShareData sdata;
+
+    uint16_t userId;
+
+    int            encryptionLevel;
+    CryptContext & encrypt;
+
+    SuppressOutputPDU(uint32_t shareId,
+                      uint16_t userId,
+                      int encryptionLevel,
+                      CryptContext & encrypt) :
+    buffer_stream(256),
+    sdata(buffer_stream),
+    userId(userId),
+    encryptionLevel(encryptionLevel),
+    encrypt(encrypt) {
+        this->sdata.emit_begin(PDUTYPE2_SUPPRESS_OUTPUT,
+                               shareId,
+                               RDP::STREAM_MED);
+    }
+
+    void suppressDisplayUpdates() {
+        this->buffer_stream.out_uint8(SUPPRESS_DISPLAY_UPDATES);
+        this->buffer_stream.out_clear_bytes(3); /* pad */
+    }
+
+    void allowDisplayUpdates(uint16_t left,
+                             uint16_t top,
+                             uint16_t right,
+                             uint16_t bottom) {
+        this->buffer_stream.out_uint8(ALLOW_DISPLAY_UPDATES);
+        this->buffer_stream.out_clear_bytes(3); /* pad */
+
+        this->buffer_stream.out_uint16_le(left);
+        this->buffer_stream.out_uint16_le(top);
+        this->buffer_stream.out_uint16_le(right);
+        this->buffer_stream.out_uint16_le(bottom);
+    }
+
+    void emit(Transport & trans) {
+        this->buffer_stream.mark_end();
+
+        this->sdata.emit_end();
+
+        BStream sctrl_header(256);
+        ShareControl_Send(sctrl_header,
+                          PDUTYPE_DATAPDU,
+                          this->userId + GCC::MCS_USERCHANNEL_BASE,
+                          this->buffer_stream.size());
+
+        HStream target_stream(1024, 2048);
+        target_stream.out_copy_bytes(sctrl_header);
+        target_stream.out_copy_bytes(this->buffer_stream);
+        target_stream.mark_end();
+
+        BStream x224_header(256);
+        OutPerBStream mcs_header(256);
+        BStream sec_header(256);
+
+        SEC::Sec_Send sec(sec_header,
+                          target_stream,
+                          0,
+                          this->encrypt,
+                          this->encryptionLevel);
+        MCS::SendDataRequest_Send mcs(mcs_header,
+                                      this->userId,
+                                      GCC::MCS_GLOBAL_CHANNEL,
+                                      1,
+                                      3,
+                                      sec_header.size() + target_stream.size(),
+                                      MCS::PER_ENCODING);
+        X224::DT_TPDU_Send(x224_header,
+                           mcs_header.size() + sec_header.size() + target_stream.size());
+
+        trans.send(x224_header, mcs_header, sec_header, target_stream);
+    }
+};  // struct SuppressOutputPDU
+
+}   // namespace RDP
+
+#endif  // #ifndef _REDEMPTION_CORE_RDP_SUPPRESS_OUTPUT_PDU_HPP_
@@ -331,6 +331,23 @@ struct BmpCache {
             return cache_entries;
         }
 
+        // all caches and wait list
+        unsigned total_ref_count() const {
+            unsigned total = 0;
+            for (unsigned i = 0; i < MAXIMUM_NUMBER_OF_CACHES + 1; i++) {
+                total += this->ref_counter[i];
+            }
+            return total;
+        }
+
+        unsigned total_put_count() const {
+            unsigned total = 0;
+            for (unsigned i = 0; i < MAXIMUM_NUMBER_OF_CACHES + 1; i++) {
+                total += this->put_counter[i];
+            }
+            return total;
+        }
+
         void log() const {
             LOG( LOG_INFO
                , "BmpCache: %s ref_counter=(%u %u %u ... %u) put_counter=(%u %u %u ... %u) "
@@ -345,6 +362,26 @@ struct BmpCache {
                , get_cache_usage(4), this->cache_entries[4], (this->cache_persistent[4] ? ", persistent" : ""));
         }
 
+        // color depth of a bitmap once stored in cache
+        uint8_t cached_bpp(const Bitmap & oldbmp) const {
+            return (((this->owner == Recorder) || (oldbmp.original_bpp > this->bpp)) ? this->bpp : oldbmp.original_bpp);
+        }
+
+        // true if cache_bitmap() would find bitmap in cache (stamps are left unchanged)
+        bool contains(const Bitmap & oldbmp) {
+            const Bitmap bmp(this->cached_bpp(oldbmp), oldbmp);
+
+            uint8_t bmp_sha1[20];
+            bmp.compute_sha1(bmp_sha1);
+
+            for (uint8_t id = 0; id < MAXIMUM_NUMBER_OF_CACHES; id++) {
+                if (this->cache_entries[id] && (bmp.bmp_size <= this->cache_size[id])) {
+                    return (this->finders[id].get_cache_index(bmp_sha1, bmp.cx, bmp.cy) != Finder::invalid_cache_index);
+                }
+            }
+            return false;
+        }
+
         TODO("palette to use for conversion when we are in 8 bits mode should be passed from memblt.cache_id, not stored in bitmap");
         uint32_t cache_bitmap(const Bitmap & oldbmp) {
             REDASSERT(this->owner != Mod_rdp);
@@ -367,9 +404,7 @@ struct BmpCache {
             //        this->finding_counter, oldbmp.bmp_size);
             //}
 
-            unique_ptr<const Bitmap> bmp(new Bitmap(
-                 (((this->owner == Recorder) || (oldbmp.original_bpp > this->bpp)) ? this->bpp : oldbmp.original_bpp)
-                , oldbmp));
+            unique_ptr<const Bitmap> bmp(new Bitmap(this->cached_bpp(oldbmp), oldbmp));
 
             uint8_t bmp_sha1[20];
             bmp->compute_sha1(bmp_sha1);
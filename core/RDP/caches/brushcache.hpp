@@ -41,12 +41,22 @@ enum {
 
 /* difference caches */
 struct BrushCache {
+    enum {
+        BRUSH_ENTRIES = 64
+    };
+
     /* brush */
     int brush_stamp;
-    struct brush_item brush_items[64];
+    struct brush_item brush_items[BRUSH_ENTRIES];
+
+    // Index of entries on their pattern: buckets[hash] is the first entry of
+    // a chain linked by next, -1 ends chains. Unused entries are not linked.
+    int8_t buckets[BRUSH_ENTRIES];
+    int8_t next[BRUSH_ENTRIES];
 
     BrushCache() {
         this->brush_stamp = 0;
+        this->clear_index();
     }
 
     ~BrushCache()
@@ -58,6 +68,7 @@ struct BrushCache {
     {
         /* set whole struct to zero */
         memset(this, 0, sizeof(struct BrushCache));
+        this->clear_index();
         return 0;
     }
 
@@ -74,7 +85,8 @@ struct BrushCache {
         }
         this->brush_stamp++;
         /* look for match */
-        for (i = 0; i < 64; i++) {
+        const unsigned bucket = hash(brush_item_data);
+        for (i = this->buckets[bucket]; i >= 0; i = this->next[i]) {
             if (memcmp(this->brush_items[i].pattern, brush_item_data, 8) == 0) {
                 this->brush_items[i].stamp = this->brush_stamp;
                 cache_idx = i;
@@ -84,17 +96,46 @@ struct BrushCache {
         /* look for oldest */
         index = 0;
         oldest = 0x7fffffff;
-        for (i = 0; i < 64; i++) {
+        for (i = 0; i < BRUSH_ENTRIES; i++) {
             if (this->brush_items[i].stamp < oldest) {
                 oldest = this->brush_items[i].stamp;
                 index = i;
             }
         }
+        if (oldest) {
+            this->unlink(index);
+        }
         memcpy(this->brush_items[index].pattern, brush_item_data, 8);
         this->brush_items[index].stamp = this->brush_stamp;
+        this->next[index]     = this->buckets[bucket];
+        this->buckets[bucket] = index;
         cache_idx = index;
         return BRUSH_TO_SEND;
     }
+
+private:
+    // a 8x8 1bpp pattern is a 64 bits word, multiplicative hashing
+    static unsigned hash(const uint8_t * pattern)
+    {
+        uint64_t key;
+        memcpy(&key, pattern, sizeof(key));
+        return (key * 0x9E3779B97F4A7C15ULL) >> 58;
+    }
+
+    void clear_index()
+    {
+        memset(this->buckets, -1, sizeof(this->buckets));
+        memset(this->next, -1, sizeof(this->next));
+    }
+
+    void unlink(int index)
+    {
+        int8_t * link = &this->buckets[hash(this->brush_items[index].pattern)];
+        while (*link != index) {
+            link = &this->next[*link];
+        }
+        *link = this->next[index];
+    }
 };
 
 
@@ -41,6 +41,7 @@ struct PointerCache {
     int pointer_stamp;
     struct Pointer Pointers[32];
     int stamps[32];
+    uint64_t hashes[32];    // content_hash() of each entry, only full compare on match
 
     PointerCache() {
         this->pointer_cache_entries = 0;
@@ -65,6 +66,7 @@ struct PointerCache {
         memcpy(this->Pointers[index].data, cursor.data, cursor.data_size());
         memcpy(this->Pointers[index].mask, cursor.mask, cursor.mask_size());
         this->stamps[index] = this->pointer_stamp;
+        this->hashes[index] = cursor.content_hash();
     }
 
     /* check if the pointer is in the cache or not and if it should be sent      */
@@ -75,9 +77,11 @@ struct PointerCache {
         int index = 2;
 
         this->pointer_stamp++;
+        const uint64_t hash = cursor.content_hash();
         /* look for match */
         for (i = 2; i < this->pointer_cache_entries; i++) {
-            if (this->Pointers[i].x == cursor.x 
+            if (this->hashes[i] == hash
+            &&  this->Pointers[i].x == cursor.x 
             &&  this->Pointers[i].y == cursor.y 
             &&  this->Pointers[i].width == cursor.width 
             &&  this->Pointers[i].height == cursor.height 
@@ -100,6 +104,7 @@ struct PointerCache {
         this->stamps[index] = this->pointer_stamp;
         cache_idx = index;
         this->add_pointer_static(cursor, index);
+        this->hashes[index] = hash;
         return POINTER_TO_SEND;
     }
 
@@ -116,26 +121,61 @@ struct drawable_Pointer {
 
 struct DrawablePointerCache {
     struct drawable_Pointer Pointers[32];
+    // Hash of data and mask each entry was converted from (0: none). Servers
+    // keep sending the same few shapes, converting them again is avoided.
+    uint64_t shape_hashes[32];
 
     DrawablePointerCache() {
         for (int i = 0,
                  c = sizeof(this->Pointers) / sizeof(drawable_Pointer);
              i < c; i++) {
             memset(&this->Pointers[i], 0, sizeof(this->Pointers[i]));
+            this->shape_hashes[i] = 0;
         }
     }
 
     void add_pointer_static(const Pointer & cursor, int index) {
         drawable_Pointer & dcursor = this->Pointers[index];
 
-        this->make_drawable_mouse_cursor(cursor.data, cursor.mask, dcursor);
+        const uint64_t hash = shape_hash(cursor);
+        if (this->shape_hashes[index] != hash) {
+            int found = -1;
+            for (int i = 0; i < 32; i++) {
+                if (this->shape_hashes[i] == hash) {
+                    found = i;
+                    break;
+                }
+            }
+            if (found >= 0) {
+                this->copy_drawable_mouse_cursor(this->Pointers[found], dcursor);
+            }
+            else {
+                this->make_drawable_mouse_cursor(cursor.data, cursor.mask, dcursor);
+            }
+            this->shape_hashes[index] = hash;
+        }
 
         dcursor.x = cursor.x;
         dcursor.y = cursor.y;
 
     }
 
+    // conversion always reads a 32x32x24 bpp cursor, whatever its size
+    static uint64_t shape_hash(const Pointer & cursor) {
+        uint64_t h = Pointer::hash_bytes(Pointer::HASH_SEED, cursor.data, 32 * 32 * 3);
+        return Pointer::hash_bytes(h, cursor.mask, 128) | 1;
+    }
+
 protected:
+    // Mouse_t lines point into data of their own entry
+    static void copy_drawable_mouse_cursor(const drawable_Pointer & src, drawable_Pointer & dst) {
+        memcpy(&dst, &src, sizeof(dst));
+        for (int i = 0; i < dst.contiguous_mouse_pixels; i++) {
+            dst.mouse_cursor[i].line = reinterpret_cast<const char *>(dst.data)
+                + (src.mouse_cursor[i].line - reinterpret_cast<const char *>(src.data));
+        }
+    }
+
     void make_drawable_mouse_cursor(const uint8_t * data,
         const uint8_t * mask, drawable_Pointer & Pointer) {
         memset(&Pointer, 0, sizeof(Pointer));
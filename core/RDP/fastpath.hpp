@@ -306,16 +306,20 @@ namespace FastPath {
                 stream.out_copy_bytes(fipsInformation->get_data(), 4);
             }
 
+            // numEvents field, when present, is the first byte of signed and
+            //  encrypted data
+            uint8_t numEventsField = numEvents;
+
             if (secFlags & FASTPATH_INPUT_ENCRYPTED) {
                 uint8_t signature[8] = {};
-                crypt.sign(data.get_data(), data.size(), signature, sizeof(signature));
+                crypt.sign_and_encrypt( &numEventsField, ((numEvents > 15) ? 1 : 0)
+                                      , data.get_data(), data.size(), signature, sizeof(signature));
                 TODO("Check signature size is OK, 8 truncate MD5 key generated by sign")
                 stream.out_copy_bytes(signature, 8);
-                crypt.decrypt(data.get_data(), data.size());
             }
 
             if (numEvents > 15) {
-                stream.out_uint8(numEvents);
+                stream.out_uint8(numEventsField);
             }
 
             stream.mark_end();
@@ -885,10 +889,9 @@ namespace FastPath {
 
             if (secFlags & FASTPATH_OUTPUT_ENCRYPTED) {
                 uint8_t signature[8] = {};
-                crypt.sign(data.get_data(), data.size(), signature, sizeof(signature));
+                crypt.sign_and_encrypt(data.get_data(), data.size(), signature, sizeof(signature));
                 TODO("check signature size : 8 bytes truncate MD5 result")
                 stream.out_copy_bytes(signature, 8);
-                crypt.decrypt(data.get_data(), data.size());
             }
 
             stream.mark_end();
@@ -26,6 +26,7 @@
 
 #include "log.hpp"
 #include "RDPOrdersCommon.hpp"
+#include "session_stats.hpp"
 
 /* RDP bitmap cache (version 2) constants */
 enum {
@@ -547,7 +548,10 @@ class RDPBmpCache {
         }
 
         uint32_t offset_buf_start = stream.get_offset();
-        this->bmp->compress(session_color_depth, stream);
+        {
+            SessionStatsTimer timer(session_stats().compression_usec);
+            this->bmp->compress(session_color_depth, stream);
+        }
         uint32_t bufsize = stream.get_offset() - offset_buf_start;
 
         if (!use_compact_packets){
@@ -809,7 +813,10 @@ class RDPBmpCache {
         stream.out_uint16_be(0);
         stream.out_2BUE(this->do_not_cache ? BITMAPCACHE_WAITING_LIST_INDEX : this->idx);
         uint32_t offset_startBitmap = stream.get_offset();
-        this->bmp->compress(session_color_depth, stream);
+        {
+            SessionStatsTimer timer(session_stats().compression_usec);
+            this->bmp->compress(session_color_depth, stream);
+        }
 
         stream.set_out_uint16_be((stream.get_offset() - offset_startBitmap) | 0x4000, offset_bitmapLength); // set the actual size
         stream.set_out_uint16_le(stream.get_offset() - (offset_header+12), offset_header); // length after type minus 7
@@ -22,6 +22,8 @@
 #define _REDEMPTION_CORE_RDP_POINTER_HPP_
 
 #include <math.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "drawable.hpp"
 #include "client_info.hpp"
@@ -259,6 +261,37 @@ struct Pointer {
         return (this->width * this->height) / 8;
     }
 
+    enum {
+        HASH_SEED = 0x84222325
+    };
+
+    // 64 bits FNV-1a like hash, consuming 8 bytes at once
+    static uint64_t hash_bytes(uint64_t h, const uint8_t * p, size_t len)
+    {
+        size_t n = 0;
+        for (; n + sizeof(uint64_t) <= len; n += sizeof(uint64_t)) {
+            uint64_t w;
+            memcpy(&w, p + n, sizeof(w));
+            h = (h ^ w) * 0x100000001b3ULL;
+            h ^= h >> 29;
+        }
+        for (; n < len; n++) {
+            h = (h ^ p[n]) * 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    // Hash of everything a pointer cache entry compares: hotspot, size,
+    // color depth, data and mask.
+    uint64_t content_hash() const
+    {
+        const uint32_t header[5] = { static_cast<uint32_t>(this->x), static_cast<uint32_t>(this->y)
+                                   , this->width, this->height, this->bpp };
+        uint64_t h = hash_bytes(HASH_SEED, reinterpret_cast<const uint8_t *>(header), sizeof(header));
+        h = hash_bytes(h, this->data, this->data_size());
+        return hash_bytes(h, this->mask, this->mask_size());
+    }
+
     ~Pointer() {}
 
     bool is_valid() {
@@ -836,9 +836,8 @@ enum {
             }
             if (flags & SEC_ENCRYPT){
                 uint8_t signature[8] = {};
-                crypt.sign(data.get_data(), data.size(), signature, sizeof(signature));
+                crypt.sign_and_encrypt(data.get_data(), data.size(), signature, sizeof(signature));
                 stream.out_copy_bytes(signature, 8);
-                crypt.decrypt(data.get_data(), data.size());
             }
             stream.mark_end();
         }
@@ -81,6 +81,18 @@ struct Callback : RdpInput
     virtual void send_auth_channel_data(const char * data) {}
     virtual void rdp_input_up_and_running() { /* LOG(LOG_ERR, "CB:UP_AND_RUNNING"); */}
 
+    // Front brackets input events decoded from a single client PDU with
+    // these calls, a module may gather them and forward them at once.
+    virtual void rdp_input_batch_begin() {}
+    virtual void rdp_input_batch_end() {}
+
+    // Client window was minimized (Suppress Output PDU). Once restored,
+    // module must repaint desktop rectangle (inclusive coordinates).
+    virtual void rdp_suppress_display_updates() {}
+    virtual void rdp_allow_display_updates(uint16_t left, uint16_t top, uint16_t right, uint16_t bottom) {
+        this->rdp_input_invalidate(Rect(left, top, right - left + 1, bottom - top + 1));
+    }
+
     // Front calls this member function when it became up and running.
     virtual void on_front_up_and_running() {}
     virtual void rdp_input_invalidate2(const DArray<Rect> & vr) {
@@ -93,4 +105,36 @@ struct Callback : RdpInput
 
 };
 
+// Brackets input events decoded from a single client PDU, the batch is
+// closed on every exit path. end() closes it on the normal path and lets
+// send errors through, the destructor only closes it if decoding threw.
+class ScopedInputBatch {
+    Callback & cb;
+    bool       opened;
+
+public:
+    explicit ScopedInputBatch(Callback & cb)
+    : cb(cb)
+    , opened(true)
+    {
+        this->cb.rdp_input_batch_begin();
+    }
+
+    ~ScopedInputBatch() {
+        if (this->opened) {
+            // already unwinding, a second error must not escape
+            try {
+                this->cb.rdp_input_batch_end();
+            }
+            catch (...) {
+            }
+        }
+    }
+
+    void end() {
+        this->opened = false;
+        this->cb.rdp_input_batch_end();
+    }
+};
+
 #endif
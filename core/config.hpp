@@ -480,17 +480,77 @@ static const std::string authstr[MAX_AUTHID - 1] = {
     STRAUTHID_DISABLE_KEYBOARD_LOG,
 };
 
-static inline authid_t authid_from_string(const char * strauthid) {
+/******************
+ * AuthidHash maps authid strings to authid with a single hash and string
+ * comparison (strings received from ACL are looked up for every field).
+ * The hash seed is chosen when the table is built so that no two keys
+ * collide (perfect hash), linear probing is kept as a fallback.
+ */
+struct AuthidHash {
+    enum {
+        TABLE_SIZE = 1024,
+        MAX_SEED   = 4096
+    };
+
+    uint32_t seed;
+    uint8_t  table[TABLE_SIZE]; // authid, AUTHID_UNKNOWN for empty slots
+    bool     perfect;
 
-    std::string str = std::string(strauthid);
-    authid_t res = AUTHID_UNKNOWN;
-    for (int i = 0; i < MAX_AUTHID - 1 ; i++) {
-        if (0 == authstr[i].compare(str)) {
-            res = static_cast<authid_t>(i + 1);
-            break;
+    AuthidHash()
+    : seed(0)
+    , perfect(false)
+    {
+        for (uint32_t s = 1; s < MAX_SEED && !this->perfect; s++) {
+            this->perfect = this->build(s);
+        }
+        if (!this->perfect) {
+            this->build(1);
+        }
+    }
+
+    static uint32_t hash(const char * str, uint32_t seed) {
+        // FNV-1a
+        uint32_t h = 2166136261u ^ seed;
+        for (; *str; str++) {
+            h ^= static_cast<uint8_t>(*str);
+            h *= 16777619u;
+        }
+        return h ^ (h >> 15);
+    }
+
+    bool build(uint32_t s) {
+        this->seed = s;
+        memset(this->table, AUTHID_UNKNOWN, sizeof(this->table));
+        bool collision = false;
+        for (int i = 0; i < MAX_AUTHID - 1; i++) {
+            uint32_t index = hash(authstr[i].c_str(), s) % TABLE_SIZE;
+            while (this->table[index] != AUTHID_UNKNOWN) {
+                collision = true;
+                index = (index + 1) % TABLE_SIZE;
+            }
+            this->table[index] = i + 1;
+        }
+        return !collision;
+    }
+
+    authid_t find(const char * strauthid) const {
+        for (uint32_t index = hash(strauthid, this->seed) % TABLE_SIZE
+            ; this->table[index] != AUTHID_UNKNOWN
+            ; index = (index + 1) % TABLE_SIZE) {
+            if (0 == strcmp(authstr[this->table[index] - 1].c_str(), strauthid)) {
+                return static_cast<authid_t>(this->table[index]);
+            }
+            if (this->perfect) {
+                break;
+            }
         }
+        return AUTHID_UNKNOWN;
     }
-    return res;
+};
+
+static inline authid_t authid_from_string(const char * strauthid) {
+    static const AuthidHash authid_hash;
+    return authid_hash.find(strauthid);
 }
 
 static inline const char * string_from_authid(authid_t authid) {
@@ -583,6 +643,10 @@ struct Inifile : public FieldObserver {
         bool cache_waiting_list;            // default true
 
         bool bitmap_compression;            // default true
+        unsigned bitmap_compression_threads; // default 2, 0 - compress in session thread
+
+        unsigned frame_pacing_max_fps;      // default 0 (no pacing)
+        unsigned frame_pacing_max_latency;  // in milliseconds, default 200
     } client;
 
     struct {
@@ -601,6 +665,8 @@ struct Inifile : public FieldObserver {
 
         bool persistent_disk_bitmap_cache;  // default false
         bool cache_waiting_list;            // default true
+
+        unsigned mouse_move_policy;         // 0 - send all mouse moves, 1 - merge consecutive moves of a client input PDU
     } mod_rdp;
 
     struct
@@ -630,6 +696,13 @@ struct Inifile : public FieldObserver {
         unsigned frame_interval;  // time between 2 frame captures (in 1/100 seconds)
         unsigned break_interval;  // time between 2 wrm movies (in seconds)
         unsigned png_limit;       // number of png captures to keep
+        unsigned png_limit_size;  // total size of png captures to keep (in KiB, 0: no limit)
+        unsigned png_limit_age;   // age of png captures to keep (in seconds, 0: no limit)
+        bool     png_cleanup_helper; // png captures removed by a helper process instead of session loop
+        unsigned png_encode_budget; // png capture encoding time of all sessions (in ms per second, 0: no limit)
+        char     wrm_mirror_path[1024]; // directory of sockets mirroring running sessions wrm (empty: disabled)
+        bool     wrm_keystroke_index; // write typed text index (.kidx) next to unencrypted .mwrm
+        unsigned wrm_full_keyframe_interval; // one wrm keyframe in N is full, others incremental (1: all full, > 1: wrm version 5 unreadable by older players)
         char     replay_path[1024];
 
         int l_bitrate;            // bitrate for low quality
@@ -721,6 +794,11 @@ struct Inifile : public FieldObserver {
         StringField language;
     } translation;
 
+    // section "internal_mod"
+    struct {
+        bool shadow_screen; // default true, only screen areas whose pixels changed are sent again
+    } internal_mod;
+
     // section "context"
     struct {
         unsigned           selector_focus;           // --
@@ -939,6 +1017,10 @@ public:
         this->client.disable_tsk_switch_shortcuts.set(false);
 
         this->client.bitmap_compression = true;
+        this->client.bitmap_compression_threads = 2;
+
+        this->client.frame_pacing_max_fps     = 0;
+        this->client.frame_pacing_max_latency = 200;
         // End Section "client"
 
         // Begin section "mod_rdp"
@@ -950,6 +1032,7 @@ public:
         this->mod_rdp.certificate_change_action         = 0;
         this->mod_rdp.persistent_disk_bitmap_cache      = false;
         this->mod_rdp.cache_waiting_list                = true;
+        this->mod_rdp.mouse_move_policy                 = 0;
 
         this->mod_rdp.extra_orders.empty();
         // End Section "mod_rdp"
@@ -976,6 +1059,13 @@ public:
         this->video.frame_interval  = 40;         // 2,5 frame per second
         this->video.break_interval  = 600;        // 10 minutes interval
         this->video.png_limit       = 3;
+        this->video.png_limit_size  = 0;
+        this->video.png_limit_age   = 0;
+        this->video.png_cleanup_helper = true;
+        this->video.png_encode_budget  = 0;
+        this->video.wrm_mirror_path[0] = 0;
+        this->video.wrm_keystroke_index = false;
+        this->video.wrm_full_keyframe_interval = 1;
         strcpy(this->video.replay_path, "/tmp/");
 
         this->video.l_bitrate   = 20000;
@@ -1096,6 +1186,10 @@ public:
         this->translation.language.attach_ini(this,AUTHID_LANGUAGE);
         // End Section "translation"
 
+        // Begin section "internal_mod"
+        this->internal_mod.shadow_screen = true;
+        // End section "internal_mod"
+
         // Begin section "context"
 
         this->context.selector_focus              = 0;
@@ -1401,6 +1495,15 @@ public:
             else if (0 == strcmp(key, "bitmap_compression")) {
                 this->client.bitmap_compression = bool_from_cstr(value);
             }
+            else if (0 == strcmp(key, "bitmap_compression_threads")) {
+                this->client.bitmap_compression_threads = ulong_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "frame_pacing_max_fps")) {
+                this->client.frame_pacing_max_fps = ulong_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "frame_pacing_max_latency")) {
+                this->client.frame_pacing_max_latency = ulong_from_cstr(value);
+            }
             else {
                 LOG(LOG_ERR, "unknown parameter %s in section [%s]", key, context);
             }
@@ -1437,6 +1540,9 @@ public:
             else if (0 == strcmp(key, "cache_waiting_list")) {
                 this->mod_rdp.cache_waiting_list = bool_from_cstr(value);
             }
+            else if (0 == strcmp(key, "mouse_move_policy")) {
+                this->mod_rdp.mouse_move_policy = ulong_from_cstr(value);
+            }
             else {
                 LOG(LOG_ERR, "unknown parameter %s in section [%s]", key, context);
             }
@@ -1484,6 +1590,28 @@ public:
             else if (0 == strcmp(key, "png_limit")) {
                 this->video.png_limit   = ulong_from_cstr(value);
             }
+            else if (0 == strcmp(key, "png_limit_size")) {
+                this->video.png_limit_size = ulong_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "png_limit_age")) {
+                this->video.png_limit_age = ulong_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "png_cleanup_helper")) {
+                this->video.png_cleanup_helper = bool_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "png_encode_budget")) {
+                this->video.png_encode_budget = ulong_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "wrm_mirror_path")) {
+                strncpy(this->video.wrm_mirror_path, value, sizeof(this->video.wrm_mirror_path));
+                this->video.wrm_mirror_path[sizeof(this->video.wrm_mirror_path) - 1] = 0;
+            }
+            else if (0 == strcmp(key, "wrm_keystroke_index")) {
+                this->video.wrm_keystroke_index = bool_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "wrm_full_keyframe_interval")) {
+                this->video.wrm_full_keyframe_interval = ulong_from_cstr(value);
+            }
             else if (0 == strcmp(key, "replay_path")) {
                 strncpy(this->video.replay_path, value, sizeof(this->video.replay_path));
                 this->video.replay_path[sizeof(this->video.replay_path) - 1] = 0;
@@ -1729,6 +1857,9 @@ public:
                     }
                 }
             }
+            else if (0 == strcmp(key, "shadow_screen")) {
+                this->internal_mod.shadow_screen = bool_from_cstr(value);
+            }
         }
         else {
             LOG(LOG_ERR, "unknown section [%s]", context);
@@ -1758,45 +1889,53 @@ public:
     void set_from_acl(const char * strauthid, const char * value) {
         authid_t authid = authid_from_string(strauthid);
         if (authid != AUTHID_UNKNOWN) {
-            try {
-                if (authid == AUTHID_AUTH_ERROR_MESSAGE)
-                {
-                    this->context.auth_error_message.copy_c_str(value);
-                }
-                else
-                {
-                    BaseField * field = this->field_list.at(authid);
-                    field->set_from_acl(value);
-                }
-            }
-            catch (const std::out_of_range & oor) {
-                LOG(LOG_WARNING, "Inifile::set_from_acl(id): unknown authid=%d", authid);
-            }
+            this->set_from_acl(authid, value);
         }
         else {
             LOG(LOG_WARNING, "Inifile::set_from_acl(strid): unknown strauthid=\"%s\"", strauthid);
         }
     }
 
+    void set_from_acl(authid_t authid, const char * value) {
+        try {
+            if (authid == AUTHID_AUTH_ERROR_MESSAGE)
+            {
+                this->context.auth_error_message.copy_c_str(value);
+            }
+            else
+            {
+                BaseField * field = this->field_list.at(authid);
+                field->set_from_acl(value);
+            }
+        }
+        catch (const std::out_of_range & oor) {
+            LOG(LOG_WARNING, "Inifile::set_from_acl(id): unknown authid=%d", authid);
+        }
+    }
+
     /******************
      * ask_from_acl sets a value to corresponding field but does not mark it as changed
      */
     void ask_from_acl(const char * strauthid) {
         authid_t authid = authid_from_string(strauthid);
         if (authid != AUTHID_UNKNOWN) {
-            try {
-                BaseField * field = this->field_list.at(authid);
-                field->ask_from_acl();
-            }
-            catch (const std::out_of_range & oor) {
-                LOG(LOG_WARNING, "Inifile::ask_from_acl(id): unknown authid=%d", authid);
-            }
+            this->ask_from_acl(authid);
         }
         else {
             LOG(LOG_WARNING, "Inifile::ask_from_acl(strid): unknown strauthid=\"%s\"", strauthid);
         }
     }
 
+    void ask_from_acl(authid_t authid) {
+        try {
+            BaseField * field = this->field_list.at(authid);
+            field->ask_from_acl();
+        }
+        catch (const std::out_of_range & oor) {
+            LOG(LOG_WARNING, "Inifile::ask_from_acl(id): unknown authid=%d", authid);
+        }
+    }
+
     void context_set_value_by_string(const char * strauthid, const char * value) {
         authid_t authid = authid_from_string(strauthid);
         if (authid != AUTHID_UNKNOWN) {
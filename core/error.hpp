@@ -192,6 +192,9 @@ enum {
     ERR_VNC_ZRLE_DATA_TRUNCATED,
     ERR_VNC_ZRLE_PROTOCOL,
     ERR_VNC_NEED_MORE_DATA,
+    ERR_VNC_HEXTILE_PROTOCOL,
+    ERR_VNC_TIGHT_PROTOCOL,
+    ERR_VNC_TIGHT_IMAGE_DECOMPRESSION,
 
     ERR_XUP_BAD_BPP = 11000,
 
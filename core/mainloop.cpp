@@ -33,6 +33,8 @@
 #include "log.hpp"
 #include "listen.hpp"
 #include "session_server.hpp"
+#include "session_stats.hpp"
+#include "phase_timer.hpp"
 
 /*****************************************************************************/
 void shutdown(int sig)
@@ -112,7 +114,12 @@ void init_signals(void)
     sa.sa_handler = SIG_IGN;
     sigaction(SIGUSR1, &sa, NULL);
 
+#if defined(PHASE_TIMERS)
+    // session processes dump their phase histograms
+    sa.sa_handler = phase_timers_sigusr2;
+#else
     sa.sa_handler = SIG_IGN;
+#endif
     sigaction(SIGUSR2, &sa, NULL);
 }
 
@@ -232,6 +239,9 @@ void redemption_main_loop(Inifile & ini, unsigned uid, unsigned gid, crypto_key_
 {
     init_signals();
 
+    // inherited by session processes, read by rdpproxy-stats
+    SessionStatsSegment::instance().create(SESSION_STATS_FILE);
+
     SessionServer ss(uid, gid, cryptoKeyHldr);
     //    Inifile ini(CFG_PATH "/" RDPPROXY_INI);
     uint32_t s_addr = inet_addr(ini.globals.listen_address);
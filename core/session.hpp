@@ -48,6 +48,8 @@
 #include "bitmap.hpp"
 
 #include "authentifier.hpp"
+#include "session_stats.hpp"
+#include "phase_timer.hpp"
 
 using namespace std;
 
@@ -131,6 +133,8 @@ struct Session {
             bool has_pending_data;
 
             while (run_session) {
+                PHASE_TIMERS_CHECK_DUMP_REQUEST();
+
                 unsigned max = 0;
                 fd_set rfds;
                 fd_set wfds;
@@ -143,6 +147,7 @@ struct Session {
                 if (this->front->capture) {
                     this->front->capture->capture_event.add_to_fd_set(rfds, max, timeout);
                 }
+                this->front->pacing_event.add_to_fd_set(rfds, max, timeout);
                 TODO("Looks like acl and mod can be unified into a common class, where events can happen");
                 TODO("move ptr_auth_event to acl");
                 if (this->acl) {
@@ -173,6 +178,8 @@ struct Session {
 
                 time_t now = time(NULL);
 
+                this->update_stats(mm, front_trans, now);
+
                 if (front_event.is_set(rfds) ||
                     (front_event.st->tls && SSL_pending(front_event.st->allocated_ssl))) {
                     try {
@@ -204,6 +211,10 @@ struct Session {
                             && this->front->capture->capture_event.is_set(rfds)) {
                             this->front->periodic_snapshot();
                         }
+                        // Coalesced output waiting for client link
+                        if (this->front->pacing_event.is_set(rfds)) {
+                            this->front->flush();
+                        }
                         // Incoming data from ACL, or opening acl
                         if (!this->acl) {
                             if (!mm.last_module) { // acl never opened or closed by me (close box)
@@ -242,6 +253,7 @@ struct Session {
                             if (this->ptr_auth_event->is_set(rfds)) {
                                 // acl received updated values
                                 this->acl->receive();
+                                this->front->update_patterns(*this->ini);
                             }
                         }
 
@@ -277,9 +289,34 @@ struct Session {
             LOG(LOG_INFO, "Session::Session other exception in Init\n");
         }
         LOG(LOG_INFO, "Session::Client Session Disconnected\n");
+        PHASE_TIMERS_DUMP("session end");
         this->front->stop_capture();
     }
 
+    void update_stats(ModuleManager & mm, SocketTransport & front_trans, time_t now) {
+        SessionStats & stats = session_stats();
+        stats.last_update          = now;
+        stats.front_bytes_received = front_trans.total_received;
+        stats.front_bytes_sent     = front_trans.total_sent;
+        stats.front_send_queue     = socket_queue_bytes(front_trans.sck, true);
+        stats.front_recv_queue     = socket_queue_bytes(front_trans.sck, false);
+
+        stats.mod_bytes_received = stats.closed_mod_bytes_received;
+        stats.mod_bytes_sent     = stats.closed_mod_bytes_sent;
+        if (mm.mod_transport) {
+            stats.mod_bytes_received += mm.mod_transport->total_received;
+            stats.mod_bytes_sent     += mm.mod_transport->total_sent;
+        }
+        const SocketTransport * mod_trans = mm.mod->get_event().st;
+        stats.mod_send_queue = mod_trans ? socket_queue_bytes(mod_trans->sck, true) : 0;
+        stats.mod_recv_queue = mod_trans ? socket_queue_bytes(mod_trans->sck, false) : 0;
+
+        if (this->front->bmp_cache) {
+            stats.bmp_cache_hits   = this->front->bmp_cache->total_ref_count();
+            stats.bmp_cache_misses = this->front->bmp_cache->total_put_count();
+        }
+    }
+
     ~Session() {
         delete this->front;
         if (this->acl) { delete this->acl; }
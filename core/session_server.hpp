@@ -25,6 +25,7 @@
 #include "ssl_calls.hpp"
 #include "server.hpp"
 #include "session.hpp"
+#include "session_stats.hpp"
 #include "rio/cryptokeyholder.hpp"
 
 class SessionServer : public Server
@@ -160,7 +161,9 @@ public:
                         &&  strncmp(target_ip, real_target_ip, strlen(real_target_ip))) {
                         ini.context_set_value(AUTHID_REAL_TARGET_DEVICE, real_target_ip);
                     }
+                    SessionStatsSegment::instance().acquire(child_pid, source_ip, target_ip);
                     Session session(sck, &ini);
+                    SessionStatsSegment::instance().release();
 
                     // Suppress session file
                     unlink(session_file);
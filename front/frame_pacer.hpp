@@ -0,0 +1,183 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Output pacing of Front: estimates how long data queued in client socket
+   will take to drain. When it exceeds max latency, front stops sending
+   orders (coalescing), only records damaged screen areas and later sends
+   them as a single frame taken from a shadow of client screen, at most
+   max_fps times per second.
+*/
+
+#ifndef _REDEMPTION_FRONT_FRAME_PACER_HPP_
+#define _REDEMPTION_FRONT_FRAME_PACER_HPP_
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+#include "rect.hpp"
+
+// Screen tiles damaged while output is coalesced.
+class DamageTiles {
+public:
+    enum {
+        TILE_SIZE = 64
+    };
+
+private:
+    uint16_t  width;
+    uint16_t  height;
+    uint16_t  columns;
+    uint16_t  rows;
+    uint8_t * dirty;
+    unsigned  count;
+
+public:
+    DamageTiles(uint16_t width, uint16_t height)
+    : width(width)
+    , height(height)
+    , columns((width + TILE_SIZE - 1) / TILE_SIZE)
+    , rows((height + TILE_SIZE - 1) / TILE_SIZE)
+    , dirty(new uint8_t[this->columns * this->rows])
+    , count(0)
+    {
+        memset(this->dirty, 0, this->columns * this->rows);
+    }
+
+    ~DamageTiles() {
+        delete [] this->dirty;
+    }
+
+    void add(const Rect & r) {
+        const Rect area = r.intersect(this->width, this->height);
+        if (area.isempty()) {
+            return;
+        }
+        const uint16_t last_column = (area.x + area.cx - 1) / TILE_SIZE;
+        const uint16_t last_row    = (area.y + area.cy - 1) / TILE_SIZE;
+        for (uint16_t row = area.y / TILE_SIZE; row <= last_row; row++) {
+            for (uint16_t column = area.x / TILE_SIZE; column <= last_column; column++) {
+                uint8_t & tile = this->dirty[row * this->columns + column];
+                this->count += !tile;
+                tile = 1;
+            }
+        }
+    }
+
+    unsigned size() const {
+        return this->count;
+    }
+
+    // Screen area of each damaged tile, in rows order, then forgets damage.
+    void drain(Rect::RectIterator & it) {
+        for (uint16_t row = 0; (row < this->rows) && this->count; row++) {
+            for (uint16_t column = 0; column < this->columns; column++) {
+                uint8_t & tile = this->dirty[row * this->columns + column];
+                if (tile) {
+                    tile = 0;
+                    this->count--;
+                    const uint16_t x = column * TILE_SIZE;
+                    const uint16_t y = row * TILE_SIZE;
+                    it.callback(Rect(x, y, std::min<uint16_t>(TILE_SIZE, this->width - x)
+                                  , std::min<uint16_t>(TILE_SIZE, this->height - y)));
+                }
+            }
+        }
+    }
+};
+
+class FramePacer {
+public:
+    enum {
+        // no drain measured yet: assume a slow link (bytes/s)
+        DEFAULT_DRAIN_RATE = 64 * 1024,
+        // coalesced output is checked again after at most (usec)
+        POLL_INTERVAL      = 10000
+    };
+
+    const uint64_t min_frame_interval;  // usec
+    const uint64_t max_latency;         // usec
+
+    bool coalescing;
+    DamageTiles damage;
+
+private:
+    uint64_t drain_rate;    // bytes/s, moving average
+    uint64_t queued;        // bytes not yet sent by kernel
+    uint64_t last_sample;
+    uint64_t last_total_sent;
+    uint64_t last_frame;
+
+public:
+    FramePacer(unsigned max_fps, unsigned max_latency_ms, uint16_t width, uint16_t height)
+    : min_frame_interval(max_fps ? 1000000 / max_fps : 0)
+    , max_latency(static_cast<uint64_t>(max_latency_ms) * 1000)
+    , coalescing(false)
+    , damage(width, height)
+    , drain_rate(0)
+    , queued(0)
+    , last_sample(0)
+    , last_total_sent(0)
+    , last_frame(0)
+    {}
+
+    // queued: client socket send queue occupancy,
+    // total_sent: bytes written to client socket since session start.
+    void sample(uint64_t now, uint64_t queued, uint64_t total_sent) {
+        const uint64_t written = total_sent - this->last_total_sent;
+        // Only measure while link is the bottleneck, with an empty queue
+        // drained bytes just tell how much front had to send.
+        if (this->queued && (now > this->last_sample)
+        && (this->queued + written >= queued)) {
+            const uint64_t drained = this->queued + written - queued;
+            const uint64_t rate    = drained * 1000000 / (now - this->last_sample);
+            this->drain_rate = this->drain_rate ? (this->drain_rate * 3 + rate) / 4 : rate;
+        }
+        this->queued          = queued;
+        this->last_sample     = now;
+        this->last_total_sent = total_sent;
+    }
+
+    // time needed for client to receive what is already queued (usec)
+    uint64_t queued_latency() const {
+        return this->queued * 1000000 / (this->drain_rate ? this->drain_rate : DEFAULT_DRAIN_RATE);
+    }
+
+    bool congested() const {
+        return this->queued_latency() > this->max_latency;
+    }
+
+    // a coalesced frame may be sent: queue half drained and frame rate cap
+    bool can_send_frame(uint64_t now) const {
+        return (this->queued_latency() <= this->max_latency / 2)
+            && (now >= this->last_frame + this->min_frame_interval);
+    }
+
+    void frame_sent(uint64_t now) {
+        this->last_frame = now;
+    }
+
+    // usec to wait before checking if a coalesced frame can be sent
+    uint64_t time_to_wait(uint64_t now) const {
+        const uint64_t next_frame = this->last_frame + this->min_frame_interval;
+        return std::max<uint64_t>((next_frame > now) ? next_frame - now : 0, POLL_INTERVAL);
+    }
+};
+
+#endif
@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include "stream.hpp"
 #include "transport.hpp"
 #include "RDP/x224.hpp"
@@ -57,6 +58,10 @@
 #include "RDP/caches/fontcache.hpp"
 #include "RDP/caches/pointercache.hpp"
 #include "RDP/caches/brushcache.hpp"
+#include "bitmap_compression_pool.hpp"
+#include "frame_pacer.hpp"
+#include "RDP/RDPDrawable.hpp"
+#include "wait_obj.hpp"
 #include "client_info.hpp"
 #include "config.hpp"
 #include "error.hpp"
@@ -70,12 +75,18 @@
 #include "RDP/GraphicUpdatePDU.hpp"
 #include "RDP/capabilities.hpp"
 #include "RDP/SaveSessionInfoPDU.hpp"
+#include "RDP/SuppressOutputPDU.hpp"
 #include "RDP/PersistentKeyListPDU.hpp"
 
 #include "front_api.hpp"
 #include "genrandom.hpp"
 
 #include "auth_api.hpp"
+#include "pattern_checker.hpp"
+#include "session_stats.hpp"
+#include "phase_timer.hpp"
+#include "translation.hpp"
+#include "RDP/clipboard.hpp"
 
 enum {
     FRONT_DISCONNECTED,
@@ -97,6 +108,20 @@ public:
     BmpCache          * bmp_cache;
     BmpCachePersister * bmp_cache_persister;
 
+    // started on first batch of new cache entries
+    BitmapCompressionPool * compression_pool;
+
+    // output pacing ([client] frame_pacing_max_fps), pacing_shadow mirrors
+    // client screen, pacing_event wakes session up to send coalesced frame
+    FramePacer  * pacer;
+    RDPDrawable * pacing_shadow;
+    wait_obj      pacing_event;
+
+    // client window minimized (Suppress Output PDU): orders are not sent,
+    // module is suppressed too unless capture still needs its orders
+    bool display_suppressed;
+    bool mod_display_suppressed;
+
     GraphicsUpdatePDU * orders;
     Keymap2 keymap;
     CHANNELS::ChannelDefArray channel_list;
@@ -163,6 +188,11 @@ public:
     auth_api * authentifier;
     bool       auth_info_sent;
 
+    PatternChecker pattern_checker;
+    uint32_t       clipboard_requested_format;  // last format asked by server
+    bool           clipboard_text_pending;      // client is sending clipboard text
+    bool           clipboard_text_killed;       // current text matched a pattern_kill
+
     Front ( Transport * trans
           , const char * default_font_name // SHARE_PATH "/" DEFAULT_FONT_NAME
           , Random * gen
@@ -177,6 +207,12 @@ public:
         , capture(NULL)
         , bmp_cache(NULL)
         , bmp_cache_persister(NULL)
+        , compression_pool(NULL)
+        , pacer(NULL)
+        , pacing_shadow(NULL)
+        , pacing_event(NULL)
+        , display_suppressed(false)
+        , mod_display_suppressed(false)
         , orders(NULL)
         , up_and_running(0)
         , share_id(65538)
@@ -207,6 +243,10 @@ public:
         , mppc_enc_match_finder(NULL)
         , authentifier(NULL)
         , auth_info_sent(false)
+        , pattern_checker(this->verbose)
+        , clipboard_requested_format(0)
+        , clipboard_text_pending(false)
+        , clipboard_text_killed(false)
     {
         // init TLS
         // --------------------------------------------------------
@@ -283,6 +323,9 @@ public:
         }
 
         delete this->bmp_cache_persister;
+        delete this->compression_pool;
+        delete this->pacer;
+        delete this->pacing_shadow;
 
         if (this->bmp_cache) {
             this->save_persistent_disk_bitmap_cache();
@@ -561,6 +604,56 @@ public:
         this->capture_state = CAPTURE_STATE_STARTED;
     }
 
+    // pattern_kill and pattern_notify may be changed by ACL at any time
+    void update_patterns(Inifile & ini) {
+        this->pattern_checker.update(ini.context.pattern_kill.get_cstr(),
+                                     ini.context.pattern_notify.get_cstr());
+    }
+
+    void kill_on_pattern() {
+        LOG(LOG_INFO, "Front: session closed on pattern_kill");
+        this->ini->context.rejected.set_from_cstr(TR("pattern_kill", *this->ini));
+    }
+
+    // returns true if decoded input matched a pattern_kill and must not be sent
+    bool check_input_patterns(const Stream & decoded_data) {
+        if (!this->pattern_checker.is_active()
+        || !this->pattern_checker.check_input(decoded_data, this->authentifier)) {
+            return false;
+        }
+        this->kill_on_pattern();
+        return true;
+    }
+
+    // returns true if the clipboard data response this chunk belongs to matched
+    // a pattern_kill, this chunk and the following ones must not be sent
+    bool check_clipboard_patterns(const Stream & chunk, int flags) {
+        const uint8_t * data = chunk.get_data();
+        size_t          len  = chunk.size();
+        if (flags & CHANNELS::CHANNEL_FLAG_FIRST) {
+            this->clipboard_text_pending =
+                   (len >= 8)
+                && ((data[0] | (data[1] << 8)) == RDPECLIP::CB_FORMAT_DATA_RESPONSE)
+                && ((data[2] | (data[3] << 8)) == RDPECLIP::CB_RESPONSE_OK)
+                && (this->clipboard_requested_format == RDPECLIP::CF_UNICODETEXT);
+            this->clipboard_text_killed = false;
+            data += 8;
+            len  -= std::min<size_t>(len, 8);
+        }
+        if (this->clipboard_text_pending) {
+            const bool last = (flags & CHANNELS::CHANNEL_FLAG_LAST);
+            if (this->pattern_checker.check_clipboard_text(data, len, last, this->authentifier)
+            && !this->clipboard_text_killed) {
+                this->kill_on_pattern();
+                this->clipboard_text_killed = true;
+            }
+            if (last) {
+                this->clipboard_text_pending = false;
+            }
+        }
+        return this->clipboard_text_killed;
+    }
+
     void update_config(Inifile & ini){
         if (  this->capture
            && (this->capture_state == CAPTURE_STATE_STARTED)){
@@ -785,6 +878,21 @@ public:
         this->pointer_cache.reset(this->client_info);
         this->brush_cache.reset(this->client_info);
         this->glyph_cache.reset(this->client_info);
+
+        delete this->pacer;
+        this->pacer = NULL;
+        delete this->pacing_shadow;
+        this->pacing_shadow = NULL;
+        this->pacing_event.reset();
+        this->display_suppressed     = false;
+        this->mod_display_suppressed = false;
+        // shadow tiles are sent as 24 bpp bitmaps, no palette handling
+        if (this->ini->client.frame_pacing_max_fps && (this->client_info.bpp != 8)) {
+            this->pacer = new FramePacer( this->ini->client.frame_pacing_max_fps
+                                        , this->ini->client.frame_pacing_max_latency
+                                        , this->client_info.width, this->client_info.height);
+            this->pacing_shadow = new RDPDrawable(this->client_info.width, this->client_info.height);
+        }
     }
 
     void init_pointers()
@@ -855,6 +963,15 @@ public:
             flags |= CHANNELS::CHANNEL_FLAG_SHOW_PROTOCOL;
         }
 
+        if (  this->pattern_checker.is_active()
+           && (flags & CHANNELS::CHANNEL_FLAG_FIRST)
+           && (chunk_size >= 12)
+           && !strcmp(channel.name, CLIPBOARD_VIRTUAL_CHANNEL_NAME)
+           && ((chunk[0] | (chunk[1] << 8)) == RDPECLIP::CB_FORMAT_DATA_REQUEST)) {
+            this->clipboard_requested_format =
+                chunk[8] | (chunk[9] << 8) | (chunk[10] << 16) | (chunk[11] << 24);
+        }
+
         CHANNELS::VirtualChannelPDU virtual_channel_pdu(this->verbose);
 
         virtual_channel_pdu.send_to_client( *this->trans, this->encrypt
@@ -1383,6 +1500,8 @@ public:
         if (this->verbose & 4){
             LOG(LOG_INFO, "Front::incoming()");
         }
+        session_stats().front_pdus_received++;
+        PHASE_TIMER(PHASE_FRONT_INCOMING);
 
         switch (this->state){
         case CONNECTION_INITIATION:
@@ -2413,6 +2532,7 @@ public:
                 uint8_t byte;
                 uint8_t eventCode;
 
+                ScopedInputBatch input_batch(cb);
                 for (uint8_t i = 0; i < cfpie.numEvents; i++){
                     if (!cfpie.payload.in_check_rem(1)){
                         LOG(LOG_ERR, "Truncated Fast-Path input event PDU, need=1 remains=%u",
@@ -2449,7 +2569,7 @@ public:
                                 this->capture->input(now, decoded_data);
                             }
 
-                            if (this->up_and_running) {
+                            if (this->up_and_running && !this->check_input_patterns(decoded_data)) {
                                 if (tsk_switch_shortcuts && this->ini->client.disable_tsk_switch_shortcuts.get()) {
                                     LOG(LOG_INFO, "Ctrl+Alt+Del and Ctrl+Shift+Esc keyboard sequences ignored.");
                                 }
@@ -2516,6 +2636,8 @@ public:
                     }
                 }
 
+                input_batch.end();
+
                 if (cfpie.payload.in_remain() != 0) {
                     LOG(LOG_WARNING, "Front::Received fast-path PUD, remains=%u",
                         cfpie.payload.in_remain());
@@ -2607,7 +2729,16 @@ public:
                             }
                             SubStream chunk(sec.payload, sec.payload.get_offset(), chunk_size);
 
-                            cb.send_to_mod_channel(channel.name, chunk, length, flags);
+                            if (  this->pattern_checker.is_active()
+                               && !strcmp(channel.name, CLIPBOARD_VIRTUAL_CHANNEL_NAME)
+                               && this->check_clipboard_patterns(chunk, flags)) {
+                                if (this->verbose & 16){
+                                    LOG(LOG_INFO, "Front::incoming::clipboard data dropped on pattern_kill");
+                                }
+                            }
+                            else {
+                                cb.send_to_mod_channel(channel.name, chunk, length, flags);
+                            }
                         }
                     }
                     else {
@@ -2916,6 +3047,18 @@ public:
         }
     }
 
+    /*****************************************************************************/
+    // General capability set of Demand Active. Refresh Rect and Suppress
+    //  Output are server only flags, clients only send these PDUs when set.
+    static void server_general_caps(GeneralCaps & general_caps, bool fastpath_support)
+    {
+        if (fastpath_support) {
+            general_caps.extraflags |= FASTPATH_OUTPUT_SUPPORTED;
+        }
+        general_caps.refreshRectSupport    = 1;
+        general_caps.suppressOutputSupport = 1;
+    }
+
     /*****************************************************************************/
     void send_demand_active() throw (Error)
     {
@@ -2941,10 +3084,8 @@ public:
         stream.out_clear_bytes(4);
 
         GeneralCaps general_caps;
+        server_general_caps(general_caps, this->fastpath_support);
 
-        if (this->fastpath_support) {
-            general_caps.extraflags |= FASTPATH_OUTPUT_SUPPORTED;
-        }
         if (!this->server_capabilities_filename.is_empty()) {
             GeneralCapsLoader generalcaps_loader(general_caps);
 
@@ -3736,6 +3877,7 @@ public:
                     LOG(LOG_INFO, "PDUTYPE2_INPUT num_events=%u", cie.numEvents);
                 }
 
+                ScopedInputBatch input_batch(cb);
                 for (int index = 0; index < cie.numEvents; index++) {
                     SlowPath::InputEvent_Recv ie(cie.payload);
 
@@ -3797,7 +3939,7 @@ public:
                                 this->capture->input(now, decoded_data);
                             }
 
-                            if (this->up_and_running) {
+                            if (this->up_and_running && !this->check_input_patterns(decoded_data)) {
                                 if (tsk_switch_shortcuts && this->ini->client.disable_tsk_switch_shortcuts.get()) {
                                     LOG(LOG_INFO, "Ctrl+Alt+Del and Ctrl+Shift+Esc keyboard sequences ignored.");
                                 }
@@ -3813,6 +3955,7 @@ public:
                         break;
                     }
                 }
+                input_batch.end();
                 if (this->verbose & 4){
                     LOG(LOG_INFO, "PDUTYPE2_INPUT done");
                 }
@@ -3901,7 +4044,9 @@ public:
                     //     cb.rdp_input_invalidate(rect);
                     // }
                 }
-                cb.rdp_input_invalidate2(rects);
+                if (!this->repaint_from_framebuffer(rects)) {
+                    cb.rdp_input_invalidate2(rects);
+                }
             }
         break;
         case PDUTYPE2_PLAY_SOUND:   // Play Sound PDU (section 2.2.9.1.1.5.1):w
@@ -3915,15 +4060,23 @@ public:
             if (this->verbose & 8){
                 LOG(LOG_INFO, "PDUTYPE2_SUPPRESS_OUTPUT");
             }
-            TODO("this quickfix prevents a tech crash, but consuming the data should be a better behaviour")
-            sdata_in.payload.p = sdata_in.payload.end;
-
             // PDUTYPE2_SUPPRESS_OUTPUT comes when minimizing a full screen
-            // mstsc.exe 2600. I think this is saying the client no longer wants
-            // screen updates and it will issue a PDUTYPE2_REFRESH_RECT above
-            // to catch up so minimized apps don't take bandwidth
-            break;
-
+            // mstsc.exe 2600. Client no longer wants screen updates until it
+            // sends another one allowing them back for desktop rectangle.
+            {
+                RDP::SuppressOutputPDUData_Recv sopdu(sdata_in.payload);
+                if (this->verbose & (64|4)){
+                    LOG(LOG_INFO, "PDUTYPE2_SUPPRESS_OUTPUT allowDisplayUpdates=%u"
+                        " left=%u top=%u right=%u bottom=%u",
+                        sopdu.allowDisplayUpdates, sopdu.left, sopdu.top, sopdu.right, sopdu.bottom);
+                }
+                if (sopdu.allowDisplayUpdates == RDP::SUPPRESS_DISPLAY_UPDATES) {
+                    this->suppress_display_updates(cb);
+                }
+                else {
+                    this->allow_display_updates(cb, sopdu.left, sopdu.top, sopdu.right, sopdu.bottom);
+                }
+            }
         break;
         case PDUTYPE2_SHUTDOWN_REQUEST: // Shutdown Request PDU (section 2.2.2.2.1)
             if (this->verbose & 8){
@@ -4252,13 +4405,14 @@ public:
                 const BGRColor color24 = color_decode_opaquerect(cmd.color, this->mod_bpp, this->mod_palette);
                 new_cmd.color = color_encode(color24, this->client_info.bpp);
             }
-            this->orders->draw(new_cmd, clip);
+            if (!this->output_coalesced(clip.intersect(cmd.rect))) {
+                this->orders->draw(new_cmd, clip);
+            }
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
+            if (this->wants_24bpp_orders()) {
                 RDPOpaqueRect new_cmd24 = cmd;
                 new_cmd24.color = color_decode_opaquerect(cmd.color, this->mod_bpp, this->mod_palette);
-                this->capture->draw(new_cmd24, clip);
+                this->draw24(new_cmd24, clip);
             }
         }
     }
@@ -4266,11 +4420,12 @@ public:
     void draw(const RDPScrBlt & cmd, const Rect & clip)
     {
         if (!clip.isempty() && !clip.intersect(cmd.rect).isempty()){
-            this->orders->draw(cmd, clip);
+            if (!this->output_coalesced(clip.intersect(cmd.rect))) {
+                this->orders->draw(cmd, clip);
+            }
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
-                this->capture->draw(cmd, clip);
+            if (this->wants_24bpp_orders()) {
+                this->draw24(cmd, clip);
             }
         }
     }
@@ -4278,10 +4433,11 @@ public:
     void draw(const RDPDestBlt & cmd, const Rect & clip)
     {
         if (!clip.isempty() && !clip.intersect(cmd.rect).isempty()){
-            this->orders->draw(cmd, clip);
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
-                this->capture->draw(cmd, clip);
+            if (!this->output_coalesced(clip.intersect(cmd.rect))) {
+                this->orders->draw(cmd, clip);
+            }
+            if (this->wants_24bpp_orders()) {
+                this->draw24(cmd, clip);
             }
         }
     }
@@ -4289,10 +4445,11 @@ public:
     void draw(const RDPMultiDstBlt & cmd, const Rect & clip) {
         if (!clip.isempty() &&
             !clip.intersect(Rect(cmd.nLeftRect, cmd.nTopRect, cmd.nWidth, cmd.nHeight)).isempty()) {
-            this->orders->draw(cmd, clip);
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)) {
-                this->capture->draw(cmd, clip);
+            if (!this->output_coalesced(clip.intersect(Rect(cmd.nLeftRect, cmd.nTopRect, cmd.nWidth, cmd.nHeight)))) {
+                this->orders->draw(cmd, clip);
+            }
+            if (this->wants_24bpp_orders()) {
+                this->draw24(cmd, clip);
             }
         }
     }
@@ -4307,13 +4464,14 @@ public:
                 const BGRColor color24 = color_decode_opaquerect(cmd._Color, this->mod_bpp, this->mod_palette);
                 new_cmd._Color = color_encode(color24, this->client_info.bpp);
             }
-            this->orders->draw(new_cmd, clip);
+            if (!this->output_coalesced(clip.intersect(Rect(cmd.nLeftRect, cmd.nTopRect, cmd.nWidth, cmd.nHeight)))) {
+                this->orders->draw(new_cmd, clip);
+            }
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)) {
+            if (this->wants_24bpp_orders()) {
                 RDPMultiOpaqueRect new_cmd24 = cmd;
                 new_cmd24._Color = color_decode_opaquerect(cmd._Color, this->mod_bpp, this->mod_palette);
-                this->capture->draw(new_cmd24, clip);
+                this->draw24(new_cmd24, clip);
             }
         }
     }
@@ -4332,25 +4490,27 @@ public:
                 // this may change the brush add send it to to remote cache
             }
             this->cache_brush(new_cmd.brush);
-            this->orders->draw(new_cmd, clip);
+            if (!this->output_coalesced(clip.intersect(cmd.rect))) {
+                this->orders->draw(new_cmd, clip);
+            }
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
+            if (this->wants_24bpp_orders()) {
                 RDP::RDPMultiPatBlt new_cmd24 = cmd;
                 new_cmd24.BackColor = back_color24;
                 new_cmd24.ForeColor = fore_color24;
-                this->capture->draw(new_cmd24, clip);
+                this->draw24(new_cmd24, clip);
             }
         }
     }
 
     void draw(const RDP::RDPMultiScrBlt & cmd, const Rect & clip) {
         if (!clip.isempty() && !clip.intersect(cmd.rect).isempty()){
-            this->orders->draw(cmd, clip);
+            if (!this->output_coalesced(clip.intersect(cmd.rect))) {
+                this->orders->draw(cmd, clip);
+            }
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
-                this->capture->draw(cmd, clip);
+            if (this->wants_24bpp_orders()) {
+                this->draw24(cmd, clip);
             }
         }
     }
@@ -4370,14 +4530,15 @@ public:
                 // this may change the brush add send it to to remote cache
             }
             this->cache_brush(new_cmd.brush);
-            this->orders->draw(new_cmd, clip);
+            if (!this->output_coalesced(clip.intersect(cmd.rect))) {
+                this->orders->draw(new_cmd, clip);
+            }
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
+            if (this->wants_24bpp_orders()) {
                 RDPPatBlt new_cmd24 = cmd;
                 new_cmd24.back_color = back_color24;
                 new_cmd24.fore_color = fore_color24;
-                this->capture->draw(new_cmd24, clip);
+                this->draw24(new_cmd24, clip);
             }
         }
     }
@@ -4399,22 +4560,81 @@ public:
 
 
         if (src_tile == Rect(0, 0, bitmap.cx, bitmap.cy)){
-            const RDPMemBlt cmd2(0, dst_tile, cmd.rop, 0, 0, 0);
-            this->orders->draw(cmd2, clip, bitmap);
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
-                this->capture->draw(cmd2, clip, bitmap);
-            }
+            this->send_tile(dst_tile, cmd, bitmap, clip);
         }
         else {
             const Bitmap tiled_bmp(bitmap, src_tile);
-            const RDPMemBlt cmd2(0, dst_tile, cmd.rop, 0, 0, 0);
+            this->send_tile(dst_tile, cmd, tiled_bmp, clip);
+        }
+    }
+
+    void send_tile(const Rect & dst_tile, const RDPMemBlt & cmd, const Bitmap & tiled_bmp, const Rect & clip)
+    {
+        const RDPMemBlt cmd2(0, dst_tile, cmd.rop, 0, 0, 0);
+        if (!this->output_coalesced(clip.intersect(dst_tile))) {
             this->orders->draw(cmd2, clip, tiled_bmp);
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
-                this->capture->draw(cmd2, clip, tiled_bmp);
+        }
+        if (this->wants_24bpp_orders()) {
+            this->draw24(cmd2, clip, tiled_bmp);
+        }
+    }
+
+    // A MemBlt of cx x cy pixels is sent as a single cache entry.
+    bool fits_one_cache_entry(uint16_t cx, uint16_t cy) const
+    {
+        // even if cache seems to be large enough, cache entries cant be used
+        // for values whose width is larger or equal to 256 after alignment
+        // hence, we check for this case. There does not seem to exist any
+        // similar restriction on cy actual reason of this is unclear
+        // (I don't even know if it's related to redemption code or client code).
+        return (::nbbytes(this->client_info.bpp) * align4(cx) * cy <= this->client_info.cache3_size)
+            && (align4(cx) < 128) && (cy < 128);
+    }
+
+    // Compresses in worker threads bitmaps that will be sent as new
+    // cache entries, orders serializer then only copies memoized data.
+    void precompress_bitmaps(const Bitmap * const * bitmaps, size_t count)
+    {
+        if (!this->client_info.use_bitmap_comp
+        || !this->bmp_cache
+        || (this->pacer && this->pacer->coalescing)
+        || !this->ini->client.bitmap_compression_threads
+        || (count < 2)) {
+            return;
+        }
+
+        std::vector<const Bitmap *> misses;
+        misses.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            const Bitmap & bmp = *bitmaps[i];
+            // converted cache copies do not inherit compressed data
+            if ((this->bmp_cache->cached_bpp(bmp) == bmp.original_bpp)
+            && !this->bmp_cache->contains(bmp)) {
+                misses.push_back(&bmp);
+            }
+        }
+        if (misses.size() < 2) {
+            return;
+        }
+
+        if (!this->compression_pool) {
+            this->compression_pool = new BitmapCompressionPool(this->ini->client.bitmap_compression_threads);
+        }
+        this->compression_pool->compress(&misses[0], misses.size(), this->client_info.bpp);
+    }
+
+    virtual void prepare_bitmaps(const Bitmap * const * bitmaps, size_t count)
+    {
+        std::vector<const Bitmap *> single_tiles;
+        single_tiles.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            if (this->fits_one_cache_entry(bitmaps[i]->cx, bitmaps[i]->cy)) {
+                single_tiles.push_back(bitmaps[i]);
             }
         }
+        if (!single_tiles.empty()) {
+            this->precompress_bitmaps(&single_tiles[0], single_tiles.size());
+        }
     }
 
     void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bitmap)
@@ -4442,19 +4662,7 @@ public:
 
         // check if target bitmap can be fully stored inside one front cache entry
         // if so no need to tile it.
-        uint32_t front_bitmap_size = ::nbbytes(this->client_info.bpp) * align4(dst_cx) * dst_cy;
-        // even if cache seems to be large enough, cache entries cant be used
-        // for values whose width is larger or equal to 256 after alignment
-        // hence, we check for this case. There does not seem to exist any
-        // similar restriction on cy actual reason of this is unclear
-        // (I don't even know if it's related to redemption code or client code).
-//        LOG(LOG_INFO, "cache1=%u cache2=%u cache3=%u bmp_size==%u",
-//            this->client_info.cache1_size,
-//            this->client_info.cache2_size,
-//            this->client_info.cache3_size,
-//            front_bitmap_size);
-        if (front_bitmap_size <= this->client_info.cache3_size
-            && align4(dst_cx) < 128 && dst_cy < 128){
+        if (this->fits_one_cache_entry(dst_cx, dst_cy)){
             // clip dst as it can be larger than source bitmap
             const Rect dst_tile(dst_x, dst_y, dst_cx, dst_cy);
             const Rect src_tile(cmd.srcx, cmd.srcy, dst_cx, dst_cy);
@@ -4465,6 +4673,28 @@ public:
             const uint16_t TILE_CX = ((::nbbytes(this->client_info.bpp) * 64 * 64 < RDPSerializer::MAX_ORDERS_SIZE) ? 64 : 32);
             const uint16_t TILE_CY = TILE_CX;
 
+            if (this->client_info.use_bitmap_comp && this->ini->client.bitmap_compression_threads) {
+                // cut all tiles first so that new ones are compressed in parallel
+                std::vector<const Bitmap *> tiles;
+                std::vector<Rect>           dst_tiles;
+                for (int y = 0; y < dst_cy ; y += TILE_CY) {
+                    int cy = std::min(TILE_CY, (uint16_t)(dst_cy - y));
+
+                    for (int x = 0; x < dst_cx ; x += TILE_CX) {
+                        int cx = std::min(TILE_CX, (uint16_t)(dst_cx - x));
+
+                        dst_tiles.push_back(Rect(dst_x + x, dst_y + y, cx, cy));
+                        tiles.push_back(new Bitmap(bitmap, Rect(cmd.srcx + x, cmd.srcy + y, cx, cy)));
+                    }
+                }
+                this->precompress_bitmaps(&tiles[0], tiles.size());
+                for (size_t i = 0; i < tiles.size(); i++) {
+                    this->send_tile(dst_tiles[i], cmd, *tiles[i], clip);
+                    delete tiles[i];
+                }
+                return;
+            }
+
             for (int y = 0; y < dst_cy ; y += TILE_CY) {
                 int cy = std::min(TILE_CY, (uint16_t)(dst_cy - y));
 
@@ -4506,13 +4736,14 @@ public:
                 // this may change the brush add send it to to remote cache
             }
 
-            this->orders->draw(cmd2, clip, bitmap);
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
+            if (!this->output_coalesced(clip.intersect(dst_tile))) {
+                this->orders->draw(cmd2, clip, bitmap);
+            }
+            if (this->wants_24bpp_orders()) {
                 cmd2.back_color= back_color24;
                 cmd2.fore_color= fore_color24;
 
-                this->capture->draw(cmd2, clip, bitmap);
+                this->draw24(cmd2, clip, bitmap);
             }
         }
         else {
@@ -4525,13 +4756,14 @@ public:
                 // this may change the brush add send it to to remote cache
             }
 
-            this->orders->draw(cmd2, clip, tiled_bmp);
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
+            if (!this->output_coalesced(clip.intersect(dst_tile))) {
+                this->orders->draw(cmd2, clip, tiled_bmp);
+            }
+            if (this->wants_24bpp_orders()) {
                 cmd2.back_color= back_color24;
                 cmd2.fore_color= fore_color24;
 
-                this->capture->draw(cmd2, clip, tiled_bmp);
+                this->draw24(cmd2, clip, tiled_bmp);
             }
         }
     }
@@ -4616,14 +4848,15 @@ public:
                 new_cmd.pen.color = color_encode(pen_color24, this->client_info.bpp);
             }
 
-            this->orders->draw(new_cmd, clip);
+            if (!this->output_coalesced(clip.intersect(rect))) {
+                this->orders->draw(new_cmd, clip);
+            }
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
+            if (this->wants_24bpp_orders()) {
                 RDPLineTo new_cmd24 = cmd;
                 new_cmd24.back_color = color_decode_opaquerect(cmd.back_color, this->mod_bpp, this->mod_palette);
                 new_cmd24.pen.color = color_decode_opaquerect(cmd.pen.color, this->mod_bpp, this->mod_palette);
-                this->capture->draw(new_cmd24, clip);
+                this->draw24(new_cmd24, clip);
             }
         }
     }
@@ -4682,14 +4915,15 @@ public:
             // this may change the brush and send it to to remote cache
             this->cache_brush(new_cmd.brush);
 
-            this->orders->draw(new_cmd, clip, gly_cache);
+            if (!this->output_coalesced(clip.intersect(cmd.bk))) {
+                this->orders->draw(new_cmd, clip, gly_cache);
+            }
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
+            if (this->wants_24bpp_orders()) {
                 RDPGlyphIndex new_cmd24 = /*cmd*/new_cmd;
                 new_cmd24.back_color = color_decode_opaquerect(cmd.back_color, this->mod_bpp, this->mod_palette);
                 new_cmd24.fore_color = color_decode_opaquerect(cmd.fore_color, this->mod_bpp, this->mod_palette);
-                this->capture->draw(new_cmd24, clip, gly_cache);
+                this->draw24(new_cmd24, clip, gly_cache);
             }
         }
     }
@@ -4714,9 +4948,8 @@ public:
 
             this->orders->draw(cmd2);
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)) {
-                this->capture->draw(cmd2);
+            if (this->wants_24bpp_orders()) {
+                this->draw24(cmd2);
             }
         }
     }
@@ -4746,13 +4979,14 @@ public:
                 new_cmd.BrushColor = color_encode(pen_color24, this->client_info.bpp);
             }
 
-            this->orders->draw(new_cmd, clip);
+            if (!this->output_coalesced(clip.intersect(rect))) {
+                this->orders->draw(new_cmd, clip);
+            }
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)) {
+            if (this->wants_24bpp_orders()) {
                 RDPPolygonSC new_cmd24 = cmd;
                 new_cmd24.BrushColor = color_decode_opaquerect(cmd.BrushColor, this->mod_bpp, this->mod_palette);
-                this->capture->draw(new_cmd24, clip);
+                this->draw24(new_cmd24, clip);
             }
         }
     }
@@ -4784,14 +5018,15 @@ public:
                 new_cmd.backColor = color_encode(back_pen_color24, this->client_info.bpp);
             }
 
-            this->orders->draw(new_cmd, clip);
+            if (!this->output_coalesced(clip.intersect(rect))) {
+                this->orders->draw(new_cmd, clip);
+            }
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)) {
+            if (this->wants_24bpp_orders()) {
                 RDPPolygonCB new_cmd24 = cmd;
                 new_cmd24.foreColor = color_decode_opaquerect(cmd.foreColor, this->mod_bpp, this->mod_palette);
                 new_cmd24.backColor = color_decode_opaquerect(cmd.backColor, this->mod_bpp, this->mod_palette);
-                this->capture->draw(new_cmd24, clip);
+                this->draw24(new_cmd24, clip);
             }
         }
     }
@@ -4821,13 +5056,14 @@ public:
                 new_cmd.PenColor = color_encode(pen_color24, this->client_info.bpp);
             }
 
-            this->orders->draw(new_cmd, clip);
+            if (!this->output_coalesced(clip.intersect(rect))) {
+                this->orders->draw(new_cmd, clip);
+            }
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)) {
+            if (this->wants_24bpp_orders()) {
                 RDPPolyline new_cmd24 = cmd;
                 new_cmd24.PenColor = color_decode_opaquerect(cmd.PenColor, this->mod_bpp, this->mod_palette);
-                this->capture->draw(new_cmd24, clip);
+                this->draw24(new_cmd24, clip);
             }
         }
     }
@@ -4843,13 +5079,14 @@ public:
                 const BGRColor color24 = color_decode_opaquerect(cmd.color, this->mod_bpp, this->mod_palette);
                 new_cmd.color = color_encode(color24, this->client_info.bpp);
             }
-            this->orders->draw(new_cmd, clip);
+            if (!this->output_coalesced(clip.intersect(cmd.el.get_rect()))) {
+                this->orders->draw(new_cmd, clip);
+            }
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
+            if (this->wants_24bpp_orders()) {
                 RDPEllipseSC new_cmd24 = cmd;
                 new_cmd24.color = color_decode_opaquerect(cmd.color, this->mod_bpp, this->mod_palette);
-                this->capture->draw(new_cmd24, clip);
+                this->draw24(new_cmd24, clip);
             }
         }
     }
@@ -4869,21 +5106,247 @@ public:
                 new_cmd.fore_color = color_encode(fore_color24, this->client_info.bpp);
 
             }
-            this->orders->draw(new_cmd, clip);
+            if (!this->output_coalesced(clip.intersect(cmd.el.get_rect()))) {
+                this->orders->draw(new_cmd, clip);
+            }
 
-            if (  this->capture
-               && (this->capture_state == CAPTURE_STATE_STARTED)){
+            if (this->wants_24bpp_orders()) {
                 RDPEllipseCB new_cmd24 = cmd;
                 new_cmd24.back_color = color_decode_opaquerect(cmd.back_color, this->mod_bpp, this->mod_palette);
                 new_cmd24.fore_color = color_decode_opaquerect(cmd.fore_color, this->mod_bpp, this->mod_palette);
-                this->capture->draw(new_cmd24, clip);
+                this->draw24(new_cmd24, clip);
             }
         }
     }
 
 
-    virtual void flush() {
+    // Capture and pacing shadow get orders with 24 bpp colors.
+    bool wants_24bpp_orders() const {
+        return this->pacing_shadow
+            || (this->capture && (this->capture_state == CAPTURE_STATE_STARTED));
+    }
+
+    template<class Order>
+    void draw24(const Order & order) {
+        if (this->pacing_shadow) {
+            this->pacing_shadow->draw(order);
+        }
+        if (this->capture && (this->capture_state == CAPTURE_STATE_STARTED)) {
+            this->capture->draw(order);
+        }
+    }
+
+    template<class Order>
+    void draw24(const Order & order, const Rect & clip) {
+        if (this->pacing_shadow) {
+            this->pacing_shadow->draw(order, clip);
+        }
+        if (this->capture && (this->capture_state == CAPTURE_STATE_STARTED)) {
+            this->capture->draw(order, clip);
+        }
+    }
+
+    template<class Order, class Arg>
+    void draw24(const Order & order, const Rect & clip, const Arg & arg) {
+        if (this->pacing_shadow) {
+            this->pacing_shadow->draw(order, clip, arg);
+        }
+        if (this->capture && (this->capture_state == CAPTURE_STATE_STARTED)) {
+            this->capture->draw(order, clip, arg);
+        }
+    }
+
+    void draw24(const RDPBitmapData & bitmap_data, const uint8_t * data, size_t size, const Bitmap & bmp) {
+        if (this->pacing_shadow) {
+            this->pacing_shadow->draw(bitmap_data, data, size, bmp);
+        }
+        if (this->capture && (this->capture_state == CAPTURE_STATE_STARTED)) {
+            this->capture->draw(bitmap_data, data, size, bmp);
+        }
+    }
+
+    // True while client link is behind: order covering area is not sent,
+    // area is resent later from pacing shadow. Also true while client
+    // display is suppressed, screen is repainted when it comes back.
+    bool output_coalesced(const Rect & area) {
+        if (this->display_suppressed) {
+            return true;
+        }
+        if (this->pacer && this->pacer->coalescing) {
+            this->pacer->damage.add(area);
+            return true;
+        }
+        return false;
+    }
+
+    void sample_output_queue(uint64_t now) {
+        int queued = 0;
+        const int sck = this->trans->get_native_object();
+        if ((sck < 0) || (ioctl(sck, TIOCOUTQ, &queued) < 0)) {
+            queued = 0;
+        }
+        this->pacer->sample(now, queued, this->trans->total_sent);
+    }
+
+    // Sends pending orders, or, while coalescing, damaged tiles of pacing
+    // shadow once client link drained enough and frame rate allows it.
+    void paced_flush() {
+        const uint64_t now = ustime();
+        this->sample_output_queue(now);
+        if (this->pacer->coalescing) {
+            if (!this->pacer->can_send_frame(now)) {
+                this->pacing_event.set(this->pacer->time_to_wait(now));
+                return;
+            }
+            this->pacer->coalescing = false;
+            this->send_damage();
+        }
         this->orders->flush();
+        this->pacer->frame_sent(now);
+
+        this->sample_output_queue(now);
+        this->pacer->coalescing = this->pacer->congested();
+        if (this->pacer->coalescing) {
+            if (this->verbose & 64) {
+                LOG(LOG_INFO, "Front::paced_flush: client link behind (%llu usec queued), coalescing output",
+                    static_cast<unsigned long long>(this->pacer->queued_latency()));
+            }
+            this->pacing_event.set(this->pacer->time_to_wait(now));
+        }
+        else {
+            this->pacing_event.reset();
+        }
+    }
+
+    // Damaged tiles of pacing shadow are sent as MemBlt of 24 bpp bitmaps.
+    void send_damage() {
+        struct DamagedAreas : public Rect::RectIterator {
+            std::vector<Rect> rects;
+            uint16_t tile_size;
+
+            explicit DamagedAreas(uint16_t tile_size)
+            : tile_size(tile_size)
+            {}
+
+            virtual void callback(const Rect & rect) {
+                for (uint16_t y = 0; y < rect.cy; y += this->tile_size) {
+                    for (uint16_t x = 0; x < rect.cx; x += this->tile_size) {
+                        this->rects.push_back(Rect( rect.x + x, rect.y + y
+                                                  , std::min<uint16_t>(this->tile_size, rect.cx - x)
+                                                  , std::min<uint16_t>(this->tile_size, rect.cy - y)));
+                    }
+                }
+            }
+        } areas(this->fits_one_cache_entry(DamageTiles::TILE_SIZE, DamageTiles::TILE_SIZE)
+               ? DamageTiles::TILE_SIZE : DamageTiles::TILE_SIZE / 2);
+        this->pacer->damage.drain(areas);
+        this->send_tiles(this->pacing_shadow->drawable, areas.rects);
+    }
+
+    // Areas of drawable (at most one tile large) are sent as MemBlt of 24 bpp bitmaps.
+    void send_tiles(const Drawable & drawable, const std::vector<Rect> & rects) {
+        if (rects.empty()) {
+            return;
+        }
+
+        this->send_global_palette();
+
+        uint8_t tile[DamageTiles::TILE_SIZE * DamageTiles::TILE_SIZE * 3];
+        std::vector<const Bitmap *> tiles;
+        tiles.reserve(rects.size());
+        for (size_t i = 0; i < rects.size(); i++) {
+            const Rect & r = rects[i];
+            // bitmap rows are stored bottom-up, packed 24 bpp
+            for (uint16_t row = 0; row < r.cy; row++) {
+                Drawable::pixels_to_packed24( tile + (r.cy - row - 1) * r.cx * 3
+                                            , drawable.data + (r.y + row) * drawable.rowsize + r.x * Drawable::Bpp
+                                            , r.cx);
+            }
+            tiles.push_back(new Bitmap(24, 24, NULL, r.cx, r.cy, tile, r.cx * r.cy * 3));
+        }
+        this->precompress_bitmaps(&tiles[0], tiles.size());
+        for (size_t i = 0; i < tiles.size(); i++) {
+            this->orders->draw(RDPMemBlt(0, rects[i], 0xCC, 0, 0, 0), rects[i], *tiles[i]);
+            delete tiles[i];
+        }
+    }
+
+    // Proxy copy of client screen, pacing shadow or screen of running
+    // capture, NULL if there is none (or if tiles can't be sent from it).
+    const Drawable * framebuffer() {
+        if (this->client_info.bpp == 8) {
+            return NULL;
+        }
+        if (this->pacing_shadow) {
+            return &this->pacing_shadow->drawable;
+        }
+        if (this->capture && (this->capture_state == CAPTURE_STATE_STARTED)) {
+            return this->capture->framebuffer();
+        }
+        return NULL;
+    }
+
+    // Client screen areas are sent from proxy framebuffer instead of asking
+    // module to redraw them, false if there is no framebuffer.
+    bool repaint_from_framebuffer(const DArray<Rect> & areas) {
+        const Drawable * drawable = this->framebuffer();
+        if (!drawable) {
+            return false;
+        }
+
+        const uint16_t tile_size = this->fits_one_cache_entry(DamageTiles::TILE_SIZE, DamageTiles::TILE_SIZE)
+                                 ? DamageTiles::TILE_SIZE : DamageTiles::TILE_SIZE / 2;
+        std::vector<Rect> tiles;
+        for (size_t i = 0; i < areas.size(); i++) {
+            const Rect area = areas[i].intersect(drawable->width, drawable->height);
+            for (uint16_t y = 0; y < area.cy; y += tile_size) {
+                for (uint16_t x = 0; x < area.cx; x += tile_size) {
+                    tiles.push_back(Rect( area.x + x, area.y + y
+                                        , std::min<uint16_t>(tile_size, area.cx - x)
+                                        , std::min<uint16_t>(tile_size, area.cy - y)));
+                }
+            }
+        }
+        this->send_tiles(*drawable, tiles);
+        this->orders->flush();
+        return true;
+    }
+
+    void suppress_display_updates(Callback & cb) {
+        if (this->display_suppressed) {
+            return;
+        }
+        this->display_suppressed = true;
+        if (!this->capture || (this->capture_state != CAPTURE_STATE_STARTED)) {
+            this->mod_display_suppressed = true;
+            cb.rdp_suppress_display_updates();
+        }
+    }
+
+    void allow_display_updates(Callback & cb, uint16_t left, uint16_t top, uint16_t right, uint16_t bottom) {
+        if (!this->display_suppressed) {
+            return;
+        }
+        this->display_suppressed = false;
+        if (this->mod_display_suppressed) {
+            this->mod_display_suppressed = false;
+            cb.rdp_allow_display_updates(left, top, right, bottom);
+            return;
+        }
+        DArray<Rect> areas(1);
+        areas[0] = Rect(left, top, right - left + 1, bottom - top + 1);
+        if (!this->repaint_from_framebuffer(areas)) {
+            cb.rdp_input_invalidate2(areas);
+        }
+    }
+
+    virtual void flush() {
+        if (this->pacer) {
+            this->paced_flush();
+        }
+        else {
+            this->orders->flush();
+        }
         if (  this->capture
            && (this->capture_state == CAPTURE_STATE_STARTED)) {
             this->capture->flush();
@@ -4924,12 +5387,12 @@ public:
     }
 
     virtual void draw(const RDP::FrameMarker & order) {
-        if (this->client_order_caps.orderSupportExFlags & ORDERFLAGS_EX_ALTSEC_FRAME_MARKER_SUPPORT) {
+        if ((this->client_order_caps.orderSupportExFlags & ORDERFLAGS_EX_ALTSEC_FRAME_MARKER_SUPPORT)
+        && !(this->pacer && this->pacer->coalescing)) {
             this->orders->draw(order);
         }
-        if (  this->capture
-           && (this->capture_state == CAPTURE_STATE_STARTED)) {
-            this->capture->draw(order);
+        if (this->wants_24bpp_orders()) {
+            this->draw24(order);
         }
     }
 
@@ -4944,10 +5407,13 @@ public:
     virtual void draw(const RDPBitmapData & bitmap_data, const uint8_t * data
                      , size_t size, const Bitmap & bmp) {
         //LOG(LOG_INFO, "Front::draw(BitmapUpdate)");
-        this->orders->draw(bitmap_data, data, size, bmp);
-        if (  this->capture
-           && (this->capture_state == CAPTURE_STATE_STARTED)) {
-            this->capture->draw(bitmap_data, data, size, bmp);
+        if (!this->output_coalesced(Rect( bitmap_data.dest_left, bitmap_data.dest_top
+                                        , bitmap_data.dest_right - bitmap_data.dest_left + 1
+                                        , bitmap_data.dest_bottom - bitmap_data.dest_top + 1))) {
+            this->orders->draw(bitmap_data, data, size, bmp);
+        }
+        if (this->wants_24bpp_orders()) {
+            this->draw24(bitmap_data, data, size, bmp);
         }
     }
 };
@@ -0,0 +1,34 @@
+#!/bin/bash
+
+[ -z "$*" ] && echo $0 'filename.cpp [g++-options]' >&2 && exit 1
+
+root=$(dirname $0)/../../..
+
+g++ \
+-Wall \
+-Wextra \
+-Wundef \
+-Wchar-subscripts \
+-Wformat-security \
+-Wformat \
+-Wformat=2 \
+-Werror-implicit-function-declaration \
+-Wsequence-point \
+-Wreturn-type \
+-Wpointer-arith \
+-Wsign-compare \
+-Wmissing-format-attribute \
+-Wredundant-decls \
+-Winit-self \
+-Woverloaded-virtual \
+-Wnon-virtual-dtor \
+-O3 \
+-march=native \
+-DNDEBUG \
+-I $root/utils \
+-I $root/core \
+-I $root/main \
+-I $root/transport \
+-I $root/headers \
+"$@" \
+-lcrypto -lpng -lz
@@ -0,0 +1,173 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *   Product name: redemption, a FLOSS RDP proxy
+ *   Copyright (C) Wallix 2014
+ *   Author(s): Christophe Grosjean, Raphael Zhou
+ *
+ *   Drawable primitives on a full HD framebuffer:
+ *     ./build.sh primitives.cpp && ./a.out
+ */
+
+#include <iostream>
+#include <boost/timer.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+#include "drawable.hpp"
+
+class display_timer
+{
+    boost::timer timer;
+    unsigned n;
+public:
+    explicit display_timer(unsigned n)
+    : n(n)
+    {}
+
+    ~display_timer()
+    {
+        const double elapsed = this->timer.elapsed();
+        std::ios::fmtflags old_flags = std::cout.setf(std::istream::fixed, std::istream::floatfield);
+        std::streamsize old_prec = std::cout.precision(2);
+        std::cout << elapsed << " s\t(" << (elapsed * 1000000. / this->n) << " us/op)" << std::endl;
+        std::cout.flags(old_flags);
+        std::cout.precision(old_prec);
+    }
+};
+
+enum {
+    WIDTH  = 1920,
+    HEIGHT = 1080
+};
+
+template<typename Test>
+void bench(const char * name, Drawable & drawable, const Bitmap & bmp, unsigned n)
+{
+    std::cout << name << ":\t";
+    display_timer timer(n);
+    for (unsigned i = 0; i < n; ++i) {
+        Test::exec(drawable, bmp, i);
+    }
+}
+
+// full screen and small (64x64) variants cycle over the screen
+static Rect rect_for(unsigned i, uint16_t cx, uint16_t cy)
+{
+    return Rect((i * 37) % (WIDTH - cx + 1), (i * 53) % (HEIGHT - cy + 1), cx, cy);
+}
+
+struct test_opaquerect
+{
+    static void exec(Drawable & d, const Bitmap &, unsigned i)
+    { d.opaquerect(rect_for(i, WIDTH, HEIGHT), 0x102030 + i); }
+};
+
+struct test_opaquerect_small
+{
+    static void exec(Drawable & d, const Bitmap &, unsigned i)
+    { d.opaquerect(rect_for(i, 64, 64), 0x102030 + i); }
+};
+
+struct test_scrblt
+{
+    static void exec(Drawable & d, const Bitmap &, unsigned i)
+    { d.scrblt(0, (i & 1) ? 0 : 16, Rect(0, (i & 1) ? 16 : 0, WIDTH, HEIGHT - 16), 0xCC); }
+};
+
+struct test_scrblt_xor
+{
+    static void exec(Drawable & d, const Bitmap &, unsigned i)
+    { d.scrblt(16, 16, Rect(0, 0, WIDTH - 16, HEIGHT - 16), 0x66); }
+};
+
+struct test_patblt_xor
+{
+    static void exec(Drawable & d, const Bitmap &, unsigned i)
+    { d.patblt(rect_for(i, WIDTH, HEIGHT), 0x5A, 0x00FF00); }
+};
+
+struct test_patblt_brush
+{
+    static void exec(Drawable & d, const Bitmap &, unsigned i)
+    {
+        const uint8_t brush[8] = { 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55 };
+        d.patblt_ex(rect_for(i, WIDTH, HEIGHT), 0xF0, 0x000000, 0xFFFFFF, brush);
+    }
+};
+
+// dithered desktop backgrounds come as many small PatBlt with a checker brush
+struct test_patblt_brush_small
+{
+    static void exec(Drawable & d, const Bitmap &, unsigned i)
+    {
+        const uint8_t brush[8] = { 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55 };
+        d.patblt_ex(rect_for(i, 64, 64), 0xF0, 0x000000, 0xFFFFFF, brush);
+    }
+};
+
+struct test_patblt_brush_line
+{
+    static void exec(Drawable & d, const Bitmap &, unsigned i)
+    {
+        const uint8_t brush[8] = { 0x88, 0x22, 0x88, 0x22, 0x88, 0x22, 0x88, 0x22 };
+        d.patblt_ex(rect_for(i, WIDTH, 4), 0xF0, 0x336699, 0xFFFFFF, brush);
+    }
+};
+
+struct test_memblt
+{
+    static void exec(Drawable & d, const Bitmap & bmp, unsigned i)
+    { d.mem_blt(rect_for(i, bmp.cx, bmp.cy), bmp, 0, 0, 0, false); }
+};
+
+struct test_memblt_and
+{
+    static void exec(Drawable & d, const Bitmap & bmp, unsigned i)
+    { d.mem_blt_ex(rect_for(i, bmp.cx, bmp.cy), bmp, 0, 0, 0x88, false); }
+};
+
+struct test_mem3blt
+{
+    static void exec(Drawable & d, const Bitmap & bmp, unsigned i)
+    { d.mem_3_blt(rect_for(i, bmp.cx, bmp.cy), bmp, 0, 0, 0xB8, 0x808080, false); }
+};
+
+int main()
+{
+    Drawable drawable(WIDTH, HEIGHT);
+
+    uint8_t * raw = new uint8_t[256 * 256 * 3];
+    for (unsigned i = 0; i < 256 * 256 * 3; ++i) {
+        raw[i] = static_cast<uint8_t>(i * 7);
+    }
+    Bitmap bmp(24, 24, NULL, 256, 256, raw, 256 * 256 * 3);
+    delete [] raw;
+
+    std::cout << "Drawable " << WIDTH << "x" << HEIGHT
+              << ", " << Drawable::Bpp << " bytes per pixel\n\n";
+
+    bench<test_opaquerect>      ("opaquerect 1920x1080", drawable, bmp, 500);
+    bench<test_opaquerect_small>("opaquerect 64x64    ", drawable, bmp, 200000);
+    bench<test_scrblt>          ("scrblt 0xCC         ", drawable, bmp, 500);
+    bench<test_scrblt_xor>      ("scrblt 0x66         ", drawable, bmp, 500);
+    bench<test_patblt_xor>      ("patblt 0x5A         ", drawable, bmp, 500);
+    bench<test_patblt_brush>    ("patblt_ex 0xF0      ", drawable, bmp, 500);
+    bench<test_patblt_brush_small>("patblt_ex 0xF0 64x64", drawable, bmp, 200000);
+    bench<test_patblt_brush_line>("patblt_ex 0xF0 1920x4", drawable, bmp, 50000);
+    bench<test_memblt>          ("memblt 256x256      ", drawable, bmp, 20000);
+    bench<test_memblt_and>      ("memblt 0x88 256x256 ", drawable, bmp, 20000);
+    bench<test_mem3blt>         ("mem3blt 0xB8 256x256", drawable, bmp, 20000);
+}
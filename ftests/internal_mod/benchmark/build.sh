@@ -0,0 +1,43 @@
+#!/bin/bash
+
+[ -z "$*" ] && echo $0 'filename.cpp [g++-options]' >&2 && exit 1
+
+root=$(dirname $0)/../../..
+
+g++ \
+-Wall \
+-Wextra \
+-Wundef \
+-Wchar-subscripts \
+-Wformat-security \
+-Wformat \
+-Wformat=2 \
+-Werror-implicit-function-declaration \
+-Wsequence-point \
+-Wreturn-type \
+-Wpointer-arith \
+-Wsign-compare \
+-Wmissing-format-attribute \
+-Wredundant-decls \
+-Winit-self \
+-Woverloaded-virtual \
+-Wnon-virtual-dtor \
+-O3 \
+-march=native \
+-DNDEBUG \
+-I $root/utils \
+-I $root/core \
+-I $root/main \
+-I $root/transport \
+-I $root/headers \
+-I $root/mod \
+-I $root/mod/internal \
+-I $root/front \
+-I $root/acl \
+-I $root/capture \
+-I $root/keyboard \
+-I $root/regex \
+-DFIXTURES_PATH="\"$root/tests/fixtures\"" \
+$root/transport/rio/cryptofile.cpp \
+"$@" \
+-lssl -lcrypto -lpng -lz -lsnappy -ldl
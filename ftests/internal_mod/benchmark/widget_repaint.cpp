@@ -0,0 +1,249 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *   Product name: redemption, a FLOSS RDP proxy
+ *   Copyright (C) Wallix 2014
+ *   Author(s): Christophe Grosjean, Raphael Zhou
+ *
+ *   Orders sent to front by widget repaints of internal modules, with and
+ *   without shadow screen:
+ *     ./build.sh widget_repaint.cpp && ./a.out
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <boost/timer.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+#include "font.hpp"
+#include "RDP/RDPDrawable.hpp"
+#include "shadow_screen.hpp"
+#include "widget2/screen.hpp"
+#include "widget2/flat_selector2.hpp"
+#include "widget2/flat_login.hpp"
+
+enum {
+    WIDTH  = 1024,
+    HEIGHT = 768
+};
+
+// Front stand-in: counts orders and client pixels they draw.
+class CountingFront : public DrawApi
+{
+    Font font;
+
+public:
+    unsigned long      orders;
+    unsigned long long pixels;
+    unsigned long      text_chars;
+
+    CountingFront()
+    : font(FIXTURES_PATH "/dejavu-sans-10.fv1")
+    , orders(0)
+    , pixels(0)
+    , text_chars(0)
+    {}
+
+    void count(const Rect & rect)
+    {
+        this->orders++;
+        this->pixels += rect.intersect(WIDTH, HEIGHT).cx * rect.intersect(WIDTH, HEIGHT).cy;
+    }
+
+    virtual void draw(const RDPOpaqueRect & cmd, const Rect & clip) { this->count(clip.intersect(cmd.rect)); }
+    virtual void draw(const RDPScrBlt & cmd, const Rect & clip) { this->count(clip.intersect(cmd.rect)); }
+    virtual void draw(const RDPDestBlt & cmd, const Rect & clip) { this->count(clip.intersect(cmd.rect)); }
+    virtual void draw(const RDPMultiDstBlt &, const Rect & clip) { this->count(clip); }
+    virtual void draw(const RDPMultiOpaqueRect &, const Rect & clip) { this->count(clip); }
+    virtual void draw(const RDP::RDPMultiPatBlt &, const Rect & clip) { this->count(clip); }
+    virtual void draw(const RDP::RDPMultiScrBlt &, const Rect & clip) { this->count(clip); }
+    virtual void draw(const RDPPatBlt & cmd, const Rect & clip) { this->count(clip.intersect(cmd.rect)); }
+    virtual void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap &) { this->count(clip.intersect(cmd.rect)); }
+    virtual void draw(const RDPMem3Blt & cmd, const Rect & clip, const Bitmap &) { this->count(clip.intersect(cmd.rect)); }
+    virtual void draw(const RDPLineTo &, const Rect & clip) { this->count(clip); }
+    virtual void draw(const RDPGlyphIndex &, const Rect & clip, const GlyphCache *) { this->count(clip); }
+    virtual void draw(const RDPPolygonSC &, const Rect & clip) { this->count(clip); }
+    virtual void draw(const RDPPolygonCB &, const Rect & clip) { this->count(clip); }
+    virtual void draw(const RDPPolyline &, const Rect & clip) { this->count(clip); }
+    virtual void draw(const RDPEllipseSC &, const Rect & clip) { this->count(clip); }
+    virtual void draw(const RDPEllipseCB &, const Rect & clip) { this->count(clip); }
+
+    virtual void begin_update() {}
+    virtual void end_update() {}
+
+    virtual void server_draw_text(int16_t x, int16_t y, const char * text,
+                                  uint32_t, uint32_t, const Rect & clip)
+    {
+        int w = 0;
+        int h = 0;
+        this->text_metrics(text, w, h);
+        this->count(clip.intersect(Rect(x, y, w + 1, h + 1)));
+        this->text_chars += strlen(text);
+    }
+
+    virtual void text_metrics(const char * text, int & width, int & height)
+    {
+        width = 0;
+        height = 0;
+        uint32_t uni[256];
+        const size_t len_uni = UTF8toUnicode(reinterpret_cast<const uint8_t *>(text), uni, sizeof(uni)/sizeof(uni[0]));
+        if (len_uni) {
+            for (size_t index = 0; index < len_uni; index++) {
+                const FontChar * font_item = RDPDrawable::get_font(this->font, uni[index]);
+                width += font_item->width + 2;
+                height = std::max(height, font_item->height);
+            }
+            width -= 2;
+        }
+    }
+};
+
+struct Scenario
+{
+    virtual ~Scenario() {}
+    virtual void exec(unsigned i) = 0;
+};
+
+// selector pages: group and protocol columns, filters and buttons are the
+// same from one page to another, only targets change
+struct SelectorScenario : Scenario
+{
+    WidgetScreen        screen;
+    WidgetSelectorFlat2 selector;
+    bool                flip;
+
+    SelectorScenario(DrawApi & drawable, Inifile & ini, bool flip)
+    : screen(drawable, WIDTH, HEIGHT)
+    , selector(drawable, "user@10.10.0.1", WIDTH, HEIGHT, this->screen, NULL, "1", "50", 0, 0, 0, ini)
+    , flip(flip)
+    {
+        this->fill_page(0);
+        this->selector.rearrange();
+    }
+
+    void fill_page(unsigned page)
+    {
+        this->selector.selector_lines.clear();
+        for (unsigned i = 0; i < 20; i++) {
+            char target[64];
+            snprintf(target, sizeof(target), "administrator@win2008-%03u.domain.lan", page * 20 + i);
+            this->selector.add_device((i < 10) ? "admins" : "operators", target, "RDP");
+        }
+        this->selector.selector_lines.set_selection(0);
+    }
+
+    virtual void exec(unsigned i)
+    {
+        if (this->flip) {
+            this->fill_page(i % 50);
+            char page[8];
+            snprintf(page, sizeof(page), "%u", i % 50 + 1);
+            this->selector.current_page.set_text(page);
+        }
+        this->selector.refresh(this->selector.rect);
+    }
+};
+
+// password typed in login box, the box is refreshed on each key
+struct LoginScenario : Scenario
+{
+    WidgetScreen screen;
+    FlatLogin    login;
+    char         password[64];
+
+    LoginScenario(DrawApi & drawable, Inifile & ini)
+    : screen(drawable, WIDTH, HEIGHT)
+    , login(drawable, WIDTH, HEIGHT, this->screen, NULL, "Redemption", true, 0,
+            "user", "", "Login", "Password", ini)
+    {
+        this->password[0] = 0;
+    }
+
+    virtual void exec(unsigned i)
+    {
+        const size_t len = i % 32;
+        memset(this->password, 'x', len);
+        this->password[len] = 0;
+        this->login.password_edit.set_text(this->password);
+        this->login.refresh(this->login.rect);
+    }
+};
+
+template<typename Factory>
+void bench(const char * name, unsigned n)
+{
+    Inifile ini;
+    CountingFront front_direct;
+    CountingFront front_shadow;
+    ShadowScreen shadow(front_shadow, WIDTH, HEIGHT);
+
+    Scenario * direct = Factory::make(front_direct, ini);
+    Scenario * through_shadow = Factory::make(shadow, ini);
+    direct->exec(0);
+    through_shadow->exec(0);
+    front_direct.orders = front_shadow.orders = 0;
+    front_direct.pixels = front_shadow.pixels = 0;
+    front_direct.text_chars = front_shadow.text_chars = 0;
+
+    boost::timer timer;
+    for (unsigned i = 1; i <= n; ++i) {
+        direct->exec(i);
+    }
+    const double elapsed_direct = timer.elapsed();
+    timer.restart();
+    for (unsigned i = 1; i <= n; ++i) {
+        through_shadow->exec(i);
+    }
+    const double elapsed_shadow = timer.elapsed();
+
+    delete direct;
+    delete through_shadow;
+
+    std::cout << std::fixed << std::setprecision(1) << name << "\n"
+              << "  direct: " << std::setw(8) << double(front_direct.orders) / n << " orders, "
+              << std::setw(9) << double(front_direct.pixels) / n << " pixels, "
+              << std::setw(7) << double(front_direct.text_chars) / n << " text chars, "
+              << std::setprecision(2) << elapsed_direct * 1000000. / n << " us/repaint\n"
+              << std::setprecision(1)
+              << "  shadow: " << std::setw(8) << double(front_shadow.orders) / n << " orders, "
+              << std::setw(9) << double(front_shadow.pixels) / n << " pixels, "
+              << std::setw(7) << double(front_shadow.text_chars) / n << " text chars, "
+              << std::setprecision(2) << elapsed_shadow * 1000000. / n << " us/repaint\n";
+}
+
+struct selector_flip
+{
+    static Scenario * make(DrawApi & d, Inifile & ini) { return new SelectorScenario(d, ini, true); }
+};
+
+struct selector_redraw
+{
+    static Scenario * make(DrawApi & d, Inifile & ini) { return new SelectorScenario(d, ini, false); }
+};
+
+struct login_typing
+{
+    static Scenario * make(DrawApi & d, Inifile & ini) { return new LoginScenario(d, ini); }
+};
+
+int main()
+{
+    std::cout << "Widget repaints on " << WIDTH << "x" << HEIGHT << " screen, per repaint\n\n";
+
+    bench<selector_flip>  ("selector page flip (20 lines)", 200);
+    bench<selector_redraw>("selector redraw, same page   ", 200);
+    bench<login_typing>   ("login box, password typed    ", 200);
+}
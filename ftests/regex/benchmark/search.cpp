@@ -23,13 +23,16 @@
 
 #include <regex.h>
 #include <pcre.h>
+#include <boost/xpressive/xpressive.hpp>
+
+#include <string>
 
 struct test_search
 {
     re::Regex regex;
 
-    test_search(const char * pattern, bool optimize_mem = false)
-    : regex(pattern, optimize_mem)
+    test_search(const char * pattern, re::Regex::flag_t flags = re::Regex::DEFAULT_FLAG)
+    : regex(pattern, flags)
     {}
 
     bool check_pre_condition(const char * s)
@@ -47,14 +50,33 @@ struct test_search_optimize_mem
 : test_search
 {
     test_search_optimize_mem(const char* pattern)
-    : test_search(pattern, true)
+    : test_search(pattern, re::Regex::OPTIMIZE_MEMORY)
     {}
 };
 
+struct test_search_lazy_dfa
+: test_search
+{
+    test_search_lazy_dfa(const char* pattern)
+    : test_search(pattern, re::Regex::LAZY_DFA)
+    {}
+};
+
+// NFA without step_limit (large inputs)
+struct test_search_no_limit
+: test_search
+{
+    test_search_no_limit(const char* pattern)
+    : test_search(pattern)
+    {
+        this->regex.step_limit = -1u;
+    }
+};
+
 struct test_search_capture : test_search
 {
-    test_search_capture(const char * pattern, bool optimize_mem = false)
-    : test_search(pattern, optimize_mem)
+    test_search_capture(const char * pattern, re::Regex::flag_t flags = re::Regex::DEFAULT_FLAG)
+    : test_search(pattern, flags)
     {}
 
     void exec(const char * s)
@@ -67,7 +89,7 @@ struct test_search_capture_optimize_mem
 : test_search_capture
 {
     test_search_capture_optimize_mem(const char* pattern)
-    : test_search_capture(pattern, true)
+    : test_search_capture(pattern, re::Regex::OPTIMIZE_MEMORY)
     {}
 };
 
@@ -200,6 +222,33 @@ struct test_posix_search_capture : test_posix_search
     }
 };
 
+struct test_xpressive_search
+{
+    boost::xpressive::cregex rgx;
+    bool err;
+
+    test_xpressive_search(const char * pattern)
+    : err(false)
+    {
+        try {
+            this->rgx = boost::xpressive::cregex::compile(pattern);
+        }
+        catch (const boost::xpressive::regex_error &) {
+            this->err = true;
+        }
+    }
+
+    bool check_pre_condition(const char * s)
+    {
+        return !this->err && boost::xpressive::regex_search(s, this->rgx);
+    }
+
+    void exec(const char * s)
+    {
+        boost::xpressive::regex_search(s, this->rgx);
+    }
+};
+
 template<typename BaseTest>
 class Bench
 {
@@ -229,12 +278,59 @@ class Bench
         { return this->test.exec(s); }
     };
 
-    static void test(Test & test, const char * s)
+    static void test(Test & test, const char * s, unsigned n = 600000u)
     {
-        ::test(basic_benchmark<ref_test>(test.pattern, ref_test(test)), 600000u, s);
+        ::test(basic_benchmark<ref_test>(test.pattern, ref_test(test)), n, s);
     }
 
 public:
+    // 1MB texts, match (if any) at the end
+    static void large()
+    {
+        display_timer timer;
+
+        const size_t size = 1024 * 1024;
+        std::string xs(size, 'x');
+        xs += 'y';
+
+        std::string words;
+        uint32_t seed = 42;
+        while (words.size() < size) {
+            seed = seed * 1103515245 + 12345;
+            words += "lorem ipsum dolor sit amet 0123 abc "[(seed >> 16) % 36];
+        }
+        const std::string words_match = words + "abc42def 555-1234";
+
+        std::string ab;
+        while (ab.size() < size) {
+            seed = seed * 1103515245 + 12345;
+            ab += ((seed >> 16) & 1) ? 'a' : 'b';
+        }
+
+        {
+            Test t("x*y");
+            test(t, xs.c_str(), 20);
+        }
+        {
+            Test t("abc[0-9]+def");
+            test(t, words_match.c_str(), 20);
+        }
+        {
+            Test t("\\d\\d\\d-\\d\\d\\d\\d");
+            test(t, words_match.c_str(), 20);
+        }
+        {
+            Test t("[ab]*a[ab][ab][ab][ab][ab][ab]$");
+            test(t, ab.c_str(), 20);
+        }
+        {
+            Test t("(ipsum|dolor|amet|abc)[a-z ]*42");
+            test(t, words_match.c_str(), 20);
+        }
+
+        std::cout << "\ntotal: ";
+    }
+
     Bench()
     {
         display_timer timer;
@@ -368,4 +464,17 @@ int main()
     Bench<test_posix_search>();
     std::cout << "\n\nposix search with capture:\n";
     Bench<test_posix_search_capture>();
+    std::cout << "\n\nsearch (lazy_dfa):\n";
+    Bench<test_search_lazy_dfa>();
+    std::cout << "\n\nxpressive search:\n";
+    Bench<test_xpressive_search>();
+
+    std::cout << "\n\nlarge input search (no step limit):\n";
+    Bench<test_search_no_limit>::large();
+    std::cout << "\n\nlarge input search (lazy_dfa):\n";
+    Bench<test_search_lazy_dfa>::large();
+    std::cout << "\n\nlarge input pcre search:\n";
+    Bench<test_pcre_search>::large();
+    std::cout << "\n\nlarge input xpressive search:\n";
+    Bench<test_xpressive_search>::large();
 }
@@ -155,10 +155,85 @@ void posix_test(const char * str, const char * rgx,
     }
 }
 
+#include <sys/time.h>
+#include "regex.hpp"
+
+static double elapsed_since(const timeval & start)
+{
+    timeval now;
+    gettimeofday(&now, 0);
+    return (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1000000.;
+}
+
+// search on large generated text: boost::xpressive, re::Regex (NFA without
+// step limit) and re::Regex with LAZY_DFA must agree
+void large_test(size_t size, uint iteration)
+{
+    std::string text;
+    uint32_t seed = 42;
+    while (text.size() < size) {
+        seed = seed * 1103515245 + 12345;
+        text += "lorem ipsum dolor sit amet 0123 abc \n"[(seed >> 16) % 37];
+    }
+    text += "abc42def 555-1234";
+
+    const char * patterns[] = {
+        "abc[0-9]+def",
+        "\\d\\d\\d-\\d\\d\\d\\d",
+        "(ipsum|dolor|amet|abc)[a-z ]*42",
+        "[0-3]+ [a-z]+ [0-3]+ [a-z]+ [0-3]+ ",
+        "zzz",
+    };
+
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); ++i) {
+        const char * pattern = patterns[i];
+        typedef boost::xpressive::cregex cregex;
+        cregex xrgx = cregex::compile(pattern);
+        re::Regex nfa(pattern, re::Regex::DEFAULT_FLAG, -1u);
+        re::Regex dfa(pattern, re::Regex::LAZY_DFA, -1u);
+
+        bool xres = false;
+        bool nres = false;
+        bool dres = false;
+        timeval start;
+
+        gettimeofday(&start, 0);
+        for (uint n = 0; n < iteration; ++n) {
+            xres = boost::xpressive::regex_search(text.c_str(), xrgx);
+        }
+        const double xtime = elapsed_since(start);
+
+        gettimeofday(&start, 0);
+        for (uint n = 0; n < iteration; ++n) {
+            nres = nfa.search(text.c_str());
+        }
+        const double ntime = elapsed_since(start);
+
+        gettimeofday(&start, 0);
+        for (uint n = 0; n < iteration; ++n) {
+            dres = dfa.search(text.c_str());
+        }
+        const double dtime = elapsed_since(start);
+
+        std::cout << pattern << "\n\txpressive: " << xres << " " << xtime << " s"
+                  << "\n\tre nfa:    " << nres << " " << ntime << " s"
+                  << "\n\tre dfa:    " << dres << " " << dtime << " s"
+                  << (dfa.has_dfa() ? "" : " (fallback to nfa)") << "\n";
+        if (xres != nres || xres != dres) {
+            throw std::runtime_error("results differ");
+        }
+    }
+}
+
 int main(int argc, char ** argv)
 {
     if (argc < 2) {
-        std::cout << argv[0] << "posix|boost [iteration] [text]\n";
+        std::cout << argv[0] << "posix|boost [iteration] [text]\n"
+                  << argv[0] << "large [iteration] [size]\n";
+    }
+    if (argc > 1 && argv[1][0] == 'l') {
+        large_test(argc == 4 ? atoi(argv[3]) : 4 * 1024 * 1024, argc >= 3 ? atoi(argv[2]) : 5);
+        return 0;
     }
     uint iteration = argc >= 3 ? atoi(argv[2]) : 1;
     const char * text = argc == 4 ? argv[3] : "a{b{c{d}}e}";
@@ -25,8 +25,10 @@
 #include <iostream>
 
 #include <boost/program_options/options_description.hpp>
+#include <boost/program_options/positional_options.hpp>
 #include <utility>
 #include <string>
+#include <vector>
 
 #define LOGPRINT
 #include "version.hpp"
@@ -35,6 +37,52 @@
 #include "inbymetasequencetransport.hpp"
 #include "capture.hpp"
 #include "FileToGraphic.hpp"
+#include "keystroke_index.hpp"
+
+// One line per occurrence of text typed in given recordings (.mwrm or .kidx):
+// recording, begin and end of typing (seconds, usable with --begin), offset
+// from movie start, wrm file number and some typed text around.
+static int search_keystrokes(const std::string & text, const std::vector<std::string> & files)
+{
+    int return_code = 0;
+    for (size_t f = 0; f < files.size(); f++) {
+        std::string kidx_path = files[f];
+        const size_t ext = kidx_path.rfind(".mwrm");
+        if ((ext != std::string::npos) && (ext + 5 == kidx_path.size())) {
+            kidx_path.replace(ext, 5, ".kidx");
+        }
+
+        KeystrokeIndexReader index;
+        if (!index.open(kidx_path.c_str())) {
+            fprintf(stderr, "%s: no keystroke index\n", kidx_path.c_str());
+            return_code = -1;
+            continue;
+        }
+
+        std::vector<KeystrokeIndexReader::Match> matches;
+        index.search(text.c_str(), matches);
+        for (size_t i = 0; i < matches.size(); i++) {
+            const KeystrokeIndexReader::Match & m = matches[i];
+
+            const uint32_t before  = std::min<uint32_t>(m.position, 16);
+            size_t         size    = before + text.size() + 16;
+            const char *   context = index.text_at(m.position - before, size);
+            std::string    printable(context, size);
+            for (size_t c = 0; c < printable.size(); c++) {
+                if (static_cast<uint8_t>(printable[c]) < 0x20) {
+                    printable[c] = '.';
+                }
+            }
+
+            printf("%s\t%u\t%u\t+%u\twrm=%u\t%s\n", files[f].c_str()
+                  , static_cast<unsigned>(m.begin / 1000000)
+                  , static_cast<unsigned>((m.time + 999999) / 1000000)
+                  , static_cast<unsigned>((m.begin - std::min(m.begin, index.start_time)) / 1000000)
+                  , m.wrm_index, printable.c_str());
+        }
+    }
+    return return_code;
+}
 
 
 int main(int argc, char** argv)
@@ -51,6 +99,8 @@ int main(int argc, char** argv)
 
     std::string input_filename;
     std::string output_filename;
+    std::string search_text;
+    std::vector<std::string> search_files;
 
     uint32_t verbose = 0;
     uint32_t clear = 1; // default on
@@ -86,20 +136,40 @@ int main(int argc, char** argv)
     ("clear", boost::program_options::value<uint32_t>(&clear), "Clear old capture files with same prefix (default on)")
     ("verbose", boost::program_options::value<uint32_t>(&verbose), "more logs")
     ("zoom", boost::program_options::value<uint32_t>(&zoom), "scaling factor for png capture (default 100%)")
+
+    ("search,s", boost::program_options::value(&search_text), "search typed text in keystroke indexes of recordings (given by --input-file and/or as arguments), no output file")
+    ("recordings", boost::program_options::value(&search_files), "recordings to search (.mwrm or .kidx)")
     ;
 
+    boost::program_options::positional_options_description p;
+    p.add("recordings", -1);
+
     Inifile ini;
 
     try {
         boost::program_options::variables_map options;
         boost::program_options::store(
             boost::program_options::command_line_parser(argc, argv).options(desc)
-    //            .positional(p)
+                .positional(p)
                 .run(),
             options
         );
         boost::program_options::notify(options);
 
+        if (options.count("search") > 0) {
+            if (input_filename.c_str()[0] != 0) {
+                search_files.insert(search_files.begin(), input_filename);
+            }
+            if (search_files.empty() || search_text.empty()) {
+                cout << "Missing text or recordings to search\n\n";
+                cout << copyright_notice;
+                cout << "Usage: redrec --search text [options] recording.mwrm...\n\n";
+                cout << desc << endl;
+                exit(-1);
+            }
+            return search_keystrokes(search_text, search_files);
+        }
+
         if (input_filename.c_str()[0] == 0){
             cout << "Missing input filename\n\n";
             cout << copyright_notice;
@@ -186,12 +256,31 @@ int main(int argc, char** argv)
         exit(-1);
     };
 
+    // an incremental keyframe is rebuilt from the last full one
+    unsigned chained_keyframes = 0;
+    try {
+        InByMetaSequenceTransport in_wrm_trans_tmp(infile_prefix, infile_extension);
+        for (unsigned i = 1; i < count ; i++){
+            in_wrm_trans_tmp.next_chunk_info();
+        }
+        FileToGraphic player_tmp(&in_wrm_trans_tmp, begin_capture, end_capture, false, 0);
+        if (player_tmp.keyframe_files_back && (player_tmp.keyframe_files_back < count)) {
+            count             -= player_tmp.keyframe_files_back;
+            chained_keyframes  = player_tmp.keyframes_back;
+        }
+    }
+    catch (const Error & e) {
+        printf("Failed to read keyframe of wrm file %u\n", count);
+        exit(-1);
+    };
+
     InByMetaSequenceTransport in_wrm_trans(infile_prefix, infile_extension);
     for (unsigned i = 1; i < count ; i++){
         in_wrm_trans.next_chunk_info();
     }
 
     FileToGraphic player(&in_wrm_trans, begin_capture, end_capture, false, verbose);
+    player.chain_keyframes(chained_keyframes);
     player.max_order_count = order_count;
 
     const char * outfile_fullpath = output_filename.c_str();
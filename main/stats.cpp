@@ -0,0 +1,166 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2014
+    Author(s): Christophe Grosjean, Raphael Zhou
+
+    rdpproxy-stats: dumps performance counters of live sessions
+*/
+
+#include <boost/program_options.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <iostream>
+#include <string>
+#include <stdio.h>
+
+#define LOGPRINT
+#include "log.hpp"
+
+#include "session_stats.hpp"
+#include "version.hpp"
+
+static void print_table_header() {
+    printf("%7s %-15s %-15s %8s %10s %10s %10s %10s %8s %8s %9s %4s %9s %9s %8s %8s\n",
+           "PID", "SOURCE", "TARGET", "DURATION",
+           "FRONT_IN", "FRONT_OUT", "MOD_IN", "MOD_OUT",
+           "PDU_IN", "MOD_PDU", "ORDERS", "HIT%",
+           "COMPR_MS", "CAPT_MS", "SENDQ", "MOD_SNDQ");
+}
+
+static void print_table_row(const SessionStats & s, time_t now) {
+    printf("%7d %-15s %-15s %8llu %10llu %10llu %10llu %10llu %8llu %8llu %9llu %4llu %9llu %9llu %8llu %8llu\n",
+           static_cast<int>(s.pid), s.source_ip, s.target_ip,
+           static_cast<unsigned long long>(now - s.start_time),
+           static_cast<unsigned long long>(s.front_bytes_received),
+           static_cast<unsigned long long>(s.front_bytes_sent),
+           static_cast<unsigned long long>(s.mod_bytes_received),
+           static_cast<unsigned long long>(s.mod_bytes_sent),
+           static_cast<unsigned long long>(s.front_pdus_received),
+           static_cast<unsigned long long>(s.mod_pdus_received),
+           static_cast<unsigned long long>(s.front_orders_sent),
+           static_cast<unsigned long long>(s.bmp_cache_hit_percent()),
+           static_cast<unsigned long long>(s.compression_usec / 1000),
+           static_cast<unsigned long long>(s.capture_usec / 1000),
+           static_cast<unsigned long long>(s.front_send_queue),
+           static_cast<unsigned long long>(s.mod_send_queue));
+}
+
+// one "key=value" line per session, for scripts
+static void print_raw(const SessionStats & s) {
+    printf("pid=%d source=%s target=%s start_time=%llu last_update=%llu"
+           " front_bytes_received=%llu front_bytes_sent=%llu"
+           " mod_bytes_received=%llu mod_bytes_sent=%llu"
+           " front_pdus_received=%llu mod_pdus_received=%llu"
+           " front_orders_sent=%llu front_updates_sent=%llu"
+           " mod_orders_received=%llu mod_bmp_cache_received=%llu mod_bitmap_updates_received=%llu"
+           " bmp_cache_hits=%llu bmp_cache_misses=%llu"
+           " compression_usec=%llu capture_usec=%llu"
+           " front_send_queue=%llu front_recv_queue=%llu mod_send_queue=%llu mod_recv_queue=%llu"
+           " png_snapshots=%llu png_snapshots_deferred=%llu\n",
+           static_cast<int>(s.pid), s.source_ip, s.target_ip,
+           static_cast<unsigned long long>(s.start_time),
+           static_cast<unsigned long long>(s.last_update),
+           static_cast<unsigned long long>(s.front_bytes_received),
+           static_cast<unsigned long long>(s.front_bytes_sent),
+           static_cast<unsigned long long>(s.mod_bytes_received),
+           static_cast<unsigned long long>(s.mod_bytes_sent),
+           static_cast<unsigned long long>(s.front_pdus_received),
+           static_cast<unsigned long long>(s.mod_pdus_received),
+           static_cast<unsigned long long>(s.front_orders_sent),
+           static_cast<unsigned long long>(s.front_updates_sent),
+           static_cast<unsigned long long>(s.mod_orders_received),
+           static_cast<unsigned long long>(s.mod_bmp_cache_received),
+           static_cast<unsigned long long>(s.mod_bitmap_updates_received),
+           static_cast<unsigned long long>(s.bmp_cache_hits),
+           static_cast<unsigned long long>(s.bmp_cache_misses),
+           static_cast<unsigned long long>(s.compression_usec),
+           static_cast<unsigned long long>(s.capture_usec),
+           static_cast<unsigned long long>(s.front_send_queue),
+           static_cast<unsigned long long>(s.front_recv_queue),
+           static_cast<unsigned long long>(s.mod_send_queue),
+           static_cast<unsigned long long>(s.mod_recv_queue),
+           static_cast<unsigned long long>(s.png_snapshots),
+           static_cast<unsigned long long>(s.png_snapshots_deferred));
+}
+
+int main(int argc, char * argv[]) {
+    const char * copyright_notice =
+        "\n"
+        "ReDemPtion Session Statistics " VERSION ".\n"
+        "Copyright (C) Wallix 2010-2014.\n"
+        "Christophe Grosjean, Raphael Zhou.\n"
+        "\n"
+        ;
+
+    std::string stats_filename = SESSION_STATS_FILE;
+    int         pid            = 0;
+
+    boost::program_options::options_description desc("Options");
+    desc.add_options()
+    ("help,h",    "produce help message")
+    ("version,v", "show software version")
+
+    ("stats-file,f", boost::program_options::value(&stats_filename), "statistics file name (default " SESSION_STATS_FILE ")")
+    ("pid,p",        boost::program_options::value(&pid),            "only show session of this process")
+    ("raw,r",        "one key=value line per session")
+    ;
+
+    boost::program_options::variables_map options;
+    boost::program_options::store(
+        boost::program_options::command_line_parser(argc, argv).options(desc).run(),
+        options
+    );
+    boost::program_options::notify(options);
+
+    if (options.count("help") > 0) {
+        std::cout << copyright_notice;
+        std::cout << "Usage: rdpproxy-stats [options]\n\n";
+        std::cout << desc << std::endl;
+        exit(-1);
+    }
+
+    if (options.count("version") > 0) {
+        std::cout << copyright_notice;
+        exit(-1);
+    }
+
+    SessionStatsSegment segment;
+    if (!segment.open_read_only(stats_filename.c_str())) {
+        std::cout << "Failed to open statistics file: " << stats_filename << "\n\n";
+        exit(-1);
+    }
+
+    const bool raw = options.count("raw") > 0;
+    if (!raw) {
+        print_table_header();
+    }
+
+    const time_t now = time(NULL);
+    SessionStats s;
+    for (unsigned i = 0; i < segment.slot_count(); i++) {
+        if (!segment.read(i, s) || (pid && (s.pid != pid))) {
+            continue;
+        }
+        if (raw) {
+            print_raw(s);
+        }
+        else {
+            print_table_row(s, now);
+        }
+    }
+
+    return 0;
+}
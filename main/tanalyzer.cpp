@@ -23,6 +23,9 @@
 #include <boost/program_options.hpp>
 #include <boost/program_options/options_description.hpp>
 #include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #define LOGPRINT
 #include "log.hpp"
@@ -32,6 +35,7 @@
 #include "infiletransport.hpp"
 #include "RDP/protocol.hpp"
 #include "transparentplayer.hpp"
+#include "traffic_profile.hpp"
 #include "version.hpp"
 
 class Analyzer : public FrontAPI {
@@ -54,49 +58,15 @@ private:
     RDP::RDPMultiScrBlt multiscrblt;
     RDPPolyline        polyline;
 
-    struct Statistic {
-        uint32_t cache_bitmap_compressed_count;
-        uint32_t cache_bitmap_uncompressed_count;
-        uint32_t cache_bitmap_compressed_rev2_count;
-        uint32_t cache_bitmap_uncompressed_rev2_count;
-        uint32_t cache_bitmap_compressed_rev3_count;
-
-        uint32_t bitmapupdate_count;
-
-        uint32_t dstblt_count;
-        uint32_t patblt_count;
-        uint32_t scrblt_count;
-        uint32_t lineto_count;
-        uint32_t opaquerect_count;
-        uint32_t memblt_count;
-        uint32_t mem3blt_count;
-        uint32_t multidstblt_count;
-        uint32_t multiopaquerect_count;
-        uint32_t multipatblt_count;
-        uint32_t multiscrblt_count;
-        uint32_t polyline_count;
-
-        Statistic()
-        : cache_bitmap_compressed_count(0)
-        , cache_bitmap_uncompressed_count(0)
-        , cache_bitmap_compressed_rev2_count(0)
-        , cache_bitmap_uncompressed_rev2_count(0)
-        , cache_bitmap_compressed_rev3_count(0)
-        , bitmapupdate_count(0)
-        , dstblt_count(0)
-        , patblt_count(0)
-        , scrblt_count(0)
-        , lineto_count(0)
-        , opaquerect_count(0)
-        , memblt_count(0)
-        , mem3blt_count(0)
-        , multidstblt_count(0)
-        , multiopaquerect_count(0)
-        , multipatblt_count(0)
-        , multiscrblt_count(0)
-        , polyline_count(0)
-        {}
-    } statistic;
+    uint8_t    session_color_depth;
+    BGRPalette palette;
+
+    uint64_t chunk_bytes;   // sent to client by current chunk
+
+    bool verbose;
+
+public:
+    TrafficProfiler profiler;
 
 public:
     // RDPGraphicDevice
@@ -135,8 +105,12 @@ public:
     }
     virtual void send_to_channel( const CHANNELS::ChannelDef & channel, uint8_t * data
                                 , size_t length, size_t chunk_size, int flags) {
-        LOG(LOG_INFO, "send_to_channel: channel_name=\"%s\" data_length=%u chunk_size=%u flags=0x%X",
-            channel.name, length, chunk_size, flags);
+        if (this->verbose) {
+            LOG(LOG_INFO, "send_to_channel: channel_name=\"%s\" data_length=%u chunk_size=%u flags=0x%X",
+                channel.name, length, chunk_size, flags);
+        }
+        this->profiler.channel(channel.name, length);
+        this->chunk_bytes += length;
     }
 
     virtual void send_global_palette() throw(Error) { REDASSERT(false); }
@@ -144,46 +118,66 @@ public:
 
     virtual void set_mod_color_depth(uint8_t bpp) {
         LOG(LOG_INFO, "set_mod_color_depth: bpp=%u", bpp);
+        this->session_color_depth = bpp;
     }
 
     virtual int server_resize(int width, int height, int bpp) {
         LOG(LOG_INFO, "server_resize: width=%u height=%u bpp=%u", width, height, bpp);
+        this->session_color_depth = bpp;
         return 1;
     };
 
     virtual void send_data_indication_ex(uint16_t channelId, HStream & stream) {
-        LOG(LOG_INFO, "send_data_indication_ex: channelId=%u stream_size=%u", channelId, stream.size());
+        if (this->verbose) {
+            LOG(LOG_INFO, "send_data_indication_ex: channelId=%u stream_size=%u", channelId, stream.size());
+        }
 
         stream.p = stream.get_data();
+        this->profile().slowpath_bytes += stream.size();
+        this->chunk_bytes += stream.size();
 
         ShareControl_Recv sctrl(stream);
 
         switch (sctrl.pdu_type1) {
             case PDUTYPE_DATAPDU:
             {
-                LOG(LOG_INFO, "send_data_indication_ex: Received PDUTYPE_DATAPDU(0x%X)", sctrl.pdu_type1);
+                if (this->verbose) {
+                    LOG(LOG_INFO, "send_data_indication_ex: Received PDUTYPE_DATAPDU(0x%X)", sctrl.pdu_type1);
+                }
 
                 ShareData sdata(stream);
                 sdata.recv_begin(&this->mppc_dec);
                 switch (sdata.pdutype2) {
                     case PDUTYPE2_UPDATE:
                     {
-                        LOG(LOG_INFO, "send_data_indication_ex: Received PDUTYPE2_UPDATE(0x%X)", sdata.pdutype2);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "send_data_indication_ex: Received PDUTYPE2_UPDATE(0x%X)", sdata.pdutype2);
+                        }
+                        this->profiler.update(stream.size(), (sdata.compressedType & PACKET_COMPRESSED),
+                            sdata.payload.get_data(), sdata.payload.size());
                         SlowPath::GraphicsUpdate_Recv gp_udp_r(sdata.payload);
                         switch (gp_udp_r.update_type) {
                             case RDP_UPDATE_ORDERS:
-                                LOG(LOG_INFO, "send_data_indication_ex: Received RDP_UPDATE_ORDERS(0x%X)", gp_udp_r.update_type);
+                                if (this->verbose) {
+                                    LOG(LOG_INFO, "send_data_indication_ex: Received RDP_UPDATE_ORDERS(0x%X)", gp_udp_r.update_type);
+                                }
                                 this->process_orders(sdata.payload, false);
                             break;
                             case RDP_UPDATE_BITMAP:
-                                LOG(LOG_INFO, "send_data_indication_ex: Received UPDATETYPE_BITMAP(0x%X)", gp_udp_r.update_type);
-                                this->statistic.bitmapupdate_count++;
+                                if (this->verbose) {
+                                    LOG(LOG_INFO, "send_data_indication_ex: Received UPDATETYPE_BITMAP(0x%X)", gp_udp_r.update_type);
+                                }
+                                this->profiler.bitmap_update(sdata.payload.size());
                             break;
                             case RDP_UPDATE_PALETTE:
-                                LOG(LOG_INFO, "send_data_indication_ex: Received UPDATETYPE_PALETTE(0x%X)", gp_udp_r.update_type);
+                                if (this->verbose) {
+                                    LOG(LOG_INFO, "send_data_indication_ex: Received UPDATETYPE_PALETTE(0x%X)", gp_udp_r.update_type);
+                                }
                             break;
                             case RDP_UPDATE_SYNCHRONIZE:
-                                LOG(LOG_INFO, "send_data_indication_ex: Received UPDATETYPE_SYNCHRONIZE(0x%X)", gp_udp_r.update_type);
+                                if (this->verbose) {
+                                    LOG(LOG_INFO, "send_data_indication_ex: Received UPDATETYPE_SYNCHRONIZE(0x%X)", gp_udp_r.update_type);
+                                }
                             break;
                             default:
                                 LOG(LOG_INFO, "send_data_indication_ex: Received unexpected Server Graphics Update Type (0x%X)", gp_udp_r.update_type);
@@ -192,10 +186,14 @@ public:
                     }
                     break;
                     case PDUTYPE2_SAVE_SESSION_INFO:
-                        LOG(LOG_INFO, "send_data_indication_ex: Received PDUTYPE2_SAVE_SESSION_INFO(0x%X)", sdata.pdutype2);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "send_data_indication_ex: Received PDUTYPE2_SAVE_SESSION_INFO(0x%X)", sdata.pdutype2);
+                        }
                     break;
                     case PDUTYPE2_SET_ERROR_INFO_PDU:
-                        LOG(LOG_INFO, "send_data_indication_ex: Received PDUTYPE2_SET_ERROR_INFO_PDU(0x%X)", sdata.pdutype2);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "send_data_indication_ex: Received PDUTYPE2_SET_ERROR_INFO_PDU(0x%X)", sdata.pdutype2);
+                        }
                     break;
                     default:
                         LOG(LOG_INFO, "send_data_indication_ex: ***** Received unexpected data PDU, pdu_type2=0x%X *****", sdata.pdutype2);
@@ -211,42 +209,69 @@ public:
     }
 
     virtual void send_fastpath_data(Stream & data) {
-        LOG(LOG_INFO, "send_fastpath_data: data_size=%u", data.size());
+        if (this->verbose) {
+            LOG(LOG_INFO, "send_fastpath_data: data_size=%u", data.size());
+        }
+
+        this->profile().fastpath_bytes += data.size();
+        this->chunk_bytes += data.size();
 
         while (data.in_remain()) {
             FastPath::Update_Recv fp_upd_r(data, &this->mppc_dec);
+            this->profiler.update(fp_upd_r.size, (fp_upd_r.compression & FastPath::FASTPATH_OUTPUT_COMPRESSION_USED),
+                fp_upd_r.payload.get_data(), fp_upd_r.payload.size());
             switch (fp_upd_r.updateCode) {
                 case FastPath::FASTPATH_UPDATETYPE_ORDERS:
-                    LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_ORDERS(0x%X)", fp_upd_r.updateCode);
+                    if (this->verbose) {
+                        LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_ORDERS(0x%X)", fp_upd_r.updateCode);
+                    }
                     this->process_orders(fp_upd_r.payload, true);
                 break;
                 case FastPath::FASTPATH_UPDATETYPE_BITMAP:
-                    LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_BITMAP(0x%X)", fp_upd_r.updateCode);
-                    this->statistic.bitmapupdate_count++;
+                    if (this->verbose) {
+                        LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_BITMAP(0x%X)", fp_upd_r.updateCode);
+                    }
+                    this->profiler.bitmap_update(fp_upd_r.payload.size());
                 break;
                 case FastPath::FASTPATH_UPDATETYPE_PALETTE:
-                    LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_PALETTE(0x%X)", fp_upd_r.updateCode);
+                    if (this->verbose) {
+                        LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_PALETTE(0x%X)", fp_upd_r.updateCode);
+                    }
                 break;
                 case FastPath::FASTPATH_UPDATETYPE_SYNCHRONIZE:
-                    LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_SYNCHRONIZE(0x%X)", fp_upd_r.updateCode);
+                    if (this->verbose) {
+                        LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_SYNCHRONIZE(0x%X)", fp_upd_r.updateCode);
+                    }
                 break;
                 case FastPath::FASTPATH_UPDATETYPE_PTR_NULL:
-                    LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_PTR_NULL(0x%X)", fp_upd_r.updateCode);
+                    if (this->verbose) {
+                        LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_PTR_NULL(0x%X)", fp_upd_r.updateCode);
+                    }
                 break;
                 case FastPath::FASTPATH_UPDATETYPE_PTR_DEFAULT:
-                    LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_PTR_DEFAULT(0x%X)", fp_upd_r.updateCode);
+                    if (this->verbose) {
+                        LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_PTR_DEFAULT(0x%X)", fp_upd_r.updateCode);
+                    }
                 break;
                 case FastPath::FASTPATH_UPDATETYPE_PTR_POSITION:
-                    LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_PTR_POSITION(0x%X)", fp_upd_r.updateCode);
+                    if (this->verbose) {
+                        LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_PTR_POSITION(0x%X)", fp_upd_r.updateCode);
+                    }
                 break;
                 case FastPath::FASTPATH_UPDATETYPE_COLOR:
-                    LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_COLOR(0x%X)", fp_upd_r.updateCode);
+                    if (this->verbose) {
+                        LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_COLOR(0x%X)", fp_upd_r.updateCode);
+                    }
                 break;
                 case FastPath::FASTPATH_UPDATETYPE_POINTER:
-                    LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_POINTER(0x%X)", fp_upd_r.updateCode);
+                    if (this->verbose) {
+                        LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_POINTER(0x%X)", fp_upd_r.updateCode);
+                    }
                 break;
                 case FastPath::FASTPATH_UPDATETYPE_CACHED:
-                    LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_CACHED(0x%X)", fp_upd_r.updateCode);
+                    if (this->verbose) {
+                        LOG(LOG_INFO, "send_fastpath_data: Received FASTPATH_UPDATETYPE_CACHED(0x%X)", fp_upd_r.updateCode);
+                    }
                 break;
                 default:
                     LOG(LOG_INFO, "send_fastpath_data: ***** Received unexpected fast-past PDU, updateCode=0x%X *****", fp_upd_r.updateCode);
@@ -260,6 +285,7 @@ public:
 
         int processed = 0;
         while (processed < odrs_upd_r.number_orders) {
+            const uint8_t * const order_start = stream.p;
             RDP::DrawingOrder_RecvFactory drawodr_rf(stream);
 
             if (!drawodr_rf.control_flags & RDP::STANDARD) {
@@ -269,32 +295,46 @@ public:
             if (drawodr_rf.control_flags & RDP::SECONDARY) {
                 RDPSecondaryOrderHeader sec_odr_h(stream);
                 uint8_t * next_order = stream.p + sec_odr_h.order_data_length();
+                this->profiler.secondary_order(sec_odr_h.type, next_order - order_start);
                 switch (sec_odr_h.type) {
                     case RDP::TS_CACHE_BITMAP_COMPRESSED:
-                        LOG(LOG_INFO, "process_orders: Received FASTPATH_UPDATETYPE_BITMAP(0x%X)", sec_odr_h.type);
-                        this->statistic.cache_bitmap_compressed_count++;
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_CACHE_BITMAP_COMPRESSED(0x%X)", sec_odr_h.type);
+                        }
+                        this->cache_bitmap(stream, drawodr_rf.control_flags, sec_odr_h, next_order - order_start);
                     break;
                     case RDP::TS_CACHE_BITMAP_UNCOMPRESSED:
-                        LOG(LOG_INFO, "process_orders: Received TS_CACHE_BITMAP_UNCOMPRESSED(0x%X)", sec_odr_h.type);
-                        this->statistic.cache_bitmap_uncompressed_count++;
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_CACHE_BITMAP_UNCOMPRESSED(0x%X)", sec_odr_h.type);
+                        }
+                        this->cache_bitmap(stream, drawodr_rf.control_flags, sec_odr_h, next_order - order_start);
                     break;
                     case RDP::TS_CACHE_COLOR_TABLE:
-                        LOG(LOG_INFO, "process_orders: Received TS_CACHE_COLOR_TABLE(0x%X)", sec_odr_h.type);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_CACHE_COLOR_TABLE(0x%X)", sec_odr_h.type);
+                        }
                     break;
                     case RDP::TS_CACHE_GLYPH:
-                        LOG(LOG_INFO, "process_orders: Received TS_CACHE_GLYPH(0x%X)", sec_odr_h.type);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_CACHE_GLYPH(0x%X)", sec_odr_h.type);
+                        }
                     break;
                     case RDP::TS_CACHE_BITMAP_COMPRESSED_REV2:
-                        LOG(LOG_INFO, "process_orders: Received TS_CACHE_BITMAP_COMPRESSED_REV2(0x%X)", sec_odr_h.type);
-                        this->statistic.cache_bitmap_compressed_rev2_count++;
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_CACHE_BITMAP_COMPRESSED_REV2(0x%X)", sec_odr_h.type);
+                        }
+                        this->cache_bitmap(stream, drawodr_rf.control_flags, sec_odr_h, next_order - order_start);
                     break;
                     case RDP::TS_CACHE_BITMAP_UNCOMPRESSED_REV2:
-                        LOG(LOG_INFO, "process_orders: Received TS_CACHE_BITMAP_UNCOMPRESSED_REV2(0x%X)", sec_odr_h.type);
-                        this->statistic.cache_bitmap_uncompressed_rev2_count++;
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_CACHE_BITMAP_UNCOMPRESSED_REV2(0x%X)", sec_odr_h.type);
+                        }
+                        this->cache_bitmap(stream, drawodr_rf.control_flags, sec_odr_h, next_order - order_start);
                     break;
                     case RDP::TS_CACHE_BITMAP_COMPRESSED_REV3:
-                        LOG(LOG_INFO, "process_orders: Received TS_CACHE_BITMAP_COMPRESSED_REV3(0x%X)", sec_odr_h.type);
-                        this->statistic.cache_bitmap_compressed_rev3_count++;
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_CACHE_BITMAP_COMPRESSED_REV3(0x%X)", sec_odr_h.type);
+                        }
                     break;
                     default:
                         LOG(LOG_INFO, "process_orders: ***** Received unexpected Secondary Drawing Order, type=0x%X *****", sec_odr_h.type);
@@ -306,75 +346,115 @@ public:
                 RDPPrimaryOrderHeader pri_ord_h = this->common.receive(stream, drawodr_rf.control_flags);
                 switch (this->common.order) {
                     case RDP::DESTBLT:
-                        LOG(LOG_INFO, "process_orders: Received TS_ENC_DSTBLT_ORDER(0x%X)", this->common.order);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_ENC_DSTBLT_ORDER(0x%X)", this->common.order);
+                        }
                         this->destblt.receive(stream, pri_ord_h);
-                        this->statistic.dstblt_count++;
                     break;
                     case RDP::PATBLT:
-                        LOG(LOG_INFO, "process_orders: Received TS_ENC_PATBLT_ORDER(0x%X)", this->common.order);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_ENC_PATBLT_ORDER(0x%X)", this->common.order);
+                        }
                         this->patblt.receive(stream, pri_ord_h);
-                        this->statistic.patblt_count++;
                     break;
                     case RDP::SCREENBLT:
-                        LOG(LOG_INFO, "process_orders: Received TS_ENC_SCRBLT_ORDER(0x%X)", this->common.order);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_ENC_SCRBLT_ORDER(0x%X)", this->common.order);
+                        }
                         this->scrblt.receive(stream, pri_ord_h);
-                        this->statistic.scrblt_count++;
                     break;
                     case RDP::MEMBLT:
-                        LOG(LOG_INFO, "process_orders: Received TS_ENC_MEMBLT_ORDER(0x%X)", this->common.order);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_ENC_MEMBLT_ORDER(0x%X)", this->common.order);
+                        }
                         this->memblt.receive(stream, pri_ord_h);
-                        this->statistic.memblt_count++;
+                        this->profiler.cache_reference(this->memblt.cache_id & 0x3, this->memblt.cache_idx);
                     break;
                     case RDP::MEM3BLT:
-                        LOG(LOG_INFO, "process_orders: Received TS_ENC_MEM3BLT_ORDER(0x%X)", this->common.order);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_ENC_MEM3BLT_ORDER(0x%X)", this->common.order);
+                        }
                         this->mem3blt.receive(stream, pri_ord_h);
-                        this->statistic.mem3blt_count++;
+                        this->profiler.cache_reference(this->mem3blt.cache_id & 0x3, this->mem3blt.cache_idx);
                     break;
                     case RDP::LINE:
-                        LOG(LOG_INFO, "process_orders: Received TS_ENC_LINETO_ORDER(0x%X)", this->common.order);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_ENC_LINETO_ORDER(0x%X)", this->common.order);
+                        }
                         this->lineto.receive(stream, pri_ord_h);
-                        this->statistic.lineto_count++;
                     break;
                     case RDP::RECT:
-                        LOG(LOG_INFO, "process_orders: Received TS_ENC_OPAQUERECT_ORDER(0x%X)", this->common.order);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_ENC_OPAQUERECT_ORDER(0x%X)", this->common.order);
+                        }
                         this->opaquerect.receive(stream, pri_ord_h);
-                        this->statistic.opaquerect_count++;
                     break;
                     case RDP::MULTIDSTBLT:
-                        LOG(LOG_INFO, "process_orders: Received TS_ENC_MULTIDSTBLT_ORDER(0x%X)", this->common.order);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_ENC_MULTIDSTBLT_ORDER(0x%X)", this->common.order);
+                        }
                         this->multidstblt.receive(stream, pri_ord_h);
-                        this->statistic.multidstblt_count++;
                     break;
                     case RDP::MULTIOPAQUERECT:
-                        LOG(LOG_INFO, "process_orders: Received TS_ENC_MULTIOPAQUERECT_ORDER(0x%X)", this->common.order);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_ENC_MULTIOPAQUERECT_ORDER(0x%X)", this->common.order);
+                        }
                         this->multiopaquerect.receive(stream, pri_ord_h);
-                        this->statistic.multiopaquerect_count++;
                     break;
                     case RDP::MULTIPATBLT:
-                        LOG(LOG_INFO, "process_orders: Received TS_ENC_MULTIPATBLT_ORDER(0x%X)", this->common.order);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_ENC_MULTIPATBLT_ORDER(0x%X)", this->common.order);
+                        }
                         this->multipatblt.receive(stream, pri_ord_h);
-                        this->statistic.multipatblt_count++;
                     break;
                     case RDP::MULTISCRBLT:
-                        LOG(LOG_INFO, "process_orders: Received TS_ENC_MULTISCRBLT_ORDER(0x%X)", this->common.order);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_ENC_MULTISCRBLT_ORDER(0x%X)", this->common.order);
+                        }
                         this->multiscrblt.receive(stream, pri_ord_h);
-                        this->statistic.multiscrblt_count++;
                     break;
                     case RDP::POLYLINE:
-                        LOG(LOG_INFO, "process_orders: Received TS_ENC_POLYLINE_ORDER(0x%X)", this->common.order);
+                        if (this->verbose) {
+                            LOG(LOG_INFO, "process_orders: Received TS_ENC_POLYLINE_ORDER(0x%X)", this->common.order);
+                        }
                         this->polyline.receive(stream, pri_ord_h);
-                        this->statistic.polyline_count++;
                     break;
                     default:
                         LOG(LOG_INFO, "process_orders: ***** Received unexpected Primary Drawing Order, type=0x%X *****", this->common.order);
                     break;
                 }
+                this->profiler.primary_order(this->common.order, stream.p - order_start);
             }
             processed++;
         }
     }
 
-    Analyzer()
+    void cache_bitmap(Stream & stream, uint8_t control_flags, const RDPSecondaryOrderHeader & header,
+                      size_t order_size) {
+        RDPBmpCache cmd;
+        cmd.receive(this->session_color_depth, stream, control_flags, header, this->palette);
+
+        uint8_t sig[20];
+        cmd.bmp->compute_sha1(sig);
+        uint64_t key;
+        memcpy(&key, sig, sizeof(key));
+        this->profiler.cache_store(cmd.id, cmd.idx, key, order_size);
+
+        delete cmd.bmp;
+    }
+
+    // all PDUs of a recorded chunk were processed
+    void chunk_done(const timeval & record_time) {
+        this->profiler.chunk(static_cast<uint64_t>(record_time.tv_sec) * 1000000 + record_time.tv_usec,
+            this->chunk_bytes);
+        this->chunk_bytes = 0;
+    }
+
+    TrafficProfile & profile() {
+        return this->profiler.profile;
+    }
+
+    explicit Analyzer(bool verbose)
     : FrontAPI(false, false)
     , common(RDP::PATBLT, Rect(0, 0, 1, 1))
     , destblt(Rect(), 0)
@@ -388,7 +468,11 @@ public:
     , multiopaquerect()
     , multipatblt()
     , multiscrblt()
-    , polyline() {
+    , polyline()
+    , session_color_depth(24)
+    , chunk_bytes(0)
+    , verbose(verbose) {
+        memset(this->palette, 0, sizeof(this->palette));
         InitializeVirtualChannelList();
     }
 
@@ -415,31 +499,112 @@ public:
         channel_item.chanid = 1007;
         this->channel_list.push_back(channel_item);
     }
+};  // class Analyzer
 
-    void show_statistic() {
-        LOG(LOG_INFO, "****************************************");
-        LOG(LOG_INFO, "cache_bitmap_compressed count=%u",        this->statistic.cache_bitmap_compressed_count);
-        LOG(LOG_INFO, "cache_bitmap_uncompressed count=%u",      this->statistic.cache_bitmap_uncompressed_count);
-        LOG(LOG_INFO, "cache_bitmap_compressed_rev2 count=%u",   this->statistic.cache_bitmap_compressed_rev2_count);
-        LOG(LOG_INFO, "cache_bitmap_uncompressed_rev2 count=%u", this->statistic.cache_bitmap_uncompressed_rev2_count);
-
-        LOG(LOG_INFO, "bitmapupdate count=%u", this->statistic.bitmapupdate_count);
-
-        LOG(LOG_INFO, "dstblt count=%u",          this->statistic.dstblt_count);
-        LOG(LOG_INFO, "patblt count=%u",          this->statistic.patblt_count);
-        LOG(LOG_INFO, "scrblt count=%u",          this->statistic.scrblt_count);
-        LOG(LOG_INFO, "lineto count=%u",          this->statistic.lineto_count);
-        LOG(LOG_INFO, "opaquerect count=%u",      this->statistic.opaquerect_count);
-        LOG(LOG_INFO, "memblt count=%u",          this->statistic.memblt_count);
-        LOG(LOG_INFO, "mem3blt count=%u",         this->statistic.mem3blt_count);
-        LOG(LOG_INFO, "multidstblt count=%u",     this->statistic.multidstblt_count);
-        LOG(LOG_INFO, "multiopaquerect count=%u", this->statistic.multiopaquerect_count);
-        LOG(LOG_INFO, "multipatblt count=%u",     this->statistic.multipatblt_count);
-        LOG(LOG_INFO, "multiscrblt count=%u",     this->statistic.multiscrblt_count);
-        LOG(LOG_INFO, "polyline count=%u",        this->statistic.polyline_count);
-        LOG(LOG_INFO, "****************************************");
+struct Worker {
+    pid_t pid;
+    int   fd;
+};
+
+// Analyzes one recording in a child process, its profile is then read
+// from returned pipe. Child output (logs) goes to stderr.
+static pid_t start_worker(const std::string & input_filename, bool verbose, int & result_fd) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
     }
-};  // class Analyzer
+
+    const pid_t pid = fork();
+    if (pid != 0) {
+        close(fds[1]);
+        result_fd = fds[0];
+        if (pid < 0) {
+            close(fds[0]);
+        }
+        return pid;
+    }
+
+    close(fds[0]);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    int fd = open(input_filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        LOG(LOG_ERR, "Failed to open input file: %s", input_filename.c_str());
+        _exit(1);
+    }
+
+    TrafficProfile * profile = new TrafficProfile;
+    {
+        InFileTransport trans(fd);
+        Analyzer        analyzer(verbose);
+
+        TransparentPlayer player(&trans, &analyzer);
+
+        while (player.interpret_chunk(/*real_time = */false)) {
+            analyzer.chunk_done(player.record_time());
+        }
+
+        analyzer.profiler.finish();
+        *profile = analyzer.profile();
+    }
+    close(fd);
+
+    const char * p   = reinterpret_cast<const char *>(profile);
+    size_t       len = sizeof(*profile);
+    while (len) {
+        const ssize_t res = write(fds[1], p, len);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            _exit(1);
+        }
+        p   += res;
+        len -= res;
+    }
+    delete profile;
+    _exit(0);
+}
+
+// false if worker failed
+static bool finish_worker(pid_t pid, int result_fd, TrafficProfile & profile) {
+    char * p   = reinterpret_cast<char *>(&profile);
+    size_t len = sizeof(profile);
+    while (len) {
+        const ssize_t res = read(result_fd, p, len);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            break;
+        }
+        p   += res;
+        len -= res;
+    }
+    close(result_fd);
+
+    int status = 0;
+    while ((waitpid(pid, &status, 0) == -1) && (errno == EINTR)) {
+    }
+    return !len && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+static void write_json_string(FILE * out, const std::string & s) {
+    fputc('"', out);
+    for (size_t i = 0; i < s.size(); i++) {
+        const unsigned char c = s[i];
+        if ((c == '"') || (c == '\\')) {
+            fprintf(out, "\\%c", c);
+        }
+        else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        }
+        else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
 
 int main(int argc, char * argv[]) {
     openlog("tanalyzer", LOG_CONS | LOG_PERROR, LOG_USER);
@@ -452,26 +617,34 @@ int main(int argc, char * argv[]) {
         "\n"
         ;
 
-    std::string input_filename;
+    std::vector<std::string> input_filenames;
+    std::string              output_filename;
+    unsigned                 jobs = std::max<long>(sysconf(_SC_NPROCESSORS_ONLN), 1);
 
     boost::program_options::options_description desc("Options");
     desc.add_options()
     ("help,h",    "produce help message")
     ("version,v", "show software version")
 
-    ("input-file,i", boost::program_options::value(&input_filename), "input ini file name")
+    ("input-file,i", boost::program_options::value(&input_filenames), "input recording file name (may be repeated)")
+    ("output-file,o", boost::program_options::value(&output_filename), "JSON traffic profile file name (default: standard output)")
+    ("jobs,j", boost::program_options::value(&jobs), "recordings analyzed in parallel (default: number of CPUs)")
+    ("verbose", "log every PDU and order (on standard error)")
     ;
 
+    boost::program_options::positional_options_description positional;
+    positional.add("input-file", -1);
+
     boost::program_options::variables_map options;
     boost::program_options::store(
-        boost::program_options::command_line_parser(argc, argv).options(desc).run(),
+        boost::program_options::command_line_parser(argc, argv).options(desc).positional(positional).run(),
         options
     );
     boost::program_options::notify(options);
 
     if (options.count("help") > 0) {
         std::cout << copyright_notice;
-        std::cout << "Usage: rdptanalyzer [options]\n\n";
+        std::cout << "Usage: rdptanalyzer [options] [recording...]\n\n";
         std::cout << desc << std::endl;
         exit(-1);
     }
@@ -481,31 +654,62 @@ int main(int argc, char * argv[]) {
         exit(-1);
     }
 
-    if (input_filename.empty()) {
+    if (input_filenames.empty()) {
         std::cout << "Use -i filename\n\n";
         exit(-1);
     }
 
-    int fd = open(input_filename.c_str(), O_RDONLY);
-    if (fd != -1) {
-        {
-            InFileTransport trans(fd);
-            Analyzer        analyzer;
+    const bool verbose = (options.count("verbose") > 0);
+    jobs = std::max(jobs, 1u);
+
+    FILE * out = stdout;
+    if (!output_filename.empty()) {
+        out = fopen(output_filename.c_str(), "w");
+        if (!out) {
+            std::cout << "Failed to open output file: " << output_filename << "\n\n";
+            exit(-1);
+        }
+    }
 
-            TransparentPlayer player(&trans, &analyzer);
+    // workers are collected in input order, so that output order is stable,
+    // others may finish meanwhile
+    std::vector<Worker> workers(input_filenames.size());
+    size_t started = 0;
 
-            while (player.interpret_chunk(/*real_time = */false));
+    TrafficProfile total;
+    TrafficProfile profile;
+    unsigned       failed = 0;
 
-            LOG(LOG_INFO, "");
-            analyzer.show_statistic();
+    fprintf(out, "{\n    \"recordings\": [");
+    for (size_t i = 0; i < input_filenames.size(); i++) {
+        while ((started < input_filenames.size()) && (started < i + jobs)) {
+            workers[started].pid = start_worker(input_filenames[started], verbose, workers[started].fd);
+            started++;
         }
 
-        close(fd);
+        profile.reset();
+        const bool ok = (workers[i].pid > 0) && finish_worker(workers[i].pid, workers[i].fd, profile);
+
+        fprintf(out, "%s\n        {\"file\": ", i ? "," : "");
+        write_json_string(out, input_filenames[i]);
+        if (ok) {
+            fprintf(out, ", \"status\": \"ok\", \"profile\": ");
+            profile.write_json(out, "        ");
+            total.merge(profile);
+        }
+        else {
+            fprintf(out, ", \"status\": \"failed\"");
+            failed++;
+        }
+        fprintf(out, "}");
     }
-    else {
-        std::cout << "Failed to open input file: " << input_filename << "\n\n";
-        exit(-1);
+    fprintf(out, "\n    ],\n    \"total\": ");
+    total.write_json(out, "    ");
+    fprintf(out, "\n}\n");
+
+    if (out != stdout) {
+        fclose(out);
     }
 
-    return 0;
-}
\ No newline at end of file
+    return failed ? 1 : 0;
+}
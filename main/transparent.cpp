@@ -32,7 +32,7 @@
 #include "outfiletransport.hpp"
 #include "internal/transparent_replay_mod.hpp"
 
-void run_mod(mod_api & mod, Front & front, wait_obj & front_event);
+void run_mod(mod_api & mod, Front & front, wait_obj & front_event, mod_rdp * recorded_mod = NULL);
 
 int main(int argc, char * argv[]) {
     openlog("transparent", LOG_CONS | LOG_PERROR, LOG_USER);
@@ -282,13 +282,17 @@ int main(int argc, char * argv[]) {
             mod_rdp_params.extra_orders                        = ini.mod_rdp.extra_orders.c_str();
             mod_rdp_params.enable_persistent_disk_bitmap_cache = ini.mod_rdp.persistent_disk_bitmap_cache;
             mod_rdp_params.enable_cache_waiting_list           = ini.mod_rdp.cache_waiting_list;
+            mod_rdp_params.mouse_move_policy                   = ini.mod_rdp.mouse_move_policy;
             mod_rdp_params.password_printing_mode              = ini.debug.password;
             mod_rdp_params.cache_verbose                       = ini.debug.cache;
 
-            mod_rdp mod(&mod_trans, front, client_info, gen, mod_rdp_params);
-            mod.get_event().st = &mod_trans;
+            {
+                // destroyed (last recorded chunks written) before record transport
+                mod_rdp mod(&mod_trans, front, client_info, gen, mod_rdp_params);
+                mod.get_event().st = &mod_trans;
 
-            run_mod(mod, front, front_event);
+                run_mod(mod, front, front_event, &mod);
+            }
 
             if (client_sck != -1) {
                 shutdown(client_sck, 2);
@@ -329,7 +333,7 @@ int main(int argc, char * argv[]) {
     return 0;
 }
 
-void run_mod(mod_api & mod, Front & front, wait_obj & front_event) {
+void run_mod(mod_api & mod, Front & front, wait_obj & front_event, mod_rdp * recorded_mod) {
     struct      timeval time_mark = { 0, 50000 };
     bool        run_session       = true;
     BackEvent_t mod_event_signal  = BACK_EVENT_NONE;
@@ -344,6 +348,14 @@ void run_mod(mod_api & mod, Front & front, wait_obj & front_event) {
             FD_ZERO(&wfds);
             struct timeval timeout = time_mark;
 
+            // wake up in time to write idle batch of recorded chunks
+            if (recorded_mod) {
+                const uint64_t delay = recorded_mod->flush_transparent_recorder(tvtime());
+                if (delay && (delay < static_cast<uint64_t>(timeout.tv_usec))) {
+                    timeout.tv_usec = delay;
+                }
+            }
+
             front_event.add_to_fd_set(rfds, max, timeout);
             mod.get_event().add_to_fd_set(rfds, max, timeout);
 
@@ -23,24 +23,38 @@
 
 #include "../mod/mod_api.hpp"
 #include "widget2/screen.hpp"
+#include "shadow_screen.hpp"
 
 struct InternalMod : public mod_api {
 public:
     FrontAPI & front;
 
+private:
+    // only for modules given ini, they draw through widgets; others also
+    // draw directly to front, shadow would miss these orders
+    ShadowScreen * shadow;
+
+    DrawApi & output;
+
+public:
     WidgetScreen screen;
 
     InternalMod(FrontAPI & front, uint16_t front_width, uint16_t front_height,
                 Inifile * ini = NULL)
         : mod_api(front_width, front_height)
         , front(front)
+        , shadow((ini && ini->internal_mod.shadow_screen)
+                 ? new ShadowScreen(front, front_width, front_height) : NULL)
+        , output(this->shadow ? static_cast<DrawApi &>(*this->shadow) : front)
         , screen(*this, front_width, front_height, NULL, ini ? &(ini->theme): NULL)
     {
         this->front.set_mod_color_depth(24);
     }
 
     virtual ~InternalMod()
-    {}
+    {
+        delete this->shadow;
+    }
 
     const Rect & get_screen_rect() const
     {
@@ -61,99 +75,99 @@ public:
 
     virtual void begin_update()
     {
-        this->front.begin_update();
+        this->output.begin_update();
     }
 
     virtual void end_update()
     {
-        this->front.end_update();
+        this->output.end_update();
     }
 
     virtual void draw(const RDPOpaqueRect & cmd, const Rect & clip)
     {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDPScrBlt & cmd, const Rect &clip)
     {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDPDestBlt & cmd, const Rect &clip)
     {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDPMultiDstBlt & cmd, const Rect & clip) {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDPMultiOpaqueRect & cmd, const Rect & clip) {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDP::RDPMultiPatBlt & cmd, const Rect & clip) {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDP::RDPMultiScrBlt & cmd, const Rect & clip) {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDPPatBlt & cmd, const Rect &clip)
     {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bmp)
     {
-        this->front.draw(cmd, clip, bmp);
+        this->output.draw(cmd, clip, bmp);
     }
 
     virtual void draw(const RDPMem3Blt & cmd, const Rect & clip, const Bitmap & bmp)
     {
-        this->front.draw(cmd, clip, bmp);
+        this->output.draw(cmd, clip, bmp);
     }
 
     virtual void draw(const RDPLineTo& cmd, const Rect & clip)
     {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDPGlyphIndex & cmd, const Rect & clip, const GlyphCache * gly_cache)
     {
-        this->front.draw(cmd, clip, gly_cache);
+        this->output.draw(cmd, clip, gly_cache);
     }
 
     virtual void draw(const RDPPolygonSC & cmd, const Rect & clip) {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDPPolygonCB & cmd, const Rect & clip) {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDPPolyline & cmd, const Rect & clip) {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDPEllipseSC & cmd, const Rect & clip)
     {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDPEllipseCB & cmd, const Rect & clip)
     {
-        this->front.draw(cmd, clip);
+        this->output.draw(cmd, clip);
     }
 
     virtual void draw(const RDP::FrameMarker & order) {
-        this->front.draw(order);
+        this->output.draw(order);
     }
 
     virtual void server_draw_text(int16_t x, int16_t y, const char * text, uint32_t fgcolor, uint32_t bgcolor, const Rect & clip)
     {
-        this->front.server_draw_text(x, y, text, fgcolor, bgcolor, clip);
+        this->output.server_draw_text(x, y, text, fgcolor, bgcolor, clip);
     }
 
     virtual void text_metrics(const char * text, int & width, int & height)
@@ -170,6 +184,9 @@ public:
 
     virtual void rdp_input_invalidate(const Rect& r)
     {
+        if (this->shadow) {
+            this->shadow->invalidate(r);
+        }
         this->screen.rdp_input_invalidate(r);
     }
 
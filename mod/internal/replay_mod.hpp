@@ -25,20 +25,58 @@
 #ifndef REDEMPTION_MOD_INTERNAL_REPLAY_MOD_HPP
 #define REDEMPTION_MOD_INTERNAL_REPLAY_MOD_HPP
 
+#include <vector>
+
 #include "FileToGraphic.hpp"
 #include "RDP/RDPGraphicDevice.hpp"
+#include "RDP/RDPDrawable.hpp"
 #include "inbymetasequencetransport.hpp"
 #include "internal_mod.hpp"
+#include "difftimeval.hpp"
 
+// Replay is paced by the module itself (FileToGraphic is not real time).
+// At normal speed recorded orders are forwarded to front as they are read.
+// Once speed has been changed or a seek occured, orders are only drawn into
+// a local framebuffer and front is updated from it with a tile diff at most
+// once per tick: intermediate frames are dropped. Front then stays in that
+// mode as it missed glyph cache orders sent while orders were not forwarded.
+//
+// Keyboard:  Up/Down        speed x2 / x0.5 (1x to 64x)
+//            Right/Left     seek +10s / -10s
+//            PgDown/PgUp    seek +60s / -60s
+//            Home           seek to beginning of recording
+//            Esc            stop replay
 class ReplayMod : public InternalMod {
+public:
+    enum {
+        MAX_SPEED   = 64,
+        TICK_USEC   = 40000,    // 25 frames per second
+        TILE_SIZE   = 64,
+        SHORT_SEEK  = 10,       // seconds
+        LONG_SEEK   = 60
+    };
+
     char movie[1024];
+    char prefix[4096];
+    char extension[128];
 
     redemption::string & auth_error_message;
 
     InByMetaSequenceTransport * in_trans;
     FileToGraphic             * reader;
 
-public:
+    // begin time of each wrm file of the sequence (each one starts with a keyframe)
+    std::vector<unsigned> chunk_begin;
+
+    RDPDrawable * shadow;
+    uint8_t     * sent;     // framebuffer content as last sent to front
+
+    bool     forward_orders;
+    unsigned speed;
+    uint64_t play_start_wall;    // usec, wall clock time
+    uint64_t play_start_record;  // usec, record time displayed at play_start_wall
+    uint64_t last_diff;
+
     ReplayMod( FrontAPI & front
              , char * replay_path
              , char * movie
@@ -47,6 +85,15 @@ public:
              , redemption::string & auth_error_message)
     : InternalMod(front, width, height)
     , auth_error_message(auth_error_message)
+    , in_trans(NULL)
+    , reader(NULL)
+    , shadow(NULL)
+    , sent(NULL)
+    , forward_orders(true)
+    , speed(1)
+    , play_start_wall(0)
+    , play_start_record(0)
+    , last_diff(0)
     {
         strncpy(this->movie, replay_path, sizeof(this->movie)-1);
         strncat(this->movie, movie, sizeof(this->movie)-1);
@@ -54,27 +101,22 @@ public:
 
         char path[1024];
         char basename[1024];
-        char extension[128];
         strcpy(path, RECORD_PATH); // default value, actual one should come from movie_path
         strcpy(basename, "replay"); // default value actual one should come from movie_path
-        strcpy(extension, ".mwrm"); // extension is currently ignored
-        char prefix[4096];
+        strcpy(this->extension, ".mwrm"); // extension is currently ignored
         bool res = true;
         res = canonical_path( this->movie
                             , path, sizeof(path)
                             , basename, sizeof(basename)
-                            , extension, sizeof(extension)
+                            , this->extension, sizeof(this->extension)
                             );
         if (!res) {
             LOG(LOG_ERR, "Buffer Overflowed: Path too long");
             throw Error(ERR_RECORDER_FAILED_TO_FOUND_PATH);
         }
-        snprintf(prefix,  sizeof(prefix), "%s%s", path, basename);
+        snprintf(this->prefix, sizeof(this->prefix), "%s%s", path, basename);
 
-        this->in_trans = new InByMetaSequenceTransport(prefix, extension);
-        timeval begin_capture; begin_capture.tv_sec = 0; begin_capture.tv_usec = 0;
-        timeval end_capture; end_capture.tv_sec = 0; end_capture.tv_usec = 0;
-        this->reader = new FileToGraphic(this->in_trans, begin_capture, end_capture, true, 0);
+        this->open_reader(0);
 
         switch (this->front.server_resize( this->reader->info_width
                                          , this->reader->info_height
@@ -101,18 +143,186 @@ public:
 
         this->reader->add_consumer((RDPGraphicDevice *)&this->front, NULL);
         this->front.send_global_palette();
+
+        this->load_chunk_index();
+
+        this->play_start_wall   = ustime();
+        this->play_start_record = ustime(this->reader->record_now);
     }
 
     virtual ~ReplayMod()
     {
-        if (reader)
-            delete reader;
-
-        if (in_trans)
-            delete in_trans;
+        delete this->reader;
+        delete this->in_trans;
+        delete this->shadow;
+        delete [] this->sent;
         this->screen.clear();
     }
 
+    // (re)open sequence at given wrm file, orders are drawn to shadow framebuffer only
+    void open_reader(unsigned chunk)
+    {
+        timeval begin_capture; begin_capture.tv_sec = 0; begin_capture.tv_usec = 0;
+        timeval end_capture; end_capture.tv_sec = 0; end_capture.tv_usec = 0;
+
+        // an incremental keyframe is rebuilt from the last full one
+        unsigned chained = 0;
+        for (;;) {
+            delete this->reader;
+            this->reader = NULL;
+            delete this->in_trans;
+            this->in_trans = NULL;
+
+            this->in_trans = new InByMetaSequenceTransport(this->prefix, this->extension);
+            for (unsigned i = 0; i < chunk; i++) {
+                this->in_trans->next_chunk_info();
+            }
+            this->reader = new FileToGraphic(this->in_trans, begin_capture, end_capture, false, 0);
+
+            if (chained || !this->reader->keyframe_files_back || (this->reader->keyframe_files_back > chunk)) {
+                break;
+            }
+            chunk   -= this->reader->keyframe_files_back;
+            chained  = this->reader->keyframes_back;
+        }
+        this->reader->chain_keyframes(chained);
+
+        if (!this->shadow) {
+            this->shadow = new RDPDrawable(this->reader->info_width, this->reader->info_height);
+            this->sent   = new uint8_t[this->shadow->drawable.pix_len];
+            memset(this->sent, 0, this->shadow->drawable.pix_len);
+        }
+        else {
+            // keyframe of first wrm file is read by FileToGraphic constructor,
+            // before shadow is attached: recording starts on a black screen
+            memset(this->shadow->drawable.data, 0, this->shadow->drawable.pix_len);
+        }
+        this->reader->add_consumer(this->shadow, this->shadow);
+    }
+
+    void load_chunk_index()
+    {
+        try {
+            InByMetaSequenceTransport index_trans(this->prefix, this->extension);
+            for (;;) {
+                index_trans.next_chunk_info();
+                this->chunk_begin.push_back(index_trans.begin_chunk_time);
+            }
+        }
+        catch (Error & e) {
+            // end of sequence
+        }
+    }
+
+    // stop forwarding orders, front is now refreshed from shadow framebuffer
+    void stop_forwarding_orders()
+    {
+        if (this->forward_orders) {
+            this->forward_orders = false;
+            this->reader->nbconsumers = 1;
+            // nothing is known of what front displays
+            memset(this->sent, 0xFF, this->shadow->drawable.pix_len);
+        }
+    }
+
+    uint64_t record_target(uint64_t now) const
+    {
+        return this->play_start_record + (now - this->play_start_wall) * this->speed;
+    }
+
+    void set_speed(unsigned speed, uint64_t now)
+    {
+        this->play_start_record = std::max(this->record_target(now), ustime(this->reader->record_now));
+        this->play_start_wall   = now;
+        this->speed             = speed;
+        if (speed > 1) {
+            this->stop_forwarding_orders();
+        }
+        LOG(LOG_INFO, "ReplayMod: speed x%u", speed);
+    }
+
+    // jump to given record time (seconds), restarting from last keyframe before it
+    void seek(unsigned target, uint64_t now)
+    {
+        if (!this->chunk_begin.empty() && (target < this->chunk_begin[0])) {
+            target = this->chunk_begin[0];
+        }
+
+        size_t chunk = 0;
+        while ((chunk + 1 < this->chunk_begin.size()) && (this->chunk_begin[chunk + 1] <= target)) {
+            chunk++;
+        }
+
+        this->stop_forwarding_orders();
+
+        const unsigned current = this->reader->record_now.tv_sec;
+        const bool same_chunk = (chunk + 1 >= this->chunk_begin.size())
+                             || (current < this->chunk_begin[chunk + 1]);
+        if (  this->chunk_begin.empty()
+           || (target < current)
+           || (current < this->chunk_begin[chunk])
+           || !same_chunk) {
+            // keyframe at start of wrm file restores the whole screen
+            this->open_reader(chunk);
+        }
+
+        this->play_start_record = static_cast<uint64_t>(target) * 1000000;
+        this->play_start_wall   = now;
+        this->last_diff         = 0;
+        LOG(LOG_INFO, "ReplayMod: seek to %u (wrm file %u)", target, static_cast<unsigned>(chunk));
+    }
+
+    // decode orders until record time reaches target,
+    // returns false at end of recording
+    bool decode_until(uint64_t target)
+    {
+        while (ustime(this->reader->record_now) <= target) {
+            if (!this->reader->next_order()) {
+                return false;
+            }
+            this->reader->interpret_order();
+        }
+        return true;
+    }
+
+    // send tiles of shadow framebuffer that differ from what front displays
+    void send_screen_diff()
+    {
+        const Drawable & drawable = this->shadow->drawable;
+        uint8_t tile[TILE_SIZE * TILE_SIZE * 3];
+
+        this->front.begin_update();
+        for (uint16_t y = 0; y < drawable.height; y += TILE_SIZE) {
+            const uint16_t cy = std::min<uint16_t>(TILE_SIZE, drawable.height - y);
+            for (uint16_t x = 0; x < drawable.width; x += TILE_SIZE) {
+                const uint16_t cx = std::min<uint16_t>(TILE_SIZE, drawable.width - x);
+                const size_t   line_size = cx * Drawable::Bpp;
+                const size_t   offset    = y * drawable.rowsize + x * Drawable::Bpp;
+
+                uint16_t row = 0;
+                while ((row < cy)
+                && !memcmp(drawable.data + offset + row * drawable.rowsize,
+                           this->sent + offset + row * drawable.rowsize, line_size)) {
+                    row++;
+                }
+                if (row == cy) {
+                    continue;
+                }
+
+                // bitmap rows are stored bottom-up, packed 24 bpp
+                for (row = 0; row < cy; row++) {
+                    const size_t src = offset + row * drawable.rowsize;
+                    Drawable::pixels_to_packed24(tile + (cy - row - 1) * cx * 3, drawable.data + src, cx);
+                    memcpy(this->sent + src, drawable.data + src, line_size);
+                }
+                Bitmap bmp(24, 24, NULL, cx, cy, tile, cy * cx * 3);
+                const Rect rect(x, y, cx, cy);
+                this->front.draw(RDPMemBlt(0, rect, 0xCC, 0, 0, 0), rect, bmp);
+            }
+        }
+        this->front.end_update();
+    }
+
     virtual void rdp_input_invalidate(const Rect & /*rect*/)
     {
     }
@@ -122,8 +332,45 @@ public:
     }
 
     virtual void rdp_input_scancode(long /*param1*/, long /*param2*/,
-                                    long /*param3*/, long /*param4*/, Keymap2 * /*keymap*/)
+                                    long /*param3*/, long /*param4*/, Keymap2 * keymap)
     {
+        const uint64_t now = ustime();
+        const unsigned position = this->reader->record_now.tv_sec;
+        while (keymap->nb_kevent_available() > 0) {
+            switch (keymap->get_kevent()) {
+            case Keymap2::KEVENT_UP_ARROW:
+                if (this->speed < MAX_SPEED) {
+                    this->set_speed(this->speed * 2, now);
+                }
+                break;
+            case Keymap2::KEVENT_DOWN_ARROW:
+                if (this->speed > 1) {
+                    this->set_speed(this->speed / 2, now);
+                }
+                break;
+            case Keymap2::KEVENT_RIGHT_ARROW:
+                this->seek(position + SHORT_SEEK, now);
+                break;
+            case Keymap2::KEVENT_LEFT_ARROW:
+                this->seek((position > SHORT_SEEK) ? position - SHORT_SEEK : 0, now);
+                break;
+            case Keymap2::KEVENT_PGDOWN:
+                this->seek(position + LONG_SEEK, now);
+                break;
+            case Keymap2::KEVENT_PGUP:
+                this->seek((position > LONG_SEEK) ? position - LONG_SEEK : 0, now);
+                break;
+            case Keymap2::KEVENT_HOME:
+                this->seek(0, now);
+                break;
+            case Keymap2::KEVENT_ESC:
+                this->event.signal = BACK_EVENT_STOP;
+                break;
+            default:
+                break;
+            }
+        }
+        this->event.set();
     }
 
     virtual void rdp_input_synchronize(uint32_t /*time*/, uint16_t /*device_flags*/,
@@ -136,19 +383,35 @@ public:
     // non 0 if it wants to stop (to run another module)
     virtual void draw_event(time_t now)
     {
-        TODO("use system constants for sizes");
         TODO("RZ: Support encrypted recorded file.");
+        if (this->event.signal == BACK_EVENT_STOP) {
+            this->event.set(1);
+            return;
+        }
         try
         {
-            int i;
-            for (i = 0; (i < 500) && this->reader->next_order(); i++) {
-                this->reader->interpret_order();
+            const uint64_t wall   = ustime();
+            const uint64_t target = this->record_target(wall);
+            const bool     more   = this->decode_until(target);
+
+            if (this->forward_orders) {
+                this->front.flush();
             }
-            if (i == 500) {
-                this->event.set(1);
+            else if (!more || (wall - this->last_diff >= TICK_USEC)) {
+                this->send_screen_diff();
+                this->front.flush();
+                this->last_diff = wall;
+            }
+
+            if (more) {
+                // wake up when next timestamp is due, or at next tick
+                uint64_t wait = (ustime(this->reader->record_now) - target) / this->speed;
+                if (!this->forward_orders && (wait > TICK_USEC)) {
+                    wait = TICK_USEC;
+                }
+                this->event.set(wait ? wait : 1);
             }
             else {
-                this->front.flush();
                 this->event.signal = BACK_EVENT_STOP;
                 this->event.set(1);
             }
@@ -0,0 +1,545 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *   Product name: redemption, a FLOSS RDP proxy
+ *   Copyright (C) Wallix 2014
+ *   Author(s): Christophe Grosjean, Raphael Zhou
+ *
+ *   Shadow of client screen for internal modules. Widgets repaint
+ *   themselves entirely (background, then texts and images), orders of an
+ *   update are hence kept until end of update, then only replayed on the
+ *   bands of screen whose pixels actually changed.
+ *
+ *   A pixel of shadow is not a color but a value such that equal values
+ *   are equal client pixels:
+ *     - 24 bits color for OpaqueRect and 24 bpp MemBlt (SRCCOPY),
+ *     - identifier of text drawing (text, colors and position), text
+ *       background is opaque, so the whole text box is known,
+ *     - unknown for pixels written by any other order, or not yet drawn.
+ *
+ *   Module color depth is 24 bits.
+ */
+
+#ifndef REDEMPTION_MOD_INTERNAL_SHADOW_SCREEN_HPP
+#define REDEMPTION_MOD_INTERNAL_SHADOW_SCREEN_HPP
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "draw_api.hpp"
+#include "bitmap.hpp"
+#include "colors.hpp"
+
+class ShadowScreen : public DrawApi {
+    enum {
+        UNKNOWN_PIXEL = 0xFFFFFFFFu,
+        TEXT_PIXEL    = 0x80000000u
+    };
+
+    enum {
+        // unchanged rows between two changed ones that are still sent
+        // within the same band, rather than resending orders crossing both
+        BAND_GAP = 8,
+        // texts identifiers kept for reuse
+        MAX_TEXT_IDS = 4096,
+        // longer texts are truncated by front, not modelled
+        MAX_TEXT_LENGTH = 120
+    };
+
+    struct Pending {
+        enum {
+            OPAQUE_RECT,
+            MEM_BLT,
+            TEXT
+        };
+
+        unsigned    type;
+        Rect        area;   // drawn pixels, within screen
+        uint32_t    value;  // pixel value, except for MEM_BLT
+        uint32_t    color;  // OPAQUE_RECT
+        uint16_t    cache_id;
+        uint16_t    cache_idx;
+        Bitmap    * bmp;    // MEM_BLT, pixels of area only
+        int16_t     x;      // TEXT
+        int16_t     y;
+        uint32_t    fgcolor;
+        uint32_t    bgcolor;
+        std::string text;
+
+        Pending(unsigned type, const Rect & area)
+        : type(type)
+        , area(area)
+        , value(0)
+        , color(0)
+        , cache_id(0)
+        , cache_idx(0)
+        , bmp(NULL)
+        , x(0)
+        , y(0)
+        , fgcolor(0)
+        , bgcolor(0)
+        {}
+
+        void paint_row(uint32_t * row, int16_t y) const {
+            if (this->type == MEM_BLT) {
+                const size_t stepsource = this->bmp->bmp_size / this->bmp->cy;
+                const uint8_t * source = this->bmp->data()
+                                       + (this->bmp->cy - (y - this->area.y) - 1) * stepsource;
+                uint32_t * target = row + this->area.x;
+                for (uint16_t i = 0; i < this->area.cx; i++, source += 3) {
+                    target[i] = source[0] | (source[1] << 8) | (source[2] << 16);
+                }
+            }
+            else {
+                std::fill(row + this->area.x, row + this->area.right(), this->value);
+            }
+        }
+    };
+
+    DrawApi & target;
+
+    const uint16_t width;
+    const uint16_t height;
+
+    uint32_t * screen;  // pixel values known to be on client
+    uint32_t * row;     // row of screen with pending orders applied
+
+    std::vector<Pending> pending;
+    Rect                 pending_area;
+    int                  update_level;
+
+    std::map<std::string, uint32_t> text_ids;
+    uint32_t                        next_text_id;
+
+public:
+    unsigned long received_orders;
+    unsigned long sent_orders;
+
+    ShadowScreen(DrawApi & target, uint16_t width, uint16_t height)
+    : target(target)
+    , width(width)
+    , height(height)
+    , screen(new uint32_t[width * height])
+    , row(new uint32_t[width])
+    , update_level(0)
+    , next_text_id(0)
+    , received_orders(0)
+    , sent_orders(0)
+    {
+        this->invalidate(Rect(0, 0, width, height));
+    }
+
+    virtual ~ShadowScreen()
+    {
+        this->clear_pending();
+        delete [] this->row;
+        delete [] this->screen;
+    }
+
+    // Client screen content of area is lost (refresh requested by client,
+    // or drawn behind module back), it is sent again on next drawing.
+    void invalidate(const Rect & area)
+    {
+        this->fill(area, UNKNOWN_PIXEL);
+    }
+
+    virtual void begin_update()
+    {
+        this->update_level++;
+        this->target.begin_update();
+    }
+
+    virtual void end_update()
+    {
+        if (this->update_level > 0) {
+            this->update_level--;
+        }
+        if (this->update_level == 0) {
+            this->flush_pending();
+        }
+        this->target.end_update();
+    }
+
+    virtual void flush()
+    {
+        this->flush_pending();
+        this->target.flush();
+    }
+
+    virtual void draw(const RDPOpaqueRect & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        const Rect area = clip.intersect(this->width, this->height).intersect(cmd.rect);
+        if (area.isempty()) {
+            return;
+        }
+        Pending order(Pending::OPAQUE_RECT, area);
+        order.color = cmd.color;
+        order.value = RGBtoBGR(cmd.color & 0xFFFFFF);
+        this->queue(order);
+    }
+
+    virtual void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bmp)
+    {
+        this->received_orders++;
+        if ((cmd.rop != 0xCC) || (bmp.original_bpp != 24)) {
+            this->draw_unknown(cmd.rect.intersect(clip));
+            this->target.draw(cmd, clip, bmp);
+            return;
+        }
+        if ((bmp.cx < cmd.srcx) || (bmp.cy < cmd.srcy)) {
+            return;
+        }
+        const Rect area = clip.intersect(this->width, this->height).intersect(cmd.rect)
+                              .intersect(Rect(cmd.rect.x, cmd.rect.y, bmp.cx - cmd.srcx, bmp.cy - cmd.srcy));
+        if (area.isempty()) {
+            return;
+        }
+        Pending order(Pending::MEM_BLT, area);
+        order.cache_id  = cmd.cache_id;
+        order.cache_idx = cmd.cache_idx;
+        order.bmp       = new Bitmap(bmp, Rect( cmd.srcx + (area.x - cmd.rect.x)
+                                              , cmd.srcy + (area.y - cmd.rect.y)
+                                              , area.cx, area.cy));
+        this->queue(order);
+    }
+
+    virtual void server_draw_text(int16_t x, int16_t y, const char * text,
+                                  uint32_t fgcolor, uint32_t bgcolor, const Rect & clip)
+    {
+        this->received_orders++;
+        if (!text[0]) {
+            return;
+        }
+        if (strlen(text) > MAX_TEXT_LENGTH) {
+            this->draw_unknown(clip);
+            this->target.server_draw_text(x, y, text, fgcolor, bgcolor, clip);
+            return;
+        }
+
+        // text box painted by front, with opaque background
+        int w = 0;
+        int h = 0;
+        this->target.text_metrics(text, w, h);
+        const Rect area = clip.intersect(this->width, this->height).intersect(Rect(x, y, w + 1, h + 1));
+        if (area.isempty()) {
+            return;
+        }
+        Pending order(Pending::TEXT, area);
+        order.x       = x;
+        order.y       = y;
+        order.fgcolor = fgcolor;
+        order.bgcolor = bgcolor;
+        order.text    = text;
+        order.value   = this->text_id(order);
+        this->queue(order);
+    }
+
+    virtual void text_metrics(const char * text, int & width, int & height)
+    {
+        this->target.text_metrics(text, width, height);
+    }
+
+    virtual void draw(const RDPScrBlt & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        this->flush_pending();
+        this->sent_orders++;
+        this->target.draw(cmd, clip);
+
+        const Rect drect = clip.intersect(this->width, this->height).intersect(cmd.rect);
+        if (drect.isempty()) {
+            return;
+        }
+        const Rect srect = drect.offset(cmd.srcx - cmd.rect.x, cmd.srcy - cmd.rect.y);
+        if ((cmd.rop != 0xCC) || !Rect(0, 0, this->width, this->height).contains(srect)) {
+            this->invalidate(drect);
+            return;
+        }
+        // screen to screen copy, source may overlap destination
+        for (uint16_t i = 0; i < drect.cy; i++) {
+            const uint16_t line = (srect.y < drect.y) ? (drect.cy - 1 - i) : i;
+            memmove( this->screen + (drect.y + line) * this->width + drect.x
+                   , this->screen + (srect.y + line) * this->width + srect.x
+                   , drect.cx * sizeof(uint32_t));
+        }
+    }
+
+    virtual void draw(const RDPDestBlt & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        this->draw_unknown(cmd.rect.intersect(clip));
+        this->target.draw(cmd, clip);
+    }
+
+    virtual void draw(const RDPMultiDstBlt & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        this->draw_unknown(Rect(cmd.nLeftRect, cmd.nTopRect, cmd.nWidth, cmd.nHeight).intersect(clip));
+        this->target.draw(cmd, clip);
+    }
+
+    virtual void draw(const RDPMultiOpaqueRect & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        this->draw_unknown(Rect(cmd.nLeftRect, cmd.nTopRect, cmd.nWidth, cmd.nHeight).intersect(clip));
+        this->target.draw(cmd, clip);
+    }
+
+    virtual void draw(const RDP::RDPMultiPatBlt & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        this->draw_unknown(Rect(cmd.nLeftRect, cmd.nTopRect, cmd.nWidth, cmd.nHeight).intersect(clip));
+        this->target.draw(cmd, clip);
+    }
+
+    virtual void draw(const RDP::RDPMultiScrBlt & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        this->draw_unknown(Rect(cmd.nLeftRect, cmd.nTopRect, cmd.nWidth, cmd.nHeight).intersect(clip));
+        this->target.draw(cmd, clip);
+    }
+
+    virtual void draw(const RDPPatBlt & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        this->draw_unknown(cmd.rect.intersect(clip));
+        this->target.draw(cmd, clip);
+    }
+
+    virtual void draw(const RDPMem3Blt & cmd, const Rect & clip, const Bitmap & bmp)
+    {
+        this->received_orders++;
+        this->draw_unknown(cmd.rect.intersect(clip));
+        this->target.draw(cmd, clip, bmp);
+    }
+
+    // orders below are not bounded by a rectangle, clip is lost
+
+    virtual void draw(const RDPLineTo & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        this->draw_unknown(clip);
+        this->target.draw(cmd, clip);
+    }
+
+    virtual void draw(const RDPGlyphIndex & cmd, const Rect & clip, const GlyphCache * gly_cache)
+    {
+        this->received_orders++;
+        this->draw_unknown(clip);
+        this->target.draw(cmd, clip, gly_cache);
+    }
+
+    virtual void draw(const RDPPolygonSC & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        this->draw_unknown(clip);
+        this->target.draw(cmd, clip);
+    }
+
+    virtual void draw(const RDPPolygonCB & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        this->draw_unknown(clip);
+        this->target.draw(cmd, clip);
+    }
+
+    virtual void draw(const RDPPolyline & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        this->draw_unknown(clip);
+        this->target.draw(cmd, clip);
+    }
+
+    virtual void draw(const RDPEllipseSC & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        this->draw_unknown(clip);
+        this->target.draw(cmd, clip);
+    }
+
+    virtual void draw(const RDPEllipseCB & cmd, const Rect & clip)
+    {
+        this->received_orders++;
+        this->draw_unknown(clip);
+        this->target.draw(cmd, clip);
+    }
+
+    virtual void draw(const RDP::FrameMarker & order)
+    {
+        this->flush_pending();
+        this->target.draw(order);
+    }
+
+    virtual void server_set_pointer(const Pointer & cursor)
+    {
+        this->target.server_set_pointer(cursor);
+    }
+
+    virtual void set_pointer(int cache_idx)
+    {
+        this->target.set_pointer(cache_idx);
+    }
+
+private:
+    ShadowScreen(const ShadowScreen &);
+    ShadowScreen & operator=(const ShadowScreen &);
+
+    void fill(const Rect & area, uint32_t value)
+    {
+        const Rect r = area.intersect(this->width, this->height);
+        for (int16_t y = r.y; y < r.bottom(); y++) {
+            uint32_t * line = this->screen + y * this->width;
+            std::fill(line + r.x, line + r.right(), value);
+        }
+    }
+
+    // order not modelled, keeps drawing order with pending ones
+    void draw_unknown(const Rect & area)
+    {
+        this->flush_pending();
+        this->invalidate(area);
+        this->sent_orders++;
+    }
+
+    uint32_t text_id(const Pending & order)
+    {
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "%d,%d,%06x,%06x,",
+                 order.x, order.y, order.fgcolor & 0xFFFFFF, order.bgcolor & 0xFFFFFF);
+        const std::string key = prefix + order.text;
+
+        std::map<std::string, uint32_t>::iterator it = this->text_ids.find(key);
+        if (it != this->text_ids.end()) {
+            return it->second;
+        }
+        if (this->text_ids.size() >= MAX_TEXT_IDS) {
+            // forgotten texts only get a new identifier when drawn again
+            this->text_ids.clear();
+        }
+        const uint32_t id = TEXT_PIXEL | (this->next_text_id++ % (TEXT_PIXEL - 1));
+        this->text_ids[key] = id;
+        return id;
+    }
+
+    void queue(const Pending & order)
+    {
+        this->pending_area = this->pending.empty()
+                           ? order.area
+                           : this->pending_area.enlarge_to(order.area.x, order.area.y)
+                                               .enlarge_to(order.area.right() - 1, order.area.bottom() - 1);
+        this->pending.push_back(order);
+        if (this->update_level == 0) {
+            this->flush_pending();
+        }
+    }
+
+    void clear_pending()
+    {
+        for (size_t i = 0; i < this->pending.size(); i++) {
+            delete this->pending[i].bmp;
+        }
+        this->pending.clear();
+    }
+
+    // Applies pending orders to shadow, row by row, and sends them again
+    // clipped to bands of changed rows.
+    void flush_pending()
+    {
+        if (this->pending.empty()) {
+            return;
+        }
+
+        const Rect & area = this->pending_area;
+        std::vector<Rect> bands;
+        Rect band;
+        int16_t last_changed_row = 0;
+        for (int16_t y = area.y; y < area.bottom(); y++) {
+            uint32_t * line = this->screen + y * this->width;
+            std::copy(line + area.x, line + area.right(), this->row + area.x);
+            for (size_t i = 0; i < this->pending.size(); i++) {
+                const Pending & order = this->pending[i];
+                if ((order.area.y <= y) && (y < order.area.bottom())) {
+                    order.paint_row(this->row, y);
+                }
+            }
+
+            int16_t left = area.x;
+            while ((left < area.right()) && (this->row[left] == line[left])) {
+                left++;
+            }
+            if (left == area.right()) {
+                continue;
+            }
+            int16_t right = area.right();
+            while (this->row[right - 1] == line[right - 1]) {
+                right--;
+            }
+            std::copy(this->row + left, this->row + right, line + left);
+
+            if (!band.isempty() && (y - last_changed_row <= BAND_GAP)) {
+                band = band.enlarge_to(left, y).enlarge_to(right - 1, y);
+            }
+            else {
+                if (!band.isempty()) {
+                    bands.push_back(band);
+                }
+                band = Rect(left, y, right - left, 1);
+            }
+            last_changed_row = y;
+        }
+        if (!band.isempty()) {
+            bands.push_back(band);
+        }
+
+        for (size_t i = 0; i < this->pending.size(); i++) {
+            const Pending & order = this->pending[i];
+            for (size_t b = 0; b < bands.size(); b++) {
+                const Rect clip = order.area.intersect(bands[b]);
+                if (!clip.isempty()) {
+                    this->send(order, clip);
+                }
+            }
+        }
+        this->clear_pending();
+    }
+
+    void send(const Pending & order, const Rect & clip)
+    {
+        this->sent_orders++;
+        switch (order.type) {
+        case Pending::OPAQUE_RECT:
+            this->target.draw(RDPOpaqueRect(clip, order.color), clip);
+            break;
+        case Pending::MEM_BLT:
+            this->target.draw(RDPMemBlt( order.cache_id, clip, 0xCC
+                                       , clip.x - order.area.x, clip.y - order.area.y
+                                       , order.cache_idx)
+                             , clip, *order.bmp);
+            break;
+        default:
+            this->target.server_draw_text(order.x, order.y, order.text.c_str(),
+                                          order.fgcolor, order.bgcolor, clip);
+            break;
+        }
+    }
+};
+
+#endif
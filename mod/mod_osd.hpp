@@ -380,6 +380,26 @@ public:
         this->mod.rdp_input_synchronize(time, device_flags, param1, param2);
     }
 
+    virtual void rdp_input_batch_begin()
+    {
+        this->mod.rdp_input_batch_begin();
+    }
+
+    virtual void rdp_input_batch_end()
+    {
+        this->mod.rdp_input_batch_end();
+    }
+
+    virtual void rdp_suppress_display_updates()
+    {
+        this->mod.rdp_suppress_display_updates();
+    }
+
+    virtual void rdp_allow_display_updates(uint16_t left, uint16_t top, uint16_t right, uint16_t bottom)
+    {
+        this->mod.rdp_allow_display_updates(left, top, right, bottom);
+    }
+
     virtual void rdp_input_scancode(long int param1, long int param2, long int param3, long int param4, Keymap2* keymap)
     {
         if (keymap->nb_kevent_available() > 0){
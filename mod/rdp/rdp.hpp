@@ -53,18 +53,73 @@
 #include "colors.hpp"
 #include "RDP/autoreconnect.hpp"
 #include "RDP/bitmapupdate.hpp"
+#include "phase_timer.hpp"
 #include "RDP/clipboard.hpp"
 #include "RDP/fastpath.hpp"
 #include "RDP/PersistentKeyListPDU.hpp"
 #include "RDP/protocol.hpp"
 #include "RDP/RefreshRectPDU.hpp"
 #include "RDP/SaveSessionInfoPDU.hpp"
+#include "RDP/SuppressOutputPDU.hpp"
 #include "RDP/pointer.hpp"
 #include "rdp_params.hpp"
+#include "rdp_input_batch.hpp"
 #include "transparentrecorder.hpp"
 
 #include "genrandom.hpp"
 
+// Rectangles of one Bitmap Update PDU, decoded.
+struct DecodedBitmapUpdate {
+    struct Rectangle {
+        RDPBitmapData   bmpdata;
+        const uint8_t * data;
+        const Bitmap  * bitmap;
+        bool            memblt;     // sent as MemBlt instead of Bitmap Update
+    };
+
+    Rectangle      * rectangles;
+    const Bitmap * * memblts;
+    size_t           count;
+    size_t           nb_memblts;
+
+    explicit DecodedBitmapUpdate(size_t max_count)
+    : rectangles(new Rectangle[max_count])
+    , memblts(new const Bitmap *[max_count])
+    , count(0)
+    , nb_memblts(0)
+    {}
+
+    ~DecodedBitmapUpdate() {
+        for (size_t i = 0; i < this->count; i++) {
+            delete this->rectangles[i].bitmap;
+        }
+        delete [] this->memblts;
+        delete [] this->rectangles;
+    }
+
+    const Bitmap & add(const RDPBitmapData & bmpdata, const uint8_t * data, const Bitmap * bitmap) {
+        Rectangle & r = this->rectangles[this->count++];
+        r.bmpdata = bmpdata;
+        r.data    = data;
+        r.bitmap  = bitmap;
+        r.memblt  = false;
+        return *bitmap;
+    }
+
+    void use_memblt(size_t i) {
+        this->rectangles[i].memblt = true;
+        this->memblts[this->nb_memblts++] = this->rectangles[i].bitmap;
+    }
+
+    const Bitmap * const * memblt_bitmaps() const {
+        return this->memblts;
+    }
+
+    size_t memblt_count() const {
+        return this->nb_memblts;
+    }
+};
+
 struct mod_rdp : public mod_api {
     FrontAPI & front;
 
@@ -154,6 +209,10 @@ struct mod_rdp : public mod_api {
     const bool enable_cache_waiting_list;
     const int  rdp_compression;
 
+    InputBatch input_batch;
+
+    bool server_suppress_output_support;    // from server General Capability Set
+
     size_t recv_bmp_update;
 
     rdp_mppc_unified_dec mppc_dec;
@@ -237,6 +296,8 @@ struct mod_rdp : public mod_api {
         , enable_persistent_disk_bitmap_cache(mod_rdp_params.enable_persistent_disk_bitmap_cache)
         , enable_cache_waiting_list(mod_rdp_params.enable_cache_waiting_list)
         , rdp_compression(mod_rdp_params.rdp_compression)
+        , input_batch(mod_rdp_params.mouse_move_policy)
+        , server_suppress_output_support(false)
         , recv_bmp_update(0)
         , error_message(mod_rdp_params.error_message)
         , disconnect_on_logon_user_change(mod_rdp_params.disconnect_on_logon_user_change)
@@ -457,6 +518,16 @@ struct mod_rdp : public mod_api {
         }
     }
 
+    // writes recorded chunks left idle in transparent recorder batch,
+    // returns delay (in microseconds) before next call is useful
+    uint64_t flush_transparent_recorder(const timeval & now) {
+        if (!this->transparent_recorder) {
+            return 0;
+        }
+        this->transparent_recorder->periodic(now);
+        return this->transparent_recorder->periodic_delay(now);
+    }
+
     void configure_extra_orders(const char * extra_orders) {
         const char * tmp_extra_orders  = extra_orders;
         uint8_t      order_number;
@@ -566,6 +637,48 @@ struct mod_rdp : public mod_api {
         }
     }
 
+    virtual void rdp_input_batch_begin() {
+        this->input_batch.opened = true;
+    }
+
+    virtual void rdp_input_batch_end() {
+        this->input_batch.opened = false;
+        this->send_input_batch();
+    }
+
+    virtual void rdp_suppress_display_updates() {
+        if (this->verbose & 4){
+            LOG(LOG_INFO, "mod_rdp::rdp_suppress_display_updates");
+        }
+        if ((UP_AND_RUNNING == this->connection_finalization_state)
+        && this->server_suppress_output_support) {
+            RDP::SuppressOutputPDU sopdu(this->share_id,
+                                         this->userid,
+                                         this->encryptionLevel,
+                                         this->encrypt);
+            sopdu.suppressDisplayUpdates();
+            sopdu.emit(*this->nego.trans);
+        }
+    }
+
+    virtual void rdp_allow_display_updates(uint16_t left, uint16_t top, uint16_t right, uint16_t bottom) {
+        if (this->verbose & 4){
+            LOG(LOG_INFO, "mod_rdp::rdp_allow_display_updates");
+        }
+        if (!this->server_suppress_output_support) {
+            this->rdp_input_invalidate(Rect(left, top, right - left + 1, bottom - top + 1));
+        }
+        else if (UP_AND_RUNNING == this->connection_finalization_state) {
+            // server repaints desktop rectangle by itself
+            RDP::SuppressOutputPDU sopdu(this->share_id,
+                                         this->userid,
+                                         this->encryptionLevel,
+                                         this->encrypt);
+            sopdu.allowDisplayUpdates(left, top, right, bottom);
+            sopdu.emit(*this->nego.trans);
+        }
+    }
+
     virtual void send_to_front_channel( const char * const mod_channel_name, uint8_t * data
                                         , size_t length, size_t chunk_size, int flags) {
         if (this->transparent_recorder) {
@@ -738,7 +851,10 @@ struct mod_rdp : public mod_api {
 
     virtual void draw_event(time_t now)
     {
+        PHASE_TIMER(PHASE_MOD_RDP_DRAW_EVENT);
+
         if (!this->event.waked_up_by_time) {
+            session_stats().mod_pdus_received++;
             try{
                 char * hostname = this->hostname;
 
@@ -3754,6 +3870,7 @@ struct mod_rdp : public mod_api {
                     if (this->verbose & 1) {
                         general_caps.log("Received from server");
                     }
+                    this->server_suppress_output_support = general_caps.suppressOutputSupport;
                     if (output_file)
                     {
                         general_caps.dump(output_file);
@@ -4098,7 +4215,7 @@ struct mod_rdp : public mod_api {
 
 public:
 
-    void send_input_slowpath(int time, int message_type, int device_flags, int param1, int param2) throw(Error)
+    void send_input_slowpath(const InputBatch::Event * events, size_t count) throw(Error)
     {
         if (this->verbose & 4){
             LOG(LOG_INFO, "mod_rdp::send_input_slowpath");
@@ -4108,13 +4225,15 @@ public:
         sdata.emit_begin(PDUTYPE2_INPUT, this->share_id, RDP::STREAM_HI);
 
         // Payload
-        stream.out_uint16_le(1); /* number of events */
+        stream.out_uint16_le(count); /* number of events */
         stream.out_uint16_le(0);
-        stream.out_uint32_le(time);
-        stream.out_uint16_le(message_type);
-        stream.out_uint16_le(device_flags);
-        stream.out_uint16_le(param1);
-        stream.out_uint16_le(param2);
+        for (size_t i = 0; i < count; i++) {
+            stream.out_uint32_le(events[i].time);
+            stream.out_uint16_le(events[i].message_type);
+            stream.out_uint16_le(events[i].device_flags);
+            stream.out_uint16_le(events[i].param1);
+            stream.out_uint16_le(events[i].param2);
+        }
         stream.mark_end();
 
         // Packet trailer
@@ -4135,40 +4254,44 @@ public:
         }
     }
 
-    void send_input_fastpath(int time, int message_type, int device_flags, int param1, int param2) throw(Error) {
+    void send_input_fastpath(const InputBatch::Event * events, size_t count) throw(Error) {
         if (this->verbose & 4) {
             LOG(LOG_INFO, "mod_rdp::send_input_fastpath");
         }
 
         BStream fastpath_header(256);
-        HStream stream(256, 512);
+        // mouse events are the largest ones (7 bytes)
+        HStream stream(256, 256 + InputBatch::MAX_EVENTS * 7);
 
-        switch (message_type) {
-        case RDP_INPUT_SCANCODE:
-            {
-                FastPath::KeyboardEvent_Send ke(stream, (uint16_t)device_flags, param1);
-            }
-            break;
+        for (size_t i = 0; i < count; i++) {
+            const InputBatch::Event & event = events[i];
+            switch (event.message_type) {
+            case RDP_INPUT_SCANCODE:
+                {
+                    FastPath::KeyboardEvent_Send ke(stream, event.device_flags, event.param1);
+                }
+                break;
 
-        case RDP_INPUT_SYNCHRONIZE:
-            {
-                FastPath::SynchronizeEvent_Send se(stream, param1);
-            }
-            break;
+            case RDP_INPUT_SYNCHRONIZE:
+                {
+                    FastPath::SynchronizeEvent_Send se(stream, event.param1);
+                }
+                break;
 
-        case RDP_INPUT_MOUSE:
-            {
-                FastPath::MouseEvent_Send me(stream, (uint16_t)device_flags, param1, param2);
-            }
-            break;
+            case RDP_INPUT_MOUSE:
+                {
+                    FastPath::MouseEvent_Send me(stream, event.device_flags, event.param1, event.param2);
+                }
+                break;
 
-        default:
-            LOG(LOG_WARNING, "unsupported fast-path input message type 0x%x", message_type);
-            throw Error(ERR_RDP_FASTPATH);
-            break;
+            default:
+                LOG(LOG_WARNING, "unsupported fast-path input message type 0x%x", event.message_type);
+                throw Error(ERR_RDP_FASTPATH);
+                break;
+            }
         }
 
-        FastPath::ClientInputEventPDU_Send out_cie(fastpath_header, stream, 1, this->encrypt, this->encryptionLevel, this->encryptionMethod);
+        FastPath::ClientInputEventPDU_Send out_cie(fastpath_header, stream, count, this->encrypt, this->encryptionLevel, this->encryptionMethod);
 
         this->nego.trans->send(fastpath_header, stream);
 
@@ -4177,12 +4300,40 @@ public:
         }
     }
 
-    void send_input(int time, int message_type, int device_flags, int param1, int param2) throw(Error) {
+    void send_input_events(const InputBatch::Event * events, size_t count) throw(Error) {
         if (this->enable_fastpath_client_input_event == false) {
-            send_input_slowpath(time, message_type, device_flags, param1, param2);
+            this->send_input_slowpath(events, count);
         }
         else {
-            send_input_fastpath(time, message_type, device_flags, param1, param2);
+            this->send_input_fastpath(events, count);
+        }
+    }
+
+    // Between rdp_input_batch_begin() and rdp_input_batch_end() events are
+    // queued and sent together, otherwise each one is sent at once.
+    void send_input(int time, int message_type, int device_flags, int param1, int param2) throw(Error) {
+        if (!this->input_batch.opened) {
+            InputBatch::Event event;
+            event.time         = time;
+            event.message_type = message_type;
+            event.device_flags = device_flags;
+            event.param1       = param1;
+            event.param2       = param2;
+            this->send_input_events(&event, 1);
+            return;
+        }
+        if (this->input_batch.full()) {
+            this->send_input_batch();
+        }
+        this->input_batch.add(time, message_type, device_flags, param1, param2);
+    }
+
+    void send_input_batch() throw(Error) {
+        if (this->input_batch.size()) {
+            // cleared first, a failed send must not be retried with next batch
+            const size_t count = this->input_batch.size();
+            this->input_batch.clear();
+            this->send_input_events(this->input_batch.data(), count);
         }
     }
 
@@ -4619,6 +4770,7 @@ public:
         }
 
         this->recv_bmp_update++;
+        session_stats().mod_bitmap_updates_received++;
 
         if (fast_path) {
             stream.in_skip_bytes(2); // updateType(2)
@@ -4654,6 +4806,10 @@ public:
             LOG(LOG_INFO, "/* ---------------- Sending %d rectangles ----------------- */", numberRectangles);
         }
 
+        // Rectangles are all decoded before being drawn, so that front can
+        // compress those it sends as MemBlt at once (prepare_bitmaps).
+        DecodedBitmapUpdate update(numberRectangles);
+
         for (size_t i = 0; i < numberRectangles; i++) {
 
             // rectangles (variable): Variable-length array of TS_BITMAP_DATA
@@ -4766,7 +4922,7 @@ public:
                 //                    bufsize, bitmap.bmp_size, width, height, bpp);
                 //            }
                 const uint8_t * data = stream.in_uint8p(bmpdata.bitmap_size());
-            Bitmap bitmap( this->bpp
+            const Bitmap & bitmap = update.add(bmpdata, data, new Bitmap( this->bpp
                            , bmpdata.bits_per_pixel
                            , &this->orders.global_palette
                            , bmpdata.width
@@ -4774,7 +4930,7 @@ public:
                            , data
                            , bmpdata.bitmap_size()
                            , (bmpdata.flags & BITMAP_COMPRESSION)
-                           );
+                           ));
 
             if (   bmpdata.cb_scan_width
                    && ((bmpdata.cb_scan_width - bitmap.line_size) >= nbbytes(bitmap.original_bpp))) {
@@ -4803,10 +4959,25 @@ public:
             if (!this->enable_bitmap_update
                || (bmpdata.bits_per_pixel != this->front_bpp)
                || ((bmpdata.bits_per_pixel == 8) && (this->front_bpp != 8))) {
+                update.use_memblt(i);
+            }
+        }
+
+        this->gd->prepare_bitmaps(update.memblt_bitmaps(), update.memblt_count());
+
+        for (size_t i = 0; i < update.count; i++) {
+            const RDPBitmapData & bmpdata = update.rectangles[i].bmpdata;
+            const Bitmap        & bitmap  = *update.rectangles[i].bitmap;
+            if (update.rectangles[i].memblt) {
+                const Rect boundary( bmpdata.dest_left
+                                   , bmpdata.dest_top
+                                   , bmpdata.dest_right - bmpdata.dest_left + 1
+                                   , bmpdata.dest_bottom - bmpdata.dest_top + 1
+                                   );
                 this->gd->draw(RDPMemBlt(0, boundary, 0xCC, 0, 0, 0), boundary, bitmap);
             }
             else {
-                this->gd->draw(bmpdata, data, bmpdata.bitmap_size(), bitmap);
+                this->gd->draw(bmpdata, update.rectangles[i].data, bmpdata.bitmap_size(), bitmap);
             }
         }
         if (this->verbose & 64){
@@ -0,0 +1,110 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   rdp module input events waiting to be sent to server in a single input PDU
+*/
+
+#ifndef _REDEMPTION_MOD_RDP_RDP_INPUT_BATCH_HPP_
+#define _REDEMPTION_MOD_RDP_RDP_INPUT_BATCH_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "callback.hpp"
+
+// Events decoded by front from one client input PDU. Keyboard, button and
+// synchronize events are kept in order, only consecutive pure mouse moves
+// may be merged into the last one.
+class InputBatch {
+public:
+    enum {
+        // fast-path numEvents is a single byte
+        MAX_EVENTS = 255
+    };
+
+    enum {
+        MOUSE_MOVES_KEEP_ALL = 0,
+        MOUSE_MOVES_MERGE    = 1
+    };
+
+    struct Event {
+        uint32_t time;
+        uint16_t message_type;
+        uint16_t device_flags;
+        uint16_t param1;
+        uint16_t param2;
+    };
+
+private:
+    Event    events[MAX_EVENTS];
+    size_t   count;
+    unsigned mouse_moves;
+
+public:
+    bool opened;
+
+    explicit InputBatch(unsigned mouse_moves)
+    : count(0)
+    , mouse_moves(mouse_moves)
+    , opened(false)
+    {}
+
+    void add(uint32_t time, uint16_t message_type, uint16_t device_flags, uint16_t param1, uint16_t param2) {
+        if (  (this->mouse_moves == MOUSE_MOVES_MERGE) && this->count
+           && is_mouse_move(message_type, device_flags)
+           && is_mouse_move(this->events[this->count - 1].message_type,
+                            this->events[this->count - 1].device_flags)) {
+            Event & last = this->events[this->count - 1];
+            last.time   = time;
+            last.param1 = param1;
+            last.param2 = param2;
+            return;
+        }
+
+        Event & event = this->events[this->count++];
+        event.time         = time;
+        event.message_type = message_type;
+        event.device_flags = device_flags;
+        event.param1       = param1;
+        event.param2       = param2;
+    }
+
+    bool full() const {
+        return this->count == MAX_EVENTS;
+    }
+
+    size_t size() const {
+        return this->count;
+    }
+
+    const Event * data() const {
+        return this->events;
+    }
+
+    void clear() {
+        this->count = 0;
+    }
+
+private:
+    static bool is_mouse_move(uint16_t message_type, uint16_t device_flags) {
+        return (message_type == RDP_INPUT_MOUSE) && (device_flags == MOUSE_FLAG_MOVE);
+    }
+};
+
+#endif
@@ -30,6 +30,8 @@
 #include "mod_api.hpp"
 #include "outfiletransport.hpp"
 #include "stream.hpp"
+#include "session_stats.hpp"
+#include "phase_timer.hpp"
 
 #include "RDP/protocol.hpp"
 
@@ -266,6 +268,7 @@ public:
         bmp.receive(bpp, stream, control, header, this->global_palette);
 
         this->recv_bmp_cache_count++;
+        session_stats().mod_bmp_cache_received++;
 
         REDASSERT(bmp.bmp);
         this->bmp_cache->put(bmp.id, bmp.idx, bmp.bmp, bmp.key1, bmp.key2);
@@ -330,6 +333,8 @@ public:
     /*****************************************************************************/
     int process_orders(uint8_t bpp, Stream & stream, bool fast_path, RDPGraphicDevice & gd,
                        uint16_t front_width, uint16_t front_height) {
+        PHASE_TIMER(PHASE_RDP_ORDERS_PROCESS_ORDERS);
+
         if (this->verbose & 64) {
             LOG(LOG_INFO, "process_orders bpp=%u", bpp);
         }
@@ -339,6 +344,7 @@ public:
         OrdersUpdate_Recv orders_update(stream, fast_path);
 
         this->recv_order_count += orders_update.number_orders;
+        session_stats().mod_orders_received += orders_update.number_orders;
 
         int processed = 0;
         while (processed < orders_update.number_orders) {
@@ -62,6 +62,8 @@ struct ModRDPParams {
     bool enable_persistent_disk_bitmap_cache;
     bool enable_cache_waiting_list;
 
+    unsigned mouse_move_policy;
+
     uint32_t password_printing_mode;
 
     uint32_t verbose;
@@ -114,6 +116,8 @@ struct ModRDPParams {
         , enable_persistent_disk_bitmap_cache(false)
         , enable_cache_waiting_list(false)
 
+        , mouse_move_policy(0)
+
         , password_printing_mode(0)
 
         , verbose(verbose)
@@ -190,6 +194,9 @@ struct ModRDPParams {
         LOG(LOG_INFO,
             "ModRDPParams enable_cache_waiting_list=%s",           (this->enable_cache_waiting_list ? "yes" : "no"));
 
+        LOG(LOG_INFO,
+            "ModRDPParams mouse_move_policy=%u",                   this->mouse_move_policy);
+
         LOG(LOG_INFO,
             "ModRDPParams password_printing_mode=%u",              this->password_printing_mode);
 
@@ -28,6 +28,11 @@
 #include <sys/socket.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <setjmp.h>
+#include <zlib.h>
+#include <png.h>
+#include <jpeglib.h>
 
 #include "colors.hpp"
 
@@ -96,6 +101,24 @@ struct mod_vnc : public InternalMod, public NotifyApi {
 
     z_stream zstrm;
 
+    // Tight encoding uses four independent zlib streams, selected
+    // per rectangle by the compression control byte.
+    z_stream tight_zstrm[4];
+
+    // Decoding buffers, kept for the whole session and only grown when
+    // a larger rectangle arrives (no allocation per rectangle).
+    BStream tile_buffer;        // decoded pixels in VNC pixel format
+    BStream compressed_buffer;  // zlib, JPEG or PNG payload of a rectangle
+    BStream filter_buffer;      // inflated Tight data before filtering
+
+    BStream  shadow;            // framebuffer as already sent to the front
+    BStream  frame;             // framebuffer with current update decoded
+    Rect     damage;            // part of frame not yet compared with shadow
+    size_t   shadow_size;
+    uint64_t shadow_tiles_sent;
+    uint64_t shadow_tiles_skipped;
+    uint64_t shadow_scrolls;
+
     enum {
         ASK_PASSWORD,
         DO_INITIAL_CLEAR_SCREEN,
@@ -147,6 +170,12 @@ public:
     , incr(0)
     , to_vnc_large_clipboard_data(2 * MAX_VNC_2_RDP_CLIP_DATA_SIZE + 2)
     , opt_clipboard(clipboard)
+    , shadow(0)
+    , frame(0)
+    , shadow_size(0)
+    , shadow_tiles_sent(0)
+    , shadow_tiles_skipped(0)
+    , shadow_scrolls(0)
     , state(WAIT_SECURITY_TYPES)
     , ini(ini)
     , allow_authentification_retries(allow_authentification_retries || !(*password))
@@ -164,6 +193,15 @@ public:
             throw Error(ERR_VNC_ZLIB_INITIALIZATION);
         }
 
+        memset(this->tight_zstrm, 0, sizeof(this->tight_zstrm));
+        for (size_t i = 0; i < 4; i++) {
+            if (inflateInit(&this->tight_zstrm[i]) != Z_OK)
+            {
+                LOG(LOG_ERR, "vnc tight zlib initialization failed");
+                throw Error(ERR_VNC_ZLIB_INITIALIZATION);
+            }
+        }
+
         init_palette332(this->palette332);
         this->t = t;
         keymapSym.init_layout_sym(keylayout);
@@ -192,7 +230,17 @@ public:
     //==============================================================================================================
     virtual ~mod_vnc()
     {
+        if (this->verbose) {
+            LOG(LOG_INFO, "VNC shadow: tiles sent=%llu skipped=%llu scrolls=%llu",
+                static_cast<unsigned long long>(this->shadow_tiles_sent),
+                static_cast<unsigned long long>(this->shadow_tiles_skipped),
+                static_cast<unsigned long long>(this->shadow_scrolls));
+        }
+
         inflateEnd(&this->zstrm);
+        for (size_t i = 0; i < 4; i++) {
+            inflateEnd(&this->tight_zstrm[i]);
+        }
 
         this->screen.clear();
     }
@@ -392,6 +440,19 @@ public:
             return;
         }
 
+        // the VNC server only sends changes after the first request, the
+        // client screen is repainted from the shadow framebuffer instead
+        this->repaint_from_shadow(r);
+
+        this->send_framebuffer_update_request(r);
+    } // rdp_input_invalidate
+
+private:
+    void send_framebuffer_update_request(const Rect & r) {
+        if (this->state != UP_AND_RUNNING) {
+            return;
+        }
+
         if (!r.isempty()) {
             uint8_t data[10];
             FixedSizeStream stream(data, sizeof(data));
@@ -409,7 +470,9 @@ public:
             stream.out_uint16_be(r.cy);
             this->t->send(stream.get_data(), 10);
         }
-    } // rdp_input_invalidate
+    } // send_framebuffer_update_request
+
+public:
 
     //==============================================================================================================
     virtual void draw_event(time_t now)
@@ -458,7 +521,7 @@ public:
 
                 this->state = UP_AND_RUNNING;
 
-                this->rdp_input_invalidate(Rect(0, 0, this->width, this->height));
+                this->send_framebuffer_update_request(Rect(0, 0, this->width, this->height));
 
                 this->lib_open_clip_channel();
 
@@ -524,7 +587,7 @@ public:
                 }
             }
             else {
-                this->rdp_input_invalidate(Rect(0, 0, this->width, this->height));
+                this->send_framebuffer_update_request(Rect(0, 0, this->width, this->height));
             }
             break;
         case WAIT_PASSWORD:
@@ -1331,6 +1394,573 @@ public:
             }
         }
     }
+    // Returns a decoding buffer of at least size bytes, reusing the
+    // memory of previous rectangles whenever it is large enough.
+    static uint8_t * reserve_buffer(BStream & buffer, size_t size)
+    {
+        if (buffer.get_capacity() < size) {
+            buffer.init(size);
+        }
+        else {
+            buffer.reset();
+        }
+        return buffer.get_data();
+    }
+
+    void recv_bytes(uint8_t * data, size_t length)
+    {
+        uint8_t * end = data;
+        this->t->recv(&end, length);
+    }
+
+    uint8_t recv_uint8()
+    {
+        uint8_t data;
+        this->recv_bytes(&data, 1);
+        return data;
+    }
+
+    static void fill_pixels(uint8_t * data, size_t line_size, uint16_t cx, uint16_t cy,
+                            const uint8_t * pixel, uint8_t Bpp)
+    {
+        if (!cx || !cy) {
+            return;
+        }
+        uint8_t * first_line = data;
+        for (uint8_t * cur = first_line, * end = first_line + cx * Bpp; cur < end; cur += Bpp) {
+            memcpy(cur, pixel, Bpp);
+        }
+        for (uint16_t i = 1; i < cy; i++) {
+            memcpy(first_line + i * line_size, first_line, cx * Bpp);
+        }
+    }
+
+    // 7.7.4   Hextile encoding
+    // ------------------------
+
+    // Rectangles are split up into 16x16 tiles, ordered left-to-right,
+    // top-to-bottom. Each tile starts with a subencoding mask byte:
+
+    // Raw                 (1)  : tile is sent as raw pixels, other bits ignored
+    // BackgroundSpecified (2)  : a background pixel value follows
+    // ForegroundSpecified (4)  : a foreground pixel value follows
+    // AnySubrects         (8)  : number-of-subrectangles byte follows
+    // SubrectsColoured    (16) : each subrectangle is preceded by its pixel value
+
+    // Background and foreground are kept from the previous tile of the same
+    // rectangle when not specified. Each subrectangle is encoded on two bytes:
+    // x-and-y-position (4 bits each) and width-and-height (4 bits each, minus one).
+
+    // One row of tiles is decoded at a time directly into a strip buffer
+    // which is then handed to draw_tile.
+    void lib_framebuffer_update_hextile(uint16_t x, uint16_t y, uint16_t cx, uint16_t cy, uint8_t Bpp)
+    {
+        enum {
+            HEXTILE_RAW                  = 1,
+            HEXTILE_BACKGROUND_SPECIFIED = 2,
+            HEXTILE_FOREGROUND_SPECIFIED = 4,
+            HEXTILE_ANY_SUBRECTS         = 8,
+            HEXTILE_SUBRECTS_COLOURED    = 16
+        };
+
+        const size_t line_size = cx * Bpp;
+        uint8_t * strip = reserve_buffer(this->tile_buffer, line_size * 16);
+
+        uint8_t background[4] = { 0, 0, 0, 0 };
+        uint8_t foreground[4] = { 0, 0, 0, 0 };
+        uint8_t tile_data[16 * 16 * 4];
+        uint8_t subrects_data[255 * (4 + 2)];
+
+        for (uint16_t ty = 0; ty < cy; ty += 16) {
+            const uint16_t tile_cy = std::min<uint16_t>(16, cy - ty);
+
+            for (uint16_t tx = 0; tx < cx; tx += 16) {
+                const uint16_t tile_cx = std::min<uint16_t>(16, cx - tx);
+                uint8_t * tile = strip + tx * Bpp;
+
+                const uint8_t subencoding = this->recv_uint8();
+
+                if (subencoding & HEXTILE_RAW) {
+                    const size_t tile_line_size = tile_cx * Bpp;
+                    this->recv_bytes(tile_data, tile_line_size * tile_cy);
+                    for (uint16_t i = 0; i < tile_cy; i++) {
+                        memcpy(tile + i * line_size, tile_data + i * tile_line_size, tile_line_size);
+                    }
+                    continue;
+                }
+
+                if (subencoding & HEXTILE_BACKGROUND_SPECIFIED) {
+                    this->recv_bytes(background, Bpp);
+                }
+                if (subencoding & HEXTILE_FOREGROUND_SPECIFIED) {
+                    this->recv_bytes(foreground, Bpp);
+                }
+
+                fill_pixels(tile, line_size, tile_cx, tile_cy, background, Bpp);
+
+                if (subencoding & HEXTILE_ANY_SUBRECTS) {
+                    const uint8_t number_of_subrectangles = this->recv_uint8();
+                    const bool    coloured = (subencoding & HEXTILE_SUBRECTS_COLOURED);
+                    const size_t  subrect_size = (coloured ? Bpp : 0) + 2;
+
+                    this->recv_bytes(subrects_data, number_of_subrectangles * subrect_size);
+
+                    const uint8_t * subrect = subrects_data;
+                    for (uint8_t i = 0; i < number_of_subrectangles; i++) {
+                        const uint8_t * pixel = foreground;
+                        if (coloured) {
+                            pixel    = subrect;
+                            subrect += Bpp;
+                        }
+                        const uint8_t sx = subrect[0] >> 4;
+                        const uint8_t sy = subrect[0] & 0x0F;
+                        const uint8_t sw = (subrect[1] >> 4) + 1;
+                        const uint8_t sh = (subrect[1] & 0x0F) + 1;
+                        subrect += 2;
+
+                        if ((sx >= tile_cx) || (sy >= tile_cy)) {
+                            LOG(LOG_ERR, "VNC Encoding: Hextile, subrectangle out of tile");
+                            throw Error(ERR_VNC_HEXTILE_PROTOCOL);
+                        }
+                        fill_pixels(tile + sy * line_size + sx * Bpp, line_size,
+                            std::min<uint16_t>(sw, tile_cx - sx),
+                            std::min<uint16_t>(sh, tile_cy - sy),
+                            pixel, Bpp);
+                    }
+                }
+            }
+
+            this->draw_tile(Rect(x, y + ty, cx, tile_cy), strip);
+        }
+    }
+
+    // Tight encoding
+    // --------------
+
+    // The first byte of each rectangle is the compression-control byte. Bits
+    // 0-3 ask the client to reset the corresponding zlib stream, bits 4-7 give
+    // the compression type:
+
+    // 1000 : FillCompression, the rectangle is filled with a single TPIXEL
+    // 1001 : JpegCompression, compact length followed by JPEG data
+    // 1010 : PngCompression, only with TightPNG (compact length + PNG data)
+    // 0xxx : BasicCompression, bits 4-5 give the zlib stream to use, bit 6
+    //        says an explicit filter-id byte follows (0 = copy, 1 = palette,
+    //        2 = gradient).
+
+    // TPIXEL is 3 bytes (R, G, B) when the pixel format is 32 bpp, depth 24,
+    // true colour with all channels max 255, otherwise it is a plain pixel.
+
+    // After filtering, BasicCompression data smaller than 12 bytes is sent
+    // as is, otherwise a compact length is followed by zlib data.
+    enum {
+        TIGHT_FILL       = 0x08,
+        TIGHT_JPEG       = 0x09,
+        TIGHT_PNG        = 0x0A,
+
+        TIGHT_EXPLICIT_FILTER = 0x04,
+
+        TIGHT_FILTER_COPY     = 0,
+        TIGHT_FILTER_PALETTE  = 1,
+        TIGHT_FILTER_GRADIENT = 2,
+
+        TIGHT_MIN_TO_COMPRESS = 12
+    };
+
+    uint8_t tight_tpixel_size(uint8_t Bpp) const
+    {
+        return ((this->bpp == 32) && (this->depth == 24) && this->true_color_flag
+               && (this->red_max == 0xFF) && (this->green_max == 0xFF) && (this->blue_max == 0xFF))
+             ? 3 : Bpp;
+    }
+
+    // compact length: 1 to 3 bytes, 7 bits per byte, high bit set means
+    // another byte follows.
+    uint32_t recv_tight_compact_length()
+    {
+        uint8_t  b      = this->recv_uint8();
+        uint32_t length = b & 0x7F;
+        if (b & 0x80) {
+            b = this->recv_uint8();
+            length |= (b & 0x7F) << 7;
+            if (b & 0x80) {
+                b = this->recv_uint8();
+                length |= b << 14;
+            }
+        }
+        return length;
+    }
+
+    static uint32_t read_pixel(const uint8_t * data, uint8_t Bpp)
+    {
+        uint32_t pixel = 0;
+        for (uint8_t i = 0; i < Bpp; i++) {
+            pixel |= data[i] << (8 * i);
+        }
+        return pixel;
+    }
+
+    static void write_pixel(uint8_t * data, uint32_t pixel, uint8_t Bpp)
+    {
+        for (uint8_t i = 0; i < Bpp; i++) {
+            data[i] = pixel >> (8 * i);
+        }
+    }
+
+    uint32_t pixel_from_rgb(uint8_t red, uint8_t green, uint8_t blue) const
+    {
+        return (((red   * this->red_max   + 127) / 255) << this->red_shift)
+             | (((green * this->green_max + 127) / 255) << this->green_shift)
+             | (((blue  * this->blue_max  + 127) / 255) << this->blue_shift);
+    }
+
+    // Converts a TPIXEL to a pixel in VNC pixel format (as expected by draw_tile)
+    void tight_tpixel_to_pixel(const uint8_t * tpixel, uint8_t tpixel_size, uint8_t * pixel, uint8_t Bpp) const
+    {
+        if (tpixel_size == 3) {
+            write_pixel(pixel,
+                  (tpixel[0] << this->red_shift)
+                | (tpixel[1] << this->green_shift)
+                | (tpixel[2] << this->blue_shift), Bpp);
+        }
+        else {
+            memcpy(pixel, tpixel, Bpp);
+        }
+    }
+
+    void tight_inflate(uint8_t stream_id, uint8_t * data, size_t data_size)
+    {
+        const uint32_t compressed_length = this->recv_tight_compact_length();
+        uint8_t * compressed = reserve_buffer(this->compressed_buffer, compressed_length);
+        this->recv_bytes(compressed, compressed_length);
+
+        z_stream & zs = this->tight_zstrm[stream_id];
+        zs.next_in   = compressed;
+        zs.avail_in  = compressed_length;
+        zs.next_out  = data;
+        zs.avail_out = data_size;
+
+        while (zs.avail_out > 0) {
+            const int zlib_result = inflate(&zs, Z_SYNC_FLUSH);
+            if ((zlib_result != Z_OK) && (zlib_result != Z_STREAM_END)) {
+                LOG(LOG_ERR, "vnc tight zlib decompression failed (%d)", zlib_result);
+                throw Error(ERR_VNC_ZLIB_INFLATE);
+            }
+            if (!zs.avail_in && zs.avail_out) {
+                LOG(LOG_ERR, "VNC Encoding: Tight, zlib data truncated (%u bytes missing)",
+                    static_cast<unsigned>(zs.avail_out));
+                throw Error(ERR_VNC_TIGHT_PROTOCOL);
+            }
+        }
+    }
+
+    // Gradient filter: each colour component is predicted from the left, upper
+    // and upper-left reconstructed neighbours (V = left + up - upleft clamped
+    // to [0, max]) and the filtered value is the difference modulo max + 1.
+    void tight_gradient_filter(const uint8_t * filtered, uint8_t tpixel_size,
+                               uint8_t * data, uint16_t cx, uint16_t cy, uint8_t Bpp) const
+    {
+        const uint16_t max[3]   = { this->red_max,   this->green_max,   this->blue_max   };
+        const uint8_t  shift[3] = { this->red_shift, this->green_shift, this->blue_shift };
+        const size_t   line_size = cx * Bpp;
+
+        for (uint16_t y = 0; y < cy; y++) {
+            for (uint16_t x = 0; x < cx; x++, filtered += tpixel_size) {
+                uint8_t * pixel = data + y * line_size + x * Bpp;
+
+                const uint32_t left    = x           ? read_pixel(pixel - Bpp, Bpp)             : 0;
+                const uint32_t up      = y           ? read_pixel(pixel - line_size, Bpp)       : 0;
+                const uint32_t up_left = (x && y)    ? read_pixel(pixel - line_size - Bpp, Bpp) : 0;
+                const uint32_t diff    = (tpixel_size == 3) ? 0 : read_pixel(filtered, Bpp);
+
+                uint32_t result = 0;
+                for (int c = 0; c < 3; c++) {
+                    int predicted = static_cast<int>((left >> shift[c]) & max[c])
+                                  + static_cast<int>((up   >> shift[c]) & max[c])
+                                  - static_cast<int>((up_left >> shift[c]) & max[c]);
+                    if (predicted < 0) {
+                        predicted = 0;
+                    }
+                    else if (predicted > max[c]) {
+                        predicted = max[c];
+                    }
+                    const uint32_t component_diff = (tpixel_size == 3)
+                                                  ? filtered[c]
+                                                  : ((diff >> shift[c]) & max[c]);
+                    result |= ((predicted + component_diff) & max[c]) << shift[c];
+                }
+                write_pixel(pixel, result, Bpp);
+            }
+        }
+    }
+
+    struct TightJpegErrorManager {
+        struct jpeg_error_mgr pub;
+        jmp_buf               setjmp_buffer;
+    };
+
+    static void tight_jpeg_error_exit(j_common_ptr cinfo)
+    {
+        TightJpegErrorManager * err = reinterpret_cast<TightJpegErrorManager *>(cinfo->err);
+        longjmp(err->setjmp_buffer, 1);
+    }
+
+    // Decodes a JPEG rectangle into data (VNC pixel format), returns false on error.
+    bool tight_decode_jpeg(const uint8_t * jpeg_data, size_t jpeg_length,
+                           uint8_t * data, uint16_t cx, uint16_t cy, uint8_t Bpp) const
+    {
+        struct jpeg_decompress_struct cinfo;
+        TightJpegErrorManager         jerr;
+
+        cinfo.err = jpeg_std_error(&jerr.pub);
+        jerr.pub.error_exit = tight_jpeg_error_exit;
+        if (setjmp(jerr.setjmp_buffer)) {
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+
+        jpeg_create_decompress(&cinfo);
+        jpeg_mem_src(&cinfo, const_cast<unsigned char *>(jpeg_data), jpeg_length);
+        jpeg_read_header(&cinfo, TRUE);
+        cinfo.out_color_space = JCS_RGB;
+        jpeg_start_decompress(&cinfo);
+
+        if ((cinfo.output_width != cx) || (cinfo.output_height != cy)
+        || (cinfo.output_components != 3)) {
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+
+        // With 24/32 bpp each RGB scanline is decoded at the end of its
+        // destination line and converted in place, narrower pixel formats
+        // go through a row buffer.
+        uint8_t   row_buffer[2048 * 3];
+        JSAMPROW  row[1];
+        const bool in_place = (Bpp >= 3);
+        if (!in_place && (cx > 2048)) {
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+
+        while (cinfo.output_scanline < cinfo.output_height) {
+            uint8_t * line = data + cinfo.output_scanline * cx * Bpp;
+            uint8_t * rgb  = in_place ? line + cx * (Bpp - 3) : row_buffer;
+            row[0] = rgb;
+            jpeg_read_scanlines(&cinfo, row, 1);
+            for (uint16_t x = 0; x < cx; x++, rgb += 3) {
+                write_pixel(line + x * Bpp, this->pixel_from_rgb(rgb[0], rgb[1], rgb[2]), Bpp);
+            }
+        }
+
+        jpeg_finish_decompress(&cinfo);
+        jpeg_destroy_decompress(&cinfo);
+        return true;
+    }
+
+    struct TightPngSource {
+        const uint8_t * data;
+        size_t          remaining;
+    };
+
+    static void tight_png_read(png_structp png_ptr, png_bytep data, png_size_t length)
+    {
+        TightPngSource * source = static_cast<TightPngSource *>(png_get_io_ptr(png_ptr));
+        if (length > source->remaining) {
+            png_error(png_ptr, "VNC Tight PNG data truncated");
+        }
+        memcpy(data, source->data, length);
+        source->data      += length;
+        source->remaining -= length;
+    }
+
+    // Decodes a PNG rectangle (TightPNG) into data (VNC pixel format), returns false on error.
+    bool tight_decode_png(const uint8_t * png_data, size_t png_length,
+                          uint8_t * data, uint16_t cx, uint16_t cy, uint8_t Bpp) const
+    {
+        png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+        if (!png_ptr) {
+            return false;
+        }
+        png_infop info_ptr = png_create_info_struct(png_ptr);
+        if (!info_ptr) {
+            png_destroy_read_struct(&png_ptr, NULL, NULL);
+            return false;
+        }
+        // this handle lib png errors for this call
+        if (setjmp(png_jmpbuf(png_ptr))) {
+            png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+            return false;
+        }
+
+        TightPngSource source = { png_data, png_length };
+        png_set_read_fn(png_ptr, &source, tight_png_read);
+        png_read_info(png_ptr, info_ptr);
+
+        if ((png_get_image_width(png_ptr, info_ptr) != cx)
+        ||  (png_get_image_height(png_ptr, info_ptr) != cy)) {
+            png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+            return false;
+        }
+
+        png_set_expand(png_ptr);
+        png_set_strip_16(png_ptr);
+        png_set_strip_alpha(png_ptr);
+        png_set_gray_to_rgb(png_ptr);
+        png_read_update_info(png_ptr, info_ptr);
+
+        uint8_t row_buffer[2048 * 3];
+        if ((png_get_rowbytes(png_ptr, info_ptr) != static_cast<png_size_t>(cx) * 3)
+        || (cx > 2048)) {
+            png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+            return false;
+        }
+
+        for (uint16_t y = 0; y < cy; y++) {
+            png_read_row(png_ptr, row_buffer, NULL);
+            uint8_t       * line = data + y * cx * Bpp;
+            const uint8_t * rgb  = row_buffer;
+            for (uint16_t x = 0; x < cx; x++, rgb += 3) {
+                write_pixel(line + x * Bpp, this->pixel_from_rgb(rgb[0], rgb[1], rgb[2]), Bpp);
+            }
+        }
+
+        png_read_end(png_ptr, NULL);
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        return true;
+    }
+
+    void lib_framebuffer_update_tight(uint16_t x, uint16_t y, uint16_t cx, uint16_t cy,
+                                      uint8_t Bpp, bool png_allowed)
+    {
+        uint8_t compression_control = this->recv_uint8();
+
+        for (uint8_t i = 0; i < 4; i++) {
+            if (compression_control & (1 << i)) {
+                inflateReset(&this->tight_zstrm[i]);
+            }
+        }
+        compression_control >>= 4;
+
+        const uint8_t tpixel_size = this->tight_tpixel_size(Bpp);
+        const size_t  line_size   = cx * Bpp;
+
+        if (compression_control == TIGHT_FILL) {
+            uint8_t tpixel[4];
+            uint8_t pixel[4];
+            this->recv_bytes(tpixel, tpixel_size);
+            this->tight_tpixel_to_pixel(tpixel, tpixel_size, pixel, Bpp);
+
+            uint8_t * strip = reserve_buffer(this->tile_buffer, line_size * 16);
+            fill_pixels(strip, line_size, cx, std::min<uint16_t>(16, cy), pixel, Bpp);
+            for (uint16_t ty = 0; ty < cy; ty += 16) {
+                this->draw_tile(Rect(x, y + ty, cx, std::min<uint16_t>(16, cy - ty)), strip);
+            }
+            return;
+        }
+
+        if ((compression_control == TIGHT_JPEG)
+        || ((compression_control == TIGHT_PNG) && png_allowed)) {
+            const uint32_t length = this->recv_tight_compact_length();
+            uint8_t * compressed = reserve_buffer(this->compressed_buffer, length);
+            this->recv_bytes(compressed, length);
+
+            uint8_t * data = reserve_buffer(this->tile_buffer, line_size * cy);
+            const bool decoded = (compression_control == TIGHT_JPEG)
+                               ? this->tight_decode_jpeg(compressed, length, data, cx, cy, Bpp)
+                               : this->tight_decode_png(compressed, length, data, cx, cy, Bpp);
+            if (!decoded) {
+                LOG(LOG_ERR, "VNC Encoding: Tight, %s decompression failed",
+                    (compression_control == TIGHT_JPEG) ? "JPEG" : "PNG");
+                throw Error(ERR_VNC_TIGHT_IMAGE_DECOMPRESSION);
+            }
+            this->draw_tile(Rect(x, y, cx, cy), data);
+            return;
+        }
+
+        // BasicCompression has bit 3 cleared, TightPNG does not allow it
+        if ((compression_control & TIGHT_FILL) || png_allowed) {
+            LOG(LOG_ERR, "VNC Encoding: Tight, unexpected compression control %u",
+                compression_control);
+            throw Error(ERR_VNC_TIGHT_PROTOCOL);
+        }
+
+        const uint8_t stream_id = compression_control & 0x03;
+        const uint8_t filter_id = (compression_control & TIGHT_EXPLICIT_FILTER)
+                                ? this->recv_uint8() : static_cast<uint8_t>(TIGHT_FILTER_COPY);
+
+        uint8_t  palette[256 * 4];
+        uint16_t palette_size = 0;
+        size_t   row_size     = cx * tpixel_size;
+
+        switch (filter_id) {
+        case TIGHT_FILTER_COPY:
+        case TIGHT_FILTER_GRADIENT:
+            break;
+        case TIGHT_FILTER_PALETTE:
+            {
+                palette_size = this->recv_uint8() + 1;
+                uint8_t tpixels[256 * 4];
+                this->recv_bytes(tpixels, palette_size * tpixel_size);
+                for (uint16_t i = 0; i < palette_size; i++) {
+                    this->tight_tpixel_to_pixel(tpixels + i * tpixel_size, tpixel_size,
+                        palette + i * Bpp, Bpp);
+                }
+                row_size = (palette_size == 2) ? (cx + 7) / 8 : cx;
+            }
+            break;
+        default:
+            LOG(LOG_ERR, "VNC Encoding: Tight, unknown filter %u", filter_id);
+            throw Error(ERR_VNC_TIGHT_PROTOCOL);
+        }
+
+        const size_t data_size = row_size * cy;
+        uint8_t * filtered = reserve_buffer(this->filter_buffer, data_size);
+        if (data_size < TIGHT_MIN_TO_COMPRESS) {
+            this->recv_bytes(filtered, data_size);
+        }
+        else {
+            this->tight_inflate(stream_id, filtered, data_size);
+        }
+
+        uint8_t * data = reserve_buffer(this->tile_buffer, line_size * cy);
+
+        switch (filter_id) {
+        case TIGHT_FILTER_COPY:
+            if (tpixel_size == Bpp) {
+                // pixels are already in the expected format, draw them as they are
+                this->draw_tile(Rect(x, y, cx, cy), filtered);
+                return;
+            }
+            for (size_t i = 0, n = cx * cy; i < n; i++) {
+                this->tight_tpixel_to_pixel(filtered + i * tpixel_size, tpixel_size,
+                    data + i * Bpp, Bpp);
+            }
+            break;
+        case TIGHT_FILTER_PALETTE:
+            for (uint16_t yy = 0; yy < cy; yy++) {
+                const uint8_t * src = filtered + yy * row_size;
+                uint8_t       * dst = data + yy * line_size;
+                for (uint16_t xx = 0; xx < cx; xx++, dst += Bpp) {
+                    const uint8_t index = (palette_size == 2)
+                                        ? ((src[xx / 8] >> (7 - (xx & 7))) & 1)
+                                        : src[xx];
+                    if (index >= palette_size) {
+                        LOG(LOG_ERR, "VNC Encoding: Tight, palette index out of range");
+                        throw Error(ERR_VNC_TIGHT_PROTOCOL);
+                    }
+                    memcpy(dst, palette + index * Bpp, Bpp);
+                }
+            }
+            break;
+        case TIGHT_FILTER_GRADIENT:
+            this->tight_gradient_filter(filtered, tpixel_size, data, cx, cy, Bpp);
+            break;
+        }
+
+        this->draw_tile(Rect(x, y, cx, cy), data);
+    }
+
+public:
     //==============================================================================================================
     void lib_framebuffer_update() throw (Error) {
     //==============================================================================================================
@@ -1355,11 +1985,7 @@ public:
             switch (encoding) {
             case 0: /* raw */
             {
-                uint8_t * raw = (uint8_t *)malloc(cx * 16 * Bpp);
-                if (!raw) {
-                    LOG(LOG_ERR, "Memory allocation failed for raw buffer in VNC");
-                    throw Error(ERR_VNC_MEMORY_ALLOCATION_FAILED);
-                }
+                uint8_t * raw = reserve_buffer(this->tile_buffer, cx * 16 * Bpp);
 
                 this->front.begin_update();
                 for (uint16_t yy = y ; yy < y + cy ; yy += 16) {
@@ -1370,7 +1996,6 @@ public:
                     this->draw_tile(Rect(x, yy, cx, cyy), raw);
                 }
                 this->front.end_update();
-                free(raw);
             }
             break;
             case 1: /* copy rect */
@@ -1383,26 +2008,18 @@ public:
                 const int srcy = stream_copy_rect.in_uint16_be();
 //                LOG(LOG_INFO, "copy rect: x=%d y=%d cx=%d cy=%d encoding=%d src_x=%d, src_y=%d", x, y, cx, cy, encoding, srcx, srcy);
                 const RDPScrBlt scrblt(Rect(x, y, cx, cy), 0xCC, srcx, srcy);
+                // rectangles received before are copied from
+                this->flush_damage();
                 this->front.begin_update();
-                if (this->gd == this) {
-                    this->front.draw(scrblt, Rect(0, 0, this->front_width, this->front_height));
-                }
-                else {
-                    this->incr = 0;
-                    this->gd->draw(scrblt, Rect(0, 0, this->front_width, this->front_height));
-                    this->incr = 1;
-                }
+                this->draw_scrblt(scrblt);
                 this->front.end_update();
+                this->shadow_copy_rect(Rect(x, y, cx, cy), srcx, srcy);
             }
             break;
             case 2: /* RRE */
             {
                 //LOG(LOG_INFO, "VNC Encoding: RRE, Bpp = %u, x=%u, y=%u, cx=%u, cy=%u", Bpp, x, y, cx, cy);
-                uint8_t * raw = (uint8_t *)malloc(cx * cy * Bpp);
-                if (!raw) {
-                    LOG(LOG_ERR, "Memory allocation failed for RRE buffer in VNC");
-                    throw Error(ERR_VNC_MEMORY_ALLOCATION_FAILED);
-                }
+                uint8_t * raw = reserve_buffer(this->tile_buffer, cx * cy * Bpp);
 
                 uint8_t data_rre[256];
                 FixedSizeStream stream_rre(data_rre, sizeof(data_rre));
@@ -1471,12 +2088,25 @@ public:
                 this->front.begin_update();
                 this->draw_tile(Rect(x, y, cx, cy), raw);
                 this->front.end_update();
-
-                free(raw);
             }
             break;
             case 5: /* Hextile */
-                LOG(LOG_INFO, "VNC Encoding: Hextile, Bpp = %u, x=%u, y=%u, cx=%u, cy=%u", Bpp, x, y, cx, cy);
+                if (this->verbose) {
+                    LOG(LOG_INFO, "VNC Encoding: Hextile, Bpp = %u, x=%u, y=%u, cx=%u, cy=%u", Bpp, x, y, cx, cy);
+                }
+                this->front.begin_update();
+                this->lib_framebuffer_update_hextile(x, y, cx, cy, Bpp);
+                this->front.end_update();
+            break;
+            case 7:             /* Tight */
+            case 0xfffffefc:    /* TightPNG (-260) */
+                if (this->verbose) {
+                    LOG(LOG_INFO, "VNC Encoding: %s, Bpp = %u, x=%u, y=%u, cx=%u, cy=%u",
+                        (encoding == 7) ? "Tight" : "TightPNG", Bpp, x, y, cx, cy);
+                }
+                this->front.begin_update();
+                this->lib_framebuffer_update_tight(x, y, cx, cy, Bpp, (encoding != 7));
+                this->front.end_update();
             break;
             case 16:    /* ZRLE */
             {
@@ -1495,19 +2125,9 @@ public:
                         zlib_compressed_data_length);
                 }
 
-                if (zlib_compressed_data_length > 65536)
-                {
-                    LOG(LOG_ERR,
-                        "VNC Encoding: ZRLE, compressed data buffer too small "
-                            "(65536 < %lu)",
-                        zlib_compressed_data_length);
-                    throw Error(ERR_BUFFER_TOO_SMALL);
-                }
-
-                BStream zlib_compressed_data(65536);
-                this->t->recv(&zlib_compressed_data.end,
-                    zlib_compressed_data_length);
-                REDASSERT(zlib_compressed_data.in_remain() == zlib_compressed_data_length);
+                uint8_t * zlib_compressed_data =
+                    reserve_buffer(this->compressed_buffer, zlib_compressed_data_length);
+                this->recv_bytes(zlib_compressed_data, zlib_compressed_data_length);
 
                 ZRLEUpdateContext zrle_update_context;
 
@@ -1520,7 +2140,7 @@ public:
                 zrle_update_context.tile_y    = y;
 
                 zstrm.avail_in = zlib_compressed_data_length;
-                zstrm.next_in  = zlib_compressed_data.get_data();
+                zstrm.next_in  = zlib_compressed_data;
 
                 while (zstrm.avail_in > 0)
                 {
@@ -1649,7 +2269,9 @@ public:
             }
         }
 
-        this->rdp_input_invalidate(Rect(0, 0, this->width, this->height));
+        this->flush_damage();
+
+        this->send_framebuffer_update_request(Rect(0, 0, this->width, this->height));
     } // lib_framebuffer_update
 
     //==============================================================================================================
@@ -2201,25 +2823,264 @@ public:
     }
 
 private:
-    void draw_tile(const Rect & rect, const uint8_t * raw) const
+    // Shadow framebuffer
+    // ------------------
+
+    // The shadow holds the VNC framebuffer as already sent to the front
+    // (VNC pixel format, top-down rows). Decoded rectangles of a
+    // FramebufferUpdate are first written to frame and their bounding box
+    // accumulated in damage. When the update is complete, damage is compared
+    // with the shadow on a grid of SHADOW_TILE x SHADOW_TILE screen tiles and
+    // only tiles whose pixels changed are converted to MemBlt. Vertical
+    // scrolls found by comparing rows of damage with the shadow are sent as
+    // a ScrBlt first. Working on the whole update rather than on each
+    // decoded rectangle lets scrolls be found in updates sent as 16 rows
+    // strips (Raw, Hextile, ZRLE).
+    enum {
+        SHADOW_TILE             = 64,
+        SCROLL_MIN_ROWS         = 32,
+        MEMBLT_TILE             = 32
+    };
+
+    bool shadow_ready()
     {
-        const uint16_t TILE_CX = 32;
-        const uint16_t TILE_CY = 32;
+        const size_t size = this->width * this->height * nbbytes(this->bpp);
+        if (!size) {
+            return false;
+        }
+        if (size != this->shadow_size) {
+            this->shadow.init(size);
+            memset(this->shadow.get_data(), 0, size);
+            this->frame.init(size);
+            memset(this->frame.get_data(), 0, size);
+            this->damage      = Rect();
+            this->shadow_size = size;
+        }
+        return true;
+    }
 
-        for (int y = 0; y < rect.cy ; y += TILE_CY) {
-            uint16_t cy = std::min(TILE_CY, (uint16_t)(rect.cy - y));
+    uint8_t * shadow_line(uint16_t x, uint16_t y) const
+    {
+        const uint8_t Bpp = nbbytes(this->bpp);
+        return this->shadow.get_data() + (y * this->width + x) * Bpp;
+    }
 
-            for (int x = 0; x < rect.cx ; x += TILE_CX) {
-                uint16_t cx = std::min(TILE_CX, (uint16_t)(rect.cx - x));
+    uint8_t * frame_line(uint16_t x, uint16_t y) const
+    {
+        const uint8_t Bpp = nbbytes(this->bpp);
+        return this->frame.get_data() + (y * this->width + x) * Bpp;
+    }
 
-                const Rect src_tile(x, y, cx, cy);
+    void copy_rect_in(uint8_t * buffer, const Rect & dst, int srcx, int srcy)
+    {
+        const uint8_t Bpp       = nbbytes(this->bpp);
+        const size_t  line_size = dst.cx * Bpp;
+        const size_t  stride    = this->width * Bpp;
+        uint8_t * const dst_line = buffer + (dst.y * this->width + dst.x) * Bpp;
+        uint8_t * const src_line = buffer + (srcy * this->width + srcx) * Bpp;
+        if (dst.y <= srcy) {
+            for (uint16_t i = 0; i < dst.cy; i++) {
+                memmove(dst_line + i * stride, src_line + i * stride, line_size);
+            }
+        }
+        else {
+            for (uint16_t i = dst.cy; i > 0; i--) {
+                memmove(dst_line + (i - 1) * stride, src_line + (i - 1) * stride, line_size);
+            }
+        }
+    }
+
+    // damage must have been flushed before (frame and shadow are the same)
+    void shadow_copy_rect(const Rect & dst, int srcx, int srcy)
+    {
+        const Rect src(srcx, srcy, dst.cx, dst.cy);
+        const Rect screen(0, 0, this->width, this->height);
+        if (!this->shadow_ready() || !screen.contains(dst) || !screen.contains(src)) {
+            return;
+        }
+
+        this->copy_rect_in(this->shadow.get_data(), dst, srcx, srcy);
+        this->copy_rect_in(this->frame.get_data(), dst, srcx, srcy);
+    }
+
+    void draw_scrblt(const RDPScrBlt & scrblt)
+    {
+        if (this->gd == this) {
+            this->front.draw(scrblt, Rect(0, 0, this->front_width, this->front_height));
+        }
+        else {
+            this->incr = 0;
+            this->gd->draw(scrblt, Rect(0, 0, this->front_width, this->front_height));
+            this->incr = 1;
+        }
+    }
+
+    static bool is_uniform_line(const uint8_t * line, uint16_t cx, uint8_t Bpp)
+    {
+        for (uint16_t x = 1; x < cx; x++) {
+            if (memcmp(line, line + x * Bpp, Bpp)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Looks for a changed row of rect in frame (starting from its middle)
+    // elsewhere in the shadow (same columns). When found, the band of rows
+    // matching the shadow at the same vertical offset is moved with a
+    // ScrBlt and the shadow is updated, so the tile comparison skips it
+    // afterwards.
+    void detect_vertical_scroll(const Rect & rect)
+    {
+        if ((rect.cy < 2 * SCROLL_MIN_ROWS) || (rect.cx < SHADOW_TILE)) {
+            return;
+        }
+
+        const uint8_t   Bpp       = nbbytes(this->bpp);
+        const size_t    line_size = rect.cx * Bpp;
+
+        int probe_y = -1;
+        for (int i = 0; (i < rect.cy) && (probe_y < 0); i++) {
+            const int y = (rect.cy / 2 + i) % rect.cy;
+            const uint8_t * line = this->frame_line(rect.x, rect.y + y);
+            if (memcmp(line, this->shadow_line(rect.x, rect.y + y), line_size)
+            && !is_uniform_line(line, rect.cx, Bpp)) {
+                probe_y = y;
+            }
+        }
+        if (probe_y < 0) {
+            return;
+        }
+        const uint8_t * probe = this->frame_line(rect.x, rect.y + probe_y);
+
+        for (int src_y = 0; src_y < rect.cy; src_y++) {
+            if (memcmp(probe, this->shadow_line(rect.x, rect.y + src_y), line_size)) {
+                continue;
+            }
+
+            const int dy = src_y - probe_y;
+
+            int first = probe_y;
+            while ((first > 0) && (first - 1 + dy >= 0)
+            && !memcmp(this->frame_line(rect.x, rect.y + first - 1),
+                       this->shadow_line(rect.x, rect.y + first - 1 + dy), line_size)) {
+                first--;
+            }
+            int last = probe_y;
+            while ((last + 1 < rect.cy) && (last + 1 + dy < rect.cy)
+            && !memcmp(this->frame_line(rect.x, rect.y + last + 1),
+                       this->shadow_line(rect.x, rect.y + last + 1 + dy), line_size)) {
+                last++;
+            }
+
+            const int band = last - first + 1;
+            if (band < SCROLL_MIN_ROWS) {
+                continue;
+            }
+
+            const Rect dst(rect.x, rect.y + first, rect.cx, band);
+            this->draw_scrblt(RDPScrBlt(dst, 0xCC, rect.x, rect.y + first + dy));
+            this->copy_rect_in(this->shadow.get_data(), dst, rect.x, rect.y + first + dy);
+            this->shadow_scrolls++;
+            return;
+        }
+    }
+
+    // Sends the part of raw (a rect.cx x rect.cy buffer located at rect)
+    // covered by area as MemBlt tiles.
+    void emit_tiles(const Rect & rect, const uint8_t * raw, const Rect & area)
+    {
+        for (int y = area.y; y < area.y + area.cy ; y += MEMBLT_TILE) {
+            uint16_t cy = std::min<int>(MEMBLT_TILE, area.y + area.cy - y);
+
+            for (int x = area.x; x < area.x + area.cx ; x += MEMBLT_TILE) {
+                uint16_t cx = std::min<int>(MEMBLT_TILE, area.x + area.cx - x);
+
+                const Rect src_tile(x - rect.x, y - rect.y, cx, cy);
                 const Bitmap tiled_bmp(raw, rect.cx, rect.cy, this->bpp, src_tile);
-                const Rect dst_tile(rect.x + x, rect.y + y, cx, cy);
+                const Rect dst_tile(x, y, cx, cy);
                 const RDPMemBlt cmd2(0, dst_tile, 0xCC, 0, 0, 0);
                 this->gd->draw(cmd2, dst_tile, tiled_bmp);
             }
         }
     }
+
+    // Repaints area of the front from the shadow (client refresh request)
+    void repaint_from_shadow(const Rect & area)
+    {
+        const Rect screen(0, 0, this->width, this->height);
+        const Rect part = area.intersect(screen);
+        if (part.isempty() || !this->shadow_size) {
+            return;
+        }
+        this->front.begin_update();
+        this->emit_tiles(screen, this->shadow.get_data(), part);
+        this->front.end_update();
+    }
+
+    // Decoded rectangle, sent to the front by flush_damage()
+    void draw_tile(const Rect & rect, const uint8_t * raw)
+    {
+        const Rect screen(0, 0, this->width, this->height);
+        if (!this->shadow_ready() || !screen.contains(rect)) {
+            this->flush_damage();
+            this->emit_tiles(rect, raw, rect);
+            return;
+        }
+
+        const size_t line_size = rect.cx * nbbytes(this->bpp);
+        for (uint16_t i = 0; i < rect.cy; i++) {
+            memcpy(this->frame_line(rect.x, rect.y + i), raw + i * line_size, line_size);
+        }
+
+        this->damage = this->damage.enlarge_to(rect.x, rect.y)
+                                   .enlarge_to(rect.right() - 1, rect.bottom() - 1);
+    }
+
+    // Sends changed tiles of rectangles decoded since last call
+    void flush_damage()
+    {
+        if (this->damage.isempty()) {
+            return;
+        }
+        const Rect rect = this->damage;
+        this->damage = Rect();
+
+        this->front.begin_update();
+
+        this->detect_vertical_scroll(rect);
+
+        const uint8_t Bpp    = nbbytes(this->bpp);
+        const Rect    screen(0, 0, this->width, this->height);
+
+        const int first_tile_y = rect.y - rect.y % SHADOW_TILE;
+        const int first_tile_x = rect.x - rect.x % SHADOW_TILE;
+        for (int tile_y = first_tile_y; tile_y < rect.y + rect.cy; tile_y += SHADOW_TILE) {
+            for (int tile_x = first_tile_x; tile_x < rect.x + rect.cx; tile_x += SHADOW_TILE) {
+                const Rect part = Rect(tile_x, tile_y, SHADOW_TILE, SHADOW_TILE).intersect(rect);
+                const size_t part_line_size = part.cx * Bpp;
+
+                bool changed = false;
+                for (uint16_t i = 0; i < part.cy; i++) {
+                    const uint8_t * src = this->frame_line(part.x, part.y + i);
+                    uint8_t       * dst = this->shadow_line(part.x, part.y + i);
+                    if (changed || memcmp(src, dst, part_line_size)) {
+                        changed = true;
+                        memcpy(dst, src, part_line_size);
+                    }
+                }
+
+                if (!changed) {
+                    this->shadow_tiles_skipped++;
+                    continue;
+                }
+                this->shadow_tiles_sent++;
+                this->emit_tiles(screen, this->frame.get_data(), part);
+            }
+        }
+
+        this->front.end_update();
+    }
 };
 
 #endif
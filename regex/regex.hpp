@@ -21,12 +21,77 @@
 #ifndef REDEMPTION_FTESTS_REGEX_REGEX_HPP
 #define REDEMPTION_FTESTS_REGEX_REGEX_HPP
 
+#include <string>
+#include <cstring>
+
 #include "regex_automate.hpp"
 #include "regex_parser.hpp"
+#include "regex_multi.hpp"
 
 struct Tracer;
 namespace re {
 
+    inline void append_utf8_char_int(std::string & s, char_int c)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            if ((c >> shift) & 0xFF) {
+                s += static_cast<char>((c >> shift) & 0xFF);
+            }
+        }
+    }
+
+    // Literals every match contains: the longest run of characters on the
+    // path from root that does not go through a split. prefix is set when
+    // every match starts with it (and pattern has no ^).
+    inline void required_literals(const state_list_t & sts, const State * root,
+                                  std::string & required, std::string & prefix)
+    {
+        required.clear();
+        prefix.clear();
+
+        bool has_first = false;
+        for (state_list_t::const_iterator it = sts.begin(); it != sts.end(); ++it) {
+            if ((*it)->type == FIRST) {
+                has_first = true;
+            }
+        }
+
+        std::string run;
+        bool run_is_prefix = true;
+        for (const State * st = root; ; st = st->out1) {
+            const bool literal = st && (st->is_sequence()
+                                     || (st->is_range() && st->data.range.l == st->data.range.r));
+            if (literal) {
+                if (st->is_sequence()) {
+                    for (const char_int * p = st->data.sequence.s; *p; ++p) {
+                        append_utf8_char_int(run, *p);
+                    }
+                }
+                else {
+                    append_utf8_char_int(run, st->data.range.l);
+                }
+                continue;
+            }
+            if (st && (st->is_cap() || st->is_epsilone() || st->type == FIRST)) {
+                continue;
+            }
+
+            if (!run.empty()) {
+                if (run_is_prefix && !has_first) {
+                    prefix = run;
+                }
+                if (run.size() > required.size()) {
+                    required = run;
+                }
+                run.clear();
+            }
+            run_is_prefix = false;
+            if (!st || st->is_split() || st->type == LAST || st->is_finish()) {
+                break;
+            }
+        }
+    }
+
     class Regex
     {
         struct Parser {
@@ -58,11 +123,23 @@ namespace re {
         StateMachine2 sm;
         std::size_t pos;
 
+        // LAZY_DFA: DFA built on demand for search() and exact_search()
+        MultiRegex * dfa_search;
+        MultiRegex * dfa_exact;
+        unsigned dfa_max_states;
+
+        std::string required_literal;
+        std::string prefix_literal;
+
     public:
         typedef unsigned flag_t;
         static const flag_t DEFAULT_FLAG =      0;
         static const flag_t OPTIMIZE_MEMORY =   1 << 0;
         static const flag_t MINIMAL_MEMORY =    1 << 1;
+        static const flag_t LAZY_DFA =          1 << 2;
+
+        // DFA is released (and NFA used) when a search flushes the cache more than this
+        static const unsigned DFA_MAX_FLUSH = 8;
 
         unsigned step_limit;
 
@@ -70,10 +147,14 @@ namespace re {
         : parser()
         , sm(state_list_t(), NULL, 0)
         , pos(0)
+        , dfa_search(0)
+        , dfa_exact(0)
+        , dfa_max_states(1024)
         , step_limit(step_limit)
         {}
 
-        Regex(const char * s, flag_t flags = DEFAULT_FLAG, unsigned step_limit = 10000)
+        Regex(const char * s, flag_t flags = DEFAULT_FLAG, unsigned step_limit = 10000,
+              unsigned dfa_max_states = 1024)
         : parser(s)
         , sm(this->parser.st_parser.states(),
              this->parser.st_parser.root(),
@@ -81,8 +162,12 @@ namespace re {
              flags,
              flags & MINIMAL_MEMORY)
         , pos(0)
+        , dfa_search(0)
+        , dfa_exact(0)
+        , dfa_max_states(dfa_max_states)
         , step_limit(step_limit)
         {
+            this->init_search(flags);
             if (flags) {
                 this->parser.st_parser.clear_and_shrink();
             }
@@ -93,16 +178,26 @@ namespace re {
         : parser()
         , sm(std::move(other.sm))
         , pos(0)
+        , dfa_search(other.dfa_search)
+        , dfa_exact(other.dfa_exact)
+        , dfa_max_states(other.dfa_max_states)
+        , required_literal(std::move(other.required_literal))
+        , prefix_literal(std::move(other.prefix_literal))
         , step_limit(other.step_limit)
         {
             other.parser.err = nullptr;
             other.parser.pos_err = 0;
+            other.dfa_search = nullptr;
+            other.dfa_exact = nullptr;
         }
 
         Regex(StateMachine2 && other, unsigned step_limit = 10000) noexcept
         : parser()
         , sm(std::move(other))
         , pos(0)
+        , dfa_search(0)
+        , dfa_exact(0)
+        , dfa_max_states(0)
         , step_limit(step_limit)
         {}
 #endif
@@ -116,13 +211,21 @@ namespace re {
                                           this->parser.st_parser.nb_capture(),
                                           flags,
                                           flags & MINIMAL_MEMORY);
+            this->init_search(flags);
             if (flags) {
                 this->parser.st_parser.clear_and_shrink();
             }
         }
 
         ~Regex()
-        {}
+        {
+            this->release_dfa();
+        }
+
+        bool has_dfa() const
+        {
+            return this->dfa_search;
+        }
 
         unsigned mark_count() const
         {
@@ -187,11 +290,41 @@ namespace re {
 
         bool exact_search(const char * s)
         {
+            if (!this->required_literal.empty()) {
+                if (!this->prefix_literal.empty()
+                 && strncmp(s, this->prefix_literal.c_str(), this->prefix_literal.size())) {
+                    this->pos = 0;
+                    return false;
+                }
+                if (!strstr(s, this->required_literal.c_str())) {
+                    this->pos = strlen(s);
+                    return false;
+                }
+            }
+            if (this->dfa_exact) {
+                return this->dfa_match(*this->dfa_exact, s, s, true);
+            }
             return this->sm.exact_search(s, this->step_limit, &this->pos);
         }
 
         bool search(const char * s)
         {
+            const char * start = s;
+            if (!this->required_literal.empty()) {
+                if (!this->prefix_literal.empty()) {
+                    // every match starts with prefix: skip to first occurrence
+                    start = strstr(s, this->prefix_literal.c_str());
+                }
+                if (!start
+                 || (this->required_literal.size() != this->prefix_literal.size()
+                  && !strstr(start, this->required_literal.c_str()))) {
+                    this->pos = strlen(s);
+                    return false;
+                }
+            }
+            if (this->dfa_search) {
+                return this->dfa_match(*this->dfa_search, s, start, false);
+            }
             return this->sm.search(s, this->step_limit, &this->pos);
         }
 
@@ -224,6 +357,88 @@ namespace re {
         };
 
     private:
+        void init_search(flag_t flags)
+        {
+            this->release_dfa();
+            this->required_literal.clear();
+            this->prefix_literal.clear();
+            if (this->parser.err || !this->parser.st_parser.root()) {
+                return ;
+            }
+
+            const state_list_t & sts = this->parser.st_parser.states();
+            required_literals(sts, this->parser.st_parser.root(),
+                              this->required_literal, this->prefix_literal);
+
+            bool consume = false;
+            for (state_list_t::const_iterator it = sts.begin(); it != sts.end(); ++it) {
+                if ((*it)->type & (RANGE|SEQUENCE)) {
+                    consume = true;
+                    break;
+                }
+            }
+
+            // patterns without consuming state keep the NFA semantic
+            if ((flags & LAZY_DFA) && consume) {
+                this->dfa_search = new MultiRegex(this->dfa_max_states);
+                this->dfa_exact = new MultiRegex(this->dfa_max_states, true);
+                this->dfa_search->add_state(this->parser.st_parser.root());
+                this->dfa_exact->add_state(this->parser.st_parser.root());
+
+                // patterns matching the empty string keep the NFA semantic
+                this->dfa_exact->reset();
+                if (!this->dfa_exact->matches().empty() || !this->dfa_exact->eol_matches().empty()) {
+                    this->release_dfa();
+                }
+            }
+        }
+
+        void release_dfa()
+        {
+            delete this->dfa_search;
+            delete this->dfa_exact;
+            this->dfa_search = 0;
+            this->dfa_exact = 0;
+        }
+
+        // s is the string, matching starts at start (s or after skipped prefix)
+        bool dfa_match(MultiRegex & dfa, const char * s, const char * start, bool exact)
+        {
+            const unsigned flush_count = dfa.cache_flush_count;
+            utf8_consumer consumer(start);
+            bool res = false;
+
+            dfa.reset();
+            while (consumer.valid()) {
+                if (!exact && !this->prefix_literal.empty() && dfa.is_idle()) {
+                    // every match starts with prefix
+                    const char * next = strstr(consumer.str(), this->prefix_literal.c_str());
+                    if (!next) {
+                        consumer.str(consumer.str() + strlen(consumer.str()));
+                        break;
+                    }
+                    consumer.str(next);
+                }
+                if (dfa.step(consumer.bumpc()) && !exact) {
+                    res = true;
+                    break;
+                }
+                if (exact && dfa.dead()) {
+                    break;
+                }
+            }
+            if (!res && !consumer.valid()) {
+                res = (exact && !dfa.matches().empty()) || !dfa.eol_matches().empty();
+            }
+            this->pos = consumer.str() - s;
+
+            if (dfa.cache_flush_count - flush_count > DFA_MAX_FLUSH) {
+                // budget too small for this pattern, NFA from now on
+                this->release_dfa();
+            }
+            return res;
+        }
+
         template<bool exact>
         class BasicPartOfText
         {
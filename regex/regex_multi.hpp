@@ -0,0 +1,492 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *   Product name: redemption, a FLOSS RDP proxy
+ *   Copyright (C) Wallix 2014
+ *   Author(s): Christophe Grosjean, Jonathan Poelen
+ *
+ *   MultiRegex compiles several patterns into one automaton and searches
+ *   them (unanchored) in a stream of characters given one at a time.
+ *
+ *   Patterns are parsed by StateParser then flattened into a single NFA.
+ *   DFA states (sets of NFA nodes) are built lazily on the first time a
+ *   transition is taken and cached, so stream state is a single DFA state
+ *   index whatever the number of patterns. When the cache is full it is
+ *   flushed and rebuilt from the current state.
+ *
+ *   ^ matches at the start of the stream (after reset()), $ only on finish().
+ *
+ *   In anchored mode patterns only start at the beginning of the stream,
+ *   this is how Regex::exact_search() uses it.
+ */
+
+#ifndef REDEMPTION_REGEX_REGEX_MULTI_HPP
+#define REDEMPTION_REGEX_REGEX_MULTI_HPP
+
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "regex_parser.hpp"
+
+namespace re {
+
+    // UTF-8 bytes of a code point packed like utf8_consumer::bumpc() does
+    inline char_int utf8_char_int(uint32_t unicode)
+    {
+        if (unicode < 0x80) {
+            return unicode;
+        }
+        if (unicode < 0x800) {
+            return ((0xC0 | (unicode >> 6)) << 8)
+                 | (0x80 | (unicode & 0x3F));
+        }
+        if (unicode < 0x10000) {
+            return ((0xE0 | (unicode >> 12)) << 16)
+                 | ((0x80 | ((unicode >> 6) & 0x3F)) << 8)
+                 | (0x80 | (unicode & 0x3F));
+        }
+        return ((0xF0 | ((unicode >> 18) & 0x07)) << 24)
+             | ((0x80 | ((unicode >> 12) & 0x3F)) << 16)
+             | ((0x80 | ((unicode >> 6) & 0x3F)) << 8)
+             | (0x80 | (unicode & 0x3F));
+    }
+
+    class MultiRegex
+    {
+        enum {
+            NODE_CHAR,
+            NODE_SPLIT,
+            NODE_EPSILON,
+            NODE_BOL,
+            NODE_EOL,
+            NODE_MATCH
+        };
+
+        static const unsigned NONE = -1u;
+
+        struct Node {
+            unsigned type;
+            char_int l;
+            char_int r;
+            unsigned out1;
+            unsigned out2;
+            unsigned id;        // pattern number
+        };
+
+        typedef std::vector<unsigned> node_set_t;
+        typedef std::map<node_set_t, unsigned> dstate_map_t;
+
+        struct DState {
+            const node_set_t * nodes;
+            std::vector<unsigned> matches;
+            std::vector<unsigned> eol_matches;  // patterns matching if the stream ends here
+            int ascii[128];     // next DState for ASCII characters, -1 if not computed yet
+            std::map<char_int, unsigned> others;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<unsigned> roots;
+
+        dstate_map_t dstate_map;
+        std::vector<DState> dstates;
+        unsigned current;
+        unsigned start;         // DState at the start of the stream
+        unsigned idle;          // DState without any match in progress
+
+        std::vector<unsigned> marks;
+        unsigned mark_gen;
+
+        unsigned nb_pattern;
+        bool anchored;
+
+    public:
+        unsigned max_dstates;
+        unsigned cache_flush_count;
+
+        explicit MultiRegex(unsigned max_dstates = 2048, bool anchored = false)
+        : current(0)
+        , start(0)
+        , idle(0)
+        , mark_gen(0)
+        , nb_pattern(0)
+        , anchored(anchored)
+        , max_dstates(max_dstates)
+        , cache_flush_count(0)
+        {}
+
+        // returns the pattern number or -1u on error (err and pos_err are set)
+        unsigned add_pattern(const char * s, const char * * err = 0, size_t * pos_err = 0)
+        {
+            StateParser parser;
+            const char * msg_err = 0;
+            parser.compile(s, &msg_err, pos_err);
+            if (err) {
+                *err = msg_err;
+            }
+            if (msg_err || !parser.root()) {
+                return NONE;
+            }
+            return this->add_state(parser.root());
+        }
+
+        // root of a graph built by StateParser, returns the pattern number
+        unsigned add_state(const State * root)
+        {
+            std::map<const State *, unsigned> converted;
+            this->roots.push_back(this->convert(root, converted, this->nb_pattern));
+            this->clear_cache();
+            return this->nb_pattern++;
+        }
+
+        unsigned pattern_count() const
+        {
+            return this->nb_pattern;
+        }
+
+        unsigned dstate_count() const
+        {
+            return this->dstates.size();
+        }
+
+        void clear()
+        {
+            this->nodes.clear();
+            this->roots.clear();
+            this->nb_pattern = 0;
+            this->clear_cache();
+        }
+
+        void reset()
+        {
+            if (this->dstates.empty()) {
+                this->build_start();
+            }
+            this->current = this->start;
+        }
+
+        // consumes c, returns true if some patterns match at this position
+        bool step(char_int c)
+        {
+            if (this->dstates.empty()) {
+                this->build_start();
+                this->current = this->start;
+            }
+
+            DState & dstate = this->dstates[this->current];
+            if (c < 128) {
+                if (dstate.ascii[c] < 0) {
+                    this->current = this->compute_next(this->current, c);
+                }
+                else {
+                    this->current = dstate.ascii[c];
+                }
+            }
+            else {
+                std::map<char_int, unsigned>::const_iterator it = dstate.others.find(c);
+                this->current = (it == dstate.others.end())
+                              ? this->compute_next(this->current, c) : it->second;
+            }
+            return !this->dstates[this->current].matches.empty();
+        }
+
+        // patterns matching at current position
+        const std::vector<unsigned> & matches() const
+        {
+            return this->dstates[this->current].matches;
+        }
+
+        // patterns ending with $ matching if the stream ends at current position
+        const std::vector<unsigned> & eol_matches() const
+        {
+            return this->dstates[this->current].eol_matches;
+        }
+
+        // no pattern can match anymore (only in anchored mode)
+        bool dead() const
+        {
+            return this->dstates[this->current].nodes->empty();
+        }
+
+        // no match in progress (unanchored mode), input can be skipped up to
+        // where a pattern may start
+        bool is_idle() const
+        {
+            return this->current == this->idle;
+        }
+
+        // end of stream, returns patterns ending with $ matching here
+        std::vector<unsigned> finish()
+        {
+            std::vector<unsigned> ret;
+            if (!this->dstates.empty()) {
+                ret = this->dstates[this->current].eol_matches;
+            }
+            this->reset();
+            return ret;
+        }
+
+    private:
+        unsigned new_node(unsigned type, unsigned id, char_int l = 0, char_int r = 0)
+        {
+            Node node;
+            node.type = type;
+            node.l    = l;
+            node.r    = r;
+            node.out1 = NONE;
+            node.out2 = NONE;
+            node.id   = id;
+            this->nodes.push_back(node);
+            return this->nodes.size() - 1;
+        }
+
+        unsigned convert(const State * st, std::map<const State *, unsigned> & converted, unsigned id)
+        {
+            if (!st) {
+                // a null out is an implicit finish state
+                return this->new_node(NODE_MATCH, id);
+            }
+            std::map<const State *, unsigned>::iterator it = converted.find(st);
+            if (it != converted.end()) {
+                return it->second;
+            }
+
+            unsigned idx;
+            if (st->is_sequence()) {
+                // one node per character of the sequence (zero terminated,
+                // len is not always set)
+                idx = this->nodes.size();
+                size_t i = 0;
+                for (; st->data.sequence.s[i]; i++) {
+                    const char_int c = st->data.sequence.s[i];
+                    this->new_node(NODE_CHAR, id, c, c);
+                    if (i) {
+                        this->nodes[idx + i - 1].out1 = idx + i;
+                    }
+                }
+                if (!i) {
+                    idx = this->new_node(NODE_EPSILON, id);
+                    i = 1;
+                }
+                converted[st] = idx;
+                const unsigned out = this->convert(st->out1, converted, id);
+                this->nodes[idx + i - 1].out1 = out;
+                return idx;
+            }
+
+            if (st->is_range()) {
+                idx = this->new_node(NODE_CHAR, id, st->data.range.l, st->data.range.r);
+            }
+            else if (st->is_split()) {
+                idx = this->new_node(NODE_SPLIT, id);
+            }
+            else if (st->type == FIRST) {
+                idx = this->new_node(NODE_BOL, id);
+            }
+            else if (st->type == LAST) {
+                idx = this->new_node(NODE_EOL, id);
+            }
+            else if (st->is_finish()) {
+                idx = this->new_node(NODE_MATCH, id);
+            }
+            else {
+                // captures and epsilones
+                idx = this->new_node(NODE_EPSILON, id);
+            }
+            converted[st] = idx;
+
+            if (this->nodes[idx].type != NODE_MATCH) {
+                const unsigned out1 = this->convert(st->out1, converted, id);
+                this->nodes[idx].out1 = out1;
+                if (st->is_split()) {
+                    const unsigned out2 = this->convert(st->out2, converted, id);
+                    this->nodes[idx].out2 = out2;
+                }
+            }
+            return idx;
+        }
+
+        void closure(unsigned idx, bool at_start, node_set_t & set)
+        {
+            while (idx != NONE && this->marks[idx] != this->mark_gen) {
+                this->marks[idx] = this->mark_gen;
+                const Node & node = this->nodes[idx];
+                switch (node.type) {
+                case NODE_SPLIT:
+                    this->closure(node.out2, at_start, set);
+                    idx = node.out1;
+                    break;
+                case NODE_EPSILON:
+                    idx = node.out1;
+                    break;
+                case NODE_BOL:
+                    idx = at_start ? node.out1 : NONE;
+                    break;
+                default:
+                    set.push_back(idx);
+                    idx = NONE;
+                    break;
+                }
+            }
+        }
+
+        // finish states reachable without consuming when the stream ends here
+        void end_closure(unsigned idx, std::vector<unsigned> & ids)
+        {
+            while (idx != NONE && this->marks[idx] != this->mark_gen) {
+                this->marks[idx] = this->mark_gen;
+                const Node & node = this->nodes[idx];
+                switch (node.type) {
+                case NODE_SPLIT:
+                    this->end_closure(node.out2, ids);
+                    idx = node.out1;
+                    break;
+                case NODE_EPSILON:
+                case NODE_EOL:
+                    idx = node.out1;
+                    break;
+                case NODE_MATCH:
+                    ids.push_back(node.id);
+                    idx = NONE;
+                    break;
+                default:
+                    idx = NONE;
+                    break;
+                }
+            }
+        }
+
+        void new_mark_gen()
+        {
+            if (this->marks.size() != this->nodes.size()) {
+                this->marks.assign(this->nodes.size(), 0);
+                this->mark_gen = 0;
+            }
+            if (++this->mark_gen == 0) {
+                std::fill(this->marks.begin(), this->marks.end(), 0);
+                this->mark_gen = 1;
+            }
+        }
+
+        unsigned get_dstate(node_set_t & set)
+        {
+            std::sort(set.begin(), set.end());
+
+            dstate_map_t::iterator it = this->dstate_map.find(set);
+            if (it != this->dstate_map.end()) {
+                return it->second;
+            }
+
+            it = this->dstate_map.insert(std::make_pair(set, static_cast<unsigned>(this->dstates.size()))).first;
+
+            this->dstates.push_back(DState());
+            DState & dstate = this->dstates.back();
+            dstate.nodes   = &it->first;
+            std::fill(dstate.ascii, dstate.ascii + 128, -1);
+            bool has_eol = false;
+            for (node_set_t::const_iterator it = set.begin(); it != set.end(); ++it) {
+                const Node & node = this->nodes[*it];
+                if (node.type == NODE_MATCH) {
+                    dstate.matches.push_back(node.id);
+                }
+                else if (node.type == NODE_EOL) {
+                    has_eol = true;
+                }
+            }
+            std::sort(dstate.matches.begin(), dstate.matches.end());
+            dstate.matches.erase(std::unique(dstate.matches.begin(), dstate.matches.end()),
+                                 dstate.matches.end());
+            if (has_eol) {
+                this->new_mark_gen();
+                for (node_set_t::const_iterator it = set.begin(); it != set.end(); ++it) {
+                    if (this->nodes[*it].type == NODE_EOL) {
+                        this->end_closure(this->nodes[*it].out1, dstate.eol_matches);
+                    }
+                }
+                std::sort(dstate.eol_matches.begin(), dstate.eol_matches.end());
+                dstate.eol_matches.erase(std::unique(dstate.eol_matches.begin(), dstate.eol_matches.end()),
+                                         dstate.eol_matches.end());
+            }
+            return this->dstates.size() - 1;
+        }
+
+        void build_start()
+        {
+            node_set_t set;
+            this->new_mark_gen();
+            for (std::vector<unsigned>::const_iterator it = this->roots.begin(); it != this->roots.end(); ++it) {
+                this->closure(*it, true, set);
+            }
+            this->start = this->get_dstate(set);
+
+            set.clear();
+            this->new_mark_gen();
+            for (std::vector<unsigned>::const_iterator it = this->roots.begin(); it != this->roots.end(); ++it) {
+                this->closure(*it, false, set);
+            }
+            this->idle = this->get_dstate(set);
+        }
+
+        void clear_cache()
+        {
+            this->dstates.clear();
+            this->dstate_map.clear();
+            this->current = 0;
+        }
+
+        unsigned compute_next(unsigned from, char_int c)
+        {
+            if (this->dstates.size() >= this->max_dstates) {
+                // cache full: restart from a copy of the current set
+                node_set_t current_set = *this->dstates[from].nodes;
+                this->clear_cache();
+                this->build_start();
+                from = this->get_dstate(current_set);
+                this->cache_flush_count++;
+            }
+
+            node_set_t set;
+            this->new_mark_gen();
+            const node_set_t & from_set = *this->dstates[from].nodes;
+            for (node_set_t::const_iterator it = from_set.begin(); it != from_set.end(); ++it) {
+                const Node & node = this->nodes[*it];
+                if (node.type == NODE_CHAR && node.l <= c && c <= node.r) {
+                    this->closure(node.out1, false, set);
+                }
+            }
+            // unanchored search: every pattern may start at next position
+            if (!this->anchored) {
+                for (std::vector<unsigned>::const_iterator it = this->roots.begin(); it != this->roots.end(); ++it) {
+                    this->closure(*it, false, set);
+                }
+            }
+
+            const unsigned next = this->get_dstate(set);
+            if (c < 128) {
+                this->dstates[from].ascii[c] = next;
+            }
+            else {
+                this->dstates[from].others[c] = next;
+            }
+            return next;
+        }
+
+        MultiRegex(const MultiRegex &);
+        MultiRegex& operator=(const MultiRegex &);
+    };
+
+}
+
+#endif
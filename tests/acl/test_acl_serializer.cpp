@@ -29,6 +29,8 @@
 #include "log.hpp"
 #include "acl_serializer.hpp"
 #include "testtransport.hpp"
+#include "difftimeval.hpp"
+#include "rdtsc.hpp"
 
 // Class ACL Serializer is used to Modify config file content from a remote ACL manager
 // - Send given fields from config
@@ -223,3 +225,134 @@ BOOST_AUTO_TEST_CASE(TestAclSerializerInItems)
     BOOST_CHECK(ini.context_is_asked(AUTHID_PASSWORD));
     BOOST_CHECK(!ini.context_is_asked(AUTHID_PROXY_TYPE));
 }
+
+BOOST_AUTO_TEST_CASE(TestAuthidFromString)
+{
+    for (int i = AUTHID_UNKNOWN + 1; i < MAX_AUTHID; i++) {
+        const authid_t authid = static_cast<authid_t>(i);
+        BOOST_CHECK_EQUAL(authid, authid_from_string(string_from_authid(authid)));
+    }
+    BOOST_CHECK_EQUAL(AUTHID_UNKNOWN, authid_from_string("unknown"));
+    BOOST_CHECK_EQUAL(AUTHID_UNKNOWN, authid_from_string(""));
+    BOOST_CHECK_EQUAL(AUTHID_UNKNOWN, authid_from_string("password_"));
+}
+
+static void out_binary_item(Stream & stream, authid_t authid, const char * value)
+{
+    const size_t len = value ? strlen(value) + 1 : 0;
+    stream.out_uint16_be(authid);
+    stream.out_uint16_be(len);
+    stream.out_copy_bytes(value, len);
+}
+
+BOOST_AUTO_TEST_CASE(TestAclSerializerBinary)
+{
+    Inifile ini;
+    BStream stream(1024);
+    stream.out_uint32_be(0);
+    out_binary_item(stream, AUTHID_AUTH_USER, NULL);
+    out_binary_item(stream, AUTHID_PROXY_TYPE, "VNC");
+    out_binary_item(stream, AUTHID_SESSION_ID, "6455");
+    stream.set_out_uint32_be((stream.get_offset() - 4) | AclSerializer::BINARY_FLAG, 0);
+
+    GeneratorTransport trans((char *)stream.get_data(), stream.get_offset());
+    AclSerializer acl(&ini, trans, 0);
+    ini.context.session_id.set_empty();
+    ini.context_set_value(AUTHID_AUTH_USER, "testuser");
+    BOOST_CHECK(!acl.binary);
+
+    acl.incoming();
+    BOOST_CHECK(acl.binary);
+    BOOST_CHECK(ini.context_is_asked(AUTHID_AUTH_USER));
+    BOOST_CHECK_EQUAL(std::string("VNC"), std::string(ini.context_get_value(AUTHID_PROXY_TYPE)));
+    BOOST_CHECK_EQUAL(std::string("6455"), std::string(ini.context.session_id.get_cstr()));
+
+    // answer uses binary records too
+    ini.reset();
+    ini.context_set_value(AUTHID_PROXY_TYPE, "RDP");
+    BStream expected(1024);
+    expected.out_uint32_be(0);
+    out_binary_item(expected, AUTHID_PROXY_TYPE, "RDP");
+    expected.set_out_uint32_be((expected.get_offset() - 4) | AclSerializer::BINARY_FLAG, 0);
+
+    CheckTransport check((char *)expected.get_data(), expected.get_offset());
+    AclSerializer acl_out(&ini, check, 0);
+    acl_out.binary = true;
+    acl_out.send_acl_data();
+    BOOST_CHECK(strcmp(ini.context_get_value(AUTHID_REJECTED), "Authentifier service failed"));
+
+    // truncated record
+    BStream truncated(16);
+    truncated.out_uint16_be(AUTHID_PROXY_TYPE);
+    truncated.out_uint16_be(10);
+    truncated.out_copy_bytes("RDP", 3);
+    truncated.mark_end();
+    truncated.rewind();
+    try {
+        acl.in_items_binary(truncated);
+        BOOST_CHECK(false);
+    } catch (const Error & e) {
+        BOOST_CHECK_EQUAL((uint32_t)ERR_ACL_UNEXPECTED_IN_ITEM_OUT, (uint32_t)e.id);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestAclSerializerParseBenchmark)
+{
+    static const authid_t authids[] = {
+        AUTHID_KEEPALIVE, AUTHID_SELECTOR_CURRENT_PAGE, AUTHID_TARGET_USER,
+        AUTHID_TARGET_DEVICE, AUTHID_MESSAGE, AUTHID_END_TIME,
+        AUTHID_REAL_TARGET_DEVICE, AUTHID_DISABLE_KEYBOARD_LOG
+    };
+    const size_t nb_authids = sizeof(authids) / sizeof(authids[0]);
+    const size_t nb_fields  = 10000;
+
+    Inifile ini;
+    LogTransport trans;
+    AclSerializer acl(&ini, trans, 0);
+
+    BStream text(nb_fields * 64);
+    BStream binary(nb_fields * 64);
+    for (size_t i = 0; i < nb_fields; i++) {
+        const authid_t authid = authids[i % nb_authids];
+        char value[32];
+        snprintf(value, sizeof(value), "%u", static_cast<unsigned>(i));
+        text.out_concat(string_from_authid(authid));
+        text.out_concat("\n!");
+        text.out_concat(value);
+        text.out_concat("\n");
+        out_binary_item(binary, authid, value);
+    }
+    text.mark_end();
+    binary.mark_end();
+
+    // in_item writes separators in place, parse a fresh copy each time
+    BStream work(nb_fields * 64);
+    const unsigned iterations = 10;
+
+    unsigned long long usec   = ustime();
+    unsigned long long cycles = rdtsc();
+    for (unsigned i = 0; i < iterations; i++) {
+        work.reset();
+        work.out_copy_bytes(text.get_data(), text.size());
+        work.mark_end();
+        work.rewind();
+        acl.in_items(work);
+    }
+    unsigned long long elapusec = ustime() - usec;
+    unsigned long long elapcyc  = rdtsc() - cycles;
+    printf("text records: %u x %u fields, elapsed %llu us (%llu cycles)\n",
+        iterations, static_cast<unsigned>(nb_fields), elapusec, elapcyc);
+    BOOST_CHECK_EQUAL(std::string("9999"), std::string(ini.context_get_value(authids[9999 % nb_authids])));
+
+    usec   = ustime();
+    cycles = rdtsc();
+    for (unsigned i = 0; i < iterations; i++) {
+        binary.rewind();
+        acl.in_items_binary(binary);
+    }
+    elapusec = ustime() - usec;
+    elapcyc  = rdtsc() - cycles;
+    printf("binary records: %u x %u fields, elapsed %llu us (%llu cycles)\n",
+        iterations, static_cast<unsigned>(nb_fields), elapusec, elapcyc);
+    BOOST_CHECK_EQUAL(std::string("9998"), std::string(ini.context_get_value(authids[9998 % nb_authids])));
+}
@@ -0,0 +1,116 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Meng Tan
+
+   Unit test for pattern_kill/pattern_notify checks on keyboard and clipboard
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestPatternChecker
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+
+#include "pattern_checker.hpp"
+
+class ReportAuthentifier : public auth_api {
+public:
+    std::string reports;
+
+    virtual void set_auth_channel_target(const char * target) {}
+    virtual void set_auth_channel_result(const char * result) {}
+
+    virtual void report(const char * reason, const char * message) {
+        this->reports += reason;
+        this->reports += ":";
+        this->reports += message;
+        this->reports += " ";
+    }
+};
+
+// keyboard input as given by Keymap2 (uint32_le unicode characters)
+static bool type_text(PatternChecker & checker, const char * s, auth_api * authentifier)
+{
+    BStream decoded_data(256);
+    for (const char * p = s; *p; p++) {
+        decoded_data.out_uint32_le(static_cast<uint8_t>(*p));
+    }
+    decoded_data.mark_end();
+    return checker.check_input(decoded_data, authentifier);
+}
+
+BOOST_AUTO_TEST_CASE(TestPatternCheckerKeyboard)
+{
+    ReportAuthentifier authentifier;
+    PatternChecker checker;
+    BOOST_CHECK(!checker.is_active());
+
+    BOOST_CHECK(checker.update("rm -rf\x01" "shutdown", "sudo\x01" "a(b"));
+    BOOST_CHECK(checker.is_active());
+    // same patterns: nothing rebuilt
+    BOOST_CHECK(!checker.update("rm -rf\x01" "shutdown", "sudo\x01" "a(b"));
+
+    BOOST_CHECK(!type_text(checker, "ls -l\r", &authentifier));
+    BOOST_CHECK_EQUAL(std::string(""), authentifier.reports);
+
+    BOOST_CHECK(!type_text(checker, "su", &authentifier));
+    BOOST_CHECK(!type_text(checker, "do ls\r", &authentifier));
+    BOOST_CHECK_EQUAL(std::string("FINDPATTERN_NOTIFY:sudo "), authentifier.reports);
+
+    // match spans several input events
+    BOOST_CHECK(!type_text(checker, "rm -r", &authentifier));
+    BOOST_CHECK(type_text(checker, "f /", &authentifier));
+    BOOST_CHECK_EQUAL(std::string("FINDPATTERN_NOTIFY:sudo FINDPATTERN_KILL:rm -rf "),
+                      authentifier.reports);
+
+    // no authentifier: kill is still detected
+    BOOST_CHECK(type_text(checker, "shutdown", 0));
+
+    BOOST_CHECK(checker.update("", ""));
+    BOOST_CHECK(!checker.is_active());
+}
+
+BOOST_AUTO_TEST_CASE(TestPatternCheckerClipboard)
+{
+    ReportAuthentifier authentifier;
+    PatternChecker checker;
+    checker.update("passwd$", "caf\xC3\xA9");
+
+    // "café passwd" in UTF-16LE, cut in the middle of a character
+    const uint8_t text[] = {
+        'c', 0, 'a', 0, 'f', 0, 0xE9, 0, ' ', 0,
+        'p', 0, 'a', 0, 's', 0, 's', 0, 'w', 0, 'd', 0, 0, 0
+    };
+    BOOST_CHECK(!checker.check_clipboard_text(text, 7, false, &authentifier));
+    BOOST_CHECK_EQUAL(std::string(""), authentifier.reports);
+    // $ only matches at the end of the text
+    BOOST_CHECK(!checker.check_clipboard_text(text + 7, 15, false, &authentifier));
+    BOOST_CHECK_EQUAL(std::string("FINDPATTERN_NOTIFY:caf\xC3\xA9 "), authentifier.reports);
+    BOOST_CHECK(checker.check_clipboard_text(text + 22, 2, true, &authentifier));
+    BOOST_CHECK_EQUAL(std::string("FINDPATTERN_NOTIFY:caf\xC3\xA9 FINDPATTERN_KILL:passwd$ "),
+                      authentifier.reports);
+
+    // keyboard is a separate stream
+    BOOST_CHECK(!type_text(checker, "passwd", &authentifier));
+
+    // surrogate pair (U+1F600) does not break matching
+    const uint8_t emoji[] = { 0x3D, 0xD8, 0x00, 0xDE, 'p', 0, 'a', 0, 's', 0, 's', 0, 'w', 0, 'd', 0 };
+    BOOST_CHECK(checker.check_clipboard_text(emoji, sizeof(emoji), true, &authentifier));
+}
@@ -490,3 +490,155 @@ BOOST_AUTO_TEST_CASE(TestCaptureToWrmReplayToPng)
    ::unlink("./testcap.wrm");
 }
 
+
+// Keeps everything sent, to compare recordings
+class OutBufferTransport : public Transport {
+public:
+    BStream stream;
+
+    OutBufferTransport() : stream(1024 * 1024) {}
+
+    using Transport::recv;
+    virtual void recv(char ** pbuffer, size_t len) throw (Error) {
+        throw Error(ERR_TRANSPORT_OUTPUT_ONLY_USED_FOR_SEND);
+    }
+
+    using Transport::send;
+    virtual void send(const char * const buffer, size_t len) throw (Error) {
+        this->stream.out_copy_bytes(buffer, len);
+    }
+
+    virtual void seek(int64_t offset, int whence) throw (Error) {
+        throw Error(ERR_TRANSPORT_SEEK_NOT_AVAILABLE);
+    }
+};
+
+static void record_session(Transport & trans)
+{
+    struct timeval now;
+    now.tv_usec = 0;
+    now.tv_sec = 1000;
+
+    Rect screen_rect(0, 0, 800, 600);
+    Inifile ini;
+    BmpCache bmp_cache(BmpCache::Recorder, 24, 3, false, 600, 256, false, 300, 1024, false, 262, 4096, false);
+    RDPDrawable drawable(screen_rect.cx, screen_rect.cy);
+    GraphicToFile consumer(now, &trans, screen_rect.cx, screen_rect.cy, 24, bmp_cache, drawable, ini);
+
+    uint8_t pixels[32 * 32 * 3];
+    for (size_t i = 0; i < sizeof(pixels); i++) {
+        pixels[i] = i * 7;
+    }
+    Bitmap bmp(24, 24, NULL, 32, 32, pixels, sizeof(pixels), false);
+
+    consumer.draw(RDPOpaqueRect(screen_rect, GREEN), screen_rect);
+    consumer.draw(RDPMemBlt(0, Rect(100, 100, 32, 32), 0xCC, 0, 0, 0), screen_rect, bmp);
+    now.tv_sec++;
+    consumer.timestamp(now);
+
+    consumer.draw(RDPScrBlt(Rect(200, 100, 100, 100), 0xCC, 80, 80), screen_rect);
+    consumer.draw(RDPOpaqueRect(Rect(0, 150, 700, 30), RED), screen_rect);
+    now.tv_sec++;
+    consumer.timestamp(now);
+    consumer.breakpoint();
+
+    // bitmap is now a cache hit
+    consumer.draw(RDPOpaqueRect(Rect(10, 10, 50, 50), BLUE), screen_rect);
+    consumer.draw(RDPMemBlt(0, Rect(300, 300, 32, 32), 0xCC, 0, 0, 0), screen_rect, bmp);
+    now.tv_sec++;
+    consumer.timestamp(now);
+    consumer.breakpoint();
+
+    consumer.flush();
+}
+
+static void replay_buffer(OutBufferTransport & recorded, unsigned chained_keyframes, RDPDrawable & drawable)
+{
+    GeneratorTransport trans(reinterpret_cast<const char *>(recorded.stream.get_data()),
+                             recorded.stream.get_offset());
+    timeval begin_capture;
+    begin_capture.tv_sec = 0; begin_capture.tv_usec = 0;
+    timeval end_capture;
+    end_capture.tv_sec = 0; end_capture.tv_usec = 0;
+    FileToGraphic player(&trans, begin_capture, end_capture, false, 0);
+    player.chain_keyframes(chained_keyframes);
+    player.add_consumer(&drawable, &drawable);
+    while (player.next_order()) {
+        player.interpret_order();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestIncrementalKeyframes)
+{
+    struct timeval now;
+    now.tv_usec = 0;
+    now.tv_sec = 1000;
+
+    Rect screen_rect(0, 0, 800, 600);
+    Inifile ini;
+    ini.video.wrm_full_keyframe_interval = 3;
+    BmpCache bmp_cache(BmpCache::Recorder, 24, 3, false, 600, 256, false, 300, 1024, false, 262, 4096, false);
+    RDPDrawable drawable(screen_rect.cx, screen_rect.cy);
+    OutBufferTransport trans;
+    GraphicToFile consumer(now, &trans, screen_rect.cx, screen_rect.cy, 24, bmp_cache, drawable, ini);
+
+    uint8_t pixels[32 * 32 * 3];
+    for (size_t i = 0; i < sizeof(pixels); i++) {
+        pixels[i] = i * 7;
+    }
+    Bitmap bmp(24, 24, NULL, 32, 32, pixels, sizeof(pixels), false);
+
+    // keyframe 0 (full) is sent by constructor
+    consumer.draw(RDPOpaqueRect(screen_rect, GREEN), screen_rect);
+    consumer.draw(RDPMemBlt(0, Rect(100, 100, 32, 32), 0xCC, 0, 0, 0), screen_rect, bmp);
+    now.tv_sec++;
+    consumer.timestamp(now);
+    consumer.breakpoint();  // keyframe 1 (incremental)
+
+    consumer.draw(RDPOpaqueRect(Rect(10, 10, 50, 50), BLUE), screen_rect);
+    consumer.draw(RDPMemBlt(0, Rect(300, 300, 32, 32), 0xCC, 0, 0, 0), screen_rect, bmp);
+    now.tv_sec++;
+    consumer.timestamp(now);
+    consumer.breakpoint();  // keyframe 2 (incremental)
+
+    consumer.draw(RDPOpaqueRect(Rect(400, 10, 50, 50), RED), screen_rect);
+    consumer.flush();
+
+    // first chunk is META, wrm format version 5
+    BOOST_CHECK_EQUAL(static_cast<int>(META_FILE), trans.stream.get_data()[0] | (trans.stream.get_data()[1] << 8));
+    BOOST_CHECK_EQUAL(5, trans.stream.get_data()[8] | (trans.stream.get_data()[9] << 8));
+
+    const size_t pix_len = drawable.drawable.pix_len;
+
+    // whole recording
+    RDPDrawable full(screen_rect.cx, screen_rect.cy);
+    replay_buffer(trans, 0, full);
+    BOOST_CHECK_EQUAL(0, memcmp(drawable.drawable.data, full.drawable.data, pix_len));
+
+    // orders between keyframes 0, 1 and 2 are skipped, screen comes from
+    // keyframe 0 image and tiles of incremental keyframes
+    RDPDrawable chained(screen_rect.cx, screen_rect.cy);
+    replay_buffer(trans, 2, chained);
+    BOOST_CHECK_EQUAL(0, memcmp(drawable.drawable.data, chained.drawable.data, pix_len));
+
+    // waiting for a keyframe 3 that never comes: last order is skipped
+    RDPDrawable skipped(screen_rect.cx, screen_rect.cy);
+    replay_buffer(trans, 3, skipped);
+    BOOST_CHECK(memcmp(drawable.drawable.data, skipped.drawable.data, pix_len) != 0);
+    skipped.draw(RDPOpaqueRect(Rect(400, 10, 50, 50), RED), screen_rect);
+    BOOST_CHECK_EQUAL(0, memcmp(drawable.drawable.data, skipped.drawable.data, pix_len));
+}
+
+BOOST_AUTO_TEST_CASE(TestWrmFormatVersion)
+{
+    // all keyframes full: version 3, readable by older players
+    OutBufferTransport recorded;
+    record_session(recorded);
+    uint8_t * version = recorded.stream.get_data() + 8;
+    BOOST_CHECK_EQUAL(3, version[0] | (version[1] << 8));
+
+    // versions after 5 are not known by player
+    version[0] = 6;
+    RDPDrawable drawable(800, 600);
+    BOOST_CHECK_THROW(replay_buffer(recorded, 0, drawable), Error);
+}
@@ -0,0 +1,169 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Unit test for capture files retention
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestCaptureRetention
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+
+#include <stdio.h>
+
+#include "capture_retention.hpp"
+
+static void make_file(const char * filename, size_t size) {
+    FILE * f = fopen(filename, "w");
+    for (size_t i = 0; i < size; i++) {
+        fputc('x', f);
+    }
+    fclose(f);
+}
+
+static bool file_exists(const char * filename) {
+    struct stat st;
+    return stat(filename, &st) == 0;
+}
+
+static const char * filenames[] = {
+    "./retention-0.png", "./retention-1.png", "./retention-2.png", "./retention-3.png"
+};
+
+BOOST_AUTO_TEST_CASE(TestRetainedFilesQuotas)
+{
+    RetainedFiles files;
+    files.quotas.max_files = 3;
+
+    for (unsigned i = 0; i < 4; i++) {
+        make_file(filenames[i], 100 * (i + 1));
+        files.add(filenames[i], 1000 + i * 10);
+        files.enforce(1000 + i * 10);
+    }
+    // count
+    BOOST_CHECK_EQUAL(3, files.size());
+    BOOST_CHECK_EQUAL(900, files.total_bytes());
+    BOOST_CHECK(!file_exists(filenames[0]));
+    BOOST_CHECK(file_exists(filenames[1]));
+
+    // size
+    files.quotas.max_bytes = 800;
+    files.enforce(1030);
+    BOOST_CHECK_EQUAL(2, files.size());
+    BOOST_CHECK_EQUAL(700, files.total_bytes());
+    BOOST_CHECK(!file_exists(filenames[1]));
+
+    // age
+    files.quotas.max_age = 15;
+    files.enforce(1034);
+    BOOST_CHECK_EQUAL(2, files.size());
+    files.enforce(1035);
+    BOOST_CHECK_EQUAL(1, files.size());
+    BOOST_CHECK(!file_exists(filenames[2]));
+    BOOST_CHECK(file_exists(filenames[3]));
+
+    files.remove_all();
+    BOOST_CHECK_EQUAL(0, files.size());
+    BOOST_CHECK_EQUAL(0, files.total_bytes());
+    BOOST_CHECK(!file_exists(filenames[3]));
+}
+
+BOOST_AUTO_TEST_CASE(TestCaptureRetentionInSession)
+{
+    {
+        CaptureRetention retention(true, false);
+        RetentionQuotas quotas;
+        quotas.max_files = 2;
+        retention.set_quotas(quotas);
+
+        for (unsigned i = 0; i < 3; i++) {
+            make_file(filenames[i], 10);
+            retention.add(filenames[i]);
+        }
+        BOOST_CHECK(!retention.helper_running());
+        BOOST_CHECK(!file_exists(filenames[0]));
+        BOOST_CHECK(file_exists(filenames[1]));
+        BOOST_CHECK(file_exists(filenames[2]));
+
+        // png_limit lowered
+        quotas.max_files = 1;
+        retention.set_quotas(quotas);
+        BOOST_CHECK(!file_exists(filenames[1]));
+        BOOST_CHECK(file_exists(filenames[2]));
+    }
+    // clear on exit
+    BOOST_CHECK(!file_exists(filenames[2]));
+}
+
+BOOST_AUTO_TEST_CASE(TestCaptureRetentionHelper)
+{
+    {
+        CaptureRetention retention(true, true);
+        RetentionQuotas quotas;
+        quotas.max_files = 2;
+        retention.set_quotas(quotas);
+
+        for (unsigned i = 0; i < 3; i++) {
+            make_file(filenames[i], 10);
+            retention.add(filenames[i]);
+        }
+        BOOST_CHECK(retention.helper_running());
+        retention.sync();
+        BOOST_CHECK(!file_exists(filenames[0]));
+        BOOST_CHECK(file_exists(filenames[1]));
+        BOOST_CHECK(file_exists(filenames[2]));
+
+        quotas.max_files = 1;
+        retention.set_quotas(quotas);
+        retention.sync();
+        BOOST_CHECK(!file_exists(filenames[1]));
+        BOOST_CHECK(file_exists(filenames[2]));
+    }
+
+    // helper removes remaining files once session side is closed
+    for (unsigned i = 0; (i < 500) && file_exists(filenames[2]); i++) {
+        usleep(10000);
+    }
+    BOOST_CHECK(!file_exists(filenames[2]));
+
+    // helper is not a child of session process, nothing left to reap
+    errno = 0;
+    BOOST_CHECK_EQUAL(-1, waitpid(-1, NULL, WNOHANG));
+    BOOST_CHECK_EQUAL(ECHILD, errno);
+}
+
+BOOST_AUTO_TEST_CASE(TestCaptureRetentionKeepOnExit)
+{
+    make_file(filenames[0], 10);
+    {
+        CaptureRetention retention(false, true);
+        RetentionQuotas quotas;
+        quotas.max_files = 2;
+        retention.set_quotas(quotas);
+        retention.add(filenames[0]);
+        retention.sync();
+    }
+    usleep(100000);
+    BOOST_CHECK(file_exists(filenames[0]));
+    unlink(filenames[0]);
+}
@@ -343,6 +343,9 @@ BOOST_AUTO_TEST_CASE(TestOneRedScreen)
 
     now.tv_sec++; consumer.snapshot(now, 0, 0, ignore_frame_in_timeval);
 
+    // old png files are removed by retention helper process
+    consumer.retention.sync();
+
     rio_clear(&trans.rio);
     BOOST_CHECK_EQUAL(-1, sq_outfilename_filesize(seq, 0));
     BOOST_CHECK_EQUAL(3061, sq_outfilename_filesize(seq, 1));
@@ -352,6 +355,7 @@ BOOST_AUTO_TEST_CASE(TestOneRedScreen)
 
     ini.video.png_limit = 10;
     consumer.update_config(ini);
+    consumer.retention.sync();
 
     BOOST_CHECK_EQUAL(-1, sq_outfilename_filesize(seq, 0));
     BOOST_CHECK_EQUAL(3061, sq_outfilename_filesize(seq, 1));
@@ -361,6 +365,7 @@ BOOST_AUTO_TEST_CASE(TestOneRedScreen)
 
     ini.video.png_limit = 2;
     consumer.update_config(ini);
+    consumer.retention.sync();
 
     BOOST_CHECK_EQUAL(-1, sq_outfilename_filesize(seq, 0));
     BOOST_CHECK_EQUAL(-1, sq_outfilename_filesize(seq, 1));
@@ -370,6 +375,7 @@ BOOST_AUTO_TEST_CASE(TestOneRedScreen)
 
     ini.video.png_limit = 0;
     consumer.update_config(ini);
+    consumer.retention.sync();
 
     BOOST_CHECK_EQUAL(-1, sq_outfilename_filesize(seq, 1));
     BOOST_CHECK_EQUAL(-1, sq_outfilename_filesize(seq, 2));
@@ -0,0 +1,114 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Unit test for keystroke index (.kidx) writer and search
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestKeystrokeIndex
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+
+#include "keystroke_index.hpp"
+
+static void type(KeystrokeIndexWriter & writer, time_t sec, const char * text)
+{
+    uint8_t keys[256];
+    size_t  size = 0;
+    for (const char * c = text; *c; c++) {
+        keys[size++] = *c;
+        keys[size++] = 0;
+        keys[size++] = 0;
+        keys[size++] = 0;
+    }
+    timeval now;
+    now.tv_sec  = sec;
+    now.tv_usec = 0;
+    writer.add(now, keys, size);
+}
+
+BOOST_AUTO_TEST_CASE(TestKeystrokeIndexSearch)
+{
+    const char * path = "/tmp/test_keystroke_index.kidx";
+    ::unlink(path);
+
+    timeval start;
+    start.tv_sec  = 1000;
+    start.tv_usec = 0;
+    {
+        KeystrokeIndexWriter writer(path, start);
+        type(writer, 1010, "ls -l\r");
+        type(writer, 1020, "sudo pas");     // word split over two chunks
+        writer.next_file();
+        type(writer, 1030, "swd root\r");
+        type(writer, 1040, "");             // no key: no entry
+        type(writer, 1050, "SUDO reboot\r");
+        BOOST_CHECK(writer.save());
+    }
+
+    KeystrokeIndexReader index;
+    BOOST_CHECK(!index.open("/tmp/test_keystroke_index_missing.kidx"));
+    BOOST_REQUIRE(index.open(path));
+    BOOST_CHECK_EQUAL(4u, index.entry_count);
+    BOOST_CHECK_EQUAL(35u, index.text_size);
+    BOOST_CHECK_EQUAL(1000000000ULL, index.start_time);
+
+    std::vector<KeystrokeIndexReader::Match> matches;
+
+    index.search("passwd", matches);
+    BOOST_REQUIRE_EQUAL(1u, matches.size());
+    BOOST_CHECK_EQUAL(11u, matches[0].position);
+    BOOST_CHECK_EQUAL(1u, matches[0].entry);
+    BOOST_CHECK_EQUAL(1010000000ULL, matches[0].begin);
+    BOOST_CHECK_EQUAL(1020000000ULL, matches[0].time);
+    BOOST_CHECK_EQUAL(0u, matches[0].wrm_index);
+
+    // case insensitive, in text order
+    matches.clear();
+    index.search("sudo", matches);
+    BOOST_REQUIRE_EQUAL(2u, matches.size());
+    BOOST_CHECK_EQUAL(6u, matches[0].position);
+    BOOST_CHECK_EQUAL(23u, matches[1].position);
+    BOOST_CHECK_EQUAL(3u, matches[1].entry);
+    BOOST_CHECK_EQUAL(1u, matches[1].wrm_index);
+
+    // short queries are scanned
+    matches.clear();
+    index.search("\r", matches);
+    BOOST_CHECK_EQUAL(3u, matches.size());
+
+    matches.clear();
+    index.search("root", matches);
+    BOOST_REQUIRE_EQUAL(1u, matches.size());
+    BOOST_CHECK_EQUAL(2u, matches[0].entry);
+
+    size_t size = 6;
+    BOOST_CHECK_EQUAL(std::string("passwd"), std::string(index.text_at(11, size), size));
+
+    matches.clear();
+    index.search("shutdown", matches);
+    index.search("", matches);
+    BOOST_CHECK_EQUAL(0u, matches.size());
+
+    ::unlink(path);
+}
@@ -0,0 +1,156 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Unit test for host-wide png snapshot scheduling
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestSnapshotScheduler
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "snapshot_scheduler.hpp"
+
+BOOST_AUTO_TEST_CASE(TestPhaseOffset)
+{
+    const uint64_t interval = 300000000;   // 5 minutes
+    BOOST_CHECK_EQUAL(0u, SnapshotScheduler::phase_offset(0, interval));
+
+    // 100 sessions started together: no two snapshots closer than a third
+    // of even spacing
+    std::vector<uint64_t> phases;
+    for (unsigned i = 0; i < 100; i++) {
+        const uint64_t phase = SnapshotScheduler::phase_offset(i, interval);
+        BOOST_CHECK(phase < interval);
+        phases.push_back(phase);
+    }
+    std::sort(phases.begin(), phases.end());
+    uint64_t min_gap = interval;
+    for (unsigned i = 1; i < phases.size(); i++) {
+        min_gap = std::min(min_gap, phases[i] - phases[i - 1]);
+    }
+    BOOST_CHECK(min_gap > interval / 100 / 3);
+
+    BOOST_CHECK_EQUAL(0u, SnapshotScheduler::phase_offset(7, 0));
+}
+
+BOOST_AUTO_TEST_CASE(TestBudget)
+{
+    SnapshotBudget budget;
+    memset(&budget, 0, sizeof(budget));
+
+    SnapshotScheduler a(budget, 50000);
+    SnapshotScheduler b(budget, 50000);
+
+    timeval now;
+    now.tv_sec  = 1350998222;
+    now.tv_usec = 100000;
+
+    BOOST_CHECK(a.admit(now));
+    a.spent(now, 30000);
+    BOOST_CHECK(b.admit(now));
+    b.spent(now, 30000);
+
+    // budget shared by both sessions
+    now.tv_usec = 900000;
+    BOOST_CHECK(!a.admit(now));
+    BOOST_CHECK(!b.admit(now));
+    BOOST_CHECK_EQUAL(100000u, SnapshotScheduler::next_window_delay(now));
+
+    // next second
+    now.tv_sec++;
+    now.tv_usec = 0;
+    BOOST_CHECK(a.admit(now));
+    // last encode time of a is reserved
+    BOOST_CHECK_EQUAL(30000u, budget.window_usec);
+
+    // no limit
+    b.set_budget(0);
+    a.spent(now, 100000);
+    BOOST_CHECK(!a.admit(now));
+    BOOST_CHECK(b.admit(now));
+}
+
+BOOST_AUTO_TEST_CASE(TestBudgetReservation)
+{
+    SnapshotBudget budget;
+    memset(&budget, 0, sizeof(budget));
+
+    timeval now;
+    now.tv_sec  = 1350998222;
+    now.tv_usec = 0;
+
+    // many sessions asking before any of them is done encoding: admitted
+    // ones reserve their expected encode time, budget is overshot by at
+    // most one estimate
+    const uint64_t budget_usec = 50000;
+    std::vector<SnapshotScheduler*> schedulers;
+    unsigned admitted = 0;
+    for (unsigned i = 0; i < 20; i++) {
+        schedulers.push_back(new SnapshotScheduler(budget, budget_usec, i));
+        if (schedulers.back()->admit(now)) {
+            admitted++;
+        }
+    }
+    BOOST_CHECK_EQUAL(3u, admitted);
+    BOOST_CHECK(budget.window_usec < budget_usec + SnapshotScheduler::DEFAULT_ESTIMATE_USEC);
+
+    // faster than expected: difference given back
+    now.tv_usec = 100000;
+    for (unsigned i = 0; i < admitted; i++) {
+        schedulers[i]->spent(now, 5000);
+    }
+    BOOST_CHECK_EQUAL(15000u, budget.window_usec);
+    BOOST_CHECK(schedulers[3]->admit(now));
+    BOOST_CHECK_EQUAL(35000u, budget.window_usec);
+
+    // slower than expected: difference charged
+    schedulers[3]->spent(now, 40000);
+    BOOST_CHECK_EQUAL(55000u, budget.window_usec);
+    BOOST_CHECK(!schedulers[4]->admit(now));
+
+    // reservation done in a past window is not given back to the new one
+    BOOST_CHECK(schedulers[0]->admit(now) == false);
+    now.tv_sec++;
+    BOOST_CHECK(schedulers[0]->admit(now));
+    BOOST_CHECK_EQUAL(5000u, budget.window_usec);
+    now.tv_sec++;
+    schedulers[0]->spent(now, 1000);
+    BOOST_CHECK_EQUAL(1000u, budget.window_usec);
+
+    // deferred sessions retry at different times in next window
+    now.tv_usec = 900000;
+    std::vector<uint64_t> retries;
+    for (unsigned i = 0; i < schedulers.size(); i++) {
+        const uint64_t delay = schedulers[i]->retry_delay(now);
+        BOOST_CHECK(delay >= SnapshotScheduler::next_window_delay(now));
+        BOOST_CHECK(delay < SnapshotScheduler::next_window_delay(now) + 1000000);
+        retries.push_back(delay);
+        delete schedulers[i];
+    }
+    std::sort(retries.begin(), retries.end());
+    BOOST_CHECK(std::unique(retries.begin(), retries.end()) == retries.end());
+}
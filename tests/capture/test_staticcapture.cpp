@@ -146,3 +146,62 @@ BOOST_AUTO_TEST_CASE(TestFrameMarker)
     sq_outfilename_unlink(&(trans.seq), 1);
 }
 
+
+BOOST_AUTO_TEST_CASE(TestSnapshotDeferredByEncodeBudget)
+{
+    Rect screen_rect(0, 0, 800, 600);
+    const int groupid = 0;
+    OutFilenameTransport trans(SQF_PATH_FILE_PID_COUNT_EXTENSION, "./", "test_budget", ".png", groupid);
+
+    struct timeval now;
+    now.tv_sec = 1350998222;
+    now.tv_usec = 0;
+
+    Inifile ini;
+    ini.video.png_limit = 3;
+    ini.video.png_interval = 20;
+    ini.video.png_encode_budget = 10;
+    RDPDrawable drawable(800, 600);
+    StaticCapture consumer(now, trans, &(trans.seq), 800, 600, false, ini, drawable.drawable);
+    drawable.drawable.dont_show_mouse_cursor = true;
+
+    RDPOpaqueRect cmd(Rect(0, 0, 800, 600), RED);
+    drawable.draw(cmd, screen_rect);
+
+    // other sessions already spent budget of this second
+    now.tv_sec += 2;
+    now.tv_usec = 200000;
+    snapshot_budget().window      = now.tv_sec;
+    snapshot_budget().window_usec = 10000;
+
+    const uint64_t deferred = session_stats().png_snapshots_deferred;
+    consumer.snapshot(now, 10, 10, false);
+    BOOST_CHECK_EQUAL(0u, trans.seqno);
+    BOOST_CHECK_EQUAL(deferred + 1, session_stats().png_snapshots_deferred);
+    BOOST_CHECK_EQUAL(800000u, consumer.time_to_wait);
+
+    // next second, budget available again
+    now.tv_sec++;
+    now.tv_usec = 0;
+    consumer.snapshot(now, 10, 10, false);
+    BOOST_CHECK_EQUAL(1u, trans.seqno);
+    BOOST_CHECK(snapshot_budget().window_usec > 0);
+
+    // budget exhausted, but snapshot overdue by 1.5 interval is never deferred
+    now.tv_sec++;
+    snapshot_budget().window      = now.tv_sec;
+    snapshot_budget().window_usec = 10000;
+    consumer.snapshot(now, 10, 10, false);
+    BOOST_CHECK_EQUAL(1u, trans.seqno);
+    BOOST_CHECK_EQUAL(deferred + 2, session_stats().png_snapshots_deferred);
+    now.tv_sec++;
+    snapshot_budget().window      = now.tv_sec;
+    snapshot_budget().window_usec = 10000;
+    consumer.snapshot(now, 10, 10, false);
+    BOOST_CHECK_EQUAL(2u, trans.seqno);
+
+    rio_clear(&trans.rio);
+    sq_outfilename_unlink(&(trans.seq), 0);
+    sq_outfilename_unlink(&(trans.seq), 1);
+    sq_outfilename_unlink(&(trans.seq), 2);
+}
@@ -0,0 +1,184 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Unit test for traffic profile of transparent recordings
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestTrafficProfile
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+
+#include <string>
+
+#include "traffic_profile.hpp"
+
+BOOST_AUTO_TEST_CASE(TestSizeHistogram)
+{
+    SizeHistogram h;
+    memset(&h, 0, sizeof(h));
+    for (unsigned i = 0; i < 90; i++) {
+        h.add(10);
+    }
+    for (unsigned i = 0; i < 10; i++) {
+        h.add(1000);
+    }
+    BOOST_CHECK_EQUAL(100, h.count);
+    BOOST_CHECK_EQUAL(10900, h.total);
+    BOOST_CHECK_EQUAL(1000, h.max);
+    BOOST_CHECK_EQUAL(16, h.percentile(50));
+    BOOST_CHECK_EQUAL(16, h.percentile(90));
+    BOOST_CHECK_EQUAL(1000, h.percentile(99));
+
+    SizeHistogram other;
+    memset(&other, 0, sizeof(other));
+    other.add(5000);
+    h.merge(other);
+    BOOST_CHECK_EQUAL(101, h.count);
+    BOOST_CHECK_EQUAL(5000, h.max);
+}
+
+BOOST_AUTO_TEST_CASE(TestLRUCacheSimulator)
+{
+    LRUCacheSimulator cache(2);
+    BOOST_CHECK(!cache.access(1));
+    BOOST_CHECK(!cache.access(2));
+    BOOST_CHECK(cache.access(1));
+    // 2 is least recently used
+    BOOST_CHECK(!cache.access(3));
+    BOOST_CHECK(cache.access(1));
+    BOOST_CHECK(!cache.access(2));
+    BOOST_CHECK(!cache.access(3));
+}
+
+BOOST_AUTO_TEST_CASE(TestTrafficProfilerBitmapCache)
+{
+    TrafficProfiler profiler;
+
+    // 300 distinct bitmaps stored then all referenced again: only caches
+    // of more than 300 entries keep them
+    for (unsigned i = 0; i < 300; i++) {
+        profiler.cache_store(2, i, 1000 + i, 100);
+    }
+    for (unsigned i = 0; i < 300; i++) {
+        profiler.cache_reference(2, i);
+    }
+    profiler.cache_reference(1, 7);
+
+    const TrafficProfile & p = profiler.profile;
+    BOOST_CHECK_EQUAL(300, p.cache_stores);
+    BOOST_CHECK_EQUAL(30000, p.cache_store_bytes);
+    BOOST_CHECK_EQUAL(301, p.cache_references);
+    BOOST_CHECK_EQUAL(1, p.cache_unknown_references);
+
+    BOOST_CHECK_EQUAL(256u, TrafficProfile::cache_size(0));
+    BOOST_CHECK_EQUAL(600, p.cache_misses[0]);
+    BOOST_CHECK_EQUAL(60000, p.cache_miss_bytes[0]);
+    BOOST_CHECK_EQUAL(300, p.cache_misses[1]);
+    BOOST_CHECK_EQUAL(30000, p.cache_miss_bytes[1]);
+
+    // same content in another slot is a hit for content keyed caches
+    profiler.cache_store(0, 0, 1000, 100);
+    BOOST_CHECK_EQUAL(300, p.cache_misses[1]);
+}
+
+BOOST_AUTO_TEST_CASE(TestTrafficProfilerBandwidth)
+{
+    TrafficProfiler profiler;
+
+    // 10 quiet seconds, then one busy second, then a chunk 2 minutes later
+    for (unsigned i = 0; i < 10; i++) {
+        profiler.chunk(5000000 + i * 1000000, 100);
+    }
+    profiler.chunk(15000000, 100000);
+    profiler.chunk(15500000, 100000);
+    profiler.chunk(125000000, 10);
+    profiler.finish();
+
+    const TrafficProfile & p = profiler.profile;
+    BOOST_CHECK_EQUAL(13, p.chunks);
+    BOOST_CHECK_EQUAL(120000000, p.duration_usec);
+    BOOST_CHECK_EQUAL(121, p.bytes_per_second.count);
+    BOOST_CHECK_EQUAL(200000, p.bytes_per_second.max);
+    BOOST_CHECK_EQUAL(1, p.burst_seconds);
+    BOOST_CHECK_EQUAL(201000, p.timeline[0]);
+    BOOST_CHECK_EQUAL(0, p.timeline[1]);
+    BOOST_CHECK_EQUAL(10, p.timeline[2]);
+}
+
+BOOST_AUTO_TEST_CASE(TestTrafficProfilerCompressionAndMerge)
+{
+    TrafficProfiler a;
+    uint8_t payload[4000];
+    for (unsigned i = 0; i < sizeof(payload); i++) {
+        payload[i] = static_cast<uint8_t>((i % 16) * 3);
+    }
+    a.update(4000, false, payload, sizeof(payload));
+    a.update(4000, false, payload, sizeof(payload));
+    a.primary_order(RDP::MEMBLT, 9);
+    a.secondary_order(RDP::TS_CACHE_BITMAP_COMPRESSED, 600);
+    a.channel("cliprdr", 40);
+    a.channel("rdpsnd", 1000);
+    a.finish();
+
+    BOOST_CHECK_EQUAL(2, a.profile.update_pdus);
+    BOOST_CHECK_EQUAL(8000, a.profile.update_uncompressed_bytes);
+    for (unsigned i = 0; i < TrafficProfile::CODEC_COUNT; i++) {
+        BOOST_CHECK(a.profile.codec_bytes[i] > 0);
+        BOOST_CHECK(a.profile.codec_bytes[i] < 2000);
+    }
+
+    TrafficProfiler b;
+    b.primary_order(RDP::MEMBLT, 30);
+    b.channel("rdpsnd", 24);
+    b.channel("rdpdr", 8);
+    b.finish();
+
+    TrafficProfile total;
+    total.merge(a.profile);
+    total.merge(b.profile);
+    BOOST_CHECK_EQUAL(2, total.recordings);
+    BOOST_CHECK_EQUAL(2, total.primary_orders[RDP::MEMBLT].count);
+    BOOST_CHECK_EQUAL(39, total.primary_orders[RDP::MEMBLT].total);
+    BOOST_CHECK_EQUAL(std::string("cliprdr"), total.channels[0].name);
+    BOOST_CHECK_EQUAL(40, total.channels[0].bytes);
+    BOOST_CHECK_EQUAL(std::string("rdpsnd"), total.channels[1].name);
+    BOOST_CHECK_EQUAL(1024, total.channels[1].bytes);
+    BOOST_CHECK_EQUAL(2, total.channels[1].chunks);
+    BOOST_CHECK_EQUAL(std::string("rdpdr"), total.channels[2].name);
+    BOOST_CHECK_EQUAL(1072, total.channel_bytes);
+
+    char * text = NULL;
+    size_t size = 0;
+    FILE * out = open_memstream(&text, &size);
+    total.write_json(out, "");
+    fclose(out);
+    const std::string json(text, size);
+    free(text);
+    BOOST_CHECK(json.find("\"recordings\": 2,") != std::string::npos);
+    BOOST_CHECK(json.find("\"memblt\": {\"count\": 2, \"bytes\": 39, \"max\": 30,") != std::string::npos);
+    BOOST_CHECK(json.find("\"cache_bitmap_compressed\": {\"count\": 1,") != std::string::npos);
+    BOOST_CHECK(json.find("\"rdpsnd\": {\"chunks\": 2, \"bytes\": 1024}") != std::string::npos);
+    BOOST_CHECK_EQUAL('{', json[0]);
+    BOOST_CHECK_EQUAL('}', json[json.size() - 1]);
+}
@@ -0,0 +1,182 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Unit test for transparent recorder chunk batching
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestTransparentRecorder
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+
+#include <string>
+
+#include "transparentrecorder.hpp"
+
+class StringTransport : public Transport {
+public:
+    std::string data;
+    unsigned    sends;
+
+    StringTransport()
+    : sends(0)
+    {}
+
+    using Transport::recv;
+    virtual void recv(char ** pbuffer, size_t len) throw (Error) {
+        throw Error(ERR_TRANSPORT_OUTPUT_ONLY_USED_FOR_SEND, 0);
+    }
+
+    using Transport::send;
+    virtual void send(const char * const buffer, size_t len) throw (Error) {
+        this->data.append(buffer, len);
+        this->sends++;
+    }
+
+    virtual void seek(int64_t offset, int whence) throw (Error) {
+        throw Error(ERR_TRANSPORT_SEEK_NOT_AVAILABLE);
+    }
+};
+
+// chunk types and sizes, chunk data checked by caller
+static std::string chunk_types(const std::string & data, std::vector<uint16_t> & sizes) {
+    std::string types;
+    const uint8_t * p   = reinterpret_cast<const uint8_t *>(data.data());
+    const uint8_t * end = p + data.size();
+    while (p + TRANSPARENT_CHUNT_HEADER_SIZE <= end) {
+        const uint16_t size = p[1] | (p[2] << 8);
+        types += static_cast<char>('0' + p[0]);
+        sizes.push_back(size);
+        p += TRANSPARENT_CHUNT_HEADER_SIZE + size;
+    }
+    BOOST_CHECK(p == end);
+    return types;
+}
+
+BOOST_AUTO_TEST_CASE(TestTransparentRecorderBatch)
+{
+    StringTransport trans;
+    uint8_t pdu[1000];
+    for (size_t i = 0; i < sizeof(pdu); i++) {
+        pdu[i] = i;
+    }
+
+    {
+        TransparentRecorder recorder(&trans, 4096, 3600000000LL);
+
+        recorder.server_resize(1024, 768, 16);
+        for (unsigned i = 0; i < 3; i++) {
+            FixedSizeStream stream(pdu, 100);
+            recorder.send_fastpath_data(stream);
+        }
+        recorder.send_to_front_channel("cliprdr", pdu, 20, 20, 3);
+        HStream stream(1024, 2048);
+        stream.out_copy_bytes(pdu, 50);
+        stream.mark_end();
+        recorder.send_data_indication_ex(1004, stream);
+
+        // nothing written until batch full or flushed
+        BOOST_CHECK_EQUAL(0, trans.sends);
+
+        // 4 x 1011 bytes do not fit in batch with previous chunks
+        for (unsigned i = 0; i < 4; i++) {
+            FixedSizeStream stream(pdu, sizeof(pdu));
+            recorder.send_fastpath_data(stream);
+        }
+        BOOST_CHECK_EQUAL(1, trans.sends);
+
+        // larger than batch: written directly after pending chunks
+        uint8_t big[5000] = {};
+        FixedSizeStream big_stream(big, sizeof(big));
+        recorder.send_fastpath_data(big_stream);
+        BOOST_CHECK_EQUAL(4, trans.sends);
+    }
+    BOOST_CHECK_EQUAL(4, trans.sends);
+
+    std::vector<uint16_t> sizes;
+    BOOST_CHECK_EQUAL(std::string("041112311111"), chunk_types(trans.data, sizes));
+    BOOST_CHECK_EQUAL(1, sizes[0]);
+    BOOST_CHECK_EQUAL(5, sizes[1]);
+    BOOST_CHECK_EQUAL(100, sizes[2]);
+    BOOST_CHECK_EQUAL(9 + 7 + 20, sizes[5]);
+    BOOST_CHECK_EQUAL(2 + 50, sizes[6]);
+    BOOST_CHECK_EQUAL(5000, sizes[11]);
+
+    // front channel chunk: header, channel name then data
+    const size_t front_channel = 11 + 1 + 11 + 5 + 3 * (11 + 100) + 11;
+    BOOST_CHECK_EQUAL(7, trans.data[front_channel]);
+    BOOST_CHECK_EQUAL(std::string("cliprdr"), trans.data.substr(front_channel + 9, 7));
+    BOOST_CHECK_EQUAL(0, memcmp(trans.data.data() + front_channel + 16, pdu, 20));
+
+    // slowpath chunk: channel id then pdu
+    const size_t slowpath = front_channel + 9 + 7 + 20 + 11;
+    BOOST_CHECK_EQUAL(1004, static_cast<uint8_t>(trans.data[slowpath]) | (static_cast<uint8_t>(trans.data[slowpath + 1]) << 8));
+    BOOST_CHECK_EQUAL(0, memcmp(trans.data.data() + slowpath + 2, pdu, 50));
+}
+
+BOOST_AUTO_TEST_CASE(TestTransparentRecorderDelay)
+{
+    StringTransport trans;
+    uint8_t pdu[10] = {};
+
+    // no delay: each chunk written at once
+    TransparentRecorder recorder(&trans, 4096, 0);
+    BOOST_CHECK_EQUAL(1, trans.sends);
+    FixedSizeStream stream(pdu, sizeof(pdu));
+    recorder.send_fastpath_data(stream);
+    BOOST_CHECK_EQUAL(2, trans.sends);
+
+    recorder.flush();
+    BOOST_CHECK_EQUAL(2, trans.sends);
+}
+
+BOOST_AUTO_TEST_CASE(TestTransparentRecorderIdleBatch)
+{
+    StringTransport trans;
+    uint8_t pdu[10] = {};
+
+    // batch started now with meta chunk, no further chunk afterwards
+    const timeval start = tvtime();
+    TransparentRecorder recorder(&trans, 4096, 100000);
+    FixedSizeStream stream(pdu, sizeof(pdu));
+    recorder.send_fastpath_data(stream);
+    BOOST_CHECK_EQUAL(0, trans.sends);
+    BOOST_CHECK(recorder.periodic_delay(start) <= 100000);
+
+    recorder.periodic(start);
+    BOOST_CHECK_EQUAL(0, trans.sends);
+
+    timeval later = start;
+    later.tv_sec += 1;
+    BOOST_CHECK_EQUAL(0, recorder.periodic_delay(later));
+    recorder.periodic(later);
+    BOOST_CHECK_EQUAL(1, trans.sends);
+
+    // empty batch: nothing to write
+    recorder.periodic(later);
+    BOOST_CHECK_EQUAL(1, trans.sends);
+    BOOST_CHECK_EQUAL(100000, recorder.periodic_delay(later));
+
+    std::vector<uint16_t> sizes;
+    BOOST_CHECK_EQUAL(std::string("01"), chunk_types(trans.data, sizes));
+}
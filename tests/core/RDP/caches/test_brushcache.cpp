@@ -21,13 +21,69 @@
 
 #define BOOST_AUTO_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
-#define BOOST_TEST_MODULE TestXXX
+#define BOOST_TEST_MODULE TestBrushCache
 #include <boost/test/auto_unit_test.hpp>
 
 #define LOGNULL
 #include "log.hpp"
 
+#include "client_info.hpp"
+#include "RDP/caches/brushcache.hpp"
 
-BOOST_AUTO_TEST_CASE(TestXXX)
+BOOST_AUTO_TEST_CASE(TestBrushCacheHitMiss)
 {
+    BrushCache cache;
+    uint8_t checker[8] = { 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55 };
+    uint8_t zero[8]    = { 0 };
+
+    int idx_checker = -1;
+    BOOST_CHECK_EQUAL(static_cast<int>(BRUSH_TO_SEND), cache.add_brush(checker, idx_checker));
+    int idx = -1;
+    BOOST_CHECK_EQUAL(static_cast<int>(BRUSH_ALLREADY_SENT), cache.add_brush(checker, idx));
+    BOOST_CHECK_EQUAL(idx_checker, idx);
+
+    // empty entries are zero filled, a zero brush was never sent yet
+    int idx_zero = -1;
+    BOOST_CHECK_EQUAL(static_cast<int>(BRUSH_TO_SEND), cache.add_brush(zero, idx_zero));
+    BOOST_CHECK(idx_zero != idx_checker);
+    BOOST_CHECK_EQUAL(static_cast<int>(BRUSH_ALLREADY_SENT), cache.add_brush(zero, idx));
+    BOOST_CHECK_EQUAL(idx_zero, idx);
+
+    ClientInfo client_info(1, true, true);
+    cache.reset(client_info);
+    BOOST_CHECK_EQUAL(static_cast<int>(BRUSH_TO_SEND), cache.add_brush(checker, idx));
+}
+
+BOOST_AUTO_TEST_CASE(TestBrushCacheEviction)
+{
+    BrushCache cache;
+    uint8_t pattern[8] = { 0 };
+    int idx = -1;
+
+    // fill the cache, entry 0 is then refreshed and is not the oldest anymore
+    for (unsigned i = 0; i < BrushCache::BRUSH_ENTRIES; i++) {
+        pattern[i % 8] = 1 + i;
+        BOOST_CHECK_EQUAL(static_cast<int>(BRUSH_TO_SEND), cache.add_brush(pattern, idx));
+        BOOST_CHECK_EQUAL(static_cast<int>(i), idx);
+        memset(pattern, 0, sizeof(pattern));
+    }
+    pattern[0] = 1;
+    BOOST_CHECK_EQUAL(static_cast<int>(BRUSH_ALLREADY_SENT), cache.add_brush(pattern, idx));
+    BOOST_CHECK_EQUAL(0, idx);
+
+    uint8_t other[8] = { 0xFF, 0, 0, 0, 0, 0, 0, 0xFF };
+    BOOST_CHECK_EQUAL(static_cast<int>(BRUSH_TO_SEND), cache.add_brush(other, idx));
+    BOOST_CHECK_EQUAL(1, idx);
+
+    // evicted brush is not found anymore, others still are
+    pattern[0] = 0;
+    pattern[1] = 2;
+    BOOST_CHECK_EQUAL(static_cast<int>(BRUSH_TO_SEND), cache.add_brush(pattern, idx));
+    BOOST_CHECK_EQUAL(2, idx);
+    memset(pattern, 0, sizeof(pattern));
+    pattern[7] = 64;
+    BOOST_CHECK_EQUAL(static_cast<int>(BRUSH_ALLREADY_SENT), cache.add_brush(pattern, idx));
+    BOOST_CHECK_EQUAL(63, idx);
+    BOOST_CHECK_EQUAL(static_cast<int>(BRUSH_ALLREADY_SENT), cache.add_brush(other, idx));
+    BOOST_CHECK_EQUAL(1, idx);
 }
@@ -21,13 +21,131 @@
 
 #define BOOST_AUTO_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
-#define BOOST_TEST_MODULE TestXXX
+#define BOOST_TEST_MODULE TestPointerCache
 #include <boost/test/auto_unit_test.hpp>
 
 #define LOGNULL
 #include "log.hpp"
 
+#include "RDP/caches/pointercache.hpp"
 
-BOOST_AUTO_TEST_CASE(TestXXX)
+static void make_cursor(Pointer & cursor, uint8_t seed)
 {
+    memset(&cursor, 0, sizeof(cursor));
+    cursor.bpp    = 24;
+    cursor.width  = 32;
+    cursor.height = 32;
+    cursor.x      = seed % 32;
+    cursor.y      = 3;
+    for (unsigned i = 0; i < cursor.data_size(); i++) {
+        cursor.data[i] = static_cast<uint8_t>(i * seed);
+    }
+    for (unsigned i = 0; i < cursor.mask_size(); i++) {
+        cursor.mask[i] = static_cast<uint8_t>((i & 1) ? seed : 0x0F);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestPointerCacheHitMissEviction)
+{
+    ClientInfo client_info(1, true, true);
+    client_info.pointer_cache_entries = 4;  // slots 2 and 3 usable
+
+    PointerCache cache;
+    cache.reset(client_info);
+
+    Pointer a, b, c;
+    make_cursor(a, 1);
+    make_cursor(b, 2);
+    make_cursor(c, 3);
+
+    int idx_a = -1;
+    BOOST_CHECK_EQUAL(static_cast<int>(POINTER_TO_SEND), cache.add_pointer(a, idx_a));
+    int idx = -1;
+    BOOST_CHECK_EQUAL(static_cast<int>(POINTER_ALLREADY_SENT), cache.add_pointer(a, idx));
+    BOOST_CHECK_EQUAL(idx_a, idx);
+
+    // same shape, other hotspot is another pointer
+    Pointer a2 = a;
+    a2.x++;
+    int idx_a2 = -1;
+    BOOST_CHECK_EQUAL(static_cast<int>(POINTER_TO_SEND), cache.add_pointer(a2, idx_a2));
+    BOOST_CHECK(idx_a != idx_a2);
+
+    // a was used first: c evicts it
+    BOOST_CHECK_EQUAL(static_cast<int>(POINTER_ALLREADY_SENT), cache.add_pointer(a2, idx));
+    int idx_c = -1;
+    BOOST_CHECK_EQUAL(static_cast<int>(POINTER_TO_SEND), cache.add_pointer(c, idx_c));
+    BOOST_CHECK_EQUAL(idx_a, idx_c);
+    BOOST_CHECK_EQUAL(static_cast<int>(POINTER_TO_SEND), cache.add_pointer(b, idx));
+    BOOST_CHECK_EQUAL(idx_a2, idx);
+    BOOST_CHECK_EQUAL(static_cast<int>(POINTER_ALLREADY_SENT), cache.add_pointer(c, idx));
+    BOOST_CHECK_EQUAL(idx_c, idx);
+}
+
+BOOST_AUTO_TEST_CASE(TestPointerCacheHash)
+{
+    Pointer a, b;
+    make_cursor(a, 5);
+    make_cursor(b, 5);
+    BOOST_CHECK_EQUAL(a.content_hash(), b.content_hash());
+
+    b.mask[7] ^= 0x10;
+    BOOST_CHECK(a.content_hash() != b.content_hash());
+    b.mask[7] ^= 0x10;
+    b.data[a.data_size() - 1] ^= 1;
+    BOOST_CHECK(a.content_hash() != b.content_hash());
+    b.data[a.data_size() - 1] ^= 1;
+    b.bpp = 16;
+    BOOST_CHECK(a.content_hash() != b.content_hash());
+}
+
+struct TestDrawablePointerCache : public DrawablePointerCache {
+    void convert(const Pointer & cursor, drawable_Pointer & dcursor) {
+        this->make_drawable_mouse_cursor(cursor.data, cursor.mask, dcursor);
+    }
+};
+
+static void check_same_cursor(const drawable_Pointer & expected, const drawable_Pointer & p)
+{
+    BOOST_CHECK_EQUAL(expected.contiguous_mouse_pixels, p.contiguous_mouse_pixels);
+    BOOST_CHECK(!memcmp(expected.data, p.data, sizeof(p.data)));
+    for (int i = 0; i < p.contiguous_mouse_pixels; i++) {
+        BOOST_CHECK_EQUAL(expected.mouse_cursor[i].x,  p.mouse_cursor[i].x);
+        BOOST_CHECK_EQUAL(expected.mouse_cursor[i].y,  p.mouse_cursor[i].y);
+        BOOST_CHECK_EQUAL(expected.mouse_cursor[i].lg, p.mouse_cursor[i].lg);
+        // lines must point into entry own data
+        BOOST_CHECK_EQUAL(expected.mouse_cursor[i].line - reinterpret_cast<const char *>(expected.data),
+                          p.mouse_cursor[i].line - reinterpret_cast<const char *>(p.data));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestDrawablePointerCacheMemoizedConversion)
+{
+    Pointer a, b;
+    make_cursor(a, 7);
+    make_cursor(b, 9);
+
+    TestDrawablePointerCache cache;
+    static drawable_Pointer expected_a;
+    static drawable_Pointer expected_b;
+    cache.convert(a, expected_a);
+    cache.convert(b, expected_b);
+    BOOST_CHECK(expected_a.contiguous_mouse_pixels > 0);
+
+    cache.add_pointer_static(a, 2);
+    check_same_cursor(expected_a, cache.Pointers[2]);
+
+    // same shape in another slot is copied, other hotspot kept
+    a.x = 1;
+    cache.add_pointer_static(a, 5);
+    check_same_cursor(expected_a, cache.Pointers[5]);
+    BOOST_CHECK_EQUAL(1, cache.Pointers[5].x);
+    BOOST_CHECK_EQUAL(7, cache.Pointers[2].x);
+
+    // slot reused for another shape is converted again
+    cache.add_pointer_static(b, 2);
+    check_same_cursor(expected_b, cache.Pointers[2]);
+    check_same_cursor(expected_a, cache.Pointers[5]);
+    cache.add_pointer_static(b, 2);
+    check_same_cursor(expected_b, cache.Pointers[2]);
 }
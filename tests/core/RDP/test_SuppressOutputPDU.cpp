@@ -0,0 +1,100 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2014
+    Author(s): Christophe Grosjean, Raphael Zhou
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestSuppressOutputPDU
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+#include "RDP/SuppressOutputPDU.hpp"
+#include "testtransport.hpp"
+
+BOOST_AUTO_TEST_CASE(TestSuppressDisplayUpdates)
+{
+    const char *payload =
+/* 0000 */ "\x03\x00\x00\x24\x02\xf0\x80\x64\x00\x07\x03\xeb\x70\x16\x16\x00" //...$...d....p...
+/* 0010 */ "\x17\x00\xf0\x03\xea\x03\x02\x00\x00\x02\x16\x00\x23\x00\x00\x00" //............#...
+/* 0020 */ "\x00\x00\x00\x00"                                                 //....
+        ;
+    size_t payload_length = 36;
+
+    CheckTransport out_t(payload, payload_length);
+    CryptContext   encrypt;
+
+    RDP::SuppressOutputPDU sopdu(132074, 7, 0, encrypt);
+
+    sopdu.suppressDisplayUpdates();
+
+    sopdu.emit(out_t);
+}
+
+BOOST_AUTO_TEST_CASE(TestAllowDisplayUpdates)
+{
+    const char *payload =
+/* 0000 */ "\x03\x00\x00\x2c\x02\xf0\x80\x64\x00\x07\x03\xeb\x70\x1e\x1e\x00" //...,...d....p...
+/* 0010 */ "\x17\x00\xf0\x03\xea\x03\x02\x00\x00\x02\x1e\x00\x23\x00\x00\x00" //............#...
+/* 0020 */ "\x01\x00\x00\x00\x00\x00\x00\x00\x1f\x03\x57\x02"                 //..........W.
+        ;
+    size_t payload_length = 44;
+
+    CheckTransport out_t(payload, payload_length);
+    CryptContext   encrypt;
+
+    RDP::SuppressOutputPDU sopdu(132074, 7, 0, encrypt);
+
+    sopdu.allowDisplayUpdates(0, 0, 800 - 1, 600 - 1);
+
+    sopdu.emit(out_t);
+}
+
+BOOST_AUTO_TEST_CASE(TestSuppressOutputPDUDataRecv)
+{
+    {
+        BStream stream(256);
+        stream.out_copy_bytes("\x00\x00\x00\x00", 4);
+        stream.mark_end();
+        stream.rewind();
+        RDP::SuppressOutputPDUData_Recv sopdu(stream);
+        BOOST_CHECK_EQUAL(0, sopdu.allowDisplayUpdates);  // SUPPRESS_DISPLAY_UPDATES
+        BOOST_CHECK_EQUAL(0u, stream.in_remain());
+    }
+    {
+        BStream stream(256);
+        stream.out_copy_bytes("\x01\x00\x00\x00\x0a\x00\x14\x00\x1f\x03\x57\x02", 12);
+        stream.mark_end();
+        stream.rewind();
+        RDP::SuppressOutputPDUData_Recv sopdu(stream);
+        BOOST_CHECK_EQUAL(1, sopdu.allowDisplayUpdates);  // ALLOW_DISPLAY_UPDATES
+        BOOST_CHECK_EQUAL(10, sopdu.left);
+        BOOST_CHECK_EQUAL(20, sopdu.top);
+        BOOST_CHECK_EQUAL(799, sopdu.right);
+        BOOST_CHECK_EQUAL(599, sopdu.bottom);
+    }
+    {
+        // desktopRect is missing
+        BStream stream(256);
+        stream.out_copy_bytes("\x01\x00\x00\x00\x0a\x00", 6);
+        stream.mark_end();
+        stream.rewind();
+        BOOST_CHECK_THROW(RDP::SuppressOutputPDUData_Recv sopdu(stream), Error);
+    }
+}
@@ -345,3 +345,58 @@ BOOST_AUTO_TEST_CASE(TestReceive_FastPathServerUpdatePDU3) {
     BOOST_CHECK_EQUAL(true, out_t.status);
 }
 
+
+BOOST_AUTO_TEST_CASE(TestFastPathClientInputPDUManyEventsEncrypted) {
+    // more than 15 events: numEvents is carried in encrypted data
+    uint8_t keyblob[16];
+    uint8_t sign_key[16];
+    for (unsigned i = 0; i < 16; i++) {
+        keyblob[i]  = i * 5 + 3;
+        sign_key[i] = 0xa0 + i;
+    }
+
+    CryptContext encrypt;
+    CryptContext decrypt;
+    CryptContext check;
+    memcpy(encrypt.sign_key, sign_key, 16);
+    memcpy(check.sign_key, sign_key, 16);
+    encrypt.generate_key(keyblob, 1);
+    decrypt.generate_key(keyblob, 1);
+    check.generate_key(keyblob, 1);
+
+    for (unsigned pdu = 0; pdu < 2; pdu++) {
+        const uint8_t numEvents = 20 + pdu * 30;
+
+        BStream header(256);
+        BStream events(65536);
+        for (uint8_t i = 0; i < numEvents; i++) {
+            FastPath::KeyboardEvent_Send(events, static_cast<uint8_t>(0), static_cast<uint8_t>(i + 1));
+        }
+
+        FastPath::ClientInputEventPDU_Send out_cie(header, events, numEvents, encrypt, 1, 1);
+
+        BStream pdu_s(65536);
+        pdu_s.out_copy_bytes(header.get_data(), header.size());
+        pdu_s.out_copy_bytes(events.get_data(), events.size());
+        pdu_s.mark_end();
+
+        GeneratorTransport in_t(reinterpret_cast<const char *>(pdu_s.get_data()), pdu_s.size());
+        BStream in_s(65536);
+        FastPath::ClientInputEventPDU_Recv in_cie(in_t, in_s, decrypt);
+
+        BOOST_CHECK(in_cie.secFlags & FastPath::FASTPATH_INPUT_ENCRYPTED);
+        BOOST_CHECK_EQUAL(numEvents, in_cie.numEvents);
+
+        // signature covers numEvents and events
+        uint8_t signature[8];
+        check.sign(in_cie.payload.get_data(), in_cie.payload.size(), signature, sizeof(signature));
+        BOOST_CHECK_EQUAL(0, memcmp(signature, in_cie.dataSignature, 8));
+
+        for (uint8_t i = 0; i < in_cie.numEvents; i++) {
+            const uint8_t byte = in_cie.payload.in_uint8();
+            FastPath::KeyboardEvent_Recv ke(in_cie.payload, byte);
+            BOOST_CHECK_EQUAL(i + 1, ke.keyCode);
+        }
+        BOOST_CHECK_EQUAL(0, in_cie.payload.in_remain());
+    }
+}
@@ -83,6 +83,13 @@ BOOST_AUTO_TEST_CASE(TestConfigFromFile)
     BOOST_CHECK_EQUAL(40,                               ini.video.ocr_max_unrecog_char_rate);
 
     BOOST_CHECK_EQUAL(3,                                ini.video.png_limit);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_size);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_age);
+    BOOST_CHECK_EQUAL(true,                             ini.video.png_cleanup_helper);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_encode_budget);
+    BOOST_CHECK_EQUAL(std::string(""),                  std::string(ini.video.wrm_mirror_path));
+    BOOST_CHECK_EQUAL(false,                            ini.video.wrm_keystroke_index);
+    BOOST_CHECK_EQUAL(1,                                ini.video.wrm_full_keyframe_interval);
 
     BOOST_CHECK_EQUAL(20000,                            ini.video.l_bitrate);
     BOOST_CHECK_EQUAL(5,                                ini.video.l_framerate);
@@ -181,6 +188,7 @@ BOOST_AUTO_TEST_CASE(TestConfigFromFile)
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.client.cache_waiting_list);
     BOOST_CHECK_EQUAL(true,                             ini.client.bitmap_compression);
+    BOOST_CHECK_EQUAL(true,                             ini.internal_mod.shadow_screen);
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.rdp_compression);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.disconnect_on_logon_user_change);
@@ -190,6 +198,7 @@ BOOST_AUTO_TEST_CASE(TestConfigFromFile)
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_rdp.extra_orders.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.mod_rdp.cache_waiting_list);
+    BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.mouse_move_policy);
 
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_vnc.encodings.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_vnc.allow_authentification_retries);
@@ -347,6 +356,13 @@ BOOST_AUTO_TEST_CASE(TestConfigDefaultEmpty)
     BOOST_CHECK_EQUAL(40,                               ini.video.ocr_max_unrecog_char_rate);
 
     BOOST_CHECK_EQUAL(3,                                ini.video.png_limit);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_size);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_age);
+    BOOST_CHECK_EQUAL(true,                             ini.video.png_cleanup_helper);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_encode_budget);
+    BOOST_CHECK_EQUAL(std::string(""),                  std::string(ini.video.wrm_mirror_path));
+    BOOST_CHECK_EQUAL(false,                            ini.video.wrm_keystroke_index);
+    BOOST_CHECK_EQUAL(1,                                ini.video.wrm_full_keyframe_interval);
 
     BOOST_CHECK_EQUAL(20000,                            ini.video.l_bitrate);
     BOOST_CHECK_EQUAL(5,                                ini.video.l_framerate);
@@ -444,6 +460,7 @@ BOOST_AUTO_TEST_CASE(TestConfigDefaultEmpty)
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.client.cache_waiting_list);
     BOOST_CHECK_EQUAL(true,                             ini.client.bitmap_compression);
+    BOOST_CHECK_EQUAL(true,                             ini.internal_mod.shadow_screen);
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.rdp_compression);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.disconnect_on_logon_user_change);
@@ -453,6 +470,7 @@ BOOST_AUTO_TEST_CASE(TestConfigDefaultEmpty)
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_rdp.extra_orders.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.mod_rdp.cache_waiting_list);
+    BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.mouse_move_policy);
 
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_vnc.encodings.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_vnc.allow_authentification_retries);
@@ -620,6 +638,13 @@ BOOST_AUTO_TEST_CASE(TestConfigDefault)
     BOOST_CHECK_EQUAL(40,                               ini.video.ocr_max_unrecog_char_rate);
 
     BOOST_CHECK_EQUAL(3,                                ini.video.png_limit);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_size);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_age);
+    BOOST_CHECK_EQUAL(true,                             ini.video.png_cleanup_helper);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_encode_budget);
+    BOOST_CHECK_EQUAL(std::string(""),                  std::string(ini.video.wrm_mirror_path));
+    BOOST_CHECK_EQUAL(false,                            ini.video.wrm_keystroke_index);
+    BOOST_CHECK_EQUAL(1,                                ini.video.wrm_full_keyframe_interval);
 
     BOOST_CHECK_EQUAL(20000,                            ini.video.l_bitrate);
     BOOST_CHECK_EQUAL(5,                                ini.video.l_framerate);
@@ -720,6 +745,7 @@ BOOST_AUTO_TEST_CASE(TestConfigDefault)
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.client.cache_waiting_list);
     BOOST_CHECK_EQUAL(true,                             ini.client.bitmap_compression);
+    BOOST_CHECK_EQUAL(true,                             ini.internal_mod.shadow_screen);
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.rdp_compression);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.disconnect_on_logon_user_change);
@@ -729,6 +755,7 @@ BOOST_AUTO_TEST_CASE(TestConfigDefault)
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_rdp.extra_orders.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.mod_rdp.cache_waiting_list);
+    BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.mouse_move_policy);
 
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_vnc.encodings.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_vnc.allow_authentification_retries);
@@ -868,6 +895,13 @@ BOOST_AUTO_TEST_CASE(TestConfig1)
     BOOST_CHECK_EQUAL(50,                               ini.video.ocr_max_unrecog_char_rate);
 
     BOOST_CHECK_EQUAL(3,                                ini.video.png_limit);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_size);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_age);
+    BOOST_CHECK_EQUAL(true,                             ini.video.png_cleanup_helper);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_encode_budget);
+    BOOST_CHECK_EQUAL(std::string(""),                  std::string(ini.video.wrm_mirror_path));
+    BOOST_CHECK_EQUAL(false,                            ini.video.wrm_keystroke_index);
+    BOOST_CHECK_EQUAL(1,                                ini.video.wrm_full_keyframe_interval);
 
     BOOST_CHECK_EQUAL(20000,                            ini.video.l_bitrate);
     BOOST_CHECK_EQUAL(5,                                ini.video.l_framerate);
@@ -971,6 +1005,7 @@ BOOST_AUTO_TEST_CASE(TestConfig1)
     BOOST_CHECK_EQUAL(true,                             ini.client.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(false,                            ini.client.cache_waiting_list);
     BOOST_CHECK_EQUAL(true,                             ini.client.bitmap_compression);
+    BOOST_CHECK_EQUAL(true,                             ini.internal_mod.shadow_screen);
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.rdp_compression);
     BOOST_CHECK_EQUAL(true,                             ini.mod_rdp.disconnect_on_logon_user_change);
@@ -980,6 +1015,7 @@ BOOST_AUTO_TEST_CASE(TestConfig1)
     BOOST_CHECK_EQUAL(std::string("22"),                ini.mod_rdp.extra_orders.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.cache_waiting_list);
+    BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.mouse_move_policy);
 
     BOOST_CHECK_EQUAL(std::string("16,2,0,1,-239"),     ini.mod_vnc.encodings.c_str());
     BOOST_CHECK_EQUAL(true,                             ini.mod_vnc.allow_authentification_retries);
@@ -1096,6 +1132,13 @@ BOOST_AUTO_TEST_CASE(TestConfig1bis)
     BOOST_CHECK_EQUAL(40,                               ini.video.ocr_max_unrecog_char_rate);
 
     BOOST_CHECK_EQUAL(3,                                ini.video.png_limit);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_size);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_age);
+    BOOST_CHECK_EQUAL(true,                             ini.video.png_cleanup_helper);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_encode_budget);
+    BOOST_CHECK_EQUAL(std::string(""),                  std::string(ini.video.wrm_mirror_path));
+    BOOST_CHECK_EQUAL(false,                            ini.video.wrm_keystroke_index);
+    BOOST_CHECK_EQUAL(1,                                ini.video.wrm_full_keyframe_interval);
 
     BOOST_CHECK_EQUAL(20000,                            ini.video.l_bitrate);
     BOOST_CHECK_EQUAL(5,                                ini.video.l_framerate);
@@ -1195,6 +1238,7 @@ BOOST_AUTO_TEST_CASE(TestConfig1bis)
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.client.cache_waiting_list);
     BOOST_CHECK_EQUAL(true,                             ini.client.bitmap_compression);
+    BOOST_CHECK_EQUAL(true,                             ini.internal_mod.shadow_screen);
 
     BOOST_CHECK_EQUAL(2,                                ini.mod_rdp.rdp_compression);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.disconnect_on_logon_user_change);
@@ -1204,6 +1248,7 @@ BOOST_AUTO_TEST_CASE(TestConfig1bis)
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_rdp.extra_orders.c_str());
     BOOST_CHECK_EQUAL(true,                             ini.mod_rdp.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.cache_waiting_list);
+    BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.mouse_move_policy);
 
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_vnc.encodings.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_vnc.allow_authentification_retries);
@@ -1302,6 +1347,13 @@ BOOST_AUTO_TEST_CASE(TestConfig2)
     BOOST_CHECK_EQUAL(40,                               ini.video.ocr_max_unrecog_char_rate);
 
     BOOST_CHECK_EQUAL(3,                                ini.video.png_limit);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_size);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_age);
+    BOOST_CHECK_EQUAL(true,                             ini.video.png_cleanup_helper);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_encode_budget);
+    BOOST_CHECK_EQUAL(std::string(""),                  std::string(ini.video.wrm_mirror_path));
+    BOOST_CHECK_EQUAL(false,                            ini.video.wrm_keystroke_index);
+    BOOST_CHECK_EQUAL(1,                                ini.video.wrm_full_keyframe_interval);
 
     BOOST_CHECK_EQUAL(20000,                            ini.video.l_bitrate);
     BOOST_CHECK_EQUAL(5,                                ini.video.l_framerate);
@@ -1395,6 +1447,7 @@ BOOST_AUTO_TEST_CASE(TestConfig2)
     BOOST_CHECK_EQUAL(true,                             ini.client.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(false,                            ini.client.cache_waiting_list);
     BOOST_CHECK_EQUAL(false,                            ini.client.bitmap_compression);
+    BOOST_CHECK_EQUAL(true,                             ini.internal_mod.shadow_screen);
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.rdp_compression);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.disconnect_on_logon_user_change);
@@ -1404,6 +1457,7 @@ BOOST_AUTO_TEST_CASE(TestConfig2)
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_rdp.extra_orders.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.mod_rdp.cache_waiting_list);
+    BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.mouse_move_policy);
 
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_vnc.encodings.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_vnc.allow_authentification_retries);
@@ -1493,6 +1547,13 @@ BOOST_AUTO_TEST_CASE(TestMultiple)
     BOOST_CHECK_EQUAL(40,                               ini.video.ocr_max_unrecog_char_rate);
 
     BOOST_CHECK_EQUAL(3,                                ini.video.png_limit);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_size);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_age);
+    BOOST_CHECK_EQUAL(true,                             ini.video.png_cleanup_helper);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_encode_budget);
+    BOOST_CHECK_EQUAL(std::string(""),                  std::string(ini.video.wrm_mirror_path));
+    BOOST_CHECK_EQUAL(false,                            ini.video.wrm_keystroke_index);
+    BOOST_CHECK_EQUAL(1,                                ini.video.wrm_full_keyframe_interval);
 
     BOOST_CHECK_EQUAL(20000,                            ini.video.l_bitrate);
     BOOST_CHECK_EQUAL(5,                                ini.video.l_framerate);
@@ -1583,6 +1644,7 @@ BOOST_AUTO_TEST_CASE(TestMultiple)
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.client.cache_waiting_list);
     BOOST_CHECK_EQUAL(true,                             ini.client.bitmap_compression);
+    BOOST_CHECK_EQUAL(true,                             ini.internal_mod.shadow_screen);
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.rdp_compression);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.disconnect_on_logon_user_change);
@@ -1592,6 +1654,7 @@ BOOST_AUTO_TEST_CASE(TestMultiple)
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_rdp.extra_orders.c_str());
     BOOST_CHECK_EQUAL(true,                             ini.mod_rdp.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.cache_waiting_list);
+    BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.mouse_move_policy);
 
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_vnc.encodings.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_vnc.allow_authentification_retries);
@@ -1672,6 +1735,13 @@ BOOST_AUTO_TEST_CASE(TestMultiple)
     BOOST_CHECK_EQUAL(40,                               ini.video.ocr_max_unrecog_char_rate);
 
     BOOST_CHECK_EQUAL(3,                                ini.video.png_limit);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_size);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_age);
+    BOOST_CHECK_EQUAL(true,                             ini.video.png_cleanup_helper);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_encode_budget);
+    BOOST_CHECK_EQUAL(std::string(""),                  std::string(ini.video.wrm_mirror_path));
+    BOOST_CHECK_EQUAL(false,                            ini.video.wrm_keystroke_index);
+    BOOST_CHECK_EQUAL(1,                                ini.video.wrm_full_keyframe_interval);
 
     BOOST_CHECK_EQUAL(20000,                            ini.video.l_bitrate);
     BOOST_CHECK_EQUAL(5,                                ini.video.l_framerate);
@@ -1762,6 +1832,7 @@ BOOST_AUTO_TEST_CASE(TestMultiple)
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.client.cache_waiting_list);
     BOOST_CHECK_EQUAL(false,                            ini.client.bitmap_compression);
+    BOOST_CHECK_EQUAL(true,                             ini.internal_mod.shadow_screen);
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.rdp_compression);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.disconnect_on_logon_user_change);
@@ -1771,6 +1842,7 @@ BOOST_AUTO_TEST_CASE(TestMultiple)
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_rdp.extra_orders.c_str());
     BOOST_CHECK_EQUAL(true,                             ini.mod_rdp.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.cache_waiting_list);
+    BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.mouse_move_policy);
 
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_vnc.encodings.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_vnc.allow_authentification_retries);
@@ -1848,6 +1920,13 @@ BOOST_AUTO_TEST_CASE(TestNewConf)
     BOOST_CHECK_EQUAL(40,                               ini.video.ocr_max_unrecog_char_rate);
 
     BOOST_CHECK_EQUAL(3,                                ini.video.png_limit);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_size);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_age);
+    BOOST_CHECK_EQUAL(true,                             ini.video.png_cleanup_helper);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_encode_budget);
+    BOOST_CHECK_EQUAL(std::string(""),                  std::string(ini.video.wrm_mirror_path));
+    BOOST_CHECK_EQUAL(false,                            ini.video.wrm_keystroke_index);
+    BOOST_CHECK_EQUAL(1,                                ini.video.wrm_full_keyframe_interval);
 
     BOOST_CHECK_EQUAL(20000,                            ini.video.l_bitrate);
     BOOST_CHECK_EQUAL(5,                                ini.video.l_framerate);
@@ -1937,6 +2016,7 @@ BOOST_AUTO_TEST_CASE(TestNewConf)
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.client.cache_waiting_list);
     BOOST_CHECK_EQUAL(true,                             ini.client.bitmap_compression);
+    BOOST_CHECK_EQUAL(true,                             ini.internal_mod.shadow_screen);
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.rdp_compression);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.disconnect_on_logon_user_change);
@@ -1946,6 +2026,7 @@ BOOST_AUTO_TEST_CASE(TestNewConf)
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_rdp.extra_orders.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.mod_rdp.cache_waiting_list);
+    BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.mouse_move_policy);
 
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_vnc.encodings.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_vnc.allow_authentification_retries);
@@ -2023,6 +2104,13 @@ BOOST_AUTO_TEST_CASE(TestNewConf)
     BOOST_CHECK_EQUAL(40,                               ini.video.ocr_max_unrecog_char_rate);
 
     BOOST_CHECK_EQUAL(3,                                ini.video.png_limit);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_size);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_age);
+    BOOST_CHECK_EQUAL(true,                             ini.video.png_cleanup_helper);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_encode_budget);
+    BOOST_CHECK_EQUAL(std::string(""),                  std::string(ini.video.wrm_mirror_path));
+    BOOST_CHECK_EQUAL(false,                            ini.video.wrm_keystroke_index);
+    BOOST_CHECK_EQUAL(1,                                ini.video.wrm_full_keyframe_interval);
 
     BOOST_CHECK_EQUAL(20000,                            ini.video.l_bitrate);
     BOOST_CHECK_EQUAL(5,                                ini.video.l_framerate);
@@ -2112,6 +2200,7 @@ BOOST_AUTO_TEST_CASE(TestNewConf)
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.client.cache_waiting_list);
     BOOST_CHECK_EQUAL(false,                            ini.client.bitmap_compression);
+    BOOST_CHECK_EQUAL(true,                             ini.internal_mod.shadow_screen);
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.rdp_compression);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.disconnect_on_logon_user_change);
@@ -2121,6 +2210,7 @@ BOOST_AUTO_TEST_CASE(TestNewConf)
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_rdp.extra_orders.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.mod_rdp.cache_waiting_list);
+    BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.mouse_move_policy);
 
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_vnc.encodings.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_vnc.allow_authentification_retries);
@@ -2187,6 +2277,13 @@ BOOST_AUTO_TEST_CASE(TestNewConf)
     BOOST_CHECK_EQUAL(40,                               ini.video.ocr_max_unrecog_char_rate);
 
     BOOST_CHECK_EQUAL(3,                                ini.video.png_limit);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_size);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_limit_age);
+    BOOST_CHECK_EQUAL(true,                             ini.video.png_cleanup_helper);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_encode_budget);
+    BOOST_CHECK_EQUAL(std::string(""),                  std::string(ini.video.wrm_mirror_path));
+    BOOST_CHECK_EQUAL(false,                            ini.video.wrm_keystroke_index);
+    BOOST_CHECK_EQUAL(1,                                ini.video.wrm_full_keyframe_interval);
 
     BOOST_CHECK_EQUAL(20000,                            ini.video.l_bitrate);
     BOOST_CHECK_EQUAL(5,                                ini.video.l_framerate);
@@ -2276,6 +2373,7 @@ BOOST_AUTO_TEST_CASE(TestNewConf)
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.client.cache_waiting_list);
     BOOST_CHECK_EQUAL(true,                             ini.client.bitmap_compression);
+    BOOST_CHECK_EQUAL(true,                             ini.internal_mod.shadow_screen);
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.rdp_compression);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.disconnect_on_logon_user_change);
@@ -2285,6 +2383,7 @@ BOOST_AUTO_TEST_CASE(TestNewConf)
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_rdp.extra_orders.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.persistent_disk_bitmap_cache);
     BOOST_CHECK_EQUAL(true,                             ini.mod_rdp.cache_waiting_list);
+    BOOST_CHECK_EQUAL(0,                                ini.mod_rdp.mouse_move_policy);
 
     BOOST_CHECK_EQUAL(std::string(""),                  ini.mod_vnc.encodings.c_str());
     BOOST_CHECK_EQUAL(false,                            ini.mod_vnc.allow_authentification_retries);
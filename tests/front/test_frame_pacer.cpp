@@ -0,0 +1,110 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Unit test for front output pacing
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestFramePacer
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+#include "frame_pacer.hpp"
+
+#include <vector>
+
+namespace {
+    struct CollectRects : public Rect::RectIterator {
+        std::vector<Rect> rects;
+
+        virtual void callback(const Rect & rect) {
+            this->rects.push_back(rect);
+        }
+    };
+}
+
+BOOST_AUTO_TEST_CASE(TestDamageTiles)
+{
+    DamageTiles damage(200, 100);
+    BOOST_CHECK_EQUAL(0u, damage.size());
+
+    damage.add(Rect(10, 10, 5, 5));
+    damage.add(Rect(60, 0, 10, 1));     // across two tiles, one already damaged
+    damage.add(Rect(190, 90, 50, 50));  // clipped to screen, two tiles
+    damage.add(Rect(300, 10, 5, 5));    // out of screen
+    BOOST_CHECK_EQUAL(4u, damage.size());
+
+    CollectRects collect;
+    damage.drain(collect);
+    BOOST_CHECK_EQUAL(0u, damage.size());
+    BOOST_REQUIRE_EQUAL(4u, collect.rects.size());
+    BOOST_CHECK_EQUAL(Rect(0, 0, 64, 64), collect.rects[0]);
+    BOOST_CHECK_EQUAL(Rect(64, 0, 64, 64), collect.rects[1]);
+    BOOST_CHECK_EQUAL(Rect(128, 64, 64, 36), collect.rects[2]);
+    BOOST_CHECK_EQUAL(Rect(192, 64, 8, 36), collect.rects[3]);
+
+    CollectRects none;
+    damage.drain(none);
+    BOOST_CHECK_EQUAL(0u, none.rects.size());
+}
+
+BOOST_AUTO_TEST_CASE(TestFramePacer)
+{
+    // 25 fps, 100 ms
+    FramePacer pacer(25, 100, 800, 600);
+    BOOST_CHECK_EQUAL(40000u, pacer.min_frame_interval);
+
+    uint64_t now   = 1000000;
+    uint64_t total = 0;
+
+    // empty queue: never congested
+    pacer.sample(now, 0, total);
+    BOOST_CHECK(!pacer.congested());
+
+    // nothing measured yet: default drain rate (64KiB/s), 100ms is 6553 bytes
+    total += 10000;
+    pacer.sample(now, 10000, total);
+    BOOST_CHECK(pacer.congested());
+    BOOST_CHECK(!pacer.can_send_frame(now));
+
+    // link drains 100000 bytes/s
+    now += 50000;
+    pacer.sample(now, 5000, total);
+    BOOST_CHECK_EQUAL(50000u, pacer.queued_latency());
+    BOOST_CHECK(!pacer.congested());
+    BOOST_CHECK(pacer.can_send_frame(now));
+
+    // frame rate cap
+    pacer.frame_sent(now);
+    BOOST_CHECK(!pacer.can_send_frame(now + 39999));
+    BOOST_CHECK(pacer.can_send_frame(now + 40000));
+    BOOST_CHECK_EQUAL(40000u, pacer.time_to_wait(now));
+    BOOST_CHECK_EQUAL(static_cast<uint64_t>(FramePacer::POLL_INTERVAL), pacer.time_to_wait(now + 40000));
+
+    // 20000 more bytes written, 1000 drained in 50 ms: average rate drops
+    // to (3 * 100000 + 20000) / 4
+    now   += 50000;
+    total += 20000;
+    pacer.sample(now, 24000, total);
+    BOOST_CHECK_EQUAL(300000u, pacer.queued_latency());
+    BOOST_CHECK(pacer.congested());
+}
@@ -27,7 +27,35 @@
 #define LOGNULL
 #include "log.hpp"
 
+#include "front.hpp"
 
 BOOST_AUTO_TEST_CASE(TestXXX)
 {
 }
+
+BOOST_AUTO_TEST_CASE(TestServerGeneralCaps)
+{
+    GeneralCaps general_caps;
+    Front::server_general_caps(general_caps, true);
+
+    BStream stream(1024);
+    general_caps.emit(stream);
+    stream.mark_end();
+    BOOST_CHECK_EQUAL(static_cast<size_t>(CAPLEN_GENERAL), stream.size());
+
+    stream.rewind();
+    GeneralCaps received;
+    BOOST_CHECK_EQUAL(static_cast<uint16_t>(CAPSTYPE_GENERAL), stream.in_uint16_le());
+    const uint16_t len = stream.in_uint16_le();
+    received.recv(stream, len);
+
+    BOOST_CHECK(received.extraflags & FASTPATH_OUTPUT_SUPPORTED);
+    // clients send Refresh Rect and Suppress Output PDUs only if set
+    BOOST_CHECK_EQUAL(1, received.refreshRectSupport);
+    BOOST_CHECK_EQUAL(1, received.suppressOutputSupport);
+
+    GeneralCaps slowpath_caps;
+    Front::server_general_caps(slowpath_caps, false);
+    BOOST_CHECK(!(slowpath_caps.extraflags & FASTPATH_OUTPUT_SUPPORTED));
+    BOOST_CHECK_EQUAL(1, slowpath_caps.suppressOutputSupport);
+}
@@ -27,7 +27,99 @@
 #define LOGNULL
 #include "log.hpp"
 
+#include "capture.hpp"
+#include "internal/replay_mod.hpp"
+#include "../../front/fake_front.hpp"
 
-BOOST_AUTO_TEST_CASE(TestXXX)
+static bool same_screen(const Drawable & a, const Drawable & b)
 {
+    return (a.pix_len == b.pix_len) && !memcmp(a.data, b.data, a.pix_len);
+}
+
+static bool blank_row(const Drawable & d, uint16_t y)
+{
+    for (size_t i = 0; i < d.rowsize; i++) {
+        if (d.data[y * d.rowsize + i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(TestReplaySeek)
+{
+    Inifile ini;
+    ini.video.frame_interval = 100;
+    ini.video.break_interval = 3;   // one WRM file every 3 seconds
+    ini.video.png_limit      = 0;
+    ini.video.capture_wrm    = true;
+    ini.globals.enable_file_encryption.set(false);
+
+    {
+        timeval now;
+        now.tv_sec  = 1000;
+        now.tv_usec = 0;
+        Rect scr(0, 0, 800, 600);
+        Capture capture(now, scr.cx, scr.cy, "/tmp/", "/tmp/", "/tmp/", "test_replay", false, false, NULL, ini);
+
+        const uint32_t colors[] = { GREEN, BLUE, WHITE, RED, BLACK, PINK, WABGREEN };
+        for (int i = 0; i < 7; i++) {
+            capture.draw(RDPOpaqueRect(Rect(10, 50 * (i + 1), 700, 30), colors[i] | 0x010101), scr);
+            now.tv_sec++;
+            capture.snapshot(now, 0, 0, false);
+        }
+        capture.flush();
+    }
+
+    ClientInfo info(1, true, true);
+    info.keylayout = 0x040C;
+    info.console_session = 0;
+    info.brush_cache_code = 0;
+    info.bpp = 24;
+    info.width = 800;
+    info.height = 600;
+    FakeFront front(info, 0);
+
+    char path[] = "/tmp/";
+    char movie[256];
+    snprintf(movie, sizeof(movie), "test_replay-%06u.mwrm", getpid());
+    redemption::string auth_error_message;
+    ReplayMod mod(front, path, movie, 800, 600, auth_error_message);
+
+    BOOST_CHECK_EQUAL(3u, mod.chunk_begin.size());
+    BOOST_CHECK_EQUAL(1000u, mod.reader->record_now.tv_sec);
+    BOOST_CHECK(mod.forward_orders);
+
+    // jump to third second of second wrm file: starts from its keyframe
+    mod.seek(1005, 0);
+    BOOST_CHECK(!mod.forward_orders);
+    BOOST_CHECK(mod.decode_until(1005000000ULL));
+    mod.send_screen_diff();
+    const Drawable & screen = front.gd.drawable;
+    BOOST_CHECK(same_screen(mod.shadow->drawable, screen));
+    BOOST_CHECK(!blank_row(screen, 55));    // drawn in first wrm file
+    BOOST_CHECK(!blank_row(screen, 205));
+    BOOST_CHECK(blank_row(screen, 355));    // not yet drawn
+
+    // backward
+    mod.seek(1000, 0);
+    BOOST_CHECK(mod.decode_until(1001000000ULL));
+    mod.send_screen_diff();
+    BOOST_CHECK(same_screen(mod.shadow->drawable, screen));
+    BOOST_CHECK(blank_row(screen, 205));
+
+    // play to end at maximum speed
+    mod.set_speed(ReplayMod::MAX_SPEED, 0);
+    BOOST_CHECK(!mod.decode_until(mod.record_target(1000000)));
+    mod.send_screen_diff();
+    BOOST_CHECK(same_screen(mod.shadow->drawable, screen));
+    BOOST_CHECK(!blank_row(screen, 355));
+
+    for (size_t i = 0; i < 3; i++) {
+        char filename[256];
+        snprintf(filename, sizeof(filename), "/tmp/test_replay-%06u-%06u.wrm", getpid(), static_cast<unsigned>(i));
+        unlink(filename);
+    }
+    snprintf(movie, sizeof(movie), "/tmp/test_replay-%06u.mwrm", getpid());
+    unlink(movie);
 }
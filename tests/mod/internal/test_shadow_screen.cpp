@@ -0,0 +1,218 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *   Product name: redemption, a FLOSS RDP proxy
+ *   Copyright (C) Wallix 2014
+ *   Author(s): Christophe Grosjean, Raphael Zhou
+ *
+ *   Unit test for shadow screen of internal modules
+ */
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestShadowScreen
+#include <boost/test/auto_unit_test.hpp>
+
+#undef FIXTURES_PATH
+#define FIXTURES_PATH "./tests/fixtures"
+
+#define LOGNULL
+#include "log.hpp"
+
+#include "internal/shadow_screen.hpp"
+#include "RDP/RDPDrawable.hpp"
+#include "widget2/fake_draw.hpp"
+
+// Client side: counts received orders and draws texts with an opaque
+// background box, as front does.
+struct ClientDraw : TestDraw
+{
+    unsigned orders;
+    Rect     area;      // drawn by received orders
+
+    ClientDraw(uint16_t w, uint16_t h)
+    : TestDraw(w, h)
+    , orders(0)
+    {}
+
+    void received(const Rect & rect)
+    {
+        this->orders++;
+        this->area = this->area.isempty()
+                   ? rect
+                   : this->area.enlarge_to(rect.x, rect.y).enlarge_to(rect.right() - 1, rect.bottom() - 1);
+    }
+
+    void reset()
+    {
+        this->orders = 0;
+        this->area = Rect();
+    }
+
+    bool same_pixels(const ClientDraw & other) const
+    {
+        return 0 == memcmp(this->gd.drawable.data, other.gd.drawable.data, this->gd.drawable.pix_len);
+    }
+
+    virtual void draw(const RDPOpaqueRect & cmd, const Rect & clip)
+    {
+        this->received(clip.intersect(cmd.rect));
+        TestDraw::draw(cmd, clip);
+    }
+
+    virtual void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bmp)
+    {
+        this->received(clip.intersect(cmd.rect));
+        TestDraw::draw(cmd, clip, bmp);
+    }
+
+    virtual void draw(const RDPScrBlt & cmd, const Rect & clip)
+    {
+        this->received(clip.intersect(cmd.rect));
+        TestDraw::draw(cmd, clip);
+    }
+
+    virtual void draw(const RDPLineTo & cmd, const Rect & clip)
+    {
+        this->received(clip);
+        TestDraw::draw(cmd, clip);
+    }
+
+    virtual void server_draw_text(int16_t x, int16_t y, const char * text,
+                                  uint32_t fgcolor, uint32_t bgcolor, const Rect & clip)
+    {
+        int w = 0;
+        int h = 0;
+        this->text_metrics(text, w, h);
+        const Rect bk(x, y, w + 1, h + 1);
+        this->received(clip.intersect(bk));
+        this->gd.draw(RDPOpaqueRect(bk, bgcolor), clip);
+        TestDraw::server_draw_text(x, y, text, fgcolor, bgcolor, clip);
+    }
+};
+
+static void draw_dialog(DrawApi & d, const char * second_line)
+{
+    const Rect dialog(0, 0, 200, 100);
+    d.begin_update();
+    d.draw(RDPOpaqueRect(dialog, BLUE), dialog);
+    d.server_draw_text(10, 10, "first line", WHITE, BLUE, dialog);
+    d.server_draw_text(10, 60, second_line, WHITE, BLUE, dialog);
+    d.end_update();
+}
+
+BOOST_AUTO_TEST_CASE(TestShadowScreenRepaint)
+{
+    ClientDraw reference(300, 200);
+    ClientDraw client(300, 200);
+    ShadowScreen shadow(client, 300, 200);
+
+    draw_dialog(reference, "second line");
+    draw_dialog(shadow, "second line");
+    BOOST_CHECK_EQUAL(3, shadow.received_orders);
+    BOOST_CHECK_EQUAL(3, client.orders);
+    BOOST_CHECK(client.same_pixels(reference));
+
+    // nothing changed
+    client.reset();
+    draw_dialog(shadow, "second line");
+    BOOST_CHECK_EQUAL(0, client.orders);
+
+    // only band of second line is sent again: background and text
+    int w = 0;
+    int h = 0;
+    client.text_metrics("second line", w, h);
+    client.reset();
+    draw_dialog(reference, "changed line");
+    draw_dialog(shadow, "changed line");
+    BOOST_CHECK_EQUAL(2, client.orders);
+    BOOST_CHECK(client.area.y >= 60);
+    BOOST_CHECK(client.area.bottom() <= 60 + h + 1);
+    BOOST_CHECK(client.area.cx < 200);
+    BOOST_CHECK(client.same_pixels(reference));
+
+    // client asked for refresh
+    client.reset();
+    shadow.invalidate(Rect(0, 0, 300, 200));
+    draw_dialog(shadow, "changed line");
+    BOOST_CHECK_EQUAL(3, client.orders);
+    BOOST_CHECK(client.same_pixels(reference));
+}
+
+BOOST_AUTO_TEST_CASE(TestShadowScreenMemBlt)
+{
+    uint8_t data[16 * 16 * 3];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i * 7;
+    }
+    Bitmap bmp(24, 24, NULL, 16, 16, data, sizeof(data));
+
+    ClientDraw reference(100, 100);
+    ClientDraw client(100, 100);
+    ShadowScreen shadow(client, 100, 100);
+
+    const Rect screen(0, 0, 100, 100);
+    for (unsigned i = 0; i < 2; i++) {
+        reference.draw(RDPOpaqueRect(screen, GREEN), screen);
+        reference.draw(RDPMemBlt(0, Rect(20, 30, 16, 16), 0xCC, 0, 0, 0), screen, bmp);
+        shadow.begin_update();
+        shadow.draw(RDPOpaqueRect(screen, GREEN), screen);
+        shadow.draw(RDPMemBlt(0, Rect(20, 30, 16, 16), 0xCC, 0, 0, 0), screen, bmp);
+        shadow.end_update();
+    }
+    BOOST_CHECK_EQUAL(2, client.orders);
+    BOOST_CHECK(client.same_pixels(reference));
+
+    // bitmap moved by screen to screen copy, shadow follows
+    reference.draw(RDPScrBlt(Rect(50, 50, 16, 16), 0xCC, 20, 30), screen);
+    shadow.draw(RDPScrBlt(Rect(50, 50, 16, 16), 0xCC, 20, 30), screen);
+    client.reset();
+    shadow.draw(RDPMemBlt(0, Rect(50, 50, 16, 16), 0xCC, 0, 0, 0), screen, bmp);
+    BOOST_CHECK_EQUAL(0, client.orders);
+
+    // part of bitmap overwritten, only this part is sent again
+    reference.draw(RDPOpaqueRect(Rect(20, 40, 16, 2), RED), screen);
+    shadow.draw(RDPOpaqueRect(Rect(20, 40, 16, 2), RED), screen);
+    client.reset();
+    reference.draw(RDPMemBlt(0, Rect(20, 30, 16, 16), 0xCC, 0, 0, 0), screen, bmp);
+    shadow.draw(RDPMemBlt(0, Rect(20, 30, 16, 16), 0xCC, 0, 0, 0), screen, bmp);
+    BOOST_CHECK_EQUAL(1, client.orders);
+    BOOST_CHECK_EQUAL(Rect(20, 40, 16, 2), client.area);
+    BOOST_CHECK(client.same_pixels(reference));
+}
+
+BOOST_AUTO_TEST_CASE(TestShadowScreenUnknownOrder)
+{
+    ClientDraw reference(100, 100);
+    ClientDraw client(100, 100);
+    ShadowScreen shadow(client, 100, 100);
+
+    const Rect screen(0, 0, 100, 100);
+    const Rect clip(10, 10, 20, 20);
+    const RDPLineTo line(1, 0, 0, 99, 99, WHITE, 0x0D, RDPPen(0, 1, BLACK));
+    for (unsigned i = 0; i < 2; i++) {
+        // line order is kept between both rectangles
+        reference.draw(RDPOpaqueRect(screen, WHITE), screen);
+        reference.draw(line, clip);
+        reference.draw(RDPOpaqueRect(Rect(0, 0, 15, 15), RED), screen);
+        shadow.begin_update();
+        shadow.draw(RDPOpaqueRect(screen, WHITE), screen);
+        shadow.draw(line, clip);
+        shadow.draw(RDPOpaqueRect(Rect(0, 0, 15, 15), RED), screen);
+        shadow.end_update();
+        BOOST_CHECK(client.same_pixels(reference));
+        client.reset();
+    }
+}
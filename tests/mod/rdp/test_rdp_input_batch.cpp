@@ -0,0 +1,145 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Unit test for rdp module input batching
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestRdpInputBatch
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+
+#include "stream.hpp"
+#include "rect.hpp"
+#include "rdp/rdp_input_batch.hpp"
+#include "callback.hpp"
+
+static void add_events(InputBatch & batch)
+{
+    batch.add(0, RDP_INPUT_MOUSE, MOUSE_FLAG_MOVE, 10, 10);
+    batch.add(0, RDP_INPUT_MOUSE, MOUSE_FLAG_MOVE, 11, 12);
+    batch.add(0, RDP_INPUT_MOUSE, MOUSE_FLAG_MOVE, 12, 14);
+    batch.add(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON1 | MOUSE_FLAG_DOWN, 12, 14);
+    batch.add(0, RDP_INPUT_MOUSE, MOUSE_FLAG_MOVE, 20, 20);
+    batch.add(0, RDP_INPUT_SCANCODE, 0, 0x1e, 0);
+    batch.add(0, RDP_INPUT_MOUSE, MOUSE_FLAG_MOVE, 21, 21);
+    batch.add(0, RDP_INPUT_MOUSE, MOUSE_FLAG_MOVE, 22, 23);
+}
+
+BOOST_AUTO_TEST_CASE(TestKeepAllMouseMoves)
+{
+    InputBatch batch(InputBatch::MOUSE_MOVES_KEEP_ALL);
+    add_events(batch);
+    BOOST_CHECK_EQUAL(8u, batch.size());
+    BOOST_CHECK_EQUAL(11, batch.data()[1].param1);
+    BOOST_CHECK_EQUAL(12, batch.data()[1].param2);
+
+    batch.clear();
+    BOOST_CHECK_EQUAL(0u, batch.size());
+}
+
+BOOST_AUTO_TEST_CASE(TestMergeMouseMoves)
+{
+    InputBatch batch(InputBatch::MOUSE_MOVES_MERGE);
+    add_events(batch);
+    BOOST_REQUIRE_EQUAL(5u, batch.size());
+
+    const InputBatch::Event * events = batch.data();
+    BOOST_CHECK_EQUAL(static_cast<uint16_t>(MOUSE_FLAG_MOVE), events[0].device_flags);
+    BOOST_CHECK_EQUAL(12, events[0].param1);
+    BOOST_CHECK_EQUAL(14, events[0].param2);
+
+    // button press is not merged, it keeps its place
+    BOOST_CHECK_EQUAL(static_cast<uint16_t>(MOUSE_FLAG_BUTTON1 | MOUSE_FLAG_DOWN), events[1].device_flags);
+    BOOST_CHECK_EQUAL(20, events[2].param1);
+
+    BOOST_CHECK_EQUAL(static_cast<uint16_t>(RDP_INPUT_SCANCODE), events[3].message_type);
+    BOOST_CHECK_EQUAL(0x1e, events[3].param1);
+
+    BOOST_CHECK_EQUAL(static_cast<uint16_t>(RDP_INPUT_MOUSE), events[4].message_type);
+    BOOST_CHECK_EQUAL(22, events[4].param1);
+    BOOST_CHECK_EQUAL(23, events[4].param2);
+}
+
+BOOST_AUTO_TEST_CASE(TestBatchFull)
+{
+    InputBatch batch(InputBatch::MOUSE_MOVES_MERGE);
+    for (unsigned i = 0; i < InputBatch::MAX_EVENTS; i++) {
+        BOOST_CHECK(!batch.full());
+        batch.add(0, RDP_INPUT_SCANCODE, (i & 1) ? 0x8000 : 0, 0x1e, 0);
+    }
+    BOOST_CHECK(batch.full());
+}
+
+namespace {
+    struct BatchCallback : Callback {
+        unsigned begins;
+        unsigned ends;
+        bool     end_throws;
+
+        BatchCallback() : begins(0), ends(0), end_throws(false) {}
+
+        virtual void rdp_input_scancode(long, long, long, long, Keymap2 *) {}
+        virtual void rdp_input_mouse(int, int, int, Keymap2 *) {}
+        virtual void rdp_input_synchronize(uint32_t, uint16_t, int16_t, int16_t) {}
+        virtual void rdp_input_invalidate(const Rect &) {}
+
+        virtual void rdp_input_batch_begin() {
+            this->begins++;
+        }
+
+        virtual void rdp_input_batch_end() {
+            this->ends++;
+            if (this->end_throws) {
+                throw Error(ERR_TRANSPORT_WRITE_FAILED);
+            }
+        }
+    };
+}
+
+BOOST_AUTO_TEST_CASE(TestScopedInputBatch)
+{
+    BatchCallback cb;
+    {
+        ScopedInputBatch input_batch(cb);
+        BOOST_CHECK_EQUAL(1u, cb.begins);
+        BOOST_CHECK_EQUAL(0u, cb.ends);
+        input_batch.end();
+    }
+    BOOST_CHECK_EQUAL(1u, cb.ends);
+
+    // batch is closed when decoding throws, even if closing throws too
+    cb.end_throws = true;
+    try {
+        ScopedInputBatch input_batch(cb);
+        throw Error(ERR_RDP_DATA_TRUNCATED);
+    }
+    catch (Error & e) {
+        BOOST_CHECK_EQUAL(static_cast<int>(ERR_RDP_DATA_TRUNCATED), static_cast<int>(e.id));
+    }
+    BOOST_CHECK_EQUAL(2u, cb.begins);
+    BOOST_CHECK_EQUAL(2u, cb.ends);
+
+    // send errors of a normal end are not hidden
+    BOOST_CHECK_THROW(ScopedInputBatch(cb).end(), Error);
+    BOOST_CHECK_EQUAL(3u, cb.ends);
+}
@@ -0,0 +1,326 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test for VNC framebuffer update decoders (Raw, Hextile, Tight,
+   TightPNG), correctness and decoding throughput on recorded traces.
+
+   Each trace is the body of a FramebufferUpdate message (after the
+   message-type byte) using the 16 bpp pixel format asked by mod_vnc.
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestVNCDecoders
+#include <boost/test/auto_unit_test.hpp>
+
+#undef SHARE_PATH
+#define SHARE_PATH FIXTURES_PATH
+
+#define LOGNULL
+#include "log.hpp"
+
+#include <fcntl.h>
+
+#include "vnc/vnc.hpp"
+#include "testtransport.hpp"
+#include "difftimeval.hpp"
+#include "rdtsc.hpp"
+#include "../../front/fake_front.hpp"
+
+struct VNCTrace {
+    char   data[65536];
+    size_t size;
+
+    VNCTrace(const char * filename)
+    : size(0)
+    {
+        int fd = ::open(filename, O_RDONLY);
+        BOOST_REQUIRE(fd >= 0);
+        ssize_t res;
+        while ((res = ::read(fd, this->data + this->size, sizeof(this->data) - this->size)) > 0) {
+            this->size += res;
+        }
+        ::close(fd);
+    }
+};
+
+struct VNCSession {
+    Inifile ini;
+    mod_vnc mod;
+
+    VNCSession(FakeFront & front, uint16_t width, uint16_t height)
+    : mod(NULL, ini, "user", "password", front, width, height, 0x040C, 0,
+          false, "7,5,16,0,1", false, 0)
+    {
+        this->mod.width       = width;
+        this->mod.height      = height;
+        this->mod.bpp         = 16;
+        this->mod.depth       = 16;
+        this->mod.red_max     = 0x1F;
+        this->mod.green_max   = 0x3F;
+        this->mod.blue_max    = 0x1F;
+        this->mod.red_shift   = 0x0B;
+        this->mod.green_shift = 0x05;
+        this->mod.blue_shift  = 0;
+        front.set_mod_color_depth(16);
+    }
+
+    void replay(const char * data, size_t size)
+    {
+        GeneratorTransport t(data, size);
+        this->mod.t = &t;
+        this->mod.lib_framebuffer_update();
+    }
+};
+
+static void decode_trace(FakeFront & front, const char * filename, unsigned iterations,
+                         uint16_t width, uint16_t height)
+{
+    VNCSession session(front, width, height);
+
+    VNCTrace trace(filename);
+
+    // first pass checks the trace decodes, the following ones measure
+    session.replay(trace.data, trace.size);
+
+    unsigned long long usec   = ustime();
+    unsigned long long cycles = rdtsc();
+    for (unsigned i = 1; i < iterations; i++) {
+        session.replay(trace.data, trace.size);
+    }
+    unsigned long long elapusec = ustime() - usec;
+    unsigned long long elapcyc  = rdtsc() - cycles;
+
+    if (iterations > 1) {
+        printf("%s: %u updates, %llu bytes each, elapsed %llu us (%llu cycles), %.1f Mpixels/s\n",
+            filename, iterations - 1, (unsigned long long)trace.size, elapusec, elapcyc,
+            elapusec ? (double)width * height * (iterations - 1) / (double)elapusec : 0.0);
+    }
+}
+
+static ClientInfo make_info(uint16_t width, uint16_t height)
+{
+    ClientInfo info(1, true, true);
+    info.keylayout = 0x040C;
+    info.console_session = 0;
+    info.brush_cache_code = 0;
+    info.bpp = 24;
+    info.width = width;
+    info.height = height;
+    return info;
+}
+
+BOOST_AUTO_TEST_CASE(TestHextileAndTightMatchRaw)
+{
+    ClientInfo info = make_info(160, 120);
+
+    FakeFront raw_front(info, 0);
+    decode_trace(raw_front, FIXTURES_PATH "/vnc_raw_160x120.trace", 1, 160, 120);
+
+    const Drawable & expected = raw_front.gd.drawable;
+
+    FakeFront hextile_front(info, 0);
+    decode_trace(hextile_front, FIXTURES_PATH "/vnc_hextile_160x120.trace", 1, 160, 120);
+    BOOST_CHECK_EQUAL(0, memcmp(expected.data, hextile_front.gd.drawable.data,
+                                expected.rowsize * expected.height));
+
+    FakeFront tight_front(info, 0);
+    decode_trace(tight_front, FIXTURES_PATH "/vnc_tight_160x120.trace", 1, 160, 120);
+    BOOST_CHECK_EQUAL(0, memcmp(expected.data, tight_front.gd.drawable.data,
+                                expected.rowsize * expected.height));
+
+    // PNG data is 24 bits RGB, back to 16 bpp we only expect quantization errors
+    FakeFront tightpng_front(info, 0);
+    decode_trace(tightpng_front, FIXTURES_PATH "/vnc_tightpng_160x120.trace", 1, 160, 120);
+    unsigned differences = 0;
+    for (size_t i = 0; i < expected.rowsize * expected.height; i++) {
+        const int delta = expected.data[i] - tightpng_front.gd.drawable.data[i];
+        if (delta > 8 || delta < -8) {
+            differences++;
+        }
+    }
+    BOOST_CHECK_EQUAL(0, differences);
+}
+
+BOOST_AUTO_TEST_CASE(TestTightJpeg)
+{
+    ClientInfo info = make_info(256, 125);
+
+    FakeFront front(info, 0);
+    decode_trace(front, FIXTURES_PATH "/vnc_tight_jpeg_256x125.trace", 1, 256, 125);
+
+    // xrdp logo on black background
+    const Drawable & drawable = front.gd.drawable;
+    unsigned lit = 0;
+    for (size_t i = 0; i < drawable.rowsize * drawable.height; i++) {
+        lit += (drawable.data[i] > 0x20);
+    }
+    BOOST_CHECK(lit > 10000);
+}
+
+BOOST_AUTO_TEST_CASE(TestDecodeThroughput)
+{
+    ClientInfo info = make_info(256, 125);
+
+    FakeFront front(info, 0);
+    decode_trace(front, FIXTURES_PATH "/vnc_raw_160x120.trace",      101, 160, 120);
+    decode_trace(front, FIXTURES_PATH "/vnc_hextile_160x120.trace",  101, 160, 120);
+    decode_trace(front, FIXTURES_PATH "/vnc_tight_160x120.trace",    101, 160, 120);
+    decode_trace(front, FIXTURES_PATH "/vnc_tightpng_160x120.trace", 101, 160, 120);
+    decode_trace(front, FIXTURES_PATH "/vnc_tight_jpeg_256x125.trace", 101, 256, 125);
+}
+
+BOOST_AUTO_TEST_CASE(TestShadowSkipsUnchangedTiles)
+{
+    ClientInfo info = make_info(160, 120);
+
+    FakeFront front(info, 0);
+    VNCSession session(front, 160, 120);
+    VNCTrace trace(FIXTURES_PATH "/vnc_hextile_160x120.trace");
+
+    // hextile rows (16 pixels high) merged, 3 x 2 shadow tiles
+    session.replay(trace.data, trace.size);
+    BOOST_CHECK_EQUAL(6u, session.mod.shadow_tiles_sent);
+    BOOST_CHECK_EQUAL(0u, session.mod.shadow_tiles_skipped);
+
+    // server sending the same content again
+    session.replay(trace.data, trace.size);
+    BOOST_CHECK_EQUAL(6u, session.mod.shadow_tiles_sent);
+    BOOST_CHECK_EQUAL(6u, session.mod.shadow_tiles_skipped);
+}
+
+// Builds a FramebufferUpdate with a single Tight rectangle (basic
+// compression, copy filter, zlib stream 0 reset first).
+static size_t make_tight_copy_update(const uint8_t * pixels, uint16_t cx, uint16_t cy,
+                                     char * out, size_t out_size)
+{
+    uLongf compressed_size = out_size - 32;
+    BOOST_REQUIRE_EQUAL(Z_OK, compress2(reinterpret_cast<Bytef *>(out) + 32, &compressed_size,
+                                        pixels, cx * cy * 2, 6));
+    BOOST_REQUIRE(compressed_size <= 0x3FFFFF);
+
+    FixedSizeStream stream(reinterpret_cast<uint8_t *>(out), out_size);
+    stream.out_uint8(0);                // padding
+    stream.out_uint16_be(1);            // number-of-rectangles
+    stream.out_uint16_be(0);
+    stream.out_uint16_be(0);
+    stream.out_uint16_be(cx);
+    stream.out_uint16_be(cy);
+    stream.out_uint32_be(7);            // Tight
+    stream.out_uint8(0x01);             // reset stream 0, basic compression
+    stream.out_uint8(0x80 | (compressed_size & 0x7F));
+    stream.out_uint8(0x80 | ((compressed_size >> 7) & 0x7F));
+    stream.out_uint8(compressed_size >> 14);
+    memmove(stream.p, out + 32, compressed_size);
+    stream.out_skip_bytes(compressed_size);
+    return stream.get_offset();
+}
+
+BOOST_AUTO_TEST_CASE(TestShadowVerticalScroll)
+{
+    ClientInfo info = make_info(160, 120);
+
+    VNCTrace trace(FIXTURES_PATH "/vnc_raw_160x120.trace");
+    const uint8_t * pixels = reinterpret_cast<const uint8_t *>(trace.data) + 3 + 12;
+
+    // same content, then scrolled up by 16 rows
+    const size_t line_size = 160 * 2;
+    uint8_t scrolled_pixels[160 * 120 * 2];
+    memcpy(scrolled_pixels, pixels + 16 * line_size, (120 - 16) * line_size);
+    memcpy(scrolled_pixels + (120 - 16) * line_size, pixels, 16 * line_size);
+
+    char   update[65536];
+    char   scrolled[65536];
+    size_t update_size   = make_tight_copy_update(pixels, 160, 120, update, sizeof(update));
+    size_t scrolled_size = make_tight_copy_update(scrolled_pixels, 160, 120, scrolled, sizeof(scrolled));
+
+    FakeFront front(info, 0);
+    VNCSession session(front, 160, 120);
+    session.replay(update, update_size);
+    session.replay(scrolled, scrolled_size);
+    BOOST_CHECK_EQUAL(1u, session.mod.shadow_scrolls);
+
+    FakeFront expected_front(info, 0);
+    VNCSession expected_session(expected_front, 160, 120);
+    expected_session.replay(scrolled, scrolled_size);
+    BOOST_CHECK_EQUAL(0u, expected_session.mod.shadow_scrolls);
+
+    const Drawable & expected = expected_front.gd.drawable;
+    BOOST_CHECK_EQUAL(0, memcmp(expected.data, front.gd.drawable.data,
+                                expected.rowsize * expected.height));
+}
+
+// Builds a FramebufferUpdate with one Raw rectangle per strip of 16 rows,
+// as sent by servers splitting their updates.
+static size_t make_raw_strips_update(const uint8_t * pixels, uint16_t cx, uint16_t cy,
+                                     char * out, size_t out_size)
+{
+    const size_t line_size = cx * 2;
+    const uint16_t strips = (cy + 15) / 16;
+
+    FixedSizeStream stream(reinterpret_cast<uint8_t *>(out), out_size);
+    stream.out_uint8(0);                // padding
+    stream.out_uint16_be(strips);       // number-of-rectangles
+    for (uint16_t y = 0; y < cy; y += 16) {
+        const uint16_t strip_cy = std::min<uint16_t>(16, cy - y);
+        stream.out_uint16_be(0);
+        stream.out_uint16_be(y);
+        stream.out_uint16_be(cx);
+        stream.out_uint16_be(strip_cy);
+        stream.out_uint32_be(0);        // Raw
+        stream.out_copy_bytes(pixels + y * line_size, strip_cy * line_size);
+    }
+    return stream.get_offset();
+}
+
+BOOST_AUTO_TEST_CASE(TestShadowVerticalScrollStrips)
+{
+    ClientInfo info = make_info(160, 120);
+
+    VNCTrace trace(FIXTURES_PATH "/vnc_raw_160x120.trace");
+    const uint8_t * pixels = reinterpret_cast<const uint8_t *>(trace.data) + 3 + 12;
+
+    // scrolled up by 8 rows, new rows at bottom
+    const size_t line_size = 160 * 2;
+    uint8_t scrolled_pixels[160 * 120 * 2];
+    memcpy(scrolled_pixels, pixels + 8 * line_size, (120 - 8) * line_size);
+    memcpy(scrolled_pixels + (120 - 8) * line_size, pixels, 8 * line_size);
+
+    char   update[65536];
+    char   scrolled[65536];
+    size_t update_size   = make_raw_strips_update(pixels, 160, 120, update, sizeof(update));
+    size_t scrolled_size = make_raw_strips_update(scrolled_pixels, 160, 120, scrolled, sizeof(scrolled));
+
+    FakeFront front(info, 0);
+    VNCSession session(front, 160, 120);
+    session.replay(update, update_size);
+    const uint64_t tiles_sent = session.mod.shadow_tiles_sent;
+    session.replay(scrolled, scrolled_size);
+    BOOST_CHECK_EQUAL(1u, session.mod.shadow_scrolls);
+    // only the bottom tiles holding new rows are sent
+    BOOST_CHECK_EQUAL(tiles_sent + 3, session.mod.shadow_tiles_sent);
+
+    FakeFront expected_front(info, 0);
+    VNCSession expected_session(expected_front, 160, 120);
+    expected_session.replay(scrolled, scrolled_size);
+
+    const Drawable & expected = expected_front.gd.drawable;
+    BOOST_CHECK_EQUAL(0, memcmp(expected.data, front.gd.drawable.data,
+                                expected.rowsize * expected.height));
+}
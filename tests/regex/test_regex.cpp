@@ -668,6 +668,54 @@ BOOST_AUTO_TEST_CASE(TestRegexOptimize)
     test_re(re::Regex::MINIMAL_MEMORY|re::Regex::OPTIMIZE_MEMORY);
 }
 
+BOOST_AUTO_TEST_CASE(TestRegexLazyDfa)
+{
+    test_re(re::Regex::LAZY_DFA);
+    test_re(re::Regex::LAZY_DFA|re::Regex::MINIMAL_MEMORY|re::Regex::OPTIMIZE_MEMORY);
+}
+
+BOOST_AUTO_TEST_CASE(TestRegexLazyDfaLargeInput)
+{
+    std::string text(100000, 'x');
+    text += 'y';
+
+    // NFA stops at step_limit, DFA has no limit
+    Regex nfa("x*y");
+    Regex dfa("x*y", re::Regex::LAZY_DFA);
+    BOOST_CHECK(dfa.has_dfa());
+    BOOST_CHECK(!nfa.search(text.c_str()));
+    BOOST_CHECK(dfa.search(text.c_str()));
+    BOOST_CHECK(dfa.exact_search(text.c_str()));
+    BOOST_CHECK_EQUAL(text.size(), dfa.last_index());
+
+    // literal prefilter
+    Regex literal("abc[0-9]+def", re::Regex::LAZY_DFA);
+    BOOST_CHECK(!literal.search(text.c_str()));
+    BOOST_CHECK_EQUAL(text.size(), literal.last_index());
+    text.replace(5000, 8, "abc12def");
+    BOOST_CHECK(literal.search(text.c_str()));
+    BOOST_CHECK_EQUAL(5008u, literal.last_index());
+    BOOST_CHECK(!literal.exact_search(text.c_str()));
+    BOOST_CHECK(literal.exact_search("abc0def"));
+    BOOST_CHECK(!literal.exact_search("abc0de"));
+
+    // DFA with 2^8 states: too small budget falls back to NFA
+    const char * pattern = "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)";
+    Regex small(pattern, re::Regex::LAZY_DFA, 1000000, 16);
+    Regex large(pattern, re::Regex::LAZY_DFA, 1000000, 1024);
+    std::string ab;
+    uint32_t seed = 42;
+    for (unsigned i = 0; i < 20000; i++) {
+        seed = seed * 1103515245 + 12345;
+        ab += ((seed >> 16) & 1) ? 'a' : 'b';
+    }
+    BOOST_CHECK_EQUAL(large.exact_search(ab.c_str()), small.exact_search(ab.c_str()));
+    BOOST_CHECK(!small.has_dfa());
+    BOOST_CHECK(large.has_dfa());
+    BOOST_CHECK_EQUAL(large.exact_search(ab.c_str()), small.exact_search(ab.c_str()));
+    BOOST_CHECK_EQUAL(large.search(ab.c_str()), small.search(ab.c_str()));
+}
+
 BOOST_AUTO_TEST_CASE(TestRegexPartOfText)
 {
     const char * str_regex = "a";
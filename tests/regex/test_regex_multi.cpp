@@ -0,0 +1,158 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Jonathan Poelen
+
+   Unit test for multi-pattern streaming search, per character cost with
+   1000 patterns
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestRegexMulti
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+
+#include "regex_multi.hpp"
+#include "difftimeval.hpp"
+#include "rdtsc.hpp"
+
+#include <string>
+
+using namespace re;
+
+// feeds s, returns "pos:id " for each match
+static std::string search(MultiRegex & rgx, const char * s)
+{
+    std::string res;
+    rgx.reset();
+    utf8_consumer consumer(s);
+    for (unsigned pos = 0; consumer.valid(); pos++) {
+        if (rgx.step(consumer.bumpc())) {
+            for (size_t i = 0; i < rgx.matches().size(); i++) {
+                char tmp[32];
+                snprintf(tmp, sizeof(tmp), "%u:%u ", pos, rgx.matches()[i]);
+                res += tmp;
+            }
+        }
+    }
+    std::vector<unsigned> eol = rgx.finish();
+    for (size_t i = 0; i < eol.size(); i++) {
+        char tmp[32];
+        snprintf(tmp, sizeof(tmp), "$:%u ", eol[i]);
+        res += tmp;
+    }
+    return res;
+}
+
+BOOST_AUTO_TEST_CASE(TestRegexMultiSearch)
+{
+    MultiRegex rgx;
+    BOOST_CHECK_EQUAL(0u, rgx.add_pattern("rm -rf"));
+    BOOST_CHECK_EQUAL(1u, rgx.add_pattern("sh(utdown|alt)"));
+    BOOST_CHECK_EQUAL(2u, rgx.add_pattern("^su"));
+    BOOST_CHECK_EQUAL(3u, rgx.add_pattern("pass[0-9]+"));
+    BOOST_CHECK_EQUAL(4u, rgx.add_pattern("exit$"));
+    BOOST_CHECK_EQUAL(5u, rgx.add_pattern("é+t"));
+    BOOST_CHECK_EQUAL(6u, rgx.pattern_count());
+
+    BOOST_CHECK_EQUAL(std::string("1:2 9:0 "), search(rgx, "su; rm -rf /"));
+    BOOST_CHECK_EQUAL(std::string("1:2 "), search(rgx, "sudo rm -r"));
+    BOOST_CHECK_EQUAL(std::string(""), search(rgx, " sudo rm -r"));
+    BOOST_CHECK_EQUAL(std::string("9:1 16:1 "), search(rgx, "x shutdown; shalt"));
+    BOOST_CHECK_EQUAL(std::string("6:3 7:3 8:3 "), search(rgx, "a pass123"));
+    BOOST_CHECK_EQUAL(std::string("$:4 "), search(rgx, "exit"));
+    BOOST_CHECK_EQUAL(std::string(""), search(rgx, "exit now"));
+    BOOST_CHECK_EQUAL(std::string("3:5 "), search(rgx, "éééta"));
+
+    const char * err = 0;
+    BOOST_CHECK_EQUAL(-1u, rgx.add_pattern("a(b", &err));
+    BOOST_CHECK(err);
+    BOOST_CHECK_EQUAL(6u, rgx.pattern_count());
+
+    BOOST_CHECK_EQUAL(utf8_char_int('a'), utf8_consumer("a").bumpc());
+    BOOST_CHECK_EQUAL(utf8_char_int(0xE9), utf8_consumer("\xC3\xA9").bumpc());
+    BOOST_CHECK_EQUAL(utf8_char_int(0x20AC), utf8_consumer("\xE2\x82\xAC").bumpc());
+    BOOST_CHECK_EQUAL(utf8_char_int(0x1F600), utf8_consumer("\xF0\x9F\x98\x80").bumpc());
+}
+
+BOOST_AUTO_TEST_CASE(TestRegexMultiCacheFlush)
+{
+    // same results when DFA cache is flushed all the time
+    MultiRegex rgx;
+    MultiRegex small(4);
+    const char * patterns[] = { "abc", "b[cd]+e", "^x.z", "c.*f" };
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        rgx.add_pattern(patterns[i]);
+        small.add_pattern(patterns[i]);
+    }
+    const char * text = "xyzabcddeabcf bcdcdcde abxabc cf";
+    BOOST_CHECK_EQUAL(search(rgx, text), search(small, text));
+    BOOST_CHECK(small.cache_flush_count > 0);
+    BOOST_CHECK_EQUAL(0u, rgx.cache_flush_count);
+}
+
+BOOST_AUTO_TEST_CASE(TestRegexMultiThroughput)
+{
+    MultiRegex rgx;
+    for (unsigned i = 0; i < 1000; i++) {
+        char pattern[64];
+        switch (i % 4) {
+        case 0: snprintf(pattern, sizeof(pattern), "forbidden%u", i); break;
+        case 1: snprintf(pattern, sizeof(pattern), "cmd%u\\s+-[a-z]+", i); break;
+        case 2: snprintf(pattern, sizeof(pattern), "^login%u", i); break;
+        default: snprintf(pattern, sizeof(pattern), "secret[-_]?%u", i); break;
+        }
+        BOOST_REQUIRE_EQUAL(i, rgx.add_pattern(pattern));
+    }
+
+    // pseudo random typing (shell-like words and digits)
+    const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789 -_forbiddencmdsecret";
+    const unsigned text_len = 200000;
+    std::vector<char_int> text(text_len);
+    uint32_t seed = 12345;
+    for (unsigned i = 0; i < text_len; i++) {
+        seed = seed * 1103515245 + 12345;
+        text[i] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+    }
+    const char * hit = "secret_999 forbidden4";
+    for (unsigned i = 0; hit[i]; i++) {
+        text[1000 + i] = hit[i];
+    }
+
+    rgx.reset();
+    unsigned matched = 0;
+    unsigned long long usec   = ustime();
+    unsigned long long cycles = rdtsc();
+    for (unsigned i = 0; i < text_len; i++) {
+        matched += rgx.step(text[i]);
+    }
+    unsigned long long elapusec = ustime() - usec;
+    unsigned long long elapcyc  = rdtsc() - cycles;
+
+    printf("1000 patterns: %u characters, elapsed %llu us (%llu cycles), %.3f us/char, "
+           "%u DFA states, %u cache flushes\n",
+           text_len, elapusec, elapcyc, (double)elapusec / text_len,
+           rgx.dstate_count(), rgx.cache_flush_count);
+
+    BOOST_CHECK(matched >= 2);
+    // per keystroke overhead must stay far below a millisecond
+    BOOST_CHECK(elapusec < text_len * 10ULL);
+}
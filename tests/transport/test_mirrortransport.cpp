@@ -0,0 +1,167 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test for WRM mirroring on local socket
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestMirrorTransport
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+
+#include "mirrortransport.hpp"
+#include "GraphicToFile.hpp"
+#include "RDP/caches/bmpcache.hpp"
+#include "RDP/RDPDrawable.hpp"
+
+class OutBufferTransport : public Transport {
+public:
+    BStream stream;
+
+    OutBufferTransport() : stream(1024 * 1024) {}
+
+    using Transport::recv;
+    virtual void recv(char ** pbuffer, size_t len) throw (Error) {
+        throw Error(ERR_TRANSPORT_OUTPUT_ONLY_USED_FOR_SEND);
+    }
+
+    using Transport::send;
+    virtual void send(const char * const buffer, size_t len) throw (Error) {
+        this->stream.out_copy_bytes(buffer, len);
+    }
+
+    virtual void seek(int64_t offset, int whence) throw (Error) {
+        throw Error(ERR_TRANSPORT_SEEK_NOT_AVAILABLE);
+    }
+};
+
+static int connect_reader(const char * path)
+{
+    int sck = socket(AF_UNIX, SOCK_STREAM, 0);
+    BOOST_REQUIRE(sck >= 0);
+    union {
+        sockaddr     s;
+        sockaddr_un  s_un;
+    } u;
+    memset(&u, 0, sizeof(u));
+    u.s_un.sun_family = AF_UNIX;
+    strcpy(u.s_un.sun_path, path);
+    BOOST_REQUIRE_EQUAL(0, connect(sck, &u.s, sizeof(u.s_un)));
+    fcntl(sck, F_SETFL, fcntl(sck, F_GETFL) | O_NONBLOCK);
+    return sck;
+}
+
+static size_t read_available(int sck, BStream & stream)
+{
+    size_t total = 0;
+    for (;;) {
+        ssize_t res = ::recv(sck, stream.p, stream.tailroom(), 0);
+        if (res <= 0) {
+            break;
+        }
+        stream.p += res;
+        total    += res;
+    }
+    return total;
+}
+
+BOOST_AUTO_TEST_CASE(TestMirrorTransportReaders)
+{
+    struct timeval now;
+    now.tv_usec = 0;
+    now.tv_sec = 1000;
+
+    OutBufferTransport file;
+    MirrorTransport mirror(&file, "/tmp", "test_mirror");
+    BOOST_REQUIRE(mirror.sck >= 0);
+
+    Rect screen_rect(0, 0, 800, 600);
+    Inifile ini;
+    BmpCache bmp_cache(BmpCache::Recorder, 24, 3, false, 600, 256, false, 300, 1024, false, 262, 4096, false);
+    RDPDrawable drawable(screen_rect.cx, screen_rect.cy);
+    GraphicToFile consumer(now, &mirror, screen_rect.cx, screen_rect.cy, 24, bmp_cache, drawable, ini);
+
+    // first reader connects at the beginning of the session
+    int first = connect_reader(mirror.path);
+
+    consumer.draw(RDPOpaqueRect(screen_rect, GREEN), screen_rect);
+    consumer.draw(RDPOpaqueRect(Rect(0, 150, 700, 30), RED), screen_rect);
+    now.tv_sec++;
+    consumer.timestamp(now);
+
+    BStream first_stream(1024 * 1024);
+    read_available(first, first_stream);
+
+    consumer.breakpoint();
+    const size_t keyframe_offset = mirror.keyframe_pos;
+    consumer.draw(RDPOpaqueRect(Rect(10, 10, 50, 50), BLUE), screen_rect);
+    now.tv_sec++;
+    consumer.timestamp(now);
+
+    // late reader starts from the last keyframe
+    int late = connect_reader(mirror.path);
+    consumer.draw(RDPOpaqueRect(Rect(20, 20, 50, 50), RED), screen_rect);
+    now.tv_sec++;
+    consumer.timestamp(now);
+    consumer.flush();
+
+    read_available(first, first_stream);
+    BOOST_CHECK_EQUAL(file.stream.get_offset(), first_stream.get_offset());
+    BOOST_CHECK_EQUAL(0, memcmp(file.stream.get_data(), first_stream.get_data(),
+                                file.stream.get_offset()));
+
+    BStream late_stream(1024 * 1024);
+    read_available(late, late_stream);
+    BOOST_CHECK_EQUAL(file.stream.get_offset() - keyframe_offset, late_stream.get_offset());
+    BOOST_CHECK_EQUAL(0, memcmp(file.stream.get_data() + keyframe_offset, late_stream.get_data(),
+                                late_stream.get_offset()));
+    // stream starts with META chunk
+    late_stream.mark_end();
+    late_stream.rewind();
+    BOOST_CHECK_EQUAL(static_cast<unsigned>(META_FILE), late_stream.in_uint16_le());
+
+    ::close(first);
+    ::close(late);
+}
+
+BOOST_AUTO_TEST_CASE(TestMirrorTransportSlowReader)
+{
+    OutBufferTransport file;
+    MirrorTransport mirror(&file, "/tmp", "test_mirror_slow");
+    BOOST_REQUIRE(mirror.sck >= 0);
+
+    int reader = connect_reader(mirror.path);
+    mirror.next();
+    mirror.flush();
+    BOOST_CHECK(mirror.readers[0].sck >= 0);
+
+    // reader never reads: when the ring wraps it is disconnected, sending
+    // never blocks
+    char buffer[65536] = {};
+    for (size_t i = 0; i < (MirrorTransport::RING_SIZE / sizeof(buffer)) * 2; i++) {
+        file.stream.reset();
+        mirror.send(buffer, sizeof(buffer));
+    }
+    BOOST_CHECK_EQUAL(-1, mirror.readers[0].sck);
+
+    ::close(reader);
+}
@@ -0,0 +1,144 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Unit test for parallel bitmap compression
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestBitmapCompressionPool
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+
+#include "bitmap_compression_pool.hpp"
+#include "RDP/caches/bmpcache.hpp"
+
+namespace {
+    enum {
+        NB_BITMAPS = 12,
+        BMP_CX     = 64,
+        BMP_CY     = 64
+    };
+
+    // some runs of colors so that RLE has something to do
+    Bitmap * make_bitmap(unsigned seed) {
+        uint8_t data[BMP_CX * BMP_CY * 3];
+        for (unsigned i = 0; i < sizeof(data); i++) {
+            data[i] = ((i / (3 * (seed % 7 + 1))) * (seed + 13)) & 0xFF;
+        }
+        return new Bitmap(24, 24, NULL, BMP_CX, BMP_CY, data, sizeof(data));
+    }
+
+    void check_same_compression(const Bitmap & a, const Bitmap & b, uint8_t depth) {
+        BStream sa(65536);
+        BStream sb(65536);
+        a.compress(depth, sa);
+        b.compress(depth, sb);
+        BOOST_CHECK_EQUAL(sb.get_offset(), sa.get_offset());
+        BOOST_CHECK_EQUAL(0, memcmp(sa.get_data(), sb.get_data(), sb.get_offset()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapCompressionPool)
+{
+    BitmapCompressionPool pool(4);
+    BOOST_CHECK_EQUAL(4u, pool.thread_count());
+
+    const Bitmap * parallel[NB_BITMAPS];
+    const Bitmap * sequential[NB_BITMAPS];
+    for (unsigned i = 0; i < NB_BITMAPS; i++) {
+        parallel[i]   = make_bitmap(i);
+        sequential[i] = make_bitmap(i);
+    }
+
+    // several batches with the same workers, their time is reported to
+    // the session counters
+    const uint64_t compression_usec = session_stats().compression_usec;
+    pool.compress(parallel, NB_BITMAPS / 2, 24);
+    pool.compress(parallel + NB_BITMAPS / 2, NB_BITMAPS / 2, 24);
+    BOOST_CHECK(session_stats().compression_usec > compression_usec);
+
+    for (unsigned i = 0; i < NB_BITMAPS; i++) {
+        BOOST_CHECK(parallel[i]->data_compressed.get() != NULL);
+        BOOST_CHECK_EQUAL(24, parallel[i]->data_compressed_depth);
+        BOOST_CHECK(sequential[i]->data_compressed.get() == NULL);
+        check_same_compression(*parallel[i], *sequential[i], 24);
+    }
+
+    // memoized data made for another depth is not reused
+    pool.compress(parallel, NB_BITMAPS, 16);
+    for (unsigned i = 0; i < NB_BITMAPS; i++) {
+        BOOST_CHECK_EQUAL(16, parallel[i]->data_compressed_depth);
+        const Bitmap fresh(24, *sequential[i]);
+        check_same_compression(*parallel[i], fresh, 16);
+    }
+
+    for (unsigned i = 0; i < NB_BITMAPS; i++) {
+        delete parallel[i];
+        delete sequential[i];
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapCompressionPoolNoThread)
+{
+    BitmapCompressionPool pool(0);
+
+    unique_ptr<Bitmap> bmp(make_bitmap(3));
+    const Bitmap * bitmaps[] = { bmp.get() };
+    pool.compress(bitmaps, 1, 24);
+    BOOST_CHECK(bmp->data_compressed.get() != NULL);
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapClearCompressed)
+{
+    unique_ptr<Bitmap> bmp(make_bitmap(4));
+    bmp->precompress(24);
+    BOOST_CHECK(bmp->data_compressed.get() != NULL);
+
+    // what a failed precompress() leaves: compressed again when sent
+    bmp->clear_compressed();
+    BOOST_CHECK(bmp->data_compressed.get() == NULL);
+    BOOST_CHECK_EQUAL(0u, bmp->data_compressed_size);
+    BOOST_CHECK_EQUAL(0, bmp->data_compressed_depth);
+
+    unique_ptr<Bitmap> fresh(make_bitmap(4));
+    check_same_compression(*bmp, *fresh, 24);
+}
+
+BOOST_AUTO_TEST_CASE(TestBmpCacheKeepsCompressedData)
+{
+    BmpCache bmp_cache(BmpCache::Front, 24, 3, false, 600, 768, false, 300, 3072, false, 262, 12288, false);
+
+    unique_ptr<Bitmap> bmp(make_bitmap(5));
+    BOOST_CHECK_EQUAL(24, bmp_cache.cached_bpp(*bmp));
+    BOOST_CHECK(!bmp_cache.contains(*bmp));
+
+    bmp->precompress(24);
+
+    // same depth cache copy inherits compressed data
+    const Bitmap copy(bmp_cache.cached_bpp(*bmp), *bmp);
+    BOOST_CHECK(copy.data_compressed.get() != NULL);
+    BOOST_CHECK_EQUAL(bmp->data_compressed_size, copy.data_compressed_size);
+
+    bmp_cache.cache_bitmap(*bmp);
+    BOOST_CHECK(bmp_cache.contains(*bmp));
+}
@@ -466,6 +466,54 @@ BOOST_AUTO_TEST_CASE(TestPatBlt)
 //       dump_png("/tmp/test_patblt_000_", gd.drawable);
 }
 
+// brush pixel (x, y) is back color when bit x of brush row y is set
+static bool check_brush_rect(const Drawable & d, const Rect & rect, const uint8_t * brush,
+                             uint32_t back_color, uint32_t fore_color)
+{
+    for (int y = rect.y; y < rect.y + rect.cy; y++) {
+        for (int x = rect.x; x < rect.x + rect.cx; x++) {
+            const uint32_t expected = (brush[y % 8] & (1 << (x % 8))) ? back_color : fore_color;
+            const uint8_t * p = d.data + y * d.rowsize + x * Drawable::Bpp;
+            if (  (p[0] != (expected & 0xFF))
+               || (p[1] != ((expected >> 8) & 0xFF))
+               || (p[2] != ((expected >> 16) & 0xFF))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(TestPatBltBrush)
+{
+    Drawable d(100, 50);
+    const uint8_t checker[8] = { 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55 };
+    const uint8_t hatch[8]   = { 0x81, 0x42, 0x24, 0x18, 0x18, 0x24, 0x42, 0x81 };
+
+    // unaligned rectangles, narrower than pattern, up to right border
+    const Rect r1(3, 5, 17, 11);
+    const Rect r2(41, 1, 5, 3);
+    const Rect r3(93, 37, 7, 13);
+    d.patblt_ex(r1, 0xF0, 0x112233, 0xFFFFFF, checker);
+    d.patblt_ex(r2, 0xF0, 0x112233, 0xFFFFFF, checker);
+    d.patblt_ex(r3, 0xF0, 0x112233, 0xFFFFFF, checker);
+    BOOST_CHECK(check_brush_rect(d, r1, checker, 0x112233, 0xFFFFFF));
+    BOOST_CHECK(check_brush_rect(d, r2, checker, 0x112233, 0xFFFFFF));
+    BOOST_CHECK(check_brush_rect(d, r3, checker, 0x112233, 0xFFFFFF));
+
+    // same brush with other colors, then another brush
+    const Rect r4(20, 20, 30, 20);
+    d.patblt_ex(r4, 0xF0, 0x0000FF, 0x00FF00, checker);
+    BOOST_CHECK(check_brush_rect(d, r4, checker, 0x0000FF, 0x00FF00));
+    d.patblt_ex(r4, 0xF0, 0x0000FF, 0x00FF00, hatch);
+    BOOST_CHECK(check_brush_rect(d, r4, hatch, 0x0000FF, 0x00FF00));
+    BOOST_CHECK(check_brush_rect(d, r1, checker, 0x112233, 0xFFFFFF));
+
+    const Rect screen(0, 0, 100, 50);
+    d.patblt_ex(screen, 0xF0, 0x123456, 0x654321, hatch);
+    BOOST_CHECK(check_brush_rect(d, screen, hatch, 0x123456, 0x654321));
+}
+
 BOOST_AUTO_TEST_CASE(TestDestBlt)
 {
     // Create a simple capture image and dump it to file
@@ -0,0 +1,125 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Unit test for scoped phase timers and cycle histograms
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestPhaseTimer
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+
+#define PHASE_TIMERS
+#include "phase_timer.hpp"
+
+#include <string>
+
+BOOST_AUTO_TEST_CASE(TestPhaseHistogram)
+{
+    PhaseHistogram h;
+    BOOST_CHECK_EQUAL(0u, h.percentile(50));
+
+    h.add(0);       // bucket 0
+    h.add(1);       // bucket 0
+    h.add(1000);    // bucket 9 [512, 1024)
+    h.add(1023);    // bucket 9
+    h.add(1024);    // bucket 10
+    BOOST_CHECK_EQUAL(5u, h.count);
+    BOOST_CHECK_EQUAL(3048u, h.total);
+    BOOST_CHECK_EQUAL(1024u, h.max);
+    BOOST_CHECK_EQUAL(2u, h.buckets[0]);
+    BOOST_CHECK_EQUAL(2u, h.buckets[9]);
+    BOOST_CHECK_EQUAL(1u, h.buckets[10]);
+
+    BOOST_CHECK_EQUAL(2u, h.percentile(40));
+    BOOST_CHECK_EQUAL(1024u, h.percentile(50));
+    BOOST_CHECK_EQUAL(2048u, h.percentile(99));
+
+    for (unsigned i = 0; i < 95; i++) {
+        h.add(100);  // bucket 6
+    }
+    BOOST_CHECK_EQUAL(128u, h.percentile(90));
+    BOOST_CHECK_EQUAL(2048u, h.percentile(100));
+
+    PhaseHistogram other;
+    other.add(4096);    // bucket 12
+    other.add(1);       // bucket 0
+    h.merge(other);
+    BOOST_CHECK_EQUAL(102u, h.count);
+    BOOST_CHECK_EQUAL(3048u + 9500u + 4097u, h.total);
+    BOOST_CHECK_EQUAL(4096u, h.max);
+    BOOST_CHECK_EQUAL(3u, h.buckets[0]);
+    BOOST_CHECK_EQUAL(1u, h.buckets[12]);
+}
+
+BOOST_AUTO_TEST_CASE(TestScopedPhaseTimer)
+{
+    PhaseTimers & timers = PhaseTimers::instance();
+    timers.reset();
+
+    for (unsigned i = 0; i < 10; i++) {
+        PHASE_TIMER(PHASE_BITMAP_COMPRESS);
+        usleep(100);
+    }
+    {
+        PHASE_TIMER(PHASE_PNG_ENCODE);
+        PHASE_TIMER(PHASE_MPPC_COMPRESS);   // nested timers in the same scope
+    }
+
+    BOOST_CHECK_EQUAL(10u, timers.histogram(PHASE_BITMAP_COMPRESS).count);
+    BOOST_CHECK_EQUAL(1u, timers.histogram(PHASE_PNG_ENCODE).count);
+    BOOST_CHECK_EQUAL(1u, timers.histogram(PHASE_MPPC_COMPRESS).count);
+    BOOST_CHECK_EQUAL(0u, timers.histogram(PHASE_FRONT_INCOMING).count);
+    // 100us at more than 100MHz
+    BOOST_CHECK(timers.histogram(PHASE_BITMAP_COMPRESS).max > 10000);
+    BOOST_CHECK(timers.cycles_per_usec() > 0);
+
+    char buffer[2048];
+    timers.format(PHASE_BITMAP_COMPRESS, buffer, sizeof(buffer));
+    BOOST_CHECK_EQUAL(0, strncmp(buffer, "Bitmap::compress: count=10 mean=", 32));
+    BOOST_CHECK(strstr(buffer, "buckets 2^"));
+
+    // truncated output stays terminated
+    BOOST_CHECK_EQUAL(15u, timers.format(PHASE_BITMAP_COMPRESS, buffer, 16));
+    BOOST_CHECK_EQUAL(std::string("Bitmap::compres"), buffer);
+
+    // worst case line fits in FORMAT_SIZE: every bucket holding 20 digits
+    PhaseHistogram & h = timers.histogram(PHASE_PNG_ENCODE);
+    for (unsigned i = 0; i < PhaseHistogram::BUCKET_COUNT; i++) {
+        h.buckets[i] = 18446744073709551615ULL;
+    }
+    h.count = h.total = h.max = 18446744073709551615ULL;
+    char longest[PhaseTimers::FORMAT_SIZE];
+    const size_t len = timers.format(PHASE_PNG_ENCODE, longest, sizeof(longest));
+    BOOST_CHECK(len < sizeof(longest) - 1);
+    BOOST_CHECK_EQUAL(len, strlen(longest));
+    BOOST_CHECK_EQUAL(std::string(" 2^63:18446744073709551615"), std::string(longest + len - 26));
+
+    // SIGUSR2 only raises a flag
+    BOOST_CHECK_EQUAL(0, static_cast<int>(PhaseTimers::dump_requested()));
+    signal(SIGUSR2, phase_timers_sigusr2);
+    raise(SIGUSR2);
+    BOOST_CHECK_EQUAL(1, static_cast<int>(PhaseTimers::dump_requested()));
+    PHASE_TIMERS_CHECK_DUMP_REQUEST();
+    BOOST_CHECK_EQUAL(0, static_cast<int>(PhaseTimers::dump_requested()));
+}
@@ -0,0 +1,134 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Unit test for per session statistics segment
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestSessionStats
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+#include "log.hpp"
+#include "session_stats.hpp"
+
+#include <sys/wait.h>
+
+BOOST_AUTO_TEST_CASE(TestSessionStatsLayout)
+{
+    BOOST_CHECK_EQUAL(512u, sizeof(SessionStats));
+    BOOST_CHECK_EQUAL(64u, sizeof(SessionStatsHeader));
+
+    // not attached: counters go to a process local slot
+    session_stats().front_pdus_received++;
+    BOOST_CHECK_EQUAL(1u, session_stats().front_pdus_received);
+}
+
+BOOST_AUTO_TEST_CASE(TestSessionStatsSharedSlot)
+{
+    const char * filename = "/tmp/test_session_stats";
+
+    SessionStatsSegment & segment = SessionStatsSegment::instance();
+    BOOST_REQUIRE(segment.create(filename, 4));
+
+    int to_parent[2];
+    int to_child[2];
+    BOOST_REQUIRE(pipe(to_parent) == 0);
+    BOOST_REQUIRE(pipe(to_child) == 0);
+
+    pid_t pid = fork();
+    BOOST_REQUIRE(pid != -1);
+    if (pid == 0) {
+        // session process
+        char c = 0;
+        segment.acquire(getpid(), "10.10.47.1", "10.10.47.2");
+        session_stats().front_bytes_received = 1234;
+        session_stats().front_orders_sent   += 42;
+        session_stats().bmp_cache_hits       = 3;
+        session_stats().bmp_cache_misses     = 1;
+        {
+            SessionStatsTimer timer(session_stats().compression_usec);
+            usleep(2000);
+        }
+        if (write(to_parent[1], &c, 1) != 1 || read(to_child[0], &c, 1) != 1) {
+            _exit(1);
+        }
+        segment.release();
+        _exit(0);
+    }
+
+    char c = 0;
+    BOOST_REQUIRE_EQUAL(1, read(to_parent[0], &c, 1));
+
+    SessionStatsSegment reader;
+    BOOST_REQUIRE(reader.open_read_only(filename));
+    BOOST_CHECK_EQUAL(4u, reader.slot_count());
+
+    SessionStats s;
+    unsigned live = 0;
+    for (unsigned i = 0; i < reader.slot_count(); i++) {
+        if (reader.read(i, s)) {
+            live++;
+            BOOST_CHECK_EQUAL(pid, s.pid);
+            BOOST_CHECK_EQUAL(std::string("10.10.47.1"), s.source_ip);
+            BOOST_CHECK_EQUAL(std::string("10.10.47.2"), s.target_ip);
+            BOOST_CHECK_EQUAL(1234u, s.front_bytes_received);
+            BOOST_CHECK_EQUAL(42u, s.front_orders_sent);
+            BOOST_CHECK_EQUAL(75u, s.bmp_cache_hit_percent());
+            BOOST_CHECK(s.compression_usec >= 2000);
+        }
+    }
+    BOOST_CHECK_EQUAL(1u, live);
+
+    BOOST_REQUIRE_EQUAL(1, write(to_child[1], &c, 1));
+    int status = 0;
+    waitpid(pid, &status, 0);
+    BOOST_CHECK_EQUAL(0, status);
+
+    // released slot is not shown anymore
+    live = 0;
+    for (unsigned i = 0; i < reader.slot_count(); i++) {
+        live += reader.read(i, s);
+    }
+    BOOST_CHECK_EQUAL(0u, live);
+
+    // slots of dead processes are reclaimed when segment is full
+    SessionStatsSegment full;
+    BOOST_REQUIRE(full.create("/tmp/test_session_stats_full", 1));
+    pid = fork();
+    if (pid == 0) {
+        // killed session: slot is never released
+        full.acquire(getpid(), "a", "b");
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    BOOST_CHECK(!full.read(0, s));
+    BOOST_CHECK(full.acquire(getpid(), "c", "d"));
+    BOOST_CHECK(full.read(0, s));
+    BOOST_CHECK_EQUAL(std::string("c"), s.source_ip);
+    full.close();
+
+    close(to_parent[0]); close(to_parent[1]);
+    close(to_child[0]);  close(to_child[1]);
+    segment.close();
+    unlink(filename);
+    unlink("/tmp/test_session_stats_full");
+}
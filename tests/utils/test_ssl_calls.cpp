@@ -866,3 +866,86 @@ BOOST_AUTO_TEST_CASE(TestAES)
                       0);
 
 }
+
+// MAC of 5.2.3.1 computed from scratch
+static void reference_sign(const uint8_t * key, size_t key_size, const uint8_t * data, size_t data_size, uint8_t * signature)
+{
+    uint8_t pad1[40];
+    uint8_t pad2[48];
+    memset(pad1, 0x36, sizeof(pad1));
+    memset(pad2, 0x5c, sizeof(pad2));
+    uint8_t lenhdr[4];
+    buf_out_uint32(lenhdr, data_size);
+
+    uint8_t shasig[20];
+    SslSha1 sha1;
+    sha1.update(key, key_size);
+    sha1.update(pad1, sizeof(pad1));
+    sha1.update(lenhdr, sizeof(lenhdr));
+    sha1.update(data, data_size);
+    sha1.final(shasig, sizeof(shasig));
+
+    SslMd5 md5;
+    md5.update(key, key_size);
+    md5.update(pad2, sizeof(pad2));
+    md5.update(shasig, sizeof(shasig));
+    md5.final(signature, 8);
+}
+
+BOOST_AUTO_TEST_CASE(TestCryptContextSignAndEncrypt)
+{
+    uint8_t keyblob[16];
+    uint8_t sign_key[16];
+    for (unsigned i = 0; i < 16; i++) {
+        keyblob[i]  = i * 7 + 1;
+        sign_key[i] = 0xf0 - i * 3;
+    }
+
+    for (uint32_t encryptionMethod = 1; encryptionMethod <= 2; encryptionMethod++) {
+        const size_t keylen = (encryptionMethod == 1) ? 8 : 16;
+
+        // separate sign then RC4, and fused pass
+        CryptContext separate;
+        CryptContext fused;
+        memcpy(separate.sign_key, sign_key, 16);
+        memcpy(fused.sign_key, sign_key, 16);
+        separate.generate_key(keyblob, encryptionMethod);
+        fused.generate_key(keyblob, encryptionMethod);
+
+        const size_t sizes[] = { 0, 1, 1023, 1024, 1025, 5000 };
+        uint8_t data[5000];
+        uint8_t copy[5000];
+        // more than 4096 PDUs, session key is updated once
+        for (unsigned n = 0; n < 4200; n++) {
+            const size_t size = sizes[n % (sizeof(sizes) / sizeof(sizes[0]))];
+            for (size_t i = 0; i < size; i++) {
+                data[i] = static_cast<uint8_t>(i * 13 + n);
+            }
+            memcpy(copy, data, size);
+
+            // sign key changed by caller (licensing, reconnection)
+            if (n == 100) {
+                sign_key[0]++;
+                memcpy(separate.sign_key, sign_key, 16);
+                memcpy(fused.sign_key, sign_key, 16);
+            }
+
+            uint8_t expected[8];
+            reference_sign(sign_key, keylen, data, size, expected);
+
+            uint8_t signature1[8];
+            separate.sign(data, size, signature1, sizeof(signature1));
+            separate.decrypt(data, size);
+
+            uint8_t signature2[8];
+            fused.sign_and_encrypt(copy, size, signature2, sizeof(signature2));
+
+            if (memcmp(expected, signature1, 8) || memcmp(expected, signature2, 8) || memcmp(data, copy, size)) {
+                BOOST_CHECK_MESSAGE(false, "mismatch at PDU " << n << " method " << encryptionMethod);
+                break;
+            }
+        }
+        BOOST_CHECK_EQUAL(0, memcmp(separate.key, fused.key, 16));
+        BOOST_CHECK_EQUAL(4200 - 4096, fused.use_count);
+    }
+}
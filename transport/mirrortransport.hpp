@@ -0,0 +1,248 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Transport layer abstraction
+
+   MirrorTransport forwards a WRM stream to the real (file) transport and
+   mirrors it to readers connected on a local (UNIX) socket, allowing to
+   follow a running session without polling recorded files.
+
+   The stream is kept in a ring buffer. A reader connecting late receives
+   the stream from the last keyframe (next() is called by GraphicToFile
+   just before writing a breakpoint) if it is still in the ring, or waits
+   for the next keyframe otherwise. Readers are only served (with non
+   blocking sends) on timestamp() and flush(), a reader which would lose
+   data not sent yet is disconnected: the session is never blocked.
+*/
+
+#ifndef _REDEMPTION_TRANSPORT_MIRRORTRANSPORT_HPP_
+#define _REDEMPTION_TRANSPORT_MIRRORTRANSPORT_HPP_
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "transport.hpp"
+#include "netutils.hpp"
+#include "stream.hpp"
+#include "error.hpp"
+
+class MirrorTransport : public Transport
+{
+public:
+    enum {
+        RING_SIZE   = 8 * 1024 * 1024,
+        MAX_READERS = 4
+    };
+
+    static const uint64_t WAIT_KEYFRAME = ~0ULL;
+
+    Transport * trans;
+    int         sck;
+    char        path[108];
+
+    BStream  ring;
+    uint64_t total;         // bytes written to the ring since start
+    uint64_t keyframe_pos;  // position of the last keyframe in the stream
+
+    struct Reader {
+        int      sck;
+        uint64_t pos;       // position of next byte to send to this reader
+    } readers[MAX_READERS];
+
+    uint32_t verbose;
+
+    MirrorTransport(Transport * trans, const char * path, const char * basename, uint32_t verbose = 0)
+    : trans(trans)
+    , sck(-1)
+    , ring(RING_SIZE)
+    , total(0)
+    , keyframe_pos(0)
+    , verbose(verbose)
+    {
+        for (size_t i = 0; i < MAX_READERS; i++) {
+            this->readers[i].sck = -1;
+            this->readers[i].pos = WAIT_KEYFRAME;
+        }
+
+        int len = snprintf(this->path, sizeof(this->path), "%s/%s-%06u.sock", path, basename, getpid());
+        if ((len < 0) || (static_cast<size_t>(len) >= sizeof(this->path))) {
+            LOG(LOG_ERR, "MirrorTransport: socket path too long (%s/%s)", path, basename);
+            this->path[0] = 0;
+            return;
+        }
+
+        this->sck = local_listen(this->path);
+        if (this->sck < 0) {
+            this->path[0] = 0;
+            return;
+        }
+        chmod(this->path, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+        LOG(LOG_INFO, "MirrorTransport: session mirrored on %s", this->path);
+    }
+
+    virtual ~MirrorTransport()
+    {
+        for (size_t i = 0; i < MAX_READERS; i++) {
+            if (this->readers[i].sck >= 0) {
+                ::close(this->readers[i].sck);
+            }
+        }
+        if (this->sck >= 0) {
+            ::close(this->sck);
+            ::unlink(this->path);
+        }
+    }
+
+    using Transport::recv;
+    virtual void recv(char ** pbuffer, size_t len) throw (Error) {
+        throw Error(ERR_TRANSPORT_OUTPUT_ONLY_USED_FOR_SEND);
+    }
+
+    using Transport::send;
+    virtual void send(const char * const buffer, size_t len) throw (Error)
+    {
+        this->trans->send(buffer, len);
+        if (this->sck < 0) {
+            return;
+        }
+
+        REDASSERT(len <= RING_SIZE);
+        for (size_t i = 0; i < MAX_READERS; i++) {
+            Reader & reader = this->readers[i];
+            if ((reader.sck >= 0) && (reader.pos != WAIT_KEYFRAME)
+            && (reader.pos + RING_SIZE < this->total + len)) {
+                this->send_to_reader(reader);
+                if ((reader.sck >= 0) && (reader.pos + RING_SIZE < this->total + len)) {
+                    LOG(LOG_WARNING, "MirrorTransport: reader too slow, disconnected");
+                    this->drop_reader(reader);
+                }
+            }
+        }
+
+        size_t done = 0;
+        while (done < len) {
+            const size_t offset = this->total % RING_SIZE;
+            const size_t part   = std::min<size_t>(len - done, RING_SIZE - offset);
+            memcpy(this->ring.get_data() + offset, buffer + done, part);
+            this->total += part;
+            done        += part;
+        }
+    }
+
+    virtual void seek(int64_t offset, int whence) throw (Error) { throw Error(ERR_TRANSPORT_SEEK_NOT_AVAILABLE); }
+
+    virtual void flush()
+    {
+        this->trans->flush();
+        this->serve();
+    }
+
+    virtual void timestamp(timeval now)
+    {
+        this->trans->timestamp(now);
+        this->serve();
+    }
+
+    REDOC("Called before writing a keyframe (breakpoint): readers waiting for"
+          " a keyframe start from here")
+    virtual bool next()
+    {
+        bool res = this->trans->next();
+        this->keyframe_pos = this->total;
+        for (size_t i = 0; i < MAX_READERS; i++) {
+            if ((this->readers[i].sck >= 0) && (this->readers[i].pos == WAIT_KEYFRAME)) {
+                this->readers[i].pos = this->keyframe_pos;
+            }
+        }
+        return res;
+    }
+
+    REDOC("Accepts new readers and sends them what they miss (non blocking)")
+    void serve()
+    {
+        if (this->sck < 0) {
+            return;
+        }
+
+        for (;;) {
+            int reader_sck = ::accept(this->sck, NULL, NULL);
+            if (reader_sck < 0) {
+                break;
+            }
+            fcntl(reader_sck, F_SETFL, fcntl(reader_sck, F_GETFL) | O_NONBLOCK);
+
+            size_t i = 0;
+            while ((i < MAX_READERS) && (this->readers[i].sck >= 0)) {
+                i++;
+            }
+            if (i == MAX_READERS) {
+                LOG(LOG_WARNING, "MirrorTransport: too many readers");
+                ::close(reader_sck);
+                continue;
+            }
+            this->readers[i].sck = reader_sck;
+            this->readers[i].pos = (this->keyframe_pos + RING_SIZE >= this->total)
+                                 ? this->keyframe_pos : WAIT_KEYFRAME;
+            if (this->verbose) {
+                LOG(LOG_INFO, "MirrorTransport: new reader%s",
+                    (this->readers[i].pos == WAIT_KEYFRAME) ? " (waiting for next keyframe)" : "");
+            }
+        }
+
+        for (size_t i = 0; i < MAX_READERS; i++) {
+            if ((this->readers[i].sck >= 0) && (this->readers[i].pos != WAIT_KEYFRAME)) {
+                this->send_to_reader(this->readers[i]);
+            }
+        }
+    }
+
+private:
+    void send_to_reader(Reader & reader)
+    {
+        while (reader.pos < this->total) {
+            const size_t offset = reader.pos % RING_SIZE;
+            const size_t part   = std::min<uint64_t>(this->total - reader.pos, RING_SIZE - offset);
+            ssize_t res = ::send(reader.sck, this->ring.get_data() + offset, part, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (res > 0) {
+                reader.pos += res;
+                continue;
+            }
+            if ((res < 0) && try_again(errno)) {
+                return;
+            }
+            if (this->verbose) {
+                LOG(LOG_INFO, "MirrorTransport: reader disconnected");
+            }
+            this->drop_reader(reader);
+            return;
+        }
+    }
+
+    void drop_reader(Reader & reader)
+    {
+        ::close(reader.sck);
+        reader.sck = -1;
+        reader.pos = WAIT_KEYFRAME;
+    }
+};
+
+#endif
@@ -157,12 +157,15 @@ struct FieldObserver : public ConfigurationHolder {
 
         virtual const char* get_value() = 0;
 
-        const char* get_serialized(char * buff, size_t size, uint32_t password_printing_mode) {
+        const char* get_serialized(char * buff, size_t size, uint32_t password_printing_mode,
+                                   bool log_item = true) {
             const char * key = string_from_authid(this->authid);
             int n;
             if (this->is_asked()) {
                 n = snprintf(buff, size, "%s\nASK\n",key);
-                LOG(LOG_INFO, "sending %s=ASK", key);
+                if (log_item) {
+                    LOG(LOG_INFO, "sending %s=ASK", key);
+                }
             }
             else {
                 const char * val         = this->get_value();
@@ -172,7 +175,9 @@ struct FieldObserver : public ConfigurationHolder {
                     ||(strncasecmp("target_password", static_cast<const char*>(key), 15) == 0)){
                     display_val = get_printable_password(val, password_printing_mode);
                 }
-                LOG(LOG_INFO, "sending %s=%s", key, display_val);
+                if (log_item) {
+                    LOG(LOG_INFO, "sending %s=%s", key, display_val);
+                }
             }
             if (n < 0 || static_cast<size_t>(n) >= size ) {
                 LOG(LOG_ERR, "Sending Data to ACL Error: Buffer overflow,"
@@ -50,6 +50,7 @@
 #include "ssl_calls.hpp"
 #include "rect.hpp"
 #include "unique_ptr.hpp"
+#include "phase_timer.hpp"
 
 class Bitmap {
 public:
@@ -97,6 +98,9 @@ public:
     // Memoize compressed bitmap
     mutable unique_ptr<uint8_t[]> data_compressed;
     mutable size_t data_compressed_size;
+    // Session color depth data_compressed was made for by compress(),
+    // 0 if data_compressed was received already compressed.
+    mutable uint8_t data_compressed_depth;
 
     Bitmap(uint8_t session_color_depth, uint8_t bpp, const BGRPalette * palette,
            uint16_t cx, uint16_t cy, const uint8_t * data, const size_t size,
@@ -109,6 +113,7 @@ public:
         , data_bitmap()
         , data_compressed(NULL)
         , data_compressed_size(0)
+        , data_compressed_depth(0)
     {
         this->data_bitmap.alloc(this->bmp_size);
         //LOG(LOG_INFO, "Creating bitmap (%p) cx=%u cy=%u size=%u bpp=%u", this, cx, cy, size, bpp);
@@ -159,6 +164,7 @@ public:
         , data_bitmap()
         , data_compressed(NULL)
         , data_compressed_size(0)
+        , data_compressed_depth(0)
 
     {
         this->data_bitmap.alloc(this->bmp_size);
@@ -202,6 +208,7 @@ public:
         , data_bitmap()
         , data_compressed(NULL)
         , data_compressed_size(0)
+        , data_compressed_depth(0)
 
     {
         //LOG(LOG_INFO, "Creating bitmap (%p) extracting part cx=%u cy=%u size=%u bpp=%u", this, cx, cy, bmp_size, original_bpp);
@@ -242,6 +249,7 @@ public:
         , data_bitmap()
         , data_compressed(NULL)
         , data_compressed_size(0)
+        , data_compressed_depth(0)
 
     {
         //LOG(LOG_INFO, "loading bitmap %s", filename);
@@ -1374,10 +1382,40 @@ public:
     TODO(" simplify and enhance compression using 1 pixel orders BLACK or WHITE.");
     void compress(uint8_t session_color_depth, Stream & outbuffer) const
     {
-        if (this->data_compressed) {
+        PHASE_TIMER(PHASE_BITMAP_COMPRESS);
+
+        this->compress_untimed(session_color_depth, outbuffer);
+    }
+
+    // Fills memoized compressed data only (see BitmapCompressionPool).
+    void precompress(uint8_t session_color_depth) const
+    {
+        if (!this->data_compressed
+        || (this->data_compressed_depth && (this->data_compressed_depth != session_color_depth))) {
+            BStream stream(this->bmp_size * 2 + 1024);
+            this->compress_untimed(session_color_depth, stream);
+        }
+    }
+
+    // Forgets memoized compressed data, e.g. left half made by a failed
+    // precompress(): next compress() starts over.
+    void clear_compressed() const
+    {
+        this->data_compressed.reset();
+        this->data_compressed_size  = 0;
+        this->data_compressed_depth = 0;
+    }
+
+    // Same as compress() without phase timer, hence safe to call from
+    // several threads at once on distinct bitmaps.
+    void compress_untimed(uint8_t session_color_depth, Stream & outbuffer) const
+    {
+        if (this->data_compressed
+        && (!this->data_compressed_depth || (this->data_compressed_depth == session_color_depth))) {
             outbuffer.out_copy_bytes(this->data_compressed.get(), this->data_compressed_size);
             return;
         }
+        this->data_compressed_depth = session_color_depth;
 
         if ((session_color_depth == 32) && ((this->original_bpp == 24) || (this->original_bpp == 32))) {
             return this->compress60(outbuffer);
@@ -2188,6 +2226,7 @@ public:
     , data_bitmap()
     , data_compressed(NULL)
     , data_compressed_size(0)
+    , data_compressed_depth(0)
     {
         //LOG(LOG_INFO, "Creating bitmap (%p) (copy constructor) cx=%u cy=%u size=%u bpp=%u", this, cx, cy, bmp_size, original_bpp);
 
@@ -2224,6 +2263,15 @@ public:
         }
         else {
             this->data_bitmap.use(bmp.data_bitmap);
+            // only data compressed locally is known to match this bitmap geometry
+            if (bmp.data_compressed && bmp.data_compressed_depth) {
+                this->data_compressed_size  = bmp.data_compressed_size;
+                this->data_compressed_depth = bmp.data_compressed_depth;
+                this->data_compressed.reset(new uint8_t[this->data_compressed_size]);
+                if (this->data_compressed) {
+                    memcpy(this->data_compressed.get(), bmp.data_compressed.get(), this->data_compressed_size);
+                }
+            }
         }
 
         if (out_bpp == 8){
@@ -2245,6 +2293,7 @@ public:
         , data_bitmap()
         , data_compressed(NULL)
         , data_compressed_size(0)
+        , data_compressed_depth(0)
     {
         this->data_bitmap.alloc(this->bmp_size);
         //LOG(LOG_INFO, "Creating bitmap (%p) cx=%u cy=%u size=%u bpp=%u", this, cx, cy, bmp_size, bpp);
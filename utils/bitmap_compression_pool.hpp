@@ -0,0 +1,242 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Worker threads compressing a batch of bitmaps in parallel. Results are
+   only memoized in each Bitmap (data_compressed), bitmaps are then sent in
+   order by the caller as usual and compress() just copies memoized data.
+
+   Workers are started on first use, hence after session process fork.
+
+   A bitmap whose compression fails (Error, allocation) has its memo cleared
+   and is compressed again by the session thread when sent. Time spent by
+   workers is added to the session compression counters (compression_usec
+   and Bitmap::compress phase timer) by the caller once the batch is done,
+   workers never write session statistics themselves.
+*/
+
+#ifndef _REDEMPTION_UTILS_BITMAP_COMPRESSION_POOL_HPP_
+#define _REDEMPTION_UTILS_BITMAP_COMPRESSION_POOL_HPP_
+
+#include <pthread.h>
+
+#include "log.hpp"
+#include "bitmap.hpp"
+#include "phase_timer.hpp"
+#include "session_stats.hpp"
+
+class BitmapCompressionPool {
+public:
+    enum {
+        MAX_THREADS = 16
+    };
+
+private:
+    pthread_t       threads[MAX_THREADS];
+    unsigned        nb_threads;
+    bool            started;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  work_available;
+    pthread_cond_t  batch_done;
+
+    // current batch
+    const Bitmap * const * bitmaps;
+    size_t                 count;
+    size_t                 next;
+    size_t                 pending;
+    uint8_t                session_color_depth;
+    bool                   stop;
+
+    // accounting of current batch, reported by caller thread
+    PhaseHistogram         batch_cycles;
+    uint64_t               batch_usec;
+    size_t                 batch_failures;
+
+public:
+    explicit BitmapCompressionPool(unsigned nb_threads)
+    : nb_threads(std::min<unsigned>(nb_threads, MAX_THREADS))
+    , started(false)
+    , bitmaps(NULL)
+    , count(0)
+    , next(0)
+    , pending(0)
+    , session_color_depth(0)
+    , stop(false)
+    , batch_usec(0)
+    , batch_failures(0)
+    {
+        pthread_mutex_init(&this->mutex, NULL);
+        pthread_cond_init(&this->work_available, NULL);
+        pthread_cond_init(&this->batch_done, NULL);
+    }
+
+    ~BitmapCompressionPool() {
+        pthread_mutex_lock(&this->mutex);
+        this->stop = true;
+        pthread_cond_broadcast(&this->work_available);
+        pthread_mutex_unlock(&this->mutex);
+        if (this->started) {
+            for (unsigned i = 0; i < this->nb_threads; i++) {
+                pthread_join(this->threads[i], NULL);
+            }
+        }
+        pthread_cond_destroy(&this->batch_done);
+        pthread_cond_destroy(&this->work_available);
+        pthread_mutex_destroy(&this->mutex);
+    }
+
+    unsigned thread_count() const {
+        return this->nb_threads;
+    }
+
+    // Returns when all bitmaps have their compressed data memoized, the
+    // calling thread takes part in the work. Batches are not reentrant.
+    void compress(const Bitmap * const * bitmaps, size_t count, uint8_t session_color_depth) {
+        if (!this->nb_threads || (count < 2)) {
+            for (size_t i = 0; i < count; i++) {
+                this->account(bitmaps[i], session_color_depth);
+            }
+            this->report();
+            return;
+        }
+
+        this->start();
+
+        pthread_mutex_lock(&this->mutex);
+        this->bitmaps             = bitmaps;
+        this->count               = count;
+        this->next                = 0;
+        this->pending             = count;
+        this->session_color_depth = session_color_depth;
+        pthread_cond_broadcast(&this->work_available);
+        pthread_mutex_unlock(&this->mutex);
+
+        while (this->run_one()) {
+        }
+
+        pthread_mutex_lock(&this->mutex);
+        while (this->pending) {
+            pthread_cond_wait(&this->batch_done, &this->mutex);
+        }
+        this->bitmaps = NULL;
+        this->count   = 0;
+        this->next    = 0;
+        pthread_mutex_unlock(&this->mutex);
+
+        this->report();
+    }
+
+private:
+    void start() {
+        if (this->started) {
+            return;
+        }
+        for (unsigned i = 0; i < this->nb_threads; i++) {
+            if (pthread_create(&this->threads[i], NULL, &BitmapCompressionPool::worker, this) != 0) {
+                LOG(LOG_WARNING, "BitmapCompressionPool: failed to start worker %u, using %u", i, i);
+                this->nb_threads = i;
+                break;
+            }
+        }
+        this->started = true;
+    }
+
+    // never throws: a failed bitmap is left uncompressed, returns false then
+    static bool precompress(const Bitmap * bmp, uint8_t depth) {
+        try {
+            bmp->precompress(depth);
+            return true;
+        }
+        catch (...) {
+            bmp->clear_compressed();
+            return false;
+        }
+    }
+
+    // caller thread only, mutex not needed
+    void account(const Bitmap * bmp, uint8_t depth) {
+        const uint64_t start_cycles = rdtsc();
+        const uint64_t start_usec   = ustime();
+        const bool     done         = precompress(bmp, depth);
+        this->batch_cycles.add(rdtsc() - start_cycles);
+        this->batch_usec += ustime() - start_usec;
+        this->batch_failures += !done;
+    }
+
+    // caller thread, once batch is done
+    void report() {
+        session_stats().compression_usec += this->batch_usec;
+        PHASE_TIMERS_MERGE(PHASE_BITMAP_COMPRESS, this->batch_cycles);
+        if (this->batch_failures) {
+            LOG(LOG_WARNING, "BitmapCompressionPool: %u bitmaps failed to compress, left to session thread",
+                static_cast<unsigned>(this->batch_failures));
+        }
+        this->batch_cycles.reset();
+        this->batch_usec     = 0;
+        this->batch_failures = 0;
+    }
+
+    // compress next bitmap of current batch, false if none left
+    bool run_one() {
+        pthread_mutex_lock(&this->mutex);
+        if (this->next >= this->count) {
+            pthread_mutex_unlock(&this->mutex);
+            return false;
+        }
+        const Bitmap * bmp   = this->bitmaps[this->next++];
+        const uint8_t  depth = this->session_color_depth;
+        pthread_mutex_unlock(&this->mutex);
+
+        const uint64_t start_cycles = rdtsc();
+        const uint64_t start_usec   = ustime();
+        const bool     done         = precompress(bmp, depth);
+        const uint64_t cycles       = rdtsc() - start_cycles;
+        const uint64_t usec         = ustime() - start_usec;
+
+        pthread_mutex_lock(&this->mutex);
+        this->batch_cycles.add(cycles);
+        this->batch_usec += usec;
+        this->batch_failures += !done;
+        if (--this->pending == 0) {
+            pthread_cond_signal(&this->batch_done);
+        }
+        pthread_mutex_unlock(&this->mutex);
+        return true;
+    }
+
+    static void * worker(void * arg) {
+        BitmapCompressionPool & pool = *static_cast<BitmapCompressionPool *>(arg);
+        for (;;) {
+            pthread_mutex_lock(&pool.mutex);
+            while (!pool.stop && (pool.next >= pool.count)) {
+                pthread_cond_wait(&pool.work_available, &pool.mutex);
+            }
+            const bool stop = pool.stop;
+            pthread_mutex_unlock(&pool.mutex);
+            if (stop) {
+                break;
+            }
+            while (pool.run_one()) {
+            }
+        }
+        return NULL;
+    }
+};
+
+#endif
@@ -32,6 +32,12 @@
 #include "difftimeval.hpp"
 #include "rdtsc.hpp"
 
+// Internal pixel layout: packed 24 bits BGR, the layout of PNG and WRM image
+// chunk rows. A 32 bits XRGB layout was measured slower on every primitive
+// (more bytes to move per row, see ftests/drawable/benchmark).
+
+// unaligned word access to pixel rows, ROP kernels work on these
+typedef uint64_t drawable_word_t __attribute__((__may_alias__, __aligned__(1)));
 
 struct Drawable {
     static const std::size_t Bpp = 3;
@@ -42,6 +48,24 @@ struct Drawable {
     unsigned long pix_len;
     uint8_t * data;
 
+    // row buffers used by ROP kernels (patterns, decoded bitmap rows)
+    enum {
+        scratch_rows = 9
+    };
+    uint8_t * scratch;
+
+private:
+    // 8 rows of last brush pattern expanded to screen width, aligned on
+    // screen coordinates so that any PatBlt with this brush reads its rows
+    // at rect.x. Dithered backgrounds are drawn with one brush in many
+    // PatBlt, the pattern is only expanded again when brush changes.
+    uint8_t * brush_rows;
+    uint8_t   brush_key[8];
+    uint32_t  brush_back_color;
+    uint32_t  brush_fore_color;
+    bool      brush_expanded;
+
+public:
     enum {
         char_width  = 7,
         char_height = 12
@@ -96,6 +120,12 @@ public:
     , height(height)
     , rowsize(width * Bpp)
     , pix_len(this->rowsize * height)
+    , data(NULL)
+    , scratch(NULL)
+    , brush_rows(NULL)
+    , brush_back_color(0)
+    , brush_fore_color(0)
+    , brush_expanded(false)
     , tracked_area(0, 0, 0, 0)
     , tracked_area_changed(false)
     , logical_frame_ended(true)
@@ -134,10 +164,14 @@ public:
         if (!this->pix_len) {
             throw Error(ERR_RECORDER_EMPTY_IMAGE);
         }
-        this->data = new (std::nothrow) uint8_t[this->pix_len];
-        if (this->data == 0) {
+        void * mem = NULL;
+        if (posix_memalign(&mem, 64, this->pix_len + (scratch_rows + 8) * this->rowsize) != 0) {
             throw Error(ERR_RECORDER_FRAME_ALLOCATION_FAILED);
         }
+        this->data       = static_cast<uint8_t *>(mem);
+        this->scratch    = this->data + this->pix_len;
+        this->brush_rows = this->scratch + scratch_rows * this->rowsize;
+        memset(this->brush_key, 0, sizeof(this->brush_key));
         std::fill<>(this->data, this->data + this->pix_len, 0);
 
         memset(this->timestamp_data, 0xFF, sizeof(this->timestamp_data));
@@ -146,7 +180,7 @@ public:
     }
 
     ~Drawable() {
-        delete[] this->data;
+        free(this->data);
     }
 
     uint8_t * first_pixel() {
@@ -158,23 +192,23 @@ public:
     }
 
     uint8_t * first_pixel(const Rect & rect) {
-        return this->data + (rect.y * this->width + rect.x) * Bpp;
+        return this->data + rect.y * this->rowsize + rect.x * Bpp;
     }
 
     const uint8_t * first_pixel(const Rect & rect) const {
-        return this->data + (rect.y * this->width + rect.x) * Bpp;
+        return this->data + rect.y * this->rowsize + rect.x * Bpp;
     }
 
     uint8_t * first_pixel(int y) {
-        return this->data + y * this->width * Bpp;
+        return this->data + y * this->rowsize;
     }
 
     uint8_t * first_pixel(int x, int y) {
-        return this->data + (y * this->width + x) * Bpp;
+        return this->data + y * this->rowsize + x * Bpp;
     }
 
     const uint8_t * first_pixel(int x, int y) const {
-        return this->data + (y * this->width + x) * Bpp;
+        return this->data + y * this->rowsize + x * Bpp;
     }
 
     uint8_t * after_last_pixel() {
@@ -182,7 +216,32 @@ public:
     }
 
     uint8_t * beginning_of_last_line(const Rect & rect) {
-        return this->data + ((rect.y + rect.cy - 1) * this->width + rect.x) * Bpp;
+        return this->data + (rect.y + rect.cy - 1) * this->rowsize + rect.x * Bpp;
+    }
+
+    // color is 0x00BBGGRR (byte order of a packed 24 bits pixel)
+    static void put_pixel(uint8_t * p, uint32_t color) {
+        p[0] = color; p[1] = color >> 8; p[2] = color >> 16;
+    }
+
+    static void fill_pixels(uint8_t * p, uint32_t color, size_t count) {
+        for (size_t i = 0; i < count; i++, p += Bpp) {
+            put_pixel(p, color);
+        }
+    }
+
+    // conversion from and to packed 24 bits rows (image chunks, PNG)
+    static void pixels_from_packed24(uint8_t * dest, const uint8_t * src, size_t count) {
+        memcpy(dest, src, count * Bpp);
+    }
+
+    static void pixels_to_packed24(uint8_t * dest, const uint8_t * src, size_t count) {
+        memcpy(dest, src, count * Bpp);
+    }
+
+    // row of width pixels in packed 24 bits format
+    void set_row(size_t rownum, const uint8_t * data) {
+        pixels_from_packed24(this->data + this->rowsize * rownum, data, this->width);
     }
 
     int size() const {
@@ -758,6 +817,73 @@ private:
     }
 
 public:
+    // ROP kernels: raster operations are bitwise, so a row of pixels is
+    // processed as a byte span, one 64 bits word at a time (compiler turns
+    // these loops into vector code). Op functors are templated on the word
+    // type. backward is used for overlapping spans when target is after source.
+    template <typename Op>
+    static void rop_row(uint8_t * target, const uint8_t * source, size_t len, bool backward = false) {
+        Op op;
+        if (copies_source(op)) {
+            memmove(target, source, len);
+        }
+        else if (!backward) {
+            size_t i = 0;
+            for (; i + sizeof(drawable_word_t) <= len; i += sizeof(drawable_word_t)) {
+                drawable_word_t * t = reinterpret_cast<drawable_word_t *>(target + i);
+                *t = op(*t, *reinterpret_cast<const drawable_word_t *>(source + i));
+            }
+            for (; i < len; i++) {
+                target[i] = op(target[i], source[i]);
+            }
+        }
+        else {
+            size_t i = len;
+            for (; i >= sizeof(drawable_word_t); i -= sizeof(drawable_word_t)) {
+                drawable_word_t * t = reinterpret_cast<drawable_word_t *>(target + i - sizeof(drawable_word_t));
+                *t = op(*t, *reinterpret_cast<const drawable_word_t *>(source + i - sizeof(drawable_word_t)));
+            }
+            for (; i > 0; i--) {
+                target[i - 1] = op(target[i - 1], source[i - 1]);
+            }
+        }
+    }
+
+    template <typename Op>
+    static void rop3_row(uint8_t * target, const uint8_t * source, const uint8_t * pattern, size_t len) {
+        Op op;
+        size_t i = 0;
+        for (; i + sizeof(drawable_word_t) <= len; i += sizeof(drawable_word_t)) {
+            drawable_word_t * t = reinterpret_cast<drawable_word_t *>(target + i);
+            *t = op(*t, *reinterpret_cast<const drawable_word_t *>(source + i),
+                    *reinterpret_cast<const drawable_word_t *>(pattern + i));
+        }
+        for (; i < len; i++) {
+            target[i] = op(target[i], source[i], pattern[i]);
+        }
+    }
+
+    // decode cx pixels of a bitmap row to drawable pixel format
+    static void decode_bitmap_row(uint8_t * target, const uint8_t * source, int cx, const Bitmap & bmp,
+                                  const uint32_t xormask, const bool bgr) {
+        const uint8_t Bpp = ::nbbytes(bmp.original_bpp);
+        if ((bmp.original_bpp == 24) && !xormask && !bgr) {
+            pixels_from_packed24(target, source, cx);
+            return;
+        }
+        for (int x = 0; x < cx ; x++, target += Drawable::Bpp, source += Bpp) {
+            uint32_t px = source[Bpp-1];
+            for (int b = 1 ; b < Bpp ; b++) {
+                px = (px << 8) + source[Bpp-1-b];
+            }
+            uint32_t color = xormask ^ color_decode(px, bmp.original_bpp, bmp.original_palette);
+            if (bgr) {
+                color = ((color << 16) & 0xFF0000) | (color & 0xFF00) |((color >> 16) & 0xFF);
+            }
+            put_pixel(target, color);
+        }
+    }
+
     /*
      * The name doesn't say it : mem_blt COPIES a decoded bitmap from
      * a cache (data) and insert a subpart (srcx, srcy) to the local
@@ -783,23 +909,10 @@ public:
         const uint8_t Bpp = ::nbbytes(bmp.original_bpp);
         uint8_t * target = this->first_pixel(trect);
         const uint8_t * source = bmp.data() + (bmp.cy - srcy - 1) * (bmp.bmp_size / bmp.cy) + srcx * Bpp;
-        int steptarget = (this->width - trect.cx) * 3;
-        int stepsource = (bmp.bmp_size / bmp.cy) + trect.cx * Bpp;
-
-        for (int y = 0; y < trect.cy ; y++, target += steptarget, source -= stepsource) {
-            for (int x = 0; x < trect.cx ; x++, target += 3, source += Bpp) {
-                uint32_t px = source[Bpp-1];
-                for (int b = 1 ; b < Bpp ; b++) {
-                    px = (px << 8) + source[Bpp-1-b];
-                }
-                uint32_t color = xormask ^ color_decode(px, bmp.original_bpp, bmp.original_palette);
-                if (bgr) {
-                    color = ((color << 16) & 0xFF0000) | (color & 0xFF00) |((color >> 16) & 0xFF);
-                }
-                target[0] = color;
-                target[1] = color >> 8;
-                target[2] = color >> 16;
-            }
+        const size_t stepsource = bmp.bmp_size / bmp.cy;
+
+        for (int y = 0; y < trect.cy ; y++, target += this->rowsize, source -= stepsource) {
+            decode_bitmap_row(target, source, trect.cx, bmp, xormask, bgr);
         }
         this->update_id += 1;
     }
@@ -810,8 +923,6 @@ public:
                   , const uint16_t srcx
                   , const uint16_t srcy
                   , const bool bgr) {
-        Op op;
-
         if (bmp.cx < srcx || bmp.cy < srcy) {
             return ;
         }
@@ -834,31 +945,12 @@ public:
         uint8_t       * target = this->first_pixel(trect);
         const uint8_t * source = bmp.data() + (bmp.cy - srcy - 1) * (bmp.bmp_size / bmp.cy) +
             srcx * Bpp;
+        const size_t stepsource = bmp.bmp_size / bmp.cy;
+        const size_t line_size  = trect.cx * this->Bpp;
 
-        int steptarget = (this->width - trect.cx) * 3;
-        int stepsource = (bmp.bmp_size / bmp.cy) + trect.cx * Bpp;
-
-        uint8_t s0, s1, s2;
-
-        for (int y = 0; y < trect.cy ; y++, target += steptarget, source -= stepsource) {
-            for (int x = 0; x < trect.cx ; x++, target += 3, source += Bpp) {
-                uint32_t px = source[Bpp-1];
-                for (int b = 1 ; b < Bpp ; b++) {
-                    px = (px << 8) + source[Bpp-1-b];
-                }
-                uint32_t color = color_decode(px, bmp.original_bpp, bmp.original_palette);
-                if (bgr) {
-                    color = ((color << 16) & 0xFF0000) | (color & 0xFF00) |((color >> 16) & 0xFF);
-                }
-
-                s0 = color         & 0xFF;
-                s1 = (color >> 8 ) & 0xFF;
-                s2 = (color >> 16) & 0xFF;
-
-                target[0] = op(target[0], s0);
-                target[1] = op(target[1], s1);
-                target[2] = op(target[2], s2);
-            }
+        for (int y = 0; y < trect.cy ; y++, target += this->rowsize, source -= stepsource) {
+            decode_bitmap_row(this->scratch, source, trect.cx, bmp, 0, bgr);
+            rop_row<Op>(target, this->scratch, line_size);
         }
         this->update_id += 1;
     }
@@ -928,34 +1020,20 @@ public:
             this->tracked_area_changed = true;
         }
 
-        const uint8_t   Bpp    = ::nbbytes(bmp.original_bpp);
         uint8_t       * target = this->first_pixel(trect);
         const uint8_t * source = bmp.data() + (bmp.cy - 1) * (bmp.bmp_size / bmp.cy);
+        const size_t stepsource = bmp.bmp_size / bmp.cy;
 
-        int steptarget = (this->width - trect.cx) * 3;
-        int stepsource = (bmp.bmp_size / bmp.cy) + trect.cx * Bpp;
-
-        for (int y = 0; y < trect.cy; y++, target += steptarget, source -= stepsource) {
-            for (int x = 0; x < trect.cx; x++, target += 3, source += Bpp) {
-                uint32_t px = source[Bpp - 1];
-                for (int b = 1; b < Bpp; b++) {
-                    px = (px << 8) + source[Bpp - 1 - b];
-                }
-                uint32_t color = color_decode(px, bmp.original_bpp, bmp.original_palette);
-                if (bgr) {
-                    color = ((color << 16) & 0xFF0000) | (color & 0xFF00) |((color >> 16) & 0xFF);
-                }
-                target[0] = color      ;
-                target[1] = color >> 8 ;
-                target[2] = color >> 16;
-            }
+        for (int y = 0; y < trect.cy; y++, target += this->rowsize, source -= stepsource) {
+            decode_bitmap_row(target, source, trect.cx, bmp, 0, bgr);
         }
         this->update_id += 1;
     }
 
     struct Op_0xB8
     {
-        uint8_t operator()(uint8_t target, uint8_t source, uint8_t pattern)
+        template <typename T>
+        T operator()(T target, T source, T pattern) const
         {
             return ((target ^ pattern) & source) ^ pattern;
         }
@@ -968,8 +1046,6 @@ public:
                    , const uint16_t srcy
                    , const uint32_t pattern_color
                    , const bool bgr) {
-        Op op;
-
         if (bmp.cx < srcx || bmp.cy < srcy) {
             return;
         }
@@ -992,38 +1068,16 @@ public:
         uint8_t *       target = this->first_pixel(trect);
         const uint8_t * source = bmp.data() + (bmp.cy - srcy - 1) * (bmp.bmp_size / bmp.cy) +
             srcx * Bpp;
+        const size_t stepsource = bmp.bmp_size / bmp.cy;
+        const size_t line_size  = trect.cx * this->Bpp;
 
-        int steptarget = (this->width - trect.cx) * 3;
-        int stepsource = (bmp.bmp_size / bmp.cy) + trect.cx * Bpp;
-
-        uint8_t s0, s1, s2;
-        uint8_t p0, p1, p2;
-
-        for (int y = 0; y < trect.cy ; y++, target += steptarget, source -= stepsource) {
-            for (int x = 0; x < trect.cx ; x++, target += 3, source += Bpp) {
-                uint32_t px = source[Bpp-1];
-                for (int b = 1 ; b < Bpp ; b++) {
-                    px = (px << 8) + source[Bpp-1-b];
-                }
-                uint32_t color = color_decode(px, bmp.original_bpp, bmp.original_palette);
-                if (bgr) {
-                    color =   ((color << 16) & 0xFF0000)
-                            | ( color        & 0xFF00)
-                            | ((color >> 16) & 0xFF);
-                }
-
-                s0 = color         & 0xFF;
-                s1 = (color >> 8 ) & 0xFF;
-                s2 = (color >> 16) & 0xFF;
-
-                p0 = pattern_color         & 0xFF;
-                p1 = (pattern_color >> 8 ) & 0xFF;
-                p2 = (pattern_color >> 16) & 0xFF;
+        uint8_t * const decoded = this->scratch;
+        uint8_t * const pattern = this->scratch + this->rowsize;
+        fill_pixels(pattern, pattern_color, trect.cx);
 
-                target[0] = op(target[0], s0, p0);
-                target[1] = op(target[1], s1, p1);
-                target[2] = op(target[2], s2, p2);
-            }
+        for (int y = 0; y < trect.cy ; y++, target += this->rowsize, source -= stepsource) {
+            decode_bitmap_row(decoded, source, trect.cx, bmp, 0, bgr);
+            rop3_row<Op>(target, decoded, pattern, line_size);
         }
         this->update_id += 1;
     }
@@ -1093,12 +1147,8 @@ public:
 
         uint8_t * p = this->first_pixel(trect);
         const size_t rect_rowsize = trect.cx * this->Bpp;
-        const size_t step = this->rowsize - rect_rowsize;
-        for (int j = 0; j < trect.cy ; j++, p += step) {
-            for (int i = 0; i < trect.cx ; i++, p += 3) {
-                TODO("Applying inversion on blocks of 32 bits instead of bytes should be faster");
-                p[0] ^= 0xFF; p[1] ^= 0xFF; p[2] ^= 0xFF;
-            }
+        for (int j = 0; j < trect.cy ; j++, p += this->rowsize) {
+            rop_row<Op2_0x06>(p, p, rect_rowsize);
         }
         this->update_id += 1;
     }
@@ -1113,70 +1163,80 @@ public:
 
     struct Op2_0x01 // R2_BLACK 0
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
-            return 0x00;
+            return T(0);
         }
     };
     struct Op2_0x02 // R2_NOTMERGEPEN DPon
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~(target | source);
         }
     };
     struct Op2_0x03 // R2_MASKNOTPEN DPna
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return (target & ~source);
         }
     };
     struct Op2_0x04 // R2_NOTCOPYPEN Pn
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~source;
         }
     };
     struct Op2_0x05 // R2_MASKPENNOT PDna
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return (source & ~target);
         }
     };
     struct Op2_0x06 // R2_NOT Dn
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~target;
         }
     };
     struct Op2_0x07 // R2_XORPEN DPx
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return (target ^ source);
         }
     };
     struct Op2_0x08 // R2_NOTMASKPEN DPan
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~(target & source);
         }
     };
     struct Op2_0x09 // R2_MASKPEN DPa
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return (target & source);
         }
     };
     struct Op2_0x0A // R2_NOTXORPEN DPxn
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~(target ^ source);
         }
@@ -1190,37 +1250,42 @@ public:
     // };
     struct Op2_0x0C // R2_MERGENOTPEN DPno
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return (target | ~source);
         }
     };
     struct Op2_0x0D // R2_COPYPEN P
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return source;
         }
     };
     struct Op2_0x0E // R2_MERGEPENNOT PDno
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return (source | ~target);
         }
     };
     struct Op2_0x0F // R2_MERGEPEN PDo
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return (target | source);
         }
     };
     struct Op2_0x10 // R2_WHITE 1
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
-            return 0xFF;
+            return ~T(0);
         }
     };
 
@@ -1385,7 +1450,9 @@ private:
             return;
         }
         uint8_t * p = this->data + this->pos_xy(x, y);
-        p[0] = op2(p[0], color); p[1] = op2(p[1], color >> 8); p[2] = op2(p[2], color >> 16);
+        p[0] = op2(p[0], static_cast<uint8_t>(color));
+        p[1] = op2(p[1], static_cast<uint8_t>(color >> 8));
+        p[2] = op2(p[2], static_cast<uint8_t>(color >> 16));
         // this->bRop2(p, color);
     }
 
@@ -1404,11 +1471,11 @@ private:
         }
         uint8_t * p = this->data + this->pos_xy(x, y);
         for (int i = 0; i < l; i++) {
-            p[0] = op2(p[0], color);
-            p[1] = op2(p[1], color >> 8);
-            p[2] = op2(p[2], color >> 16);
+            p[0] = op2(p[0], static_cast<uint8_t>(color));
+            p[1] = op2(p[1], static_cast<uint8_t>(color >> 8));
+            p[2] = op2(p[2], static_cast<uint8_t>(color >> 16));
             // this->bRop2(p, color);
-            p += 3;
+            p += this->Bpp;
         }
     }
 
@@ -1422,12 +1489,8 @@ public:
             this->tracked_area_changed = true;
         }
         uint8_t * const base = this->first_pixel(rect);
-        uint8_t * p = base;
+        fill_pixels(base, color, rect.cx);
 
-        for (size_t x = 0; x < static_cast<size_t>(rect.cx) ; x++) {
-            p[0] = color; p[1] = color >> 8; p[2] = color >> 16;
-            p += 3;
-        }
         uint8_t * target = base;
         size_t line_size = rect.cx * this->Bpp;
         for (size_t y = 1; y < static_cast<size_t>(rect.cy) ; y++) {
@@ -1440,33 +1503,25 @@ public:
     template <typename Op>
     void patblt_op(const Rect & rect, const uint32_t color)
     {
-        Op op;
 
         if (this->tracked_area.has_intersection(rect)) {
             this->tracked_area_changed = true;
         }
 
-        uint8_t * const base = this->first_pixel(rect);
-        uint8_t * p = base;
-        uint8_t p0 = color & 0xFF;
-        uint8_t p1 = (color >> 8) & 0xFF;
-        uint8_t p2 = (color >> 16) & 0xFF;
-
-        for (size_t y = 0; y < static_cast<size_t>(rect.cy) ; y++) {
-            p = base + this->rowsize * y;
-            for (size_t x = 0; x < static_cast<size_t>(rect.cx) ; x++) {
-                p[0] = op(p[0], p0);
-                p[1] = op(p[1], p1);
-                p[2] = op(p[2], p2);
-                p += 3;
-            }
+        uint8_t * p = this->first_pixel(rect);
+        const size_t line_size = rect.cx * this->Bpp;
+
+        fill_pixels(this->scratch, color, rect.cx);
+        for (size_t y = 0; y < static_cast<size_t>(rect.cy) ; y++, p += this->rowsize) {
+            rop_row<Op>(p, this->scratch, line_size);
         }
         this->update_id++;
     }
 
     struct Op_0x05
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~(target | source);
         }
@@ -1474,7 +1529,8 @@ public:
 
     struct Op_0x0F
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~source;
         }
@@ -1482,7 +1538,8 @@ public:
 
     struct Op_0x50
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~target & source;
         }
@@ -1490,7 +1547,8 @@ public:
 
     struct Op_0x5A
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return target ^ source;
         }
@@ -1498,7 +1556,8 @@ public:
 
     struct Op_0x5F
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~(target & source);
         }
@@ -1506,7 +1565,8 @@ public:
 
     struct Op_0xA0
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return target & source;
         }
@@ -1514,7 +1574,8 @@ public:
 
     struct Op_0xA5
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~(target ^ source);
         }
@@ -1522,16 +1583,17 @@ public:
 
     struct Op_0xAF
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return target | ~source;
         }
     };
 
-    TODO("This one is a memset and should be simplified");
     struct Op_0xF0
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return source;
         }
@@ -1539,7 +1601,8 @@ public:
 
     struct Op_0xF5
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~target | source;
         }
@@ -1547,7 +1610,8 @@ public:
 
     struct Op_0xFA
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return target | source;
         }
@@ -1672,44 +1736,54 @@ public:
     void patblt_op_ex(const Rect & rect, const uint8_t * brush_data,
         const uint32_t back_color, const uint32_t fore_color)
     {
-        Op op;
-
         if (this->tracked_area.has_intersection(rect)) {
             this->tracked_area_changed = true;
         }
 
-        uint8_t * const base = this->first_pixel(rect);
-        uint8_t *       p    = base;
-
-        uint8_t p0;
-        uint8_t p1;
-        uint8_t p2;
+        uint8_t * p = this->first_pixel(rect);
+        const size_t line_size = rect.cx * this->Bpp;
 
-        for (size_t y = 0; y < static_cast<size_t>(rect.cy) ; y++)
-        {
-            p = base + this->rowsize * y;
-            for (size_t x = 0; x < static_cast<size_t>(rect.cx) ; x++)
-            {
-                if (brush_data[(y + rect.y) % 8] & (1 << ((x + rect.x) % 8)))
-                {
-                    p0 = back_color         & 0xFF;
-                    p1 = (back_color >> 8)  & 0xFF;
-                    p2 = (back_color >> 16) & 0xFF;
-                }
-                else
-                {
-                    p0 = fore_color         & 0xFF;
-                    p1 = (fore_color >> 8)  & 0xFF;
-                    p2 = (fore_color >> 16) & 0xFF;
-                }
+        const uint8_t * const pattern = this->expand_brush(brush_data, back_color, fore_color)
+                                       + rect.x * this->Bpp;
+        for (size_t y = 0; y < static_cast<size_t>(rect.cy) ; y++, p += this->rowsize) {
+            rop_row<Op>(p, pattern + ((y + rect.y) % 8) * this->rowsize, line_size);
+        }
+        this->update_id++;
+    }
 
-                p[0] = op(p[0], p0);
-                p[1] = op(p[1], p1);
-                p[2] = op(p[2], p2);
-                p += 3;
+    // Pixel (x, y) of a monochrome 8x8 brush pattern is at
+    // brush_rows + (y % 8) * rowsize + x * Bpp.
+    const uint8_t * expand_brush(const uint8_t * brush_data,
+        const uint32_t back_color, const uint32_t fore_color)
+    {
+        if (  this->brush_expanded
+           && (this->brush_back_color == back_color)
+           && (this->brush_fore_color == fore_color)
+           && !memcmp(this->brush_key, brush_data, sizeof(this->brush_key))) {
+            return this->brush_rows;
+        }
+
+        const size_t line_size = this->width * this->Bpp;
+        for (size_t y = 0; y < 8 ; y++) {
+            // pattern is periodic: 8 pixels are computed, then stored over
+            // the whole row with fixed size copies
+            uint8_t unit[8 * Bpp];
+            for (size_t x = 0; x < 8 ; x++) {
+                put_pixel(unit + x * this->Bpp, (brush_data[y] & (1 << x)) ? back_color : fore_color);
+            }
+            uint8_t * const row = this->brush_rows + y * this->rowsize;
+            size_t i = 0;
+            for (; i + sizeof(unit) <= line_size; i += sizeof(unit)) {
+                memcpy(row + i, unit, sizeof(unit));
             }
+            memcpy(row + i, unit, line_size - i);
         }
-        this->update_id++;
+
+        memcpy(this->brush_key, brush_data, sizeof(this->brush_key));
+        this->brush_back_color = back_color;
+        this->brush_fore_color = fore_color;
+        this->brush_expanded   = true;
+        return this->brush_rows;
     }
 
     void patblt_ex(const Rect & rect, const uint8_t rop,
@@ -1761,7 +1835,8 @@ public:
 
     struct Op_0x11
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~(target | ~source);
         }
@@ -1769,7 +1844,8 @@ public:
 
     struct Op_0x22
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return target & ~source;
         }
@@ -1777,7 +1853,8 @@ public:
 
     struct Op_0x33
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             TODO("The templated function can be optimize in the case the target is not read.");
             (void)target;
@@ -1787,7 +1864,8 @@ public:
 
     struct Op_0x44
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~target & source;
         }
@@ -1795,7 +1873,8 @@ public:
 
     struct Op_0x66
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return target ^ source;
         }
@@ -1803,7 +1882,8 @@ public:
 
     struct Op_0x77
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~(target & source);
         }
@@ -1811,7 +1891,8 @@ public:
 
     struct Op_0x88
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return target & source;
         }
@@ -1819,7 +1900,8 @@ public:
 
     struct Op_0x99
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~(target ^ source);
         }
@@ -1827,7 +1909,8 @@ public:
 
     struct Op_0xBB
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return target | ~source;
         }
@@ -1835,17 +1918,24 @@ public:
 
     struct Op_0xCC
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
-            TODO("The templated function can be optimized because in the case the target is not read. See commented code in src_blt (and add performance benchmark)");
             (void)target;
             return source;
         }
     };
 
+    // copy operations do not read target, rop_row() uses memmove for them
+    template <typename Op>
+    static bool copies_source(const Op &) { return false; }
+    static bool copies_source(const Op_0xCC &) { return true; }
+    static bool copies_source(const Op_0xF0 &) { return true; }
+
     struct Op_0xDD
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return ~target | source;
         }
@@ -1853,7 +1943,8 @@ public:
 
     struct Op_0xEE
     {
-        uint8_t operator()(uint8_t target, uint8_t source)
+        template <typename T>
+        T operator()(T target, T source) const
         {
             return target | source;
         }
@@ -1862,8 +1953,6 @@ public:
     template <typename Op>
     void scr_blt_op(uint16_t srcx, uint16_t srcy, const Rect drect)
     {
-        Op op;
-
         if (this->tracked_area.has_intersection(drect)) {
             this->tracked_area_changed = true;
         }
@@ -1881,18 +1970,11 @@ public:
         const signed int to_nextrow = static_cast<signed int>(((deltay >= 0)||overlap.isempty())
         ?  this->rowsize
         : -this->rowsize);
-        const signed to_nextpixel = ((deltay != 0)||(deltax >= 0))?this->Bpp:-this->Bpp;
-        const unsigned offset = static_cast<unsigned>(((deltay != 0)||(deltax >= 0))?0:this->Bpp*(drect.cx - 1));
+        // same row, source on the left: copy from right to left
+        const bool backward = ((deltay == 0) && (deltax < 0));
+        const size_t line_size = drect.cx * this->Bpp;
         for (size_t y = 0; y < drect.cy ; y++) {
-            uint8_t * linetarget = target + offset;
-            uint8_t * linesource = source + offset;
-            for (size_t x = 0; x < drect.cx ; x++) {
-                for (uint8_t b = 0 ; b < this->Bpp; b++) {
-                    linetarget[b] = op(linetarget[b], linesource[b]);
-                }
-                linetarget += to_nextpixel;
-                linesource += to_nextpixel;
-            }
+            rop_row<Op>(target, source, line_size, backward);
             target += to_nextrow;
             source += to_nextrow;
         }
@@ -2047,8 +2129,8 @@ public:
         int err = dx - dy;
 
         while (true) {
-            uint8_t * const p = this->data + (y * this->width + x) * this->Bpp;
-            for (uint8_t b = 0 ; b < this->Bpp; b++) {
+            uint8_t * const p = this->first_pixel(x, y);
+            for (uint8_t b = 0 ; b < 3; b++) {
                 switch (rop)
                     {
                     case 0x06:  // R2_NOT
@@ -2087,7 +2169,7 @@ public:
             , static_cast<uint8_t>(color >> 16)
         };
 
-        uint8_t * p = this->data + (starty * this->width + x) * 3;
+        uint8_t * p = this->first_pixel(x, starty);
         for (int dy = starty; dy <= endy ; dy++) {
             switch (rop)
             {
@@ -2102,7 +2184,7 @@ public:
                 p[2] = col[2];
                 break;
             }
-            p += this->width * 3;
+            p += this->rowsize;
         }
         this->update_id++;
     }
@@ -2115,7 +2197,7 @@ public:
             , static_cast<uint8_t>(color >> 16)
         };
 
-        uint8_t * p = this->data + (y * this->width + startx) * 3;
+        uint8_t * p = this->first_pixel(startx, y);
         for (int dx = startx; dx <= endx ; dx++) {
             switch (rop)
             {
@@ -2130,7 +2212,7 @@ public:
                 p[2] = col[2];
                 break;
             }
-            p += 3;
+            p += this->Bpp;
         }
         this->update_id++;
     }
@@ -2148,6 +2230,7 @@ public:
         this->mouse_hotspot_y         = hotspot_y;
     }
 
+    // cursor lines and saved pixels are packed 24 bits
     void trace_mouse() {
         if (this->dont_show_mouse_cursor) {
             return;
@@ -2159,25 +2242,19 @@ public:
         int       x     = this->mouse_cursor_pos_x - this->mouse_hotspot_x;
         int       y     = this->mouse_cursor_pos_y - this->mouse_hotspot_y;
 
-        const uint8_t * data_end = this->data + this->height * this->width * 3;
+        const int pixel_count = this->width * this->height;
 
         for (size_t i = 0; i < this->contiguous_mouse_pixels; i++) {
-            uint8_t  * pixel_start = this->pixel_start_data(x, y, i);
-            unsigned   lg          = this->line_of_mouse(i).lg;
-            int offset = 0;
-            if (pixel_start + lg <= this->data) continue;
-            if (pixel_start < this->data) {
-                offset = this->data - pixel_start;
-                lg -= offset;
-                pixel_start = this->data;
-            }
-            if (pixel_start > data_end) break;
-            if (pixel_start + lg >= data_end) {
-                lg = data_end - pixel_start;
+            const Mouse_t & line = this->line_of_mouse(i);
+            const int start = this->pixel_index(x, y, i);
+            if (start >= pixel_count) break;
+            for (int n = 0; n < line.lg / 3; n++) {
+                if ((start + n < 0) || (start + n >= pixel_count)) continue;
+                uint8_t * p = this->first_pixel((start + n) % this->width, (start + n) / this->width);
+                memcpy(psave, p, 3);
+                psave += 3;
+                memcpy(p, line.line + n * 3, 3);
             }
-            memcpy(psave, pixel_start, lg);
-            psave += lg;
-            memcpy(pixel_start, this->line_of_mouse(i).line + offset, lg);
         }
     }
 
@@ -2186,33 +2263,45 @@ public:
             return;
         }
 
-        uint8_t * psave = this->save_mouse;
-        int       x     = this->save_mouse_x - this->mouse_hotspot_x;
-        int       y     = this->save_mouse_y - this->mouse_hotspot_y;
+        const uint8_t * psave = this->save_mouse;
+        int             x     = this->save_mouse_x - this->mouse_hotspot_x;
+        int             y     = this->save_mouse_y - this->mouse_hotspot_y;
 
-        const uint8_t * data_end = this->data + this->height * this->width * 3;
+        const int pixel_count = this->width * this->height;
 
         for (size_t i = 0; i < this->contiguous_mouse_pixels; i++) {
-            uint8_t  * pixel_start = this->pixel_start_data(x, y, i);
-            unsigned   lg          = this->line_of_mouse(i).lg;
-            if (pixel_start + lg <= this->data) continue;
-            if (pixel_start < this->data) {
-                lg -= this->data - pixel_start;
-                pixel_start = this->data;
-            }
-            if (pixel_start > data_end) break;
-            if (pixel_start + lg >= data_end) {
-                lg = data_end - pixel_start;
+            const Mouse_t & line = this->line_of_mouse(i);
+            const int start = this->pixel_index(x, y, i);
+            if (start >= pixel_count) break;
+            for (int n = 0; n < line.lg / 3; n++) {
+                if ((start + n < 0) || (start + n >= pixel_count)) continue;
+                uint8_t * p = this->first_pixel((start + n) % this->width, (start + n) / this->width);
+                memcpy(p, psave, 3);
+                psave += 3;
             }
-            memcpy(pixel_start, psave, lg);
-            psave += lg;
         }
     }
 
 protected:
-    uint8_t * pixel_start_data(int x, int y, size_t i) {
-        return this->data +
-               ((this->line_of_mouse(i).y + y) * this->width + this->line_of_mouse(i).x + x) * 3;
+    // index of first pixel of cursor line i (cursor lines crossing right edge wrap to next row)
+    int pixel_index(int x, int y, size_t i) {
+        return (this->line_of_mouse(i).y + y) * this->width + this->line_of_mouse(i).x + x;
+    }
+
+    // copy timestamp area lines between drawable and packed 24 bits buffer
+    void save_timestamp_area(uint8_t * tsave, uint8_t * buf, const uint8_t * tdata, size_t length) {
+        for (size_t y = 0; y < ts_height ; ++y, buf += this->rowsize) {
+            pixels_to_packed24(tsave, buf, length * char_width);
+            tsave += length * char_width * 3;
+            pixels_from_packed24(buf, tdata + y * ts_width * 3, length * char_width);
+        }
+    }
+
+    void restore_timestamp_area(const uint8_t * tsave, uint8_t * buf, size_t length) {
+        for (size_t y = 0; y < ts_height ; ++y, buf += this->rowsize) {
+            pixels_from_packed24(buf, tsave, length * char_width);
+            tsave += length * char_width * 3;
+        }
     }
 
 public:
@@ -2235,25 +2324,12 @@ public:
         memcpy(this->previous_timestamp, rawdate, size_str_timestamp);
         this->previous_timestamp_length = timestamp_length;
 
-        uint8_t * tsave = this->timestamp_save;
-        uint8_t* buf = this->data;
-        int step = this->width * 3;
-        for (size_t y = 0; y < ts_height ; ++y, buf += step) {
-            memcpy(tsave, buf, timestamp_length*char_width*3);
-            tsave += timestamp_length*char_width*3;
-            memcpy(buf, this->timestamp_data + y*ts_width*3, timestamp_length*char_width*3);
-        }
+        this->save_timestamp_area(this->timestamp_save, this->data, this->timestamp_data, timestamp_length);
     }
 
     void clear_timestamp()
     {
-        const uint8_t * tsave = this->timestamp_save;
-        int step = this->width * 3;
-        uint8_t* buf = this->data;
-        for (size_t y = 0; y < ts_height ; ++y, buf += step) {
-            memcpy(buf, tsave, this->previous_timestamp_length*char_width*3);
-            tsave += this->previous_timestamp_length*char_width*3;
-        }
+        this->restore_timestamp_area(this->timestamp_save, this->data, this->previous_timestamp_length);
     }
 
     TODO("Instead of copying the trace timestamp function (un clear timestamp) for pause, "
@@ -2277,29 +2353,14 @@ public:
         memcpy(this->previous_timestamp, rawdate, size_str_timestamp);
         this->previous_timestamp_length = timestamp_length;
 
-        uint8_t * tsave = this->timestamp_save;
-        uint8_t* buf = this->data
-            + (this->width * 3) * (this->height / 2)
-            + ((this->width - timestamp_length*char_width)*3) / 2 ;
-        int step = this->width * 3;
-        for (size_t y = 0; y < ts_height ; ++y, buf += step) {
-            memcpy(tsave, buf, timestamp_length*char_width*3);
-            tsave += timestamp_length*char_width*3;
-            memcpy(buf, this->timestamp_data + y*ts_width*3, timestamp_length*char_width*3);
-        }
+        uint8_t* buf = this->first_pixel((this->width - timestamp_length*char_width) / 2, this->height / 2);
+        this->save_timestamp_area(this->timestamp_save, buf, this->timestamp_data, timestamp_length);
     }
 
     void clear_pausetimestamp()
     {
-        const uint8_t * tsave = this->timestamp_save;
-        int step = this->width * 3;
-        uint8_t* buf = this->data
-            + (this->width * 3) * (this->height / 2)
-            + ((this->width - this->previous_timestamp_length*char_width)*3) / 2 ;
-        for (size_t y = 0; y < ts_height ; ++y, buf += step) {
-            memcpy(buf, tsave, this->previous_timestamp_length*char_width*3);
-            tsave += this->previous_timestamp_length*char_width*3;
-        }
+        uint8_t* buf = this->first_pixel((this->width - this->previous_timestamp_length*char_width) / 2, this->height / 2);
+        this->restore_timestamp_area(this->timestamp_save, buf, this->previous_timestamp_length);
     }
 };
 
@@ -27,6 +27,7 @@
 #include <arpa/inet.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/tcp.h>
 #include <signal.h>
 #include <stddef.h>
@@ -172,4 +173,39 @@ static inline int ip_connect(const char* ip, int port,
     return sck;
 }
 
+// Creates a non blocking listening UNIX socket at path (replacing any stale
+// socket file), returns -1 on failure
+static inline int local_listen(const char * path)
+{
+    union
+    {
+      struct sockaddr s;
+      struct sockaddr_un su;
+    } u;
+
+    if (strlen(path) >= sizeof(u.su.sun_path)) {
+        LOG(LOG_ERR, "socket path too long: %s", path);
+        return -1;
+    }
+
+    int sck = socket(PF_UNIX, SOCK_STREAM, 0);
+    if (sck < 0) {
+        LOG(LOG_ERR, "socket failed with errno = %d (%s)", errno, strerror(errno));
+        return -1;
+    }
+
+    memset(&u, 0, sizeof(u));
+    u.su.sun_family = AF_UNIX;
+    strcpy(u.su.sun_path, path);
+    unlink(path);
+
+    if ((-1 == bind(sck, &u.s, sizeof(u.su))) || (-1 == listen(sck, 2))) {
+        LOG(LOG_ERR, "listening on %s failed with errno = %d (%s)", path, errno, strerror(errno));
+        close(sck);
+        return -1;
+    }
+    fcntl(sck, F_SETFL, fcntl(sck, F_GETFL) | O_NONBLOCK);
+    return sck;
+}
+
 #endif
@@ -0,0 +1,265 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Scoped hot path timers: cycles (rdtsc) spent in a phase are recorded in a
+   per phase histogram with power of two buckets.
+
+   Compiled out unless PHASE_TIMERS is defined (PHASE_TIMERS=1 bjam ...):
+   PHASE_TIMER(), PHASE_TIMERS_MERGE(), PHASE_TIMERS_DUMP() and
+   PHASE_TIMERS_CHECK_DUMP_REQUEST() then expand to nothing. Histograms are logged at session end and when
+   the session process receives SIGUSR2.
+*/
+
+#ifndef _REDEMPTION_UTILS_PHASE_TIMER_HPP_
+#define _REDEMPTION_UTILS_PHASE_TIMER_HPP_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+
+#include <algorithm>
+
+#include "log.hpp"
+#include "rdtsc.hpp"
+#include "difftimeval.hpp"
+
+enum PhaseId {
+    PHASE_FRONT_INCOMING,
+    PHASE_MOD_RDP_DRAW_EVENT,
+    PHASE_RDP_ORDERS_PROCESS_ORDERS,
+    PHASE_BITMAP_COMPRESS,
+    PHASE_MPPC_COMPRESS,
+    PHASE_GRAPHIC_TO_FILE_FLUSH,
+    PHASE_PNG_ENCODE,
+
+    PHASE_COUNT
+};
+
+static inline const char * phase_name(unsigned phase) {
+    static const char * names[PHASE_COUNT] = {
+        "Front::incoming",
+        "mod_rdp::draw_event",
+        "rdp_orders::process_orders",
+        "Bitmap::compress",
+        "MPPC compress",
+        "GraphicToFile flush",
+        "PNG encode"
+    };
+    return (phase < PHASE_COUNT) ? names[phase] : "unknown";
+}
+
+struct PhaseHistogram {
+    enum {
+        BUCKET_COUNT = 64   // bucket i: [2^i, 2^(i+1)) cycles
+    };
+
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint64_t buckets[BUCKET_COUNT];
+
+    PhaseHistogram() {
+        this->reset();
+    }
+
+    void reset() {
+        ::memset(this, 0, sizeof(*this));
+    }
+
+    void add(uint64_t cycles) {
+        this->count++;
+        this->total += cycles;
+        if (cycles > this->max) {
+            this->max = cycles;
+        }
+        this->buckets[63 - __builtin_clzll(cycles | 1)]++;
+    }
+
+    // adds samples recorded elsewhere (e.g. by worker threads)
+    void merge(const PhaseHistogram & other) {
+        this->count += other.count;
+        this->total += other.total;
+        if (other.max > this->max) {
+            this->max = other.max;
+        }
+        for (unsigned i = 0; i < BUCKET_COUNT; i++) {
+            this->buckets[i] += other.buckets[i];
+        }
+    }
+
+    // upper bound of bucket holding the given percentile (0 if empty)
+    uint64_t percentile(unsigned percent) const {
+        if (!this->count) {
+            return 0;
+        }
+        const uint64_t rank = (this->count * percent + 99) / 100;
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < BUCKET_COUNT; i++) {
+            seen += this->buckets[i];
+            if (seen >= rank) {
+                return (i < 63) ? (uint64_t(2) << i) : this->max;
+            }
+        }
+        return this->max;
+    }
+};
+
+class PhaseTimers {
+    PhaseHistogram histograms[PHASE_COUNT];
+
+    // cycles to time conversion, measured between first use and dump
+    uint64_t start_cycles;
+    uint64_t start_usec;
+
+public:
+    PhaseTimers()
+    : start_cycles(rdtsc())
+    , start_usec(ustime())
+    {}
+
+    static PhaseTimers & instance() {
+        static PhaseTimers timers;
+        return timers;
+    }
+
+    static volatile sig_atomic_t & dump_requested() {
+        static volatile sig_atomic_t requested = 0;
+        return requested;
+    }
+
+    PhaseHistogram & histogram(unsigned phase) {
+        return this->histograms[phase];
+    }
+
+    void reset() {
+        for (unsigned i = 0; i < PHASE_COUNT; i++) {
+            this->histograms[i].reset();
+        }
+        this->start_cycles = rdtsc();
+        this->start_usec   = ustime();
+    }
+
+    // cycles per microsecond (0 if not measurable yet)
+    uint64_t cycles_per_usec() const {
+        const uint64_t usec = ustime() - this->start_usec;
+        return usec ? (rdtsc() - this->start_cycles) / usec : 0;
+    }
+
+    enum {
+        // longest format() line: name (< 32) and header text with 6 counters
+        // (< 160), then 64 buckets " 2^NN:" followed by up to 20 digits
+        FORMAT_SIZE = 32 + 160 + PhaseHistogram::BUCKET_COUNT * 26 + 1
+    };
+
+    // one line: "name: count=N mean=C max=C p50<=C p90<=C p99<=C cycles [buckets 2^i:n ...]",
+    // built whole then truncated to size, returns length copied in buffer
+    size_t format(unsigned phase, char * buffer, size_t size) const {
+        if (!size) {
+            return 0;
+        }
+
+        const PhaseHistogram & h = this->histograms[phase];
+        char line[FORMAT_SIZE];
+        int len = snprintf(line, sizeof(line),
+            "%s: count=%llu mean=%llu max=%llu p50<=%llu p90<=%llu p99<=%llu cycles, buckets",
+            phase_name(phase),
+            static_cast<unsigned long long>(h.count),
+            static_cast<unsigned long long>(h.count ? h.total / h.count : 0),
+            static_cast<unsigned long long>(h.max),
+            static_cast<unsigned long long>(h.percentile(50)),
+            static_cast<unsigned long long>(h.percentile(90)),
+            static_cast<unsigned long long>(h.percentile(99)));
+        for (unsigned i = 0; (i < PhaseHistogram::BUCKET_COUNT) && (len > 0); i++) {
+            if (h.buckets[i]) {
+                char bucket[32];
+                const int bucket_len = snprintf(bucket, sizeof(bucket), " 2^%u:%llu",
+                                                i, static_cast<unsigned long long>(h.buckets[i]));
+                if ((bucket_len < 0) || (len + bucket_len >= FORMAT_SIZE)) {
+                    break;
+                }
+                memcpy(line + len, bucket, bucket_len + 1);
+                len += bucket_len;
+            }
+        }
+
+        size_t copied = (len < 0) ? 0 : std::min<size_t>(len, sizeof(line) - 1);
+        if (copied >= size) {
+            copied = size - 1;
+        }
+        memcpy(buffer, line, copied);
+        buffer[copied] = 0;
+        return copied;
+    }
+
+    void dump(const char * reason) const {
+        LOG(LOG_INFO, "PhaseTimers: %s (%llu cycles/us)", reason,
+            static_cast<unsigned long long>(this->cycles_per_usec()));
+        char buffer[FORMAT_SIZE];
+        for (unsigned i = 0; i < PHASE_COUNT; i++) {
+            if (this->histograms[i].count) {
+                this->format(i, buffer, sizeof(buffer));
+                LOG(LOG_INFO, "PhaseTimers: %s", buffer);
+            }
+        }
+    }
+};
+
+class ScopedPhaseTimer {
+    PhaseHistogram & histogram;
+    uint64_t         start;
+
+public:
+    explicit ScopedPhaseTimer(unsigned phase)
+    : histogram(PhaseTimers::instance().histogram(phase))
+    , start(rdtsc())
+    {}
+
+    ~ScopedPhaseTimer() {
+        this->histogram.add(rdtsc() - this->start);
+    }
+};
+
+// SIGUSR2 handler: only raises a flag, dump is done by session loop
+static inline void phase_timers_sigusr2(int sig) {
+    PhaseTimers::dump_requested() = 1;
+}
+
+#define PHASE_TIMER_CONCAT_(a, b) a##b
+#define PHASE_TIMER_CONCAT(a, b) PHASE_TIMER_CONCAT_(a, b)
+
+#if defined(PHASE_TIMERS)
+# define PHASE_TIMER(phase) ScopedPhaseTimer PHASE_TIMER_CONCAT(phase_timer_, __LINE__)(phase)
+# define PHASE_TIMERS_MERGE(phase, other) PhaseTimers::instance().histogram(phase).merge(other)
+# define PHASE_TIMERS_DUMP(reason) PhaseTimers::instance().dump(reason)
+# define PHASE_TIMERS_CHECK_DUMP_REQUEST()                \
+    do {                                                  \
+        if (PhaseTimers::dump_requested()) {              \
+            PhaseTimers::dump_requested() = 0;            \
+            PhaseTimers::instance().dump("SIGUSR2");      \
+        }                                                 \
+    } while (0)
+#else
+# define PHASE_TIMER(phase)
+# define PHASE_TIMERS_MERGE(phase, other)
+# define PHASE_TIMERS_DUMP(reason)
+# define PHASE_TIMERS_CHECK_DUMP_REQUEST()
+#endif
+
+#endif
@@ -25,6 +25,7 @@
 #include <png.h>
 
 #include "transport.hpp"
+#include "phase_timer.hpp"
 
 static inline void png_write_data(png_structp png_ptr, png_bytep data, png_size_t length){
     ((Transport *)(png_ptr->io_ptr))->send(data, length);
@@ -40,6 +41,8 @@ static inline void transport_dump_png24(Transport * trans, const uint8_t * data,
                             const size_t rowsize,
                             const bool bgr)
 {
+    PHASE_TIMER(PHASE_PNG_ENCODE);
+
     png_struct * ppng = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     png_set_write_fn(ppng, trans, &png_write_data, &png_flush_data);
 
@@ -97,6 +100,8 @@ static inline void dump_png24(FILE * fd, const uint8_t * data,
                             const size_t rowsize,
                             const bool bgr)
 {
+    PHASE_TIMER(PHASE_PNG_ENCODE);
+
     png_struct * ppng = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     png_info * pinfo = png_create_info_struct(ppng);
 
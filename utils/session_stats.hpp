@@ -0,0 +1,394 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Per session performance counters shared with rdpproxy-stats.
+
+   The main process maps a file holding a header and a fixed array of slots
+   before accepting connections, forked session processes inherit the
+   mapping and claim one slot each (compare and swap on pid). A slot is only
+   ever written by the session owning it: counters are plain aligned 64 bits
+   values updated in place, readers never lock nor signal sessions.
+
+   Without segment (tests, tools, creation failure) session_stats() is a
+   process local slot, hot path code never has to check anything.
+*/
+
+#ifndef _REDEMPTION_UTILS_SESSION_STATS_HPP_
+#define _REDEMPTION_UTILS_SESSION_STATS_HPP_
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+
+#include "log.hpp"
+#include "difftimeval.hpp"
+
+#if !defined(PID_PATH)
+#define PID_PATH "/var/run"
+#endif
+
+#define SESSION_STATS_FILE PID_PATH "/redemption/session_stats"
+
+struct SessionStats {
+    // identity, protected by generation (odd while the slot is being claimed)
+    volatile int32_t  pid;          // 0: free slot
+    volatile uint32_t generation;
+    uint64_t start_time;            // seconds since epoch
+    char     source_ip[48];
+    char     target_ip[48];
+
+    uint64_t last_update;           // seconds since epoch
+
+    // traffic
+    uint64_t front_bytes_received;
+    uint64_t front_bytes_sent;
+    uint64_t mod_bytes_received;
+    uint64_t mod_bytes_sent;
+    uint64_t front_pdus_received;
+    uint64_t mod_pdus_received;
+
+    // graphics
+    uint64_t front_orders_sent;
+    uint64_t front_updates_sent;
+    uint64_t mod_orders_received;
+    uint64_t mod_bmp_cache_received;
+    uint64_t mod_bitmap_updates_received;
+    uint64_t bmp_cache_hits;        // front bitmap cache
+    uint64_t bmp_cache_misses;
+
+    // CPU
+    uint64_t compression_usec;      // bitmap and bulk (MPPC) compression
+    uint64_t capture_usec;          // snapshots (png, wrm) and wrm flushes
+
+    // queue depths (gauges, bytes)
+    uint64_t front_send_queue;
+    uint64_t front_recv_queue;
+    uint64_t mod_send_queue;
+    uint64_t mod_recv_queue;
+
+    // bytes of closed module connections (not shown as such)
+    uint64_t closed_mod_bytes_received;
+    uint64_t closed_mod_bytes_sent;
+
+    // png snapshots taken, and postponed for lack of host-wide encode budget
+    uint64_t png_snapshots;
+    uint64_t png_snapshots_deferred;
+
+    uint8_t  reserved[512 - 8 - 8 - 48 - 48 - 8 - 23 * 8];
+
+    void clear() {
+        const int32_t  pid        = this->pid;
+        const uint32_t generation = this->generation;
+        ::memset(this, 0, sizeof(*this));
+        this->pid        = pid;
+        this->generation = generation;
+    }
+
+    uint64_t bmp_cache_hit_percent() const {
+        const uint64_t total = this->bmp_cache_hits + this->bmp_cache_misses;
+        return total ? (this->bmp_cache_hits * 100 / total) : 0;
+    }
+};
+
+// Host-wide encode time of png snapshots in the current second, shared by
+// all sessions (see SnapshotScheduler). Updated without lock, a session
+// dying in the middle never blocks others, concurrent window changes may
+// only lose a few microseconds of accounting.
+struct SnapshotBudget {
+    volatile uint64_t window;       // seconds since epoch
+    volatile uint64_t window_usec;  // encode time spent during window
+};
+
+struct SessionStatsHeader {
+    enum {
+        MAGIC          = 0x53545352,   // "RSTS"
+        FORMAT_VERSION = 1
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t slot_count;
+    SnapshotBudget snapshot_budget;
+    uint8_t  reserved[64 - 16 - 16];
+};
+
+// current slot of this process
+inline SessionStats * & session_stats_slot() {
+    static SessionStats local;
+    static SessionStats * slot = &local;
+    return slot;
+}
+
+inline SessionStats & session_stats() {
+    return *session_stats_slot();
+}
+
+// host-wide when segment is created, process local otherwise
+inline SnapshotBudget * & snapshot_budget_ptr() {
+    static SnapshotBudget local;
+    static SnapshotBudget * budget = &local;
+    return budget;
+}
+
+inline SnapshotBudget & snapshot_budget() {
+    return *snapshot_budget_ptr();
+}
+
+// bytes waiting in socket queue (not yet acknowledged by peer for send queue)
+static inline uint64_t socket_queue_bytes(int sck, bool send_queue) {
+    int bytes = 0;
+    if ((sck < 0) || (ioctl(sck, send_queue ? SIOCOUTQ : SIOCINQ, &bytes) == -1)) {
+        return 0;
+    }
+    return bytes;
+}
+
+// adds elapsed time of scope to counter
+class SessionStatsTimer {
+    uint64_t & counter;
+    uint64_t   start;
+
+public:
+    explicit SessionStatsTimer(uint64_t & counter)
+    : counter(counter)
+    , start(ustime())
+    {}
+
+    ~SessionStatsTimer() {
+        this->counter += ustime() - this->start;
+    }
+};
+
+class SessionStatsSegment {
+    SessionStatsHeader * header;
+    size_t               size;
+    int                  owned_slot;
+
+public:
+    enum {
+        DEFAULT_SLOT_COUNT = 1024
+    };
+
+    SessionStatsSegment()
+    : header(NULL)
+    , size(0)
+    , owned_slot(-1)
+    {}
+
+    ~SessionStatsSegment() {
+        this->close();
+    }
+
+    // segment inherited by forked session processes
+    static SessionStatsSegment & instance() {
+        static SessionStatsSegment segment;
+        return segment;
+    }
+
+    bool is_open() const {
+        return this->header;
+    }
+
+    unsigned slot_count() const {
+        return this->header ? this->header->slot_count : 0;
+    }
+
+    const SessionStats & slot(unsigned i) const {
+        return reinterpret_cast<const SessionStats *>(this->header + 1)[i];
+    }
+
+    // main process, before accepting sessions (slots of a previous run are lost)
+    bool create(const char * filename, unsigned slot_count = DEFAULT_SLOT_COUNT) {
+        this->close();
+        const size_t size = sizeof(SessionStatsHeader) + slot_count * sizeof(SessionStats);
+        unlink(filename);
+        int fd = ::open(filename, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+        if (fd == -1) {
+            LOG(LOG_WARNING, "SessionStats: failed to create %s: %s", filename, strerror(errno));
+            return false;
+        }
+        if (ftruncate(fd, size) == -1) {
+            LOG(LOG_WARNING, "SessionStats: failed to resize %s: %s", filename, strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        void * p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            LOG(LOG_WARNING, "SessionStats: failed to map %s: %s", filename, strerror(errno));
+            return false;
+        }
+        this->header = static_cast<SessionStatsHeader *>(p);
+        this->size   = size;
+        // file is zeroed by ftruncate
+        this->header->version    = SessionStatsHeader::FORMAT_VERSION;
+        this->header->slot_size  = sizeof(SessionStats);
+        this->header->slot_count = slot_count;
+        __sync_synchronize();
+        this->header->magic      = SessionStatsHeader::MAGIC;
+        snapshot_budget_ptr() = &this->header->snapshot_budget;
+        return true;
+    }
+
+    // readers (rdpproxy-stats)
+    bool open_read_only(const char * filename) {
+        this->close();
+        int fd = ::open(filename, O_RDONLY);
+        if (fd == -1) {
+            return false;
+        }
+        struct stat st;
+        if ((fstat(fd, &st) == -1) || (static_cast<size_t>(st.st_size) < sizeof(SessionStatsHeader))) {
+            ::close(fd);
+            return false;
+        }
+        void * p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        this->header = static_cast<SessionStatsHeader *>(p);
+        this->size   = st.st_size;
+        if ((this->header->magic != SessionStatsHeader::MAGIC)
+        ||  (this->header->version != SessionStatsHeader::FORMAT_VERSION)
+        ||  (this->header->slot_size != sizeof(SessionStats))
+        ||  (this->size < sizeof(SessionStatsHeader) + this->header->slot_count * sizeof(SessionStats))) {
+            this->close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (this->header) {
+            if (snapshot_budget_ptr() == &this->header->snapshot_budget) {
+                snapshot_budget_ptr() = &local_budget();
+            }
+            this->release();
+            munmap(this->header, this->size);
+            this->header = NULL;
+            this->size   = 0;
+        }
+    }
+
+    // session process: claims a free slot (or the slot of a dead process) and makes
+    // it the target of session_stats(), returns false if no slot is available
+    bool acquire(int32_t pid, const char * source_ip, const char * target_ip) {
+        if (!this->header || (this->owned_slot != -1)) {
+            return false;
+        }
+        for (int pass = 0; pass < 2; pass++) {
+            for (unsigned i = 0; i < this->header->slot_count; i++) {
+                SessionStats & s = this->slots()[i];
+                const int32_t owner = s.pid;
+                if (owner == 0) {
+                    if (!__sync_bool_compare_and_swap(&s.pid, 0, pid)) {
+                        continue;
+                    }
+                }
+                else if ((pass == 0) || !is_dead(owner)
+                     || !__sync_bool_compare_and_swap(&s.pid, owner, pid)) {
+                    continue;
+                }
+                s.generation++;
+                __sync_synchronize();
+                s.clear();
+                s.start_time = s.last_update = time(NULL);
+                strncpy(s.source_ip, source_ip, sizeof(s.source_ip) - 1);
+                strncpy(s.target_ip, target_ip, sizeof(s.target_ip) - 1);
+                __sync_synchronize();
+                s.generation++;
+
+                this->owned_slot     = i;
+                session_stats_slot() = &s;
+                return true;
+            }
+        }
+        LOG(LOG_WARNING, "SessionStats: no free slot (%u slots)", this->header->slot_count);
+        return false;
+    }
+
+    // index of slot owned by this session process, -1 if none
+    int owned_slot_index() const {
+        return this->owned_slot;
+    }
+
+    void release() {
+        if (this->owned_slot != -1) {
+            SessionStats & s = this->slots()[this->owned_slot];
+            session_stats_slot() = &local_copy(s);
+            __sync_synchronize();
+            s.pid = 0;
+            this->owned_slot = -1;
+        }
+    }
+
+    // consistent copy of slot i, false if slot is free, being claimed or
+    // owned by a dead process
+    bool read(unsigned i, SessionStats & out) const {
+        const SessionStats & s = this->slot(i);
+        const uint32_t generation = s.generation;
+        if ((generation & 1) || (s.pid == 0)) {
+            return false;
+        }
+        __sync_synchronize();
+        ::memcpy(&out, &s, sizeof(out));
+        __sync_synchronize();
+        if ((s.generation != generation) || (out.pid == 0)) {
+            return false;
+        }
+        out.source_ip[sizeof(out.source_ip) - 1] = 0;
+        out.target_ip[sizeof(out.target_ip) - 1] = 0;
+        return !is_dead(out.pid);
+    }
+
+    // signal 0 only checks existence, the process is not disturbed
+    static bool is_dead(int32_t pid) {
+        return (kill(pid, 0) == -1) && (errno == ESRCH);
+    }
+
+private:
+    SessionStats * slots() {
+        return reinterpret_cast<SessionStats *>(this->header + 1);
+    }
+
+    static SnapshotBudget & local_budget() {
+        static SnapshotBudget local;
+        return local;
+    }
+
+    // counters updated after release() stay in process memory
+    static SessionStats & local_copy(const SessionStats & s) {
+        static SessionStats local;
+        ::memcpy(&local, &s, sizeof(local));
+        return local;
+    }
+};
+
+#endif
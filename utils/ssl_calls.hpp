@@ -31,6 +31,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include "openssl_crypto.hpp"
 #include "bitfu.hpp"
 
@@ -267,24 +269,32 @@ class SslHMAC_Md5
 };
 
 /* Generate a MAC hash (5.2.3.1), using a combination of SHA1 and MD5 */
+// Both SHA1 (key + pad1) and MD5 (key + pad2) prefixes are hashed at
+// construction, a Sign may be copied to reuse them for several MACs of the
+// same key.
 class Sign
 {
     SslSha1 sha1;
-    const uint8_t * const key;
-    size_t key_size;
+    SslMd5  md5;
 
     public:
     Sign(const uint8_t * const key, size_t key_size)
-        : key(key)
-        , key_size(key_size)
     {
-        this->sha1.update(this->key, this->key_size);
+        this->sha1.update(key, key_size);
         const uint8_t sha1const[40] = {
             0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36,
             0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36,
             0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36
         };
-        sha1.update(sha1const, 40);
+        this->sha1.update(sha1const, 40);
+
+        this->md5.update(key, key_size);
+        const uint8_t sigconst[48] = {
+            0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c,
+            0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c,
+            0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c
+        };
+        this->md5.update(sigconst, sizeof(sigconst));
     }
 
     void update(const uint8_t * const data, size_t data_size) {
@@ -295,16 +305,8 @@ class Sign
         uint8_t shasig[20];
         this->sha1.final(shasig, 20);
 
-        SslMd5 md5;
-        md5.update(this->key, this->key_size);
-        const uint8_t sigconst[48] = {
-            0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c,
-            0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c,
-            0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c, 0x5c
-        };
-        md5.update(sigconst, sizeof(sigconst));
-        md5.update(shasig, sizeof(shasig));
-        md5.final(out, out_size);
+        this->md5.update(shasig, sizeof(shasig));
+        this->md5.final(out, out_size);
     }
 };
 
@@ -355,6 +357,22 @@ struct CryptContext
     uint8_t update_key[MD5_DIGEST_LENGTH];
     SslRC4 rc4;
 
+private:
+    // MAC prefixes of sign_key (copied by callers) and update_key, rebuilt
+    // when key they were built from changes
+    Sign    sign_prefix;
+    uint8_t sign_prefix_key[MD5_DIGEST_LENGTH];
+    size_t  sign_prefix_key_size;
+    Sign    update_prefix;
+    uint8_t update_prefix_key[MD5_DIGEST_LENGTH];
+    size_t  update_prefix_key_size;
+
+public:
+    enum {
+        // payload is hashed then encrypted by blocks staying in L1 cache
+        SIGN_AND_ENCRYPT_BLOCK_SIZE = 1024
+    };
+
     // encryptionMethod (4 bytes): A 32-bit, unsigned integer. The selected
     // cryptographic method to use for the session. When Enhanced RDP Security
     // (section 5.4) is being used, this field MUST be set to ENCRYPTION_METHOD_NONE
@@ -386,11 +404,17 @@ struct CryptContext
 
     CryptContext()
         : use_count(0)
+        , sign_prefix(NULL, 0)
+        , sign_prefix_key_size(0)
+        , update_prefix(NULL, 0)
+        , update_prefix_key_size(0)
         , encryptionMethod(0)
     {
         memset(this->sign_key, 0, MD5_DIGEST_LENGTH);
         memset(this->key, 0, MD5_DIGEST_LENGTH);
         memset(this->update_key, 0, MD5_DIGEST_LENGTH);
+        memset(this->sign_prefix_key, 0, MD5_DIGEST_LENGTH);
+        memset(this->update_prefix_key, 0, MD5_DIGEST_LENGTH);
     }
 
     void generate_key(uint8_t * keyblob, uint32_t encryptionMethod)
@@ -417,12 +441,83 @@ struct CryptContext
     /* Decrypt data using RC4 */
     void decrypt(uint8_t * data, size_t data_size)
     {
-        ssllib ssl;
+        this->update_rc4_key();
+
+        // size, in, out
+        this->rc4.crypt(data_size, data, data);
+        this->use_count++;
+    }
+
+    /* Generate a MAC hash (5.2.3.1), using a combination of SHA1 and MD5 */
+    void sign(const uint8_t * data, size_t data_size, uint8_t * signature, size_t signature_size)
+    {
+        Sign sign(this->begin_sign(data_size));
+        sign.update(data, data_size);
+        sign.final(signature, 8);
+    }
+
+    /* Same as sign() then decrypt() (RC4 encryption), in one pass over data */
+    void sign_and_encrypt(uint8_t * data, size_t data_size, uint8_t * signature, size_t signature_size)
+    {
+        this->sign_and_encrypt(NULL, 0, data, data_size, signature, signature_size);
+    }
+
+    /* Same as above, for a PDU whose data is split in two buffers (head then data) */
+    void sign_and_encrypt(uint8_t * head, size_t head_size, uint8_t * data, size_t data_size,
+                          uint8_t * signature, size_t signature_size)
+    {
+        Sign sign(this->begin_sign(head_size + data_size));
+        this->update_rc4_key();
+
+        this->sign_and_encrypt_blocks(sign, head, head_size);
+        this->sign_and_encrypt_blocks(sign, data, data_size);
+        this->use_count++;
+
+        sign.final(signature, 8);
+    }
+
+private:
+    void sign_and_encrypt_blocks(Sign & sign, uint8_t * data, size_t data_size)
+    {
+        for (size_t offset = 0; offset < data_size; offset += SIGN_AND_ENCRYPT_BLOCK_SIZE) {
+            const size_t block_size = std::min<size_t>(data_size - offset, SIGN_AND_ENCRYPT_BLOCK_SIZE);
+            sign.update(data + offset, block_size);
+            this->rc4.crypt(block_size, data + offset, data + offset);
+        }
+    }
+
+    static const Sign & cached_prefix(Sign & prefix, uint8_t * prefix_key, size_t & prefix_key_size,
+                                      const uint8_t * key, size_t key_size)
+    {
+        if ((prefix_key_size != key_size) || memcmp(prefix_key, key, key_size)) {
+            prefix = Sign(key, key_size);
+            memcpy(prefix_key, key, key_size);
+            prefix_key_size = key_size;
+        }
+        return prefix;
+    }
+
+    // MAC of data_size bytes, with length header already hashed
+    Sign begin_sign(size_t data_size)
+    {
+        uint8_t lenhdr[4];
+        buf_out_uint32(lenhdr, data_size);
+
+        Sign sign(cached_prefix(this->sign_prefix, this->sign_prefix_key, this->sign_prefix_key_size,
+                                this->sign_key, (this->encryptionMethod==1)?8:16));
+        sign.update(lenhdr, sizeof(lenhdr));
+        return sign;
+    }
 
+    // session key update (5.3.7) every 4096 packets
+    void update_rc4_key()
+    {
         if (this->use_count == 4096) {
+            ssllib ssl;
             size_t keylen = (this->encryptionMethod==1)?8:16;
 
-            Sign sign(this->update_key, keylen);
+            Sign sign(cached_prefix(this->update_prefix, this->update_prefix_key, this->update_prefix_key_size,
+                                    this->update_key, keylen));
             sign.update(this->key, keylen);
             sign.final(this->key, sizeof(key));
 
@@ -437,21 +532,6 @@ struct CryptContext
             this->rc4.set_key(this->key, keylen);
             this->use_count = 0;
         }
-        // size, in, out
-        this->rc4.crypt(data_size, data, data);
-        this->use_count++;
-    }
-
-    /* Generate a MAC hash (5.2.3.1), using a combination of SHA1 and MD5 */
-    void sign(const uint8_t * data, size_t data_size, uint8_t * signature, size_t signature_size)
-    {
-        uint8_t lenhdr[4];
-        buf_out_uint32(lenhdr, data_size);
-
-        Sign sign(this->sign_key, (this->encryptionMethod==1)?8:16);
-        sign.update(lenhdr, sizeof(lenhdr));
-        sign.update(data, data_size);
-        sign.final(signature, 8);
     }
 };
 